@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "benchmark.h"
+#include <algorithm>
+#include <numeric>
+#include <iomanip>
+#include <sstream>
+#include <map>
+
+using namespace std;
+
+namespace benchmarks {
+
+	map<string, benchmark_function> &registry() {
+		static map<string, benchmark_function> benchmarks;
+		return benchmarks;
+	}
+
+	registration::registration(const string &name, benchmark_function fun) {
+		registry()[name] = fun;
+	}
+
+	state::state(const options &opts)
+	: m_options(opts) {
+		if (m_options.m_iterations) {
+			m_batch = m_options.m_iterations;
+		}
+	}
+
+	/*
+	 * Called when a batch of iterations is done. During the warm up the batch is doubled until the warm up time
+	 * has passed, then the batch size is set so each sample takes about m_sample_ms.
+	 * */
+	bool state::next_batch() {
+
+		const auto now = clock::now();
+
+		if (m_started) {
+			const double elapsed_ns = chrono::duration<double, nano>(now - m_batch_start).count();
+
+			if (m_warming_up) {
+				m_warm_up_ns += elapsed_ns;
+				m_warm_up_iterations += m_batch;
+
+				if (m_warm_up_ns >= m_options.m_warm_up_ms * 1.0e6) {
+					m_warming_up = false;
+					if (m_options.m_iterations) {
+						m_batch = m_options.m_iterations;
+					} else {
+						const double ns_per_iteration = max(m_warm_up_ns / m_warm_up_iterations, 1.0);
+						m_batch = max<size_t>(1, (size_t)(m_options.m_sample_ms * 1.0e6 / ns_per_iteration));
+					}
+				} else if (!m_options.m_iterations) {
+					m_batch *= 2;
+				}
+			} else {
+				m_samples.push_back(elapsed_ns / m_batch);
+				m_iterations += m_batch;
+
+				if (m_samples.size() >= m_options.m_samples) {
+					return false;
+				}
+			}
+		}
+
+		m_started = true;
+		m_remaining_in_batch = m_batch - 1;
+		m_batch_start = clock::now();
+
+		return true;
+	}
+
+	result state::get_result(const string &name) const {
+
+		result res;
+		res.m_name = name;
+		res.m_iterations = m_iterations;
+
+		if (m_samples.empty()) return res;
+
+		vector<double> sorted = m_samples;
+		sort(sorted.begin(), sorted.end());
+
+		auto percentile = [&sorted](double p) {
+			const size_t idx = min(sorted.size() - 1, (size_t)(p * sorted.size()));
+			return sorted[idx];
+		};
+
+		res.m_mean_ns = accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+		res.m_min_ns = sorted.front();
+		res.m_p50_ns = percentile(0.5);
+		res.m_p90_ns = percentile(0.9);
+		res.m_p99_ns = percentile(0.99);
+
+		if (res.m_mean_ns > 0.0) {
+			res.m_items_per_second = m_items_per_iteration * 1.0e9 / res.m_mean_ns;
+			res.m_bytes_per_second = m_bytes_per_iteration * 1.0e9 / res.m_mean_ns;
+		}
+
+		return res;
+	}
+
+	string format_time(double ns) {
+		stringstream ss;
+		ss << fixed << setprecision(1);
+		if (ns < 1.0e3) ss << ns << " ns";
+		else if (ns < 1.0e6) ss << ns / 1.0e3 << " us";
+		else if (ns < 1.0e9) ss << ns / 1.0e6 << " ms";
+		else ss << ns / 1.0e9 << " s";
+		return ss.str();
+	}
+
+	string format_rate(double rate, const string &unit) {
+		if (rate == 0.0) return "-";
+		stringstream ss;
+		ss << fixed << setprecision(1);
+		if (rate < 1.0e3) ss << rate << " " << unit << "/s";
+		else if (rate < 1.0e6) ss << rate / 1.0e3 << " k" << unit << "/s";
+		else if (rate < 1.0e9) ss << rate / 1.0e6 << " M" << unit << "/s";
+		else ss << rate / 1.0e9 << " G" << unit << "/s";
+		return ss.str();
+	}
+
+	void print_header() {
+		cout << left << setw(32) << "benchmark" << right << setw(12) << "iterations" << setw(12) << "mean"
+			<< setw(12) << "min" << setw(12) << "p50" << setw(12) << "p90" << setw(12) << "p99"
+			<< setw(16) << "items" << setw(16) << "bytes" << endl;
+	}
+
+	void print_result(const result &res) {
+		cout << left << setw(32) << res.m_name << right << setw(12) << res.m_iterations
+			<< setw(12) << format_time(res.m_mean_ns) << setw(12) << format_time(res.m_min_ns)
+			<< setw(12) << format_time(res.m_p50_ns) << setw(12) << format_time(res.m_p90_ns)
+			<< setw(12) << format_time(res.m_p99_ns) << setw(16) << format_rate(res.m_items_per_second, "")
+			<< setw(16) << format_rate(res.m_bytes_per_second, "B") << endl;
+	}
+
+	vector<result> run(const options &opts) {
+
+		vector<result> results;
+
+		print_header();
+		for (const auto &iter : registry()) {
+			if (iter.first.find(opts.m_filter) == string::npos) continue;
+
+			state st(opts);
+			iter.second(st);
+
+			results.push_back(st.get_result(iter.first));
+			print_result(results.back());
+		}
+
+		return results;
+	}
+
+	int main(int argc, char *argv[]) {
+
+		options opts;
+
+		for (int i = 1; i < argc; i++) {
+			const string arg(argv[i]);
+			const size_t eq = arg.find('=');
+			const string key = arg.substr(0, eq);
+			const string value = eq == string::npos ? "" : arg.substr(eq + 1);
+
+			try {
+				if (key == "--filter") opts.m_filter = value;
+				else if (key == "--samples") opts.m_samples = max<size_t>(1, stoull(value));
+				else if (key == "--warm-up-ms") opts.m_warm_up_ms = stoull(value);
+				else if (key == "--sample-ms") opts.m_sample_ms = stoull(value);
+				else if (key == "--iterations") opts.m_iterations = stoull(value);
+				else {
+					cout << "usage: " << argv[0] << " [--filter=name] [--samples=n] [--warm-up-ms=n] [--sample-ms=n]"
+						" [--iterations=n]" << endl;
+					return 1;
+				}
+			} catch (const exception &error) {
+				cout << "invalid value for " << key << ": " << value << endl;
+				return 1;
+			}
+		}
+
+		run(opts);
+
+		return 0;
+	}
+
+}
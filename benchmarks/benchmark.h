@@ -0,0 +1,150 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+
+/*
+ * Small harness for micro benchmarks. A benchmark is a function that runs the code under test in a
+ * while (state.keep_running()) loop. The loop is first run for a warm up period that is also used to pick how many
+ * iterations each sample runs, then a number of samples are timed and reported as mean and percentiles per
+ * iteration.
+ *
+ * BENCHMARK(hash_str) {
+ *     std::string str = "hello";
+ *     while (state.keep_running()) {
+ *         benchmarks::do_not_optimize(Hash::str(str));
+ *     }
+ *     state.set_bytes_per_iteration(str.size());
+ * }
+ * */
+
+namespace benchmarks {
+
+	struct options {
+		std::string m_filter;
+		size_t m_samples = 20;
+		size_t m_warm_up_ms = 100;
+		size_t m_sample_ms = 10;
+		// Iterations per sample, 0 means that it is calibrated during the warm up.
+		size_t m_iterations = 0;
+	};
+
+	struct result {
+		std::string m_name;
+		size_t m_iterations = 0;
+		double m_mean_ns = 0.0;
+		double m_min_ns = 0.0;
+		double m_p50_ns = 0.0;
+		double m_p90_ns = 0.0;
+		double m_p99_ns = 0.0;
+		double m_items_per_second = 0.0;
+		double m_bytes_per_second = 0.0;
+	};
+
+	class state {
+
+	public:
+
+		explicit state(const options &opts);
+
+		bool keep_running() {
+			if (m_remaining_in_batch) {
+				m_remaining_in_batch--;
+				return true;
+			}
+			return next_batch();
+		}
+
+		void set_items_per_iteration(size_t items) { m_items_per_iteration = items; }
+		void set_bytes_per_iteration(size_t bytes) { m_bytes_per_iteration = bytes; }
+
+		result get_result(const std::string &name) const;
+
+	private:
+
+		using clock = std::chrono::steady_clock;
+
+		const options m_options;
+
+		size_t m_remaining_in_batch = 0;
+		size_t m_batch = 1;
+		bool m_started = false;
+		bool m_warming_up = true;
+		clock::time_point m_batch_start;
+
+		double m_warm_up_ns = 0.0;
+		size_t m_warm_up_iterations = 0;
+
+		// Nanoseconds per iteration for each sample.
+		std::vector<double> m_samples;
+		size_t m_iterations = 0;
+
+		size_t m_items_per_iteration = 0;
+		size_t m_bytes_per_iteration = 0;
+
+		bool next_batch();
+
+	};
+
+	using benchmark_function = std::function<void(state &)>;
+
+	/*
+	 * Registers benchmarks at static initialization, used by the BENCHMARK macro.
+	 * */
+	struct registration {
+		registration(const std::string &name, benchmark_function fun);
+	};
+
+	/*
+	 * Prevents the compiler from optimizing away a value that is otherwise unused.
+	 * */
+	template<typename T>
+	inline void do_not_optimize(const T &value) {
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	/*
+	 * Runs all registered benchmarks matching the options and prints the results to cout.
+	 * */
+	std::vector<result> run(const options &opts);
+
+	/*
+	 * Parses --filter=, --samples=, --warm-up-ms=, --sample-ms= and --iterations= and runs the benchmarks.
+	 * */
+	int main(int argc, char *argv[]);
+
+}
+
+#define BENCHMARK(name) \
+	void benchmark_##name(benchmarks::state &state); \
+	static benchmarks::registration benchmark_registration_##name(#name, benchmark_##name); \
+	void benchmark_##name(benchmarks::state &state)
@@ -11,10 +11,10 @@
  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
  * copies of the Software, and to permit persons to whom the Software is
  * furnished to do so, subject to the following conditions:
- * 
+ *
  * The above copyright notice and this permission notice shall be included in all
  * copies or substantial portions of the Software.
- * 
+ *
  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
@@ -24,15 +24,11 @@
  * SOFTWARE.
  */
 
-#include "sort/Sort.h"
-#include "system/Profiler.h"
-
-BOOST_AUTO_TEST_SUITE(performance)
-
-BOOST_AUTO_TEST_CASE(domain_index_sharp) {
-
-	// We cannot make performace tests yet.
+#include "benchmark.h"
+#include "primitives.h"
+#include "search.h"
+#include "warc.h"
 
+int main(int argc, char *argv[]) {
+	return benchmarks::main(argc, argv);
 }
-
-BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "benchmark.h"
+#include "hash/Hash.h"
+#include "text/Text.h"
+#include "text/tokenizer.h"
+#include "parser/URL.h"
+#include "algorithm/HyperLogLog.h"
+#include "urlstore/UrlData.h"
+
+namespace benchmarks {
+
+	/*
+	 * Deterministic text with a skewed word distribution, a bit like real page text.
+	 * */
+	inline std::string synthetic_text(size_t num_words) {
+		const std::vector<std::string> words = {"the", "of", "and", "Alexandria", "search", "engine", "index",
+			"library", "Ptolemaic", "scrolls", "Mouseion", "Pharos", "ancient", "knowledge", "öppen", "källkod",
+			"free-software", "data", "2021", "web"};
+		std::string text;
+		uint64_t x = 88172645463325252ull;
+		for (size_t i = 0; i < num_words; i++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			// Squaring a uniform number in [0, 1) gives more weight to the first words.
+			const double r = (double)(x % 10000) / 10000.0;
+			text += words[(size_t)(r * r * words.size())];
+			text += (i % 12 == 11) ? ". " : " ";
+		}
+		return text;
+	}
+
+	inline std::vector<std::string> synthetic_urls(size_t num_urls) {
+		std::vector<std::string> urls;
+		for (size_t i = 0; i < num_urls; i++) {
+			urls.push_back("https://www.site" + std::to_string(i % 97) + ".example.com/path/to/page-" +
+				std::to_string(i) + ".html?query=" + std::to_string(i * 7) + "&lang=en");
+		}
+		return urls;
+	}
+
+}
+
+BENCHMARK(hash_str) {
+	const std::string str = "https://www.example.com/a/path/to/a/page.html";
+	while (state.keep_running()) {
+		benchmarks::do_not_optimize(Hash::str(str));
+	}
+	state.set_items_per_iteration(1);
+	state.set_bytes_per_iteration(str.size());
+}
+
+BENCHMARK(text_get_full_text_words) {
+	const std::string text = benchmarks::synthetic_text(1000);
+	while (state.keep_running()) {
+		benchmarks::do_not_optimize(Text::get_full_text_words(text));
+	}
+	state.set_items_per_iteration(1000);
+	state.set_bytes_per_iteration(text.size());
+}
+
+BENCHMARK(text_full_text_word_hashes) {
+	const std::string text = benchmarks::synthetic_text(1000);
+	while (state.keep_running()) {
+		uint64_t sum = 0;
+		text::for_each_full_text_word(text, [&sum](const text::word &word) {
+			sum += word.hash();
+		});
+		benchmarks::do_not_optimize(sum);
+	}
+	state.set_items_per_iteration(1000);
+	state.set_bytes_per_iteration(text.size());
+}
+
+BENCHMARK(url_parse) {
+	const std::vector<std::string> urls = benchmarks::synthetic_urls(1000);
+	size_t bytes = 0;
+	for (const std::string &url : urls) bytes += url.size();
+	while (state.keep_running()) {
+		for (const std::string &url : urls) {
+			URL parsed(url);
+			benchmarks::do_not_optimize(parsed);
+		}
+	}
+	state.set_items_per_iteration(urls.size());
+	state.set_bytes_per_iteration(bytes);
+}
+
+BENCHMARK(url_data_decode) {
+	std::vector<std::string> records;
+	size_t bytes = 0;
+	for (const std::string &url : benchmarks::synthetic_urls(1000)) {
+		UrlStore::UrlData data;
+		data.m_url = URL(url);
+		data.m_redirect = URL(url + "&redirect=1");
+		data.m_http_code = 200;
+		data.m_last_visited = 1650000000;
+		records.push_back(data.to_str());
+		bytes += records.back().size();
+	}
+	while (state.keep_running()) {
+		for (const std::string &record : records) {
+			UrlStore::UrlData data(record);
+			benchmarks::do_not_optimize(data.m_http_code);
+		}
+	}
+	state.set_items_per_iteration(records.size());
+	state.set_bytes_per_iteration(bytes);
+}
+
+BENCHMARK(hyper_log_log_insert) {
+	Algorithm::HyperLogLog<size_t> hll;
+	size_t value = 0;
+	while (state.keep_running()) {
+		for (size_t i = 0; i < 1000; i++) {
+			hll.insert(value++);
+		}
+	}
+	benchmarks::do_not_optimize(hll.size());
+	state.set_items_per_iteration(1000);
+}
@@ -0,0 +1,210 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include "benchmark.h"
+#include "algorithm/intersection.h"
+#include "sort/Sort.h"
+#include "indexer/index_builder.h"
+#include "indexer/index.h"
+#include "indexer/generic_record.h"
+#include "indexer/posting_cache.h"
+
+namespace benchmarks {
+
+	/*
+	 * Sorted list of len records with values spread over [0, range).
+	 * */
+	inline std::vector<indexer::generic_record> synthetic_postings(size_t len, size_t range, uint64_t seed) {
+		std::vector<indexer::generic_record> records;
+		uint64_t x = seed * 0x9e3779b97f4a7c15ull + 1;
+		for (size_t i = 0; i < len; i++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			records.emplace_back(x % range, (float)(x % 1000) / 1000.0f);
+		}
+		std::sort(records.begin(), records.end());
+		records.erase(std::unique(records.begin(), records.end()), records.end());
+		return records;
+	}
+
+	/*
+	 * Index shard with synthetic postings. The index files live under /mnt like all other index files so a db
+	 * name unique for this process is used and removed again at exit.
+	 * */
+	class synthetic_index {
+
+	public:
+
+		static const size_t num_keys = 10000;
+
+		static synthetic_index &instance() {
+			static synthetic_index index;
+			return index;
+		}
+
+		const indexer::index<indexer::generic_record> &index() const { return *m_index; }
+
+		~synthetic_index() {
+			m_index.reset();
+			for (size_t i = 0; i < 8; i++) {
+				boost::filesystem::remove_all("/mnt/" + std::to_string(i) + "/full_text/" + m_db_name);
+			}
+		}
+
+	private:
+
+		const std::string m_db_name = "benchmark_" + std::to_string(getpid());
+		std::unique_ptr<indexer::index<indexer::generic_record>> m_index;
+
+		synthetic_index() {
+			{
+				indexer::index_builder<indexer::generic_record> builder(m_db_name, 0, 1000);
+				builder.truncate();
+
+				// Key k gets about 100000 / (k + 1) records so a few keys have long lists.
+				for (size_t key = 0; key < num_keys; key++) {
+					const size_t len = std::max<size_t>(1, 100000 / (key + 1));
+					for (const indexer::generic_record &record : synthetic_postings(len, 10000000, key)) {
+						builder.add(key, record);
+					}
+				}
+				builder.append();
+				builder.merge();
+			}
+
+			m_index = std::make_unique<indexer::index<indexer::generic_record>>(m_db_name, 0, 1000);
+		}
+
+	};
+
+	inline void run_index_find(state &state) {
+		const auto &idx = synthetic_index::instance().index();
+		size_t key = 0;
+		size_t records = 0;
+		while (state.keep_running()) {
+			const auto res = idx.find(key);
+			records += res->size();
+			benchmarks::do_not_optimize(res);
+			key = (key + 1) % 100;
+		}
+		benchmarks::do_not_optimize(records);
+		state.set_items_per_iteration(1);
+	}
+
+}
+
+BENCHMARK(intersection_equal_lengths) {
+	const std::vector<std::vector<indexer::generic_record>> input = {
+		benchmarks::synthetic_postings(100000, 1000000, 1),
+		benchmarks::synthetic_postings(100000, 1000000, 2)
+	};
+	while (state.keep_running()) {
+		benchmarks::do_not_optimize(algorithm::intersection(input));
+	}
+	state.set_items_per_iteration(input[0].size() + input[1].size());
+}
+
+BENCHMARK(intersection_skewed_lengths) {
+	const std::vector<std::vector<indexer::generic_record>> input = {
+		benchmarks::synthetic_postings(1000, 1000000, 1),
+		benchmarks::synthetic_postings(500000, 1000000, 2)
+	};
+	while (state.keep_running()) {
+		benchmarks::do_not_optimize(algorithm::intersection(input));
+	}
+	state.set_items_per_iteration(input[0].size() + input[1].size());
+}
+
+BENCHMARK(intersection_moderate_skew) {
+	const std::vector<std::vector<indexer::generic_record>> input = {
+		benchmarks::synthetic_postings(10000, 1000000, 1),
+		benchmarks::synthetic_postings(160000, 1000000, 2)
+	};
+	while (state.keep_running()) {
+		benchmarks::do_not_optimize(algorithm::intersection(input));
+	}
+	state.set_items_per_iteration(input[0].size() + input[1].size());
+}
+
+/*
+ * Linear and simd search through the same list, advancing about 16 positions per search like an intersection with
+ * a list that is 16 times shorter. Used to pick algorithm::simd_ratio.
+ * */
+BENCHMARK(search_linear) {
+	const auto records = benchmarks::synthetic_postings(160000, 1000000, 2);
+	while (state.keep_running()) {
+		size_t pos = 0;
+		for (uint64_t key = 0; key < 1000000 && pos < records.size(); key += 100) {
+			pos = algorithm::search(algorithm::intersection_strategy::linear, records.data(), pos, records.size(), key);
+		}
+		benchmarks::do_not_optimize(pos);
+	}
+	state.set_items_per_iteration(records.size());
+}
+
+BENCHMARK(search_simd) {
+	const auto records = benchmarks::synthetic_postings(160000, 1000000, 2);
+	while (state.keep_running()) {
+		size_t pos = 0;
+		for (uint64_t key = 0; key < 1000000 && pos < records.size(); key += 100) {
+			pos = algorithm::search(algorithm::intersection_strategy::simd, records.data(), pos, records.size(), key);
+		}
+		benchmarks::do_not_optimize(pos);
+	}
+	state.set_items_per_iteration(records.size());
+}
+
+BENCHMARK(sort_merge_arrays) {
+	std::vector<std::vector<indexer::generic_record>> input;
+	size_t total = 0;
+	for (size_t i = 0; i < 8; i++) {
+		input.push_back(benchmarks::synthetic_postings(50000, 10000000, i));
+		total += input.back().size();
+	}
+	while (state.keep_running()) {
+		std::vector<indexer::generic_record> res;
+		Sort::merge_arrays(input, res);
+		benchmarks::do_not_optimize(res);
+	}
+	state.set_items_per_iteration(total);
+	state.set_bytes_per_iteration(total * sizeof(indexer::generic_record));
+}
+
+BENCHMARK(index_find) {
+	benchmarks::run_index_find(state);
+}
+
+BENCHMARK(index_find_cached) {
+	indexer::posting_cache &cache = indexer::posting_cache::instance();
+	cache.set_capacity(1024ull * 1024 * 1024);
+	benchmarks::run_index_find(state);
+	cache.set_capacity(0);
+}
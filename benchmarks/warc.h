@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <thread>
+#include <sstream>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include "benchmark.h"
+#include "primitives.h"
+#include "parser/Warc.h"
+#include "parser/warc_reader.h"
+#include "utils/thread_pool.hpp"
+
+namespace benchmarks {
+
+	struct synthetic_warc_file {
+		std::string m_data; // Gzipped, one member per record like common crawl.
+		size_t m_inflated_size = 0;
+		size_t m_num_records = 0;
+	};
+
+	inline std::string gzip_member(const std::string &data) {
+		std::string compressed;
+		{
+			boost::iostreams::filtering_ostream compress_stream;
+			compress_stream.push(boost::iostreams::gzip_compressor());
+			compress_stream.push(boost::iostreams::back_inserter(compressed));
+			compress_stream << data;
+		}
+		return compressed;
+	}
+
+	/*
+	 * WARC file with num_records html responses.
+	 * */
+	inline synthetic_warc_file synthetic_warc(size_t num_records) {
+
+		const std::string text = synthetic_text(1000);
+
+		synthetic_warc_file file;
+		for (size_t i = 0; i < num_records; i++) {
+			const std::string host = "site" + std::to_string(i % 97) + ".example.com";
+			const std::string html = "<!DOCTYPE html><html><head><title>Page " + std::to_string(i) + " on " + host +
+				"</title><meta name=\"description\" content=\"" + text.substr(i % 100, 150) + "\"></head><body><h1>"
+				"Heading " + std::to_string(i) + "</h1><p>" + text.substr(i % 200) + "</p><a href=\"https://site" +
+				std::to_string((i + 1) % 97) + ".example.com/\">Next site</a></body></html>";
+			const std::string content = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: " +
+				std::to_string(html.size()) + "\r\n\r\n" + html;
+			const std::string record = "WARC/1.0\r\nWARC-Type: response\r\nWARC-Date: 2021-07-31T20:08:45Z\r\n"
+				"WARC-Target-URI: https://" + host + "/page-" + std::to_string(i) + ".html\r\n"
+				"WARC-IP-Address: 127.0.0.1\r\nContent-Type: application/http; msgtype=response\r\nContent-Length: " +
+				std::to_string(content.size()) + "\r\n\r\n" + content + "\r\n\r\n";
+
+			file.m_data += gzip_member(record);
+			file.m_inflated_size += record.size();
+			file.m_num_records++;
+		}
+
+		return file;
+	}
+
+	inline const synthetic_warc_file &shared_synthetic_warc() {
+		static const synthetic_warc_file file = synthetic_warc(2000);
+		return file;
+	}
+
+}
+
+BENCHMARK(warc_read) {
+	const benchmarks::synthetic_warc_file &file = benchmarks::shared_synthetic_warc();
+	while (state.keep_running()) {
+		parser::warc_reader reader;
+		reader.set_input(file.m_data.data(), file.m_data.size());
+		parser::warc_record record;
+		size_t bytes = 0;
+		while (reader.next(record)) bytes += record.m_content.size();
+		benchmarks::do_not_optimize(bytes);
+	}
+	state.set_items_per_iteration(file.m_num_records);
+	state.set_bytes_per_iteration(file.m_inflated_size);
+}
+
+/*
+ * Items and bytes are per core, so they compare directly with warc_read.
+ * */
+BENCHMARK(warc_read_parallel) {
+	const benchmarks::synthetic_warc_file &file = benchmarks::shared_synthetic_warc();
+	const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+	while (state.keep_running()) {
+		const auto ranges = parser::warc_member_ranges(file.m_data.data(), file.m_data.size(), num_threads);
+		utils::thread_pool pool(ranges.size());
+		for (const auto &range : ranges) {
+			pool.enqueue([&file, range]() {
+				parser::warc_reader reader;
+				reader.set_input(file.m_data.data() + range.first, range.second - range.first);
+				parser::warc_record record;
+				size_t bytes = 0;
+				while (reader.next(record)) bytes += record.m_content.size();
+				benchmarks::do_not_optimize(bytes);
+			});
+		}
+		pool.run_all();
+	}
+	state.set_items_per_iteration(file.m_num_records / num_threads);
+	state.set_bytes_per_iteration(file.m_inflated_size / num_threads);
+}
+
+BENCHMARK(warc_parse) {
+	const benchmarks::synthetic_warc_file &file = benchmarks::shared_synthetic_warc();
+	while (state.keep_running()) {
+		std::istringstream stream(file.m_data);
+		Warc::Parser parser;
+		parser.parse_stream(stream);
+		benchmarks::do_not_optimize(parser.result().size());
+	}
+	state.set_items_per_iteration(file.m_num_records);
+	state.set_bytes_per_iteration(file.m_inflated_size);
+}
@@ -28,54 +28,27 @@
 
 using namespace std;
 
-KeyValueStore::KeyValueStore(const string &db_name) {
-	leveldb::Options options;
-	options.create_if_missing = true;
-	options.write_buffer_size = 1024ull * 1024ull * 1024ull;
-	options.max_open_files = 100000;
-	leveldb::Status status = leveldb::DB::Open(options, db_name, &m_db);
-	if (!status.ok()) {
-		cout << "Could not open database: " << db_name << endl;
-	}
+KeyValueStore::KeyValueStore(const string &db_name, const string &engine_type)
+: m_engine(key_value::open_engine(engine_type, db_name)) {
 }
 
 KeyValueStore::~KeyValueStore() {
-	delete m_db;
 }
 
-string KeyValueStore::get(const string &key_str) const {
-	leveldb::Slice key = key_str;
+string KeyValueStore::get(const string &key) const {
 	string value;
-	leveldb::Status s = m_db->Get(leveldb::ReadOptions(), key, &value);
+	m_engine->get(key, value);
 	return value;
 }
 
-void KeyValueStore::set(const string &key_str, const string &value) {
-	leveldb::Slice key = key_str;
-	leveldb::Status s = m_db->Put(leveldb::WriteOptions(), key, value);
-	if (!s.ok()) {
-		cerr << s.ToString() << endl;
-	}
+void KeyValueStore::set(const string &key, const string &value) {
+	m_engine->put(key, value);
 }
 
-bool KeyValueStore::is_full() {
-	string num_files;
-	m_db->GetProperty("leveldb.num-files-at-level0", &num_files);
-	size_t num = stoull(num_files);
-
-	cout << "level0: " << num << " - ";
-	cout << "leveldb.num-files-at-level: ";
-	for (size_t level = 0; level < 10; level++) {
-		string num_files;
-		m_db->GetProperty("leveldb.num-files-at-level" + to_string(level), &num_files);
-		cout << num_files << " ";
-	}
-	cout << endl;
-
-	return num >= 10;
+bool KeyValueStore::needs_compaction() const {
+	return m_engine->needs_compaction();
 }
 
 void KeyValueStore::compact() {
-	m_db->CompactRange(nullptr, nullptr);
+	m_engine->compact();
 }
-
@@ -23,30 +23,30 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
-// Wrapper for https://github.com/google/leveldb
+// Key value store on top of one of the engines in key_value, leveldb by default.
 
 #pragma once
 
 #include <iostream>
-#include "leveldb/db.h"
+#include <memory>
+#include "key_value/engine.h"
 
 class KeyValueStore {
 
 	public:
-		explicit KeyValueStore(const std::string &db_name);
+		explicit KeyValueStore(const std::string &db_name, const std::string &engine_type = key_value::engine_leveldb);
 		~KeyValueStore();
 
 		std::string get(const std::string &key) const;
 		void set(const std::string &key, const std::string &value);
 
-		bool is_full();
+		bool needs_compaction() const;
 		void compact();
 
-		leveldb::DB *db() { return m_db; }
+		key_value::engine &engine() { return *m_engine; }
 
 	private:
-		leveldb::DB *m_db;
+		std::unique_ptr<key_value::engine> m_engine;
 
 };
 
-
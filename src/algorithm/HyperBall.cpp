@@ -30,57 +30,199 @@
 #include "system/Profiler.h"
 #include "system/Logger.h"
 #include <thread>
+#include <bit>
 
 using namespace std;
 
 namespace Algorithm {
 
-	void hyper_ball_worker(double t, size_t v_begin, size_t v_end, const vector<uint32_t> *edge_map, vector<HyperLogLog<uint32_t>> &c,
-			vector<HyperLogLog<uint32_t>> &a, vector<double> &harmonic) {
+	/*
+	 * Layout of the counters. Each counter is 2^precision registers of register_bits bits packed in 64 bit words.
+	 * Registers never cross word boundaries so the merge can work on whole words.
+	 * */
+	struct register_layout {
+		size_t m_precision;
+		size_t m_register_bits;
+		size_t m_registers_per_word;
+		size_t m_words;
+		uint64_t m_max_register;
+		// Highest and lowest bit of every register in a word.
+		uint64_t m_high_bits;
+		uint64_t m_low_bits;
 
-		Profiler::instance prof("Timetaker");
-		for (uint32_t v = v_begin; v < v_end; v++) {
-			a[v] = c[v];
-			for (const uint32_t &w : edge_map[v]) {
-				a[v] += c[w];
+		register_layout(size_t precision, size_t n) {
+			m_precision = precision;
+			// Registers hold the rank which is around log2(n / 2^precision), leave some margin.
+			m_register_bits = clamp<size_t>(bit_width(bit_width(n) + 4), 4, 6);
+			m_registers_per_word = 64 / m_register_bits;
+			m_words = ((1ull << precision) + m_registers_per_word - 1) / m_registers_per_word;
+			m_max_register = (1ull << m_register_bits) - 1;
+			m_high_bits = 0;
+			m_low_bits = 0;
+			for (size_t i = 0; i < m_registers_per_word; i++) {
+				m_low_bits |= 1ull << (i * m_register_bits);
+				m_high_bits |= 1ull << (i * m_register_bits + m_register_bits - 1);
 			}
+		}
 
-			// a[v] is t + 1 and c[v] is at t
-			harmonic[v] += (1.0 / (t + 1.0)) * (a[v].size() - c[v].size());
+		size_t bytes_per_counter() const {
+			return m_words * sizeof(uint64_t);
 		}
-		for (uint32_t v = v_begin; v < v_end; v++) {
-			c[v] = a[v];
+	};
+
+	/*
+	 * Register wise maximum of two words, see "Broadword implementation of rank/select queries" by Vigna. The high
+	 * bit of every register of diff tells if the low bits of x are at least the low bits of y.
+	 * */
+	inline uint64_t broadword_max(uint64_t x, uint64_t y, const register_layout &layout) {
+		const uint64_t diff = (x | layout.m_high_bits) - (y & ~layout.m_high_bits);
+		const uint64_t x_greater_or_equal = ((x & ~y) | (~(x ^ y) & diff)) & layout.m_high_bits;
+		const uint64_t mask = (x_greater_or_equal >> (layout.m_register_bits - 1)) * layout.m_max_register;
+		return (x & mask) | (y & ~mask);
+	}
+
+	void insert_vertex(uint64_t *counter, uint32_t v, const register_layout &layout) {
+		const uint64_t x = HyperLogLog<uint32_t>::mix(v);
+		const size_t j = x >> (64 - layout.m_precision);
+		const uint64_t w = (x << layout.m_precision) | (1ull << (layout.m_precision - 1));
+		const uint64_t rank = min<uint64_t>(countl_zero(w) + 1, layout.m_max_register);
+
+		const size_t shift = (j % layout.m_registers_per_word) * layout.m_register_bits;
+		counter[j / layout.m_registers_per_word] |= rank << shift;
+	}
+
+	double counter_size(const uint64_t *counter, const register_layout &layout) {
+		array<size_t, 66> histogram{};
+		const size_t num_registers = 1ull << layout.m_precision;
+		for (size_t j = 0; j < num_registers; j++) {
+			const size_t shift = (j % layout.m_registers_per_word) * layout.m_register_bits;
+			histogram[(counter[j / layout.m_registers_per_word] >> shift) & layout.m_max_register]++;
 		}
+		return llround(HyperLogLog<uint32_t>::estimate(histogram, layout.m_precision));
 	}
 
-	vector<double> hyper_ball(uint32_t n, const vector<uint32_t> *edge_map) {
+	/*
+	 * Merges the counters of the neighbours of v_begin to v_end into next. Only vertices with a neighbour that
+	 * changed in the last iteration can change.
+	 * */
+	void hyper_ball_worker(double t, size_t v_begin, size_t v_end, const algorithm::edge_csr &graph,
+			const register_layout &layout, const vector<uint64_t> &current, vector<uint64_t> &next,
+			const vector<bool> &changed, vector<char> &will_change, vector<double> &sizes, vector<double> &harmonic) {
 
-		const size_t num_threads = min(12, (int)n);
-		const size_t items_per_thread = n / num_threads;
-		vector<HyperLogLog<uint32_t>> c(n);
-		vector<HyperLogLog<uint32_t>> a(n);
-		vector<double> harmonic(n, 0.0);
+		const size_t words = layout.m_words;
+		vector<uint64_t> counter(words);
+
+		for (size_t v = v_begin; v < v_end; v++) {
+			will_change[v] = false;
+
+			const auto edges = graph.edges(v);
+			bool any_changed = false;
+			for (uint32_t w : edges) {
+				if (changed[w]) {
+					any_changed = true;
+					break;
+				}
+			}
+			if (!any_changed) continue;
+
+			const uint64_t *own = &current[v * words];
+			copy(own, own + words, counter.begin());
+			for (uint32_t w : edges) {
+				const uint64_t *other = &current[w * words];
+				for (size_t i = 0; i < words; i++) {
+					counter[i] = broadword_max(counter[i], other[i], layout);
+				}
+			}
+
+			if (!equal(counter.begin(), counter.end(), own)) {
+				copy(counter.begin(), counter.end(), next.begin() + v * words);
+				will_change[v] = true;
+
+				// counter is at t + 1 and current at t
+				const double size = counter_size(counter.data(), layout);
+				harmonic[v] += (1.0 / (t + 1.0)) * (size - sizes[v]);
+				sizes[v] = size;
+			}
+		}
+	}
+
+	vector<double> hyper_ball(uint32_t n, const vector<uint32_t> *edge_map) {
 
+		vector<uint64_t> offsets(n + 1, 0);
 		for (uint32_t v = 0; v < n; v++) {
-			c[v].insert(v);
+			offsets[v + 1] = offsets[v] + edge_map[v].size();
 		}
+		vector<uint32_t> edges;
+		edges.reserve(offsets[n]);
+		for (uint32_t v = 0; v < n; v++) {
+			edges.insert(edges.end(), edge_map[v].begin(), edge_map[v].end());
+		}
+
+		return hyper_ball(algorithm::edge_csr(std::move(offsets), std::move(edges)));
+	}
+
+	vector<double> hyper_ball(const algorithm::edge_csr &graph, const hyper_ball_options &options) {
+
+		const size_t n = graph.num_vertices();
+		if (n == 0) return {};
+
+		// Two register buffers plus the sizes, harmonic and change flags of every vertex.
+		const size_t bytes_per_vertex_overhead = 2 * sizeof(double) + 2;
+		size_t precision = options.m_precision;
+		while (precision > 4 && 2 * n * register_layout(precision, n).bytes_per_counter() +
+				n * bytes_per_vertex_overhead > options.m_max_memory) {
+			precision--;
+		}
+		const register_layout layout(precision, n);
+		LOG_INFO("Running hyper ball on " + to_string(n) + " vertices with precision " + to_string(precision) +
+			" and " + to_string(layout.m_register_bits) + " bit registers");
+
+		vector<uint64_t> current(n * layout.m_words, 0);
+		for (size_t v = 0; v < n; v++) {
+			insert_vertex(&current[v * layout.m_words], v, layout);
+		}
+		vector<uint64_t> next(current.size());
+
+		vector<double> sizes(n);
+		for (size_t v = 0; v < n; v++) {
+			sizes[v] = counter_size(&current[v * layout.m_words], layout);
+		}
+
+		vector<double> harmonic(n, 0.0);
+		vector<bool> changed(n, true);
+		vector<char> will_change(n, false);
+
+		const size_t num_threads = min(options.m_num_threads, n);
+		const size_t items_per_thread = n / num_threads;
+
+		for (size_t iteration = 0; iteration < options.m_max_iterations; iteration++) {
+
+			const double t = iteration;
+			Profiler::instance prof("Hyper ball iteration");
 
-		double t = 0.0;
-		while (true) {
 			vector<thread> threads;
 			for (size_t i = 0; i < num_threads; i++) {
 				const size_t v_begin = i * items_per_thread;
 				const size_t v_end = (i == num_threads - 1) ? n : (i + 1) * items_per_thread;
-				thread th(hyper_ball_worker, t, v_begin, v_end, edge_map, ref(c), ref(a), ref(harmonic));
-				threads.push_back(move(th));
+				threads.emplace_back(hyper_ball_worker, t, v_begin, v_end, cref(graph), cref(layout), cref(current),
+					ref(next), cref(changed), ref(will_change), ref(sizes), ref(harmonic));
 			}
-
 			for (thread &th : threads) {
 				th.join();
 			}
-			LOG_INFO("Finished run t = " + to_string(t));
-			t += 1.0;
-			if (t > 40.0) break;
+
+			size_t num_changed = 0;
+			for (size_t v = 0; v < n; v++) {
+				changed[v] = will_change[v];
+				if (changed[v]) {
+					copy(next.begin() + v * layout.m_words, next.begin() + (v + 1) * layout.m_words,
+						current.begin() + v * layout.m_words);
+					num_changed++;
+				}
+			}
+
+			LOG_INFO("Finished run t = " + to_string(t) + ", " + to_string(num_changed) + " counters changed");
+			if (num_changed == 0) break;
 		}
 
 		return harmonic;
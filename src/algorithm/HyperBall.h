@@ -28,9 +28,30 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include "edge_csr.h"
 
 namespace Algorithm {
 
+	struct hyper_ball_options {
+		// Highest precision of the counters, lowered until the counters fit in m_max_memory.
+		size_t m_precision = 15;
+		size_t m_max_memory = SIZE_MAX;
+		size_t m_max_iterations = 41;
+		size_t m_num_threads = 12;
+	};
+
+	/*
+	 * Harmonic centrality with the HyperBall algorithm by Boldi and Vigna. edge_map[v] are the vertices with an edge
+	 * to v.
+	 * */
 	std::vector<double> hyper_ball(uint32_t n, const std::vector<uint32_t> *edge_map);
 
+	/*
+	 * Same as above with the incoming edges of each vertex in graph. The hyper log log registers of all counters
+	 * are packed in one buffer and merged with broadword operations. Only counters with a neighbour that changed in
+	 * the last iteration are updated and we stop when no counter changes.
+	 * */
+	std::vector<double> hyper_ball(const algorithm::edge_csr &graph, const hyper_ball_options &options = {});
+
 }
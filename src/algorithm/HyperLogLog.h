@@ -28,8 +28,20 @@
 
 #include <cmath>
 #include <cstring>
+#include <cstdint>
+#include <string>
+#include <array>
+#include <vector>
+#include <limits>
 #include <algorithm>
+#include <functional>
+#include <type_traits>
 #include <iostream>
+#include "system/Logger.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
 
 namespace Algorithm {
 
@@ -37,7 +49,18 @@ namespace Algorithm {
 	 * Implementation of the hyper log log algorithm as described by Flajolet1 et al.
 	 * http://algo.inria.fr/flajolet/Publications/FlFuGaMe07.pdf
 	 *
-	 * Using 64 bit hash instead of 32bit.
+	 * Using 64 bit hash instead of 32bit. Integers are hashed with a mixing function instead of hashing their string
+	 * representation.
+	 *
+	 * Like HyperLogLog++ (Heule et al.) small counters are stored sparse as a sorted list of (index, rank) pairs with
+	 * 25 bit precision and converted to the dense 6 bit registers when the list would take more memory than the
+	 * registers. The estimate uses the improved estimator by Ertl (https://arxiv.org/abs/1702.01284) which corrects
+	 * the bias for small and intermediate cardinalities without the empirical bias tables of HyperLogLog++.
+	 *
+	 * Serialized counters look like this:
+	 * [uint8 version][uint8 precision][uint8 flags][sparse or dense data]
+	 * sparse: [varint num_entries][num_entries varint deltas of the sorted entries]
+	 * dense: [2^precision registers packed four in three bytes]
 	 * */
 
 	template<typename T>
@@ -45,10 +68,14 @@ namespace Algorithm {
 
 		public:
 			HyperLogLog();
-			HyperLogLog(const HyperLogLog &other);
-			HyperLogLog(const char *b);
-			HyperLogLog(size_t b);
-			~HyperLogLog();
+			explicit HyperLogLog(size_t precision);
+
+			/*
+			 * Loads the 2^15 one byte registers of the counters written before the serialization was versioned.
+			 * Those counters hashed the string representation of the values so we keep doing that for this counter.
+			 * */
+			explicit HyperLogLog(const char *legacy_registers);
+
 			void insert(T v);
 			void insert_hash(size_t x);
 			size_t size() const;
@@ -56,103 +83,268 @@ namespace Algorithm {
 			size_t num_zero_registers() const;
 			double error_bound() const;
 
-			const char *data() const { return m_M; };
-			char *data() { return m_M; };
-			size_t data_size() const { return m_len; };
+			bool is_sparse() const { return m_registers.empty(); }
+			size_t precision() const { return m_precision; }
+
+			void serialize(std::ostream &writer) const;
+
+			/*
+			 * Reads a counter written by serialize. Returns false and leaves the counter empty if the data is
+			 * corrupt or from an unknown version.
+			 * */
+			bool deserialize(std::istream &reader);
 
+			/*
+			 * Both counters must have the same precision and hash, throws otherwise since the registers of such
+			 * counters can not be combined.
+			 * */
 			HyperLogLog operator +(const HyperLogLog &hl) const;
 			HyperLogLog &operator +=(const HyperLogLog &hl);
-			HyperLogLog &operator =(const HyperLogLog &other);
+
+			/*
+			 * Hash used for integers, exposed for code that keeps its own registers like hyper_ball.
+			 * */
+			static uint64_t mix(uint64_t x);
+
+			/*
+			 * Estimates the cardinality from a histogram of register values. histogram[k] is the number of
+			 * registers with value k.
+			 * */
+			static double estimate(const std::array<size_t, 66> &histogram, size_t precision);
+
+			static constexpr uint8_t serialization_version = 1;
+			static constexpr size_t default_precision = 15;
+			static constexpr size_t legacy_registers_len = 1ull << 15;
 
 		private:
-			
-			char *m_M; // Points to registers.
-			const int m_b = 15;
-			const size_t m_len = 1ull << m_b; // 2^m_b
-			const double m_alpha = 0.7213/(1.0 + 1.079/m_len);
-			std::hash<std::string> m_hasher;
+
+			static constexpr size_t m_sparse_precision = 25;
+			static constexpr uint8_t m_flag_sparse = 0x1;
+			static constexpr uint8_t m_flag_legacy_hash = 0x2;
+
+			size_t m_precision;
+			size_t m_len; // 2^m_precision
+
+			// Sorted entries (index << 6 | rank) with m_sparse_precision bits of index, used while m_registers is empty.
+			std::vector<uint32_t> m_sparse;
+			std::vector<uint8_t> m_registers;
+
+			bool m_legacy_hash = false;
+
+			uint8_t rank(uint64_t x, size_t precision) const;
+			void insert_sparse(uint32_t entry);
+			void insert_dense(uint64_t x);
+			void register_max(uint32_t entry);
+			void to_dense();
+			size_t max_sparse_entries() const { return m_len / 4; }
+
+			static double sigma(double x);
+			static double tau(double x);
+
+			static void write_varint(std::ostream &writer, uint64_t value);
+			static bool read_varint(std::istream &reader, uint64_t &value);
 
 	};
 
 	template<typename T>
-	HyperLogLog<T>::HyperLogLog() {
-		m_M = new char[m_len];
-		memset(m_M, 0, m_len);
+	HyperLogLog<T>::HyperLogLog()
+	: HyperLogLog(default_precision) {
 	}
 
 	template<typename T>
-	HyperLogLog<T>::HyperLogLog(const HyperLogLog<T> &other) {
-		m_M = new char[m_len];
-		memcpy(m_M, other.m_M, m_len);
+	HyperLogLog<T>::HyperLogLog(size_t precision)
+	: m_precision(std::clamp<size_t>(precision, 4, 18)), m_len(1ull << m_precision) {
 	}
 
 	template<typename T>
-	HyperLogLog<T>::HyperLogLog(const char *m) {
-		m_M = new char[m_len];
-		memcpy(m_M, m, m_len);
-	}
+	HyperLogLog<T>::HyperLogLog(const char *legacy_registers)
+	: HyperLogLog(default_precision) {
+		// An empty counter can start over with the integer hash.
+		if (std::all_of(legacy_registers, legacy_registers + m_len, [](char r) { return r == 0; })) return;
 
-	template<typename T>
-	HyperLogLog<T>::HyperLogLog(size_t b)
-	: m_b(20) {
-		m_M = new char[m_len];
-		memset(m_M, 0, m_len);
+		m_legacy_hash = true;
+		m_registers.resize(m_len);
+		const uint8_t max_rank = 64 - m_precision + 1;
+		for (size_t i = 0; i < m_len; i++) {
+			m_registers[i] = std::min((uint8_t)legacy_registers[i], max_rank);
+		}
 	}
 
+	/*
+	 * Finalizer of MurmurHash3, spreads the bits of integers that are often sequential ids.
+	 * */
 	template<typename T>
-	HyperLogLog<T>::~HyperLogLog() {
-		delete m_M;
+	uint64_t HyperLogLog<T>::mix(uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
 	}
 
 	template<typename T>
 	void HyperLogLog<T>::insert(T v) {
-		size_t x = m_hasher(std::to_string(v));
-		size_t j = x >> (64-m_b);
-		m_M[j] = std::max(m_M[j], leading_zeros_plus_one(x << m_b));
+		if (m_legacy_hash) {
+			insert_hash(std::hash<std::string>{}(std::to_string(v)));
+		} else if constexpr (std::is_integral_v<T>) {
+			insert_hash(mix((uint64_t)v));
+		} else {
+			insert_hash(mix(std::hash<T>{}(v)));
+		}
 	}
 
 	template<typename T>
 	void HyperLogLog<T>::insert_hash(size_t x) {
-		size_t j = x >> (64-m_b);
-		m_M[j] = std::max(m_M[j], leading_zeros_plus_one(x << m_b));
+		if (is_sparse()) {
+			const uint32_t index = x >> (64 - m_sparse_precision);
+			insert_sparse((index << 6) | rank(x, m_sparse_precision));
+			if (m_sparse.size() > max_sparse_entries()) {
+				to_dense();
+			}
+		} else {
+			insert_dense(x);
+		}
 	}
 
 	template<typename T>
-	size_t HyperLogLog<T>::size() const {
-		double Z = 0.0;
-		for (size_t j = 0; j < m_len; j++) {
-			Z += 1.0 / (1ull << m_M[j]);
+	uint8_t HyperLogLog<T>::rank(uint64_t x, size_t precision) const {
+		// The bits below the index can be all zero so the rank is capped at 64 - precision + 1.
+		const uint64_t w = (x << precision) | (1ull << (precision - 1));
+		return __builtin_clzll(w) + 1;
+	}
+
+	template<typename T>
+	void HyperLogLog<T>::insert_sparse(uint32_t entry) {
+		auto iter = std::lower_bound(m_sparse.begin(), m_sparse.end(), entry & ~0x3Fu);
+		if (iter != m_sparse.end() && (*iter >> 6) == (entry >> 6)) {
+			*iter = std::max(*iter, entry);
+		} else {
+			m_sparse.insert(iter, entry);
+		}
+	}
+
+	template<typename T>
+	void HyperLogLog<T>::insert_dense(uint64_t x) {
+		const size_t j = x >> (64 - m_precision);
+		m_registers[j] = std::max(m_registers[j], rank(x, m_precision));
+	}
+
+	/*
+	 * Applies a sparse entry to the dense registers. The bits of the sparse index below the dense index are the
+	 * first bits after the dense index in the hash.
+	 * */
+	template<typename T>
+	void HyperLogLog<T>::register_max(uint32_t entry) {
+		const size_t extra_bits = m_sparse_precision - m_precision;
+		const uint32_t sparse_index = entry >> 6;
+		const uint32_t low_bits = sparse_index & ((1u << extra_bits) - 1);
+		const size_t j = sparse_index >> extra_bits;
+
+		uint8_t r;
+		if (low_bits) {
+			r = __builtin_clz(low_bits) - (32 - extra_bits) + 1;
+		} else {
+			r = extra_bits + (entry & 0x3F);
 		}
-		double E = m_alpha * m_len * m_len / Z;
+		m_registers[j] = std::max(m_registers[j], r);
+	}
 
-		// Only small range correction implemented since we use 64 bit hash.
-		if (E <= (5.0/2.0) * m_len) {
-			size_t V = num_zero_registers();
-			if (V != 0) {
-				E = m_len * log((double)m_len / V);
+	template<typename T>
+	void HyperLogLog<T>::to_dense() {
+		m_registers.assign(m_len, 0);
+		for (uint32_t entry : m_sparse) {
+			register_max(entry);
+		}
+		std::vector<uint32_t>().swap(m_sparse);
+	}
+
+	template<typename T>
+	size_t HyperLogLog<T>::size() const {
+		std::array<size_t, 66> histogram{};
+		size_t precision = m_precision;
+		if (is_sparse()) {
+			precision = m_sparse_precision;
+			histogram[0] = (1ull << m_sparse_precision) - m_sparse.size();
+			for (uint32_t entry : m_sparse) {
+				histogram[entry & 0x3F]++;
+			}
+		} else {
+			for (uint8_t r : m_registers) {
+				histogram[r]++;
 			}
 		}
 
-		return (size_t)E;
+		return (size_t)std::llround(estimate(histogram, precision));
 	}
 
+	/*
+	 * Improved raw estimator from "New cardinality estimation algorithms for HyperLogLog sketches" by Otmar Ertl.
+	 * */
 	template<typename T>
-	char HyperLogLog<T>::leading_zeros_plus_one(size_t x) const {
-		size_t num_zeros = 1;
-		for (size_t i = 0; i < 64; i++) {
-			if ((x >> (64 - 1 - i)) & 0x1ull) return num_zeros;
-			num_zeros++;
+	double HyperLogLog<T>::estimate(const std::array<size_t, 66> &histogram, size_t precision) {
+		const size_t q = 64 - precision;
+		const double m = (double)(1ull << precision);
+
+		double z = m * tau(1.0 - histogram[q + 1] / m);
+		for (size_t k = q; k >= 1; k--) {
+			z = 0.5 * (z + histogram[k]);
 		}
-		return num_zeros;
+		z += m * sigma(histogram[0] / m);
+
+		const double alpha = 0.5 / std::log(2.0);
+		return alpha * m * m / z;
+	}
+
+	template<typename T>
+	double HyperLogLog<T>::sigma(double x) {
+		if (x == 1.0) return std::numeric_limits<double>::infinity();
+		double y = 1.0;
+		double z = x;
+		double z_prev;
+		do {
+			x *= x;
+			z_prev = z;
+			z += x * y;
+			y += y;
+		} while (z_prev != z);
+		return z;
+	}
+
+	template<typename T>
+	double HyperLogLog<T>::tau(double x) {
+		if (x == 0.0 || x == 1.0) return 0.0;
+		double y = 1.0;
+		double z = 1.0 - x;
+		double z_prev;
+		do {
+			x = std::sqrt(x);
+			z_prev = z;
+			y *= 0.5;
+			z -= (1.0 - x) * (1.0 - x) * y;
+		} while (z_prev != z);
+		return z / 3.0;
+	}
+
+	template<typename T>
+	char HyperLogLog<T>::leading_zeros_plus_one(size_t x) const {
+		if (x == 0) return 65;
+		return __builtin_clzll(x) + 1;
 	}
 
 	template<typename T>
 	size_t HyperLogLog<T>::num_zero_registers() const {
-		size_t num_zero = 0;
-		for (size_t i = 0; i < m_len; i++) {
-			if (m_M[i] == 0) num_zero++;
+		if (is_sparse()) {
+			size_t num_non_zero = 0;
+			uint32_t last = UINT32_MAX;
+			for (uint32_t entry : m_sparse) {
+				const uint32_t j = entry >> (6 + m_sparse_precision - m_precision);
+				if (j != last) num_non_zero++;
+				last = j;
+			}
+			return m_len - num_non_zero;
 		}
-		return num_zero;
+		return std::count(m_registers.begin(), m_registers.end(), 0);
 	}
 
 	template<typename T>
@@ -163,26 +355,167 @@ namespace Algorithm {
 
 	template<typename T>
 	HyperLogLog<T> HyperLogLog<T>::operator +(const HyperLogLog<T> &hl) const {
-		HyperLogLog res;
-		for (size_t i = 0; i < m_len && i < hl.m_len; i++) {
-			res.m_M[i] = std::max(m_M[i], hl.m_M[i]);
-		}
-
+		HyperLogLog res(*this);
+		res += hl;
 		return res;
 	}
 
 	template<typename T>
 	HyperLogLog<T> &HyperLogLog<T>::operator +=(const HyperLogLog<T> &hl) {
-		for (size_t i = 0; i < m_len && i < hl.m_len; i++) {
-			m_M[i] = std::max(m_M[i], hl.m_M[i]);
+		if (m_precision != hl.m_precision || m_legacy_hash != hl.m_legacy_hash) {
+			throw LOG_ERROR_EXCEPTION("Can not merge hyper log log counters with precision " +
+				std::to_string(m_precision) + " and " + std::to_string(hl.m_precision) + ", legacy hash " +
+				std::to_string(m_legacy_hash) + " and " + std::to_string(hl.m_legacy_hash));
 		}
+
+		if (is_sparse() && hl.is_sparse()) {
+			std::vector<uint32_t> merged;
+			merged.reserve(m_sparse.size() + hl.m_sparse.size());
+			std::merge(m_sparse.begin(), m_sparse.end(), hl.m_sparse.begin(), hl.m_sparse.end(),
+				std::back_inserter(merged));
+			// Entries with the same index are next to each other with the highest rank last.
+			m_sparse.clear();
+			for (uint32_t entry : merged) {
+				if (m_sparse.size() && (m_sparse.back() >> 6) == (entry >> 6)) {
+					m_sparse.back() = entry;
+				} else {
+					m_sparse.push_back(entry);
+				}
+			}
+			if (m_sparse.size() > max_sparse_entries()) {
+				to_dense();
+			}
+			return *this;
+		}
+
+		if (is_sparse()) {
+			to_dense();
+		}
+
+		if (hl.is_sparse()) {
+			for (uint32_t entry : hl.m_sparse) {
+				register_max(entry);
+			}
+			return *this;
+		}
+
+		uint8_t *dest = m_registers.data();
+		const uint8_t *src = hl.m_registers.data();
+		const size_t len = m_registers.size();
+		size_t i = 0;
+	#if defined(__x86_64__)
+		for (; i + 16 <= len; i += 16) {
+			const __m128i a = _mm_loadu_si128((const __m128i *)(dest + i));
+			const __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+			_mm_storeu_si128((__m128i *)(dest + i), _mm_max_epu8(a, b));
+		}
+	#endif
+		for (; i < len; i++) {
+			dest[i] = std::max(dest[i], src[i]);
+		}
+
 		return *this;
 	}
 
 	template<typename T>
-	HyperLogLog<T> &HyperLogLog<T>::operator =(const HyperLogLog<T> &other) {
-		memcpy(m_M, other.m_M, m_len);
-		return *this;
+	void HyperLogLog<T>::serialize(std::ostream &writer) const {
+		const uint8_t header[3] = {serialization_version, (uint8_t)m_precision,
+			(uint8_t)((is_sparse() ? m_flag_sparse : 0) | (m_legacy_hash ? m_flag_legacy_hash : 0))};
+		writer.write((const char *)header, sizeof(header));
+
+		if (is_sparse()) {
+			write_varint(writer, m_sparse.size());
+			uint32_t last = 0;
+			for (uint32_t entry : m_sparse) {
+				write_varint(writer, entry - last);
+				last = entry;
+			}
+			return;
+		}
+
+		// Registers are at most 64 - precision + 1 so they fit in 6 bits.
+		std::string packed(m_len / 4 * 3, '\0');
+		for (size_t i = 0, j = 0; i < m_len; i += 4, j += 3) {
+			const uint32_t bits = m_registers[i] | (m_registers[i + 1] << 6) | (m_registers[i + 2] << 12) |
+				(m_registers[i + 3] << 18);
+			packed[j] = bits & 0xFF;
+			packed[j + 1] = (bits >> 8) & 0xFF;
+			packed[j + 2] = (bits >> 16) & 0xFF;
+		}
+		writer.write(packed.data(), packed.size());
+	}
+
+	template<typename T>
+	bool HyperLogLog<T>::deserialize(std::istream &reader) {
+
+		uint8_t header[3];
+		if (!reader.read((char *)header, sizeof(header)) || header[0] != serialization_version ||
+				header[1] < 4 || header[1] > 18) {
+			*this = HyperLogLog(m_precision);
+			return false;
+		}
+
+		*this = HyperLogLog(header[1]);
+		m_legacy_hash = header[2] & m_flag_legacy_hash;
+
+		if (header[2] & m_flag_sparse) {
+			uint64_t num_entries;
+			if (!read_varint(reader, num_entries) || num_entries > max_sparse_entries()) {
+				*this = HyperLogLog(m_precision);
+				return false;
+			}
+			// The entries are strictly increasing and below the end of the sparse index range, register_max uses
+			// them to index the registers.
+			const uint64_t entries_end = (uint64_t(1) << m_sparse_precision) << 6;
+			m_sparse.resize(num_entries);
+			uint64_t entry = 0;
+			for (size_t i = 0; i < num_entries; i++) {
+				uint64_t delta;
+				if (!read_varint(reader, delta) || (i > 0 && delta == 0) || delta >= entries_end - entry) {
+					*this = HyperLogLog(m_precision);
+					return false;
+				}
+				entry += delta;
+				m_sparse[i] = (uint32_t)entry;
+			}
+			return true;
+		}
+
+		std::string packed(m_len / 4 * 3, '\0');
+		if (!reader.read(packed.data(), packed.size())) {
+			*this = HyperLogLog(m_precision);
+			return false;
+		}
+		m_registers.resize(m_len);
+		for (size_t i = 0, j = 0; i < m_len; i += 4, j += 3) {
+			const uint32_t bits = (uint8_t)packed[j] | ((uint8_t)packed[j + 1] << 8) | ((uint8_t)packed[j + 2] << 16);
+			m_registers[i] = bits & 0x3F;
+			m_registers[i + 1] = (bits >> 6) & 0x3F;
+			m_registers[i + 2] = (bits >> 12) & 0x3F;
+			m_registers[i + 3] = (bits >> 18) & 0x3F;
+		}
+		return true;
+	}
+
+	template<typename T>
+	void HyperLogLog<T>::write_varint(std::ostream &writer, uint64_t value) {
+		while (value >= 0x80) {
+			writer.put((char)((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		writer.put((char)value);
+	}
+
+	template<typename T>
+	bool HyperLogLog<T>::read_varint(std::istream &reader, uint64_t &value) {
+		value = 0;
+		for (size_t shift = 0; shift < 64; shift += 7) {
+			const int c = reader.get();
+			if (c == EOF) return false;
+			value |= (uint64_t)(c & 0x7F) << shift;
+			if ((c & 0x80) == 0) return true;
+		}
+		return false;
 	}
 
 }
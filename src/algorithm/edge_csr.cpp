@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "edge_csr.h"
+#include "system/Logger.h"
+#include <cstring>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace algorithm {
+
+	const size_t header_len = 3 * sizeof(uint64_t);
+
+	edge_csr::edge_csr(vector<uint64_t> &&offsets, vector<uint32_t> &&edges)
+	: m_offset_data(std::move(offsets)), m_edge_data(std::move(edges)) {
+		m_offsets = m_offset_data.data();
+		m_edges = m_edge_data.data();
+		m_num_vertices = m_offset_data.size() - 1;
+		m_num_edges = m_edge_data.size();
+	}
+
+	edge_csr::edge_csr(const string &filename)
+	: m_file(make_unique<utils::mmap_file>(filename)) {
+
+		if (m_file->size() < header_len) {
+			throw LOG_ERROR_EXCEPTION("Could not read csr file " + filename);
+		}
+
+		const uint64_t *header = (const uint64_t *)m_file->data();
+		m_num_vertices = header[1];
+		m_num_edges = header[2];
+
+		const size_t expected_len = header_len + (m_num_vertices + 1) * sizeof(uint64_t) + m_num_edges * sizeof(uint32_t);
+		if (header[0] != csr_magic || m_file->size() != expected_len) {
+			throw LOG_ERROR_EXCEPTION("Invalid csr file " + filename);
+		}
+
+		m_offsets = header + 3;
+		m_edges = (const uint32_t *)(m_offsets + m_num_vertices + 1);
+	}
+
+	void write_edge_csr(const string &filename, size_t num_vertices,
+		const function<void(const edge_callback &)> &for_each_edge) {
+
+		// First pass counts the edges of each vertex.
+		vector<uint64_t> offsets(num_vertices + 1, 0);
+		for_each_edge([&offsets, num_vertices](uint32_t vertex, uint32_t edge) {
+			if (vertex < num_vertices && edge < num_vertices) {
+				offsets[vertex + 1]++;
+			}
+		});
+		for (size_t v = 0; v < num_vertices; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		const size_t num_edges = offsets[num_vertices];
+
+		const size_t offsets_len = (num_vertices + 1) * sizeof(uint64_t);
+		const size_t file_len = header_len + offsets_len + num_edges * sizeof(uint32_t);
+
+		const int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			throw LOG_ERROR_EXCEPTION("Could not open csr file " + filename);
+		}
+		if (ftruncate(fd, file_len) != 0) {
+			close(fd);
+			throw LOG_ERROR_EXCEPTION("Could not resize csr file " + filename);
+		}
+		void *ptr = mmap(nullptr, file_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(fd);
+			throw LOG_ERROR_EXCEPTION("Could not map csr file " + filename);
+		}
+
+		uint64_t *header = (uint64_t *)ptr;
+		header[0] = edge_csr::csr_magic;
+		header[1] = num_vertices;
+		header[2] = num_edges;
+		memcpy(header + 3, offsets.data(), offsets_len);
+
+		// Second pass writes the edges, offsets[v] is the next free position of vertex v.
+		uint32_t *edges = (uint32_t *)(header + 3 + num_vertices + 1);
+		for_each_edge([&offsets, edges, num_vertices](uint32_t vertex, uint32_t edge) {
+			if (vertex < num_vertices && edge < num_vertices) {
+				edges[offsets[vertex]++] = edge;
+			}
+		});
+
+		munmap(ptr, file_len);
+		close(fd);
+	}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <span>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "utils/mmap_file.hpp"
+
+namespace algorithm {
+
+	/*
+	 * Graph in compressed sparse row format. The edges of vertex v are m_edges[m_offsets[v]] to
+	 * m_edges[m_offsets[v + 1]]. The file format is
+	 *
+	 * [uint64 csr_magic][uint64 num_vertices][uint64 num_edges][num_vertices + 1 uint64 offsets][num_edges uint32 edges]
+	 *
+	 * Files are memory mapped so graphs larger than memory can be read.
+	 * */
+	class edge_csr {
+
+	public:
+
+		edge_csr(std::vector<uint64_t> &&offsets, std::vector<uint32_t> &&edges);
+
+		/*
+		 * Maps the file, throws if it is not a complete csr file.
+		 * */
+		explicit edge_csr(const std::string &filename);
+
+		size_t num_vertices() const { return m_num_vertices; }
+		size_t num_edges() const { return m_num_edges; }
+
+		std::span<const uint32_t> edges(size_t vertex) const {
+			return std::span<const uint32_t>(m_edges + m_offsets[vertex], m_edges + m_offsets[vertex + 1]);
+		}
+
+		static const uint64_t csr_magic = 0x3130305253434248ull; // "HBCSR001"
+
+	private:
+
+		std::unique_ptr<utils::mmap_file> m_file;
+		std::vector<uint64_t> m_offset_data;
+		std::vector<uint32_t> m_edge_data;
+
+		const uint64_t *m_offsets;
+		const uint32_t *m_edges;
+		size_t m_num_vertices;
+		size_t m_num_edges;
+
+	};
+
+	using edge_callback = std::function<void(uint32_t vertex, uint32_t edge)>;
+
+	/*
+	 * Writes a csr file with two passes over the edges without holding them in memory. for_each_edge calls the
+	 * callback for every edge and has to give the same edges both times it is called.
+	 * */
+	void write_edge_csr(const std::string &filename, size_t num_vertices,
+		const std::function<void(const edge_callback &)> &for_each_edge);
+
+}
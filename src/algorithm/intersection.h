@@ -26,62 +26,270 @@
 #pragma once
 
 #include <vector>
+#include <span>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <concepts>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace algorithm {
 
+	/*
+	 * Intersection of sorted lists. The strategy used to advance in each list is picked from the ratio between its
+	 * length and the length of the shortest list:
+	 *
+	 * linear:		plain merge, best when the lists have similar lengths.
+	 * simd:		the linear merge but comparing four values at a time with AVX2, best when the list is a few times
+	 * 				longer than the shortest one. Only for 16 byte records that start with m_value (or plain uint64_t
+	 * 				keys) on cpus that support it.
+	 * galloping:	exponential search followed by binary search, best when the list is much longer than the
+	 * 				shortest one.
+	 * */
+	enum class intersection_strategy { linear = 101, simd = 102, galloping = 103 };
+
+	// Use galloping search when a list is this many times longer than the shortest list.
+	const size_t galloping_ratio = 32;
+
+	// Use simd search when a list is this many times longer than the shortest list. With shorter lists the merge
+	// advances less than four positions per key and the plain merge is as fast (see benchmarks/search.h).
+	const size_t simd_ratio = 4;
+
 	template<typename item>
-	std::vector<item> intersection(const std::vector<std::vector<item>> &input,
-		std::function<void(item &a, const item &b)> sum_fun) {
+	concept has_value = requires(const item &i) {
+		{ i.m_value } -> std::convertible_to<uint64_t>;
+	};
 
-		if (input.size() == 0) return {};
+	/*
+	 * Four values can be loaded from the records with two contiguous 32 byte loads.
+	 * */
+	template<typename item>
+	concept simd_searchable = std::same_as<item, uint64_t> || (has_value<item> && std::is_standard_layout_v<item> &&
+		sizeof(item) == 16 && sizeof(item::m_value) == 8 && offsetof(item, m_value) == 0);
 
-		size_t shortest_vector_position = 0;
-		size_t shortest_len = SIZE_MAX;
-		size_t iter_index = 0;
-		for (const std::vector<item> &vec : input) {
-			if (shortest_len > vec.size()) {
-				shortest_len = vec.size();
-				shortest_vector_position = iter_index;
+	/*
+	 * Records are compared by m_value if they have one, other items with operator<.
+	 * */
+	template<typename item>
+	requires has_value<item>
+	inline uint64_t intersection_key(const item &i) { return i.m_value; }
+
+	template<typename item>
+	inline const item &intersection_key(const item &i) { return i; }
+
+	inline bool has_simd_support() {
+	#if defined(__x86_64__)
+		static const bool supported = __builtin_cpu_supports("avx2");
+		return supported;
+	#else
+		return false;
+	#endif
+	}
+
+	template<typename item>
+	intersection_strategy choose_intersection_strategy(size_t shortest_len, size_t len) {
+		if (len / galloping_ratio > shortest_len) {
+			return intersection_strategy::galloping;
+		}
+		if constexpr (simd_searchable<item>) {
+			if (len / simd_ratio >= shortest_len && has_simd_support()) return intersection_strategy::simd;
+		}
+		return intersection_strategy::linear;
+	}
+
+	/*
+	 * All search functions return the first position from pos where the key is not less than the given key,
+	 * or len if there is no such position.
+	 * */
+	template<typename item, typename key_type>
+	size_t linear_search(const item *data, size_t pos, size_t len, const key_type &key) {
+		while (pos < len && intersection_key(data[pos]) < key) {
+			pos++;
+		}
+		return pos;
+	}
+
+	template<typename item, typename key_type>
+	size_t galloping_search(const item *data, size_t pos, size_t len, const key_type &key) {
+		if (pos >= len || !(intersection_key(data[pos]) < key)) return pos;
+
+		// Find a range (low, high] that contains the position.
+		size_t low = pos;
+		size_t step = 1;
+		size_t high = pos + step;
+		while (high < len && intersection_key(data[high]) < key) {
+			low = high;
+			step <<= 1;
+			high = low + step;
+		}
+		if (high > len) high = len;
+
+		// Binary search for the first position not less than key in (low, high].
+		low++;
+		while (low < high) {
+			const size_t mid = low + ((high - low) >> 1);
+			if (intersection_key(data[mid]) < key) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		return low;
+	}
+
+	#if defined(__x86_64__)
+	template<typename item>
+	requires simd_searchable<item>
+	__attribute__((target("avx2")))
+	size_t simd_search_avx2(const item *data, size_t pos, size_t len, uint64_t key) {
+		// AVX2 only has signed 64 bit compare so flip the sign bits to compare unsigned values.
+		const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+		const __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), sign);
+		while (pos + 4 <= len) {
+			__m256i values;
+			if constexpr (sizeof(item) == 8) {
+				values = _mm256_loadu_si256((const __m256i *)(data + pos));
+			} else {
+				// Each load holds two records, the values are the even 64 bit lanes. The lanes end up in the order
+				// 0, 2, 1, 3 which does not matter since only the number of values less than the key is used.
+				const __m256i low = _mm256_loadu_si256((const __m256i *)(data + pos));
+				const __m256i high = _mm256_loadu_si256((const __m256i *)(data + pos + 2));
+				values = _mm256_unpacklo_epi64(low, high);
 			}
-			iter_index++;
+			const __m256i block = _mm256_xor_si256(values, sign);
+			const int less_mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, block)));
+			if (less_mask != 0xF) {
+				// The data is sorted so the values that are less than the key are the first ones.
+				return pos + __builtin_popcount(less_mask);
+			}
+			pos += 4;
+		}
+		return linear_search(data, pos, len, key);
+	}
+	#endif
+
+	template<typename item>
+	requires simd_searchable<item>
+	size_t simd_search(const item *data, size_t pos, size_t len, uint64_t key) {
+	#if defined(__x86_64__)
+		if (has_simd_support()) {
+			return simd_search_avx2(data, pos, len, key);
+		}
+	#endif
+		return linear_search(data, pos, len, key);
+	}
+
+	template<typename item, typename key_type>
+	size_t search(intersection_strategy strategy, const item *data, size_t pos, size_t len, const key_type &key) {
+		if (strategy == intersection_strategy::galloping) {
+			return galloping_search(data, pos, len, key);
+		}
+		if constexpr (simd_searchable<item>) {
+			if (strategy == intersection_strategy::simd) {
+				return simd_search(data, pos, len, key);
+			}
+		}
+		return linear_search(data, pos, len, key);
+	}
+
+	/*
+	 * Finds all keys that are present in all the inputs. The inputs must be sorted and without duplicates. Calls
+	 * on_match with the matching position in each input, in the order of the inputs.
+	 * */
+	template<typename item, typename match_fun>
+	void intersection_positions(const std::vector<std::span<const item>> &input, match_fun on_match) {
+
+		if (input.size() == 0) return;
+
+		// Visit the lists from shortest to longest so that misses are found as early as possible.
+		std::vector<size_t> order(input.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&input](size_t a, size_t b) {
+			return input[a].size() < input[b].size();
+		});
+
+		const std::span<const item> &shortest = input[order[0]];
+		if (shortest.size() == 0) return;
+
+		std::vector<intersection_strategy> strategies(input.size());
+		for (size_t i = 0; i < input.size(); i++) {
+			strategies[i] = choose_intersection_strategy<item>(shortest.size(), input[i].size());
 		}
 
 		std::vector<size_t> positions(input.size(), 0);
-		std::vector<item> intersection;
+		for (size_t shortest_pos = 0; shortest_pos < shortest.size(); shortest_pos++) {
 
-		while (positions[shortest_vector_position] < shortest_len) {
+			const auto &key = intersection_key(shortest[shortest_pos]);
+			positions[order[0]] = shortest_pos;
 
 			bool all_equal = true;
-			item value = input[shortest_vector_position][positions[shortest_vector_position]];
+			for (size_t i = 1; i < order.size(); i++) {
+				const size_t input_id = order[i];
+				const std::span<const item> &vec = input[input_id];
+				size_t &pos = positions[input_id];
 
-			size_t iter_index = 0;
-			for (const std::vector<item> &vec : input) {
-				const size_t len = vec.size();
+				pos = search(strategies[input_id], vec.data(), pos, vec.size(), key);
 
-				size_t *pos = &(positions[iter_index]);
-				while (*pos < len && vec[*pos] < value) {
-					(*pos)++;
-				}
-				if (((*pos < len) && (value < vec[*pos])) || *pos >= len) {
+				// No more matches are possible when one of the lists runs out.
+				if (pos >= vec.size()) return;
+
+				if (key < intersection_key(vec[pos])) {
 					all_equal = false;
 					break;
-				} else {
-					if (iter_index != shortest_vector_position) {
-						sum_fun(value, vec[*pos]);
-					}
 				}
-				iter_index++;
 			}
+
 			if (all_equal) {
-				intersection.push_back(value);
+				on_match(positions);
 			}
+		}
+	}
 
-			positions[shortest_vector_position]++;
+	/*
+	 * Returns the items from the shortest list that are present in all lists. sum_fun is called with the
+	 * returned item and the matching items from the other lists, so scores can be summed.
+	 * */
+	template<typename item>
+	std::vector<item> intersection(std::span<const std::span<const item>> input,
+		std::function<void(item &a, const item &b)> sum_fun) {
+
+		if (input.size() == 0) return {};
+
+		size_t shortest_vector_position = 0;
+		for (size_t i = 0; i < input.size(); i++) {
+			if (input[i].size() < input[shortest_vector_position].size()) {
+				shortest_vector_position = i;
+			}
 		}
 
+		std::vector<item> intersection;
+
+		intersection_positions<item>({input.begin(), input.end()}, [&](const std::vector<size_t> &positions) {
+			item value = input[shortest_vector_position][positions[shortest_vector_position]];
+			for (size_t i = 0; i < input.size(); i++) {
+				if (i != shortest_vector_position) {
+					sum_fun(value, input[i][positions[i]]);
+				}
+			}
+			intersection.push_back(value);
+		});
+
 		return intersection;
 	}
 
+	template<typename item>
+	std::vector<item> intersection(const std::vector<std::vector<item>> &input,
+		std::function<void(item &a, const item &b)> sum_fun) {
+		const std::vector<std::span<const item>> spans(input.begin(), input.end());
+		return intersection<item>(std::span<const std::span<const item>>(spans), sum_fun);
+	}
+
 	template<typename item>
 	std::vector<item> intersection(const std::vector<std::vector<item>> &input) {
 		return intersection<item>(input, [](item &a, const item &b) {});
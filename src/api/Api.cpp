@@ -54,6 +54,28 @@ using json = nlohmann::json;
 
 namespace Api {
 
+	/*
+		Fetches the stored data for all the results with one batched hash table lookup.
+	*/
+	static vector<ResultWithSnippet> results_with_snippets(HashTable &hash_table, const vector<FullTextRecord> &results) {
+
+		vector<uint64_t> keys;
+		keys.reserve(results.size());
+		for (const FullTextRecord &res : results) {
+			keys.push_back(res.m_value);
+		}
+
+		const vector<string> tsv_data = hash_table.find_many(keys);
+
+		vector<ResultWithSnippet> with_snippets;
+		with_snippets.reserve(results.size());
+		for (size_t i = 0; i < results.size(); i++) {
+			with_snippets.emplace_back(ResultWithSnippet(tsv_data[i], results[i]));
+		}
+
+		return with_snippets;
+	}
+
 	void search(const string &query, HashTable &hash_table, const FullTextIndex<FullTextRecord> &index,
 		SearchAllocation::Allocation *allocation, stringstream &response_stream) {
 
@@ -68,11 +90,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -107,11 +125,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -160,11 +174,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -192,11 +202,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -233,11 +239,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -281,11 +283,7 @@ namespace Api {
 
 		PostProcessor post_processor(query);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		post_processor.run(with_snippets);
 
@@ -394,11 +392,7 @@ namespace Api {
 
 		SearchEngine::sort_by_score(results);
 
-		vector<ResultWithSnippet> with_snippets;
-		for (FullTextRecord &res : results) {
-			const string tsv_data = hash_table.find(res.m_value);
-			with_snippets.emplace_back(ResultWithSnippet(tsv_data, res));
-		}
+		vector<ResultWithSnippet> with_snippets = results_with_snippets(hash_table, results);
 
 		metric.m_links_handled = links_handled;
 		metric.m_total_url_links_found = total_url_links_found;
@@ -59,6 +59,7 @@ ApiResponse::ApiResponse(vector<ResultWithSnippet> &results, const struct Search
 	message["links_handled"] = metric.m_links_handled;
 	message["link_domain_matches"] = metric.m_link_domain_matches;
 	message["link_url_matches"] = metric.m_link_url_matches;
+	message["query_cpu_ms"] = metric.m_query_cpu_time / 1000.0;
 	message["results"] = result_array;
 
 	//m_response = message.dump();
@@ -5,7 +5,9 @@
 #include "parser/URL.h"
 #include "parser/cc_parser.h"
 #include <pthread.h>
+#include <atomic>
 #include <signal.h>
+#include <sys/socket.h>
 #include <boost/filesystem.hpp>
 
 #include "post_processor/PostProcessor.h"
@@ -73,13 +75,13 @@ namespace Worker {
 
 		FCGX_InitRequest(&request, worker->socket_id, 0);
 
-		HashTable hash_table("main_index");
-		HashTable hash_table_link("link_index");
-		HashTable hash_table_domain_link("domain_link_index");
+		HashTable hash_table(worker->index_prefix + "main_index");
+		HashTable hash_table_link(worker->index_prefix + "link_index");
+		HashTable hash_table_domain_link(worker->index_prefix + "domain_link_index");
 
-		FullTextIndex<FullTextRecord> index("main_index");
-		FullTextIndex<Link::FullTextRecord> link_index("link_index");
-		FullTextIndex<DomainLink::FullTextRecord> domain_link_index("domain_link_index");
+		FullTextIndex<FullTextRecord> index(worker->index_prefix + "main_index");
+		FullTextIndex<Link::FullTextRecord> link_index(worker->index_prefix + "link_index");
+		FullTextIndex<DomainLink::FullTextRecord> domain_link_index(worker->index_prefix + "domain_link_index");
 
 		LOG_INFO("Server has started...");
 
@@ -151,12 +153,30 @@ namespace Worker {
 		return NULL;
 	}
 
+	// Written by the thread running start_server and read by the one calling stop_server.
+	atomic<int> server_socket_id = -1;
+	atomic<bool> server_stop_requested = false;
+
 	void start_server() {
+		start_server("127.0.0.1:8000", "");
+	}
+
+	void start_server(const string &address, const string &index_prefix) {
 		FCGX_Init();
 
-		int socket_id = FCGX_OpenSocket("127.0.0.1:8000", 20);
+		int socket_id = FCGX_OpenSocket(address.c_str(), 20);
 		if (socket_id < 0) {
 			LOG_INFO("Could not open socket, exiting");
+			server_stop_requested = false;
+			return;
+		}
+		server_socket_id = socket_id;
+
+		// stop_server was called before the socket was published, it did not shut it down.
+		if (server_stop_requested) {
+			server_socket_id = -1;
+			server_stop_requested = false;
+			close(socket_id);
 			return;
 		}
 
@@ -166,6 +186,7 @@ namespace Worker {
 		for (size_t i = 0; i < Config::worker_count; i++) {
 			workers[i].socket_id = socket_id;
 			workers[i].thread_id = i;
+			workers[i].index_prefix = index_prefix;
 
 			pthread_create(&thread_ids[i], NULL, run_worker, &workers[i]);
 		}
@@ -174,9 +195,23 @@ namespace Worker {
 			pthread_join(thread_ids[i], NULL);
 		}
 
+		delete [] workers;
+
+		server_socket_id = -1;
+		server_stop_requested = false;
 		close(socket_id);
 	}
 
+	void stop_server() {
+		server_stop_requested = true;
+		// Makes the workers blocked in FCGX_Accept_r return with an error so they exit their loops.
+		FCGX_ShutdownPending();
+		const int socket_id = server_socket_id;
+		if (socket_id >= 0) {
+			shutdown(socket_id, SHUT_RDWR);
+		}
+	}
+
 	void download_server() {
 		Parser::warc_downloader();
 	}
@@ -17,11 +17,25 @@ namespace Worker {
 
 		int socket_id;
 		int thread_id;
+		std::string index_prefix;
 
 	};
 
 	void test_search(const std::string &query);
 	void start_server();
+
+	/*
+	 * Runs the search workers on address ("host:port" or the path of a unix socket) with the indexes named
+	 * index_prefix + "main_index" and so on. Blocks until stop_server is called.
+	 * */
+	void start_server(const std::string &address, const std::string &index_prefix);
+
+	/*
+	 * Stops start_server from another thread. Can be called before start_server has opened its socket, it then
+	 * returns as soon as it has opened it.
+	 * */
+	void stop_server();
+
 	void start_download_server();
 	void start_status_server(Status &status);
 	void start_urlstore_server();
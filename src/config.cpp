@@ -40,6 +40,8 @@ namespace Config {
 	string url_store_host = "http://node0009.alexandria.org";
 	string url_store_path = "/alexandria/urlstore";
 	string url_store_cache_path = "/mnt/4/urlstore_cache";
+	size_t url_store_bloom_mb = 256;
+	map<string, string> url_store_engines;
 
 	size_t nodes_in_cluster = 1;
 	size_t node_id = 0;
@@ -50,6 +52,7 @@ namespace Config {
 	vector<string> batches;
 	vector<string> link_batches;
 	size_t worker_count = 8;
+	size_t query_pool_threads = 0;
 	size_t query_max_words = 10;
 	size_t query_max_len = 200;
 	size_t deduplicate_domain_count = 5;
@@ -61,6 +64,22 @@ namespace Config {
 	size_t shard_hash_table_size = 100000;
 	size_t html_parser_long_text_len = 1000;
 	size_t ft_shard_builder_buffer_len = 240000;
+	size_t ft_merge_run_len = 1000000;
+	size_t merger_threads_per_disk = 3;
+	size_t posting_cache_mb = 0;
+	string posting_cache_warm_up_file = "";
+	size_t hyper_ball_max_memory_mb = 32768;
+	size_t host_graph_buffer_mb = 4096;
+	size_t memory_profiler_sample_rate = 0;
+	bool memory_size_histogram = false;
+	size_t scraper_threads = 4;
+	size_t scraper_max_per_ip = 2;
+	size_t scraper_dns_ttl = 300;
+	size_t scraper_robots_ttl = 86400;
+	size_t scraper_robots_cache_size = 100000;
+	size_t ht_compaction_mb_per_second = 50;
+	size_t ht_compaction_garbage_percent = 30;
+	size_t ht_compaction_interval = 600;
 
 	size_t ft_num_shards = 2048;
 	size_t ft_max_sections = 8;
@@ -116,6 +135,11 @@ namespace Config {
 				url_store_host = parts[1];
 			} else if (parts[0] == "url_store_path") {
 				url_store_path = parts[1];
+			} else if (parts[0] == "url_store_bloom_mb") {
+				url_store_bloom_mb = stoull(parts[1]);
+			} else if (parts[0].find("url_store_engine[") == 0 && parts[0].back() == ']') {
+				// url_store_engine[url] = hash_log
+				url_store_engines[parts[0].substr(17, parts[0].size() - 18)] = parts[1];
 			} else if (parts[0] == "nodes_in_cluster") {
 				nodes_in_cluster = stoi(parts[1]);
 			} else if (parts[0] == "node_id") {
@@ -126,6 +150,8 @@ namespace Config {
 				link_batches.push_back(parts[1]);
 			} else if (parts[0] == "worker_count") {
 				worker_count = stoi(parts[1]);
+			} else if (parts[0] == "query_pool_threads") {
+				query_pool_threads = stoull(parts[1]);
 			} else if (parts[0] == "query_max_words") {
 				query_max_words = stoi(parts[1]);
 			} else if (parts[0] == "query_max_len") {
@@ -166,6 +192,38 @@ namespace Config {
 				shard_hash_table_size = stoull(parts[1]);
 			} else if (parts[0] == "html_parser_long_text_len") {
 				html_parser_long_text_len = stoull(parts[1]);
+			} else if (parts[0] == "ft_merge_run_len") {
+				ft_merge_run_len = stoull(parts[1]);
+			} else if (parts[0] == "merger_threads_per_disk") {
+				merger_threads_per_disk = stoull(parts[1]);
+			} else if (parts[0] == "posting_cache_mb") {
+				posting_cache_mb = stoull(parts[1]);
+			} else if (parts[0] == "posting_cache_warm_up_file") {
+				posting_cache_warm_up_file = parts[1];
+			} else if (parts[0] == "hyper_ball_max_memory_mb") {
+				hyper_ball_max_memory_mb = stoull(parts[1]);
+			} else if (parts[0] == "host_graph_buffer_mb") {
+				host_graph_buffer_mb = stoull(parts[1]);
+			} else if (parts[0] == "memory_profiler_sample_rate") {
+				memory_profiler_sample_rate = stoull(parts[1]);
+			} else if (parts[0] == "memory_size_histogram") {
+				memory_size_histogram = static_cast<bool>(stoull(parts[1]));
+			} else if (parts[0] == "scraper_threads") {
+				scraper_threads = stoull(parts[1]);
+			} else if (parts[0] == "scraper_max_per_ip") {
+				scraper_max_per_ip = stoull(parts[1]);
+			} else if (parts[0] == "scraper_dns_ttl") {
+				scraper_dns_ttl = stoull(parts[1]);
+			} else if (parts[0] == "scraper_robots_ttl") {
+				scraper_robots_ttl = stoull(parts[1]);
+			} else if (parts[0] == "scraper_robots_cache_size") {
+				scraper_robots_cache_size = stoull(parts[1]);
+			} else if (parts[0] == "ht_compaction_mb_per_second") {
+				ht_compaction_mb_per_second = stoull(parts[1]);
+			} else if (parts[0] == "ht_compaction_garbage_percent") {
+				ht_compaction_garbage_percent = stoull(parts[1]);
+			} else if (parts[0] == "ht_compaction_interval") {
+				ht_compaction_interval = stoull(parts[1]);
 			}
 		}
 	}
@@ -29,6 +29,7 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
 
 namespace Config {
 
@@ -41,6 +42,8 @@ namespace Config {
 	extern std::string url_store_cache_path;
 
 	const size_t url_store_shards = 24;
+	extern size_t url_store_bloom_mb;
+	extern std::map<std::string, std::string> url_store_engines;
 
 	extern size_t nodes_in_cluster;
 	extern size_t node_id;
@@ -52,6 +55,7 @@ namespace Config {
 	extern std::vector<std::string> link_batches;
 
 	extern size_t worker_count;
+	extern size_t query_pool_threads;
 	extern size_t query_max_words;
 	extern size_t query_max_len;
 	extern size_t deduplicate_domain_count;
@@ -63,6 +67,22 @@ namespace Config {
 	extern size_t shard_hash_table_size;
 	extern size_t html_parser_long_text_len;
 	extern size_t ft_shard_builder_buffer_len;
+	extern size_t ft_merge_run_len;
+	extern size_t merger_threads_per_disk;
+	extern size_t posting_cache_mb;
+	extern std::string posting_cache_warm_up_file;
+	extern size_t hyper_ball_max_memory_mb;
+	extern size_t host_graph_buffer_mb;
+	extern size_t memory_profiler_sample_rate;
+	extern bool memory_size_histogram;
+	extern size_t scraper_threads;
+	extern size_t scraper_max_per_ip;
+	extern size_t scraper_dns_ttl;
+	extern size_t scraper_robots_ttl;
+	extern size_t scraper_robots_cache_size;
+	extern size_t ht_compaction_mb_per_second;
+	extern size_t ht_compaction_garbage_percent;
+	extern size_t ht_compaction_interval;
 
 	/*
 		Constants only configurable at compilation time.
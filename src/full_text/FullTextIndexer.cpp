@@ -28,6 +28,7 @@
 #include "FullText.h"
 #include "system/Logger.h"
 #include "text/Text.h"
+#include "text/tokenizer.h"
 #include <math.h>
 
 using namespace std;
@@ -155,48 +156,43 @@ void FullTextIndexer::write_url_to_domain() {
 
 void FullTextIndexer::add_expanded_data_to_word_map(map<uint64_t, float> &word_map, const string &text, float score) const {
 
-	vector<string> words = Text::get_expanded_full_text_words(text);
 	map<uint64_t, uint64_t> uniq;
+	const auto add_hash = [&word_map, &uniq, score](const uint64_t hash) {
+		if (uniq.find(hash) == uniq.end()) {
+			word_map[hash] += score;
+			uniq[hash] = hash;
+		}
+	};
 
 	if (Config::n_grams > 1) {
-		Text::words_to_ngram_hash(words, Config::n_grams, [&word_map, &uniq, score](const uint64_t hash) {
-			if (uniq.find(hash) == uniq.end()) {
-				word_map[hash] += score;
-				uniq[hash] = hash;
-			}
-		});
+		text::for_each_expanded_ngram_hash(text, Config::n_grams, add_hash);
 	} else {
-		for (const string &word : words) {
-			const uint64_t word_hash = Hash::str(word);
-			if (uniq.find(word_hash) == uniq.end()) {
-				word_map[word_hash] += score;
-				uniq[word_hash] = word_hash;
-			}
-		}
+		text::for_each_expanded_full_text_word(text, [&add_hash](const text::word &word) {
+			add_hash(word.hash());
+		});
 	}
 }
 
 void FullTextIndexer::add_data_to_word_map(map<uint64_t, float> &word_map, const string &text, float score) const {
 
-	vector<string> words = Text::get_full_text_words(text);
 	map<uint64_t, uint64_t> uniq;
-	for (const string &word : words) {
-		const uint64_t word_hash = m_hasher(word);
+	text::for_each_full_text_word(text, [this, &word_map, &uniq, score](const text::word &word) {
+		const uint64_t word_hash = m_hasher(word.m_text);
 		if (uniq.find(word_hash) == uniq.end()) {
 			word_map[word_hash] += score;
 			uniq[word_hash] = word_hash;
 		}
-	}
+	});
 }
 
 void FullTextIndexer::add_data_to_shards(const URL &url, const string &text, float score) {
 
-	vector<string> words = Text::get_full_text_words(text);
-	for (const string &word : words) {
+	const FullTextRecord record{.m_value = url.hash(), .m_score = score, .m_domain_hash = url.host_hash()};
+	text::for_each_full_text_word(text, [this, &record](const text::word &word) {
 
-		const uint64_t word_hash = m_hasher(word);
+		const uint64_t word_hash = m_hasher(word.m_text);
 		const size_t shard_id = word_hash % Config::ft_num_shards;
 
-		m_shards[shard_id]->add(word_hash, FullTextRecord{.m_value = url.hash(), .m_score = score, .m_domain_hash = url.host_hash()});
-	}
+		m_shards[shard_id]->add(word_hash, record);
+	});
 }
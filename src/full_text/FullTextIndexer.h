@@ -31,6 +31,7 @@
 #include <vector>
 #include <mutex>
 #include <unordered_map>
+#include <string_view>
 
 class FullTextIndexer;
 
@@ -80,7 +81,8 @@ private:
 	int m_indexer_id;
 	const std::string m_db_name;
 	const SubSystem *m_sub_system;
-	std::hash<std::string> m_hasher;
+	// Gives the same hashes as std::hash<std::string>.
+	std::hash<std::string_view> m_hasher;
 	std::vector<FullTextShardBuilder<struct FullTextRecord> *> m_shards;
 
 	UrlToDomain *m_url_to_domain = NULL;
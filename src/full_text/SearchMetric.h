@@ -34,5 +34,6 @@ struct SearchMetric {
 	size_t m_links_handled;
 	size_t m_link_domain_matches;
 	size_t m_link_url_matches;
+	double m_query_cpu_time; // Micro seconds of cpu time spent in the query pool.
 
 };
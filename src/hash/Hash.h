@@ -29,5 +29,6 @@
 namespace Hash {
 
 	size_t str(const std::string &str);
+	size_t murmur_hash(const char *key, size_t len);
 
 }
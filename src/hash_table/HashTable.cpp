@@ -28,6 +28,7 @@
 #include "HashTable.h"
 #include "HashTableShardBuilder.h"
 #include "system/Logger.h"
+#include "utils/query_pool.hpp"
 
 using namespace std;
 
@@ -57,7 +58,6 @@ void HashTable::add(uint64_t key, const string &value) {
 	HashTableShardBuilder builder(m_db_name, shard_id);
 
 	builder.add(key, value);
-
 	builder.write();
 
 }
@@ -82,6 +82,44 @@ string HashTable::find(uint64_t key) {
 	return m_shards[key % Config::ht_num_shards]->find(key);
 }
 
+vector<string> HashTable::find_many(const vector<uint64_t> &keys) {
+
+	vector<string> values(keys.size());
+
+	// Request indices for each shard.
+	map<size_t, vector<size_t>> shard_requests;
+	for (size_t i = 0; i < keys.size(); i++) {
+		shard_requests[keys[i] % Config::ht_num_shards].push_back(i);
+	}
+
+	// Shards are stored on /mnt/{shard_id % 8}, read each disk in its own task.
+	const size_t num_disks = 8;
+	vector<vector<const pair<const size_t, vector<size_t>> *>> disk_requests(num_disks);
+	for (const auto &iter : shard_requests) {
+		disk_requests[iter.first % num_disks].push_back(&iter);
+	}
+
+	utils::query_pool::query query;
+	for (const auto &requests : disk_requests) {
+		if (requests.size() == 0) continue;
+		query.submit([this, &requests, &keys, &values]() {
+			for (const auto *request : requests) {
+				vector<uint64_t> shard_keys;
+				for (size_t i : request->second) {
+					shard_keys.push_back(keys[i]);
+				}
+				vector<string> shard_values = m_shards[request->first]->find_many(shard_keys);
+				for (size_t j = 0; j < shard_values.size(); j++) {
+					values[request->second[j]] = std::move(shard_values[j]);
+				}
+			}
+		});
+	}
+	query.wait();
+
+	return values;
+}
+
 size_t HashTable::size() const {
 	return m_num_items;
 }
@@ -47,6 +47,12 @@ public:
 	void add(uint64_t key, const std::string &value);
 	void truncate();
 	std::string find(uint64_t key);
+
+	/*
+		Batch version of find. The keys are grouped by shard and the shards on each of the 8 disks are read in parallel
+		on the query pool. Returns the values in the same order as the keys.
+	*/
+	std::vector<std::string> find_many(const std::vector<uint64_t> &keys);
 	size_t size() const;
 	void print_all_items() const;
 
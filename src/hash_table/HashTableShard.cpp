@@ -27,55 +27,94 @@
 #include "config.h"
 #include "HashTableShard.h"
 #include "system/Logger.h"
+#include "dictionary_codec.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
 
 using namespace std;
 
+namespace {
+
+	// How often we look for files replaced by another process.
+	const chrono::milliseconds reopen_check_interval(1000);
+
+	struct shard_files_state {
+		shared_mutex m_lock;
+		atomic<uint64_t> m_version = 0;
+	};
+
+	shard_files_state &files_state(const string &filename_data) {
+		static mutex states_lock;
+		static map<string, unique_ptr<shard_files_state>> states;
+
+		lock_guard<mutex> guard(states_lock);
+		unique_ptr<shard_files_state> &state = states[filename_data];
+		if (!state) state = make_unique<shard_files_state>();
+		return *state;
+	}
+
+}
+
 HashTableShard::HashTableShard(const string &db_name, size_t shard_id)
-: m_db_name(db_name), m_shard_id(shard_id), m_loaded(false), m_size(0)
+: m_db_name(db_name), m_shard_id(shard_id), m_files_version(files_version(filename_data()))
 {
-	load();
+	m_files = open_files();
 }
 
 HashTableShard::~HashTableShard() {
 
 }
 
+HashTableShard::shard_files::~shard_files() {
+	if (m_fd_data >= 0) close(m_fd_data);
+	if (m_fd_pos >= 0) close(m_fd_pos);
+}
+
 string HashTableShard::find(uint64_t key) {
 
-	if (!m_loaded) load();
+	shared_ptr<const shard_files> files = current_files();
 
-	const uint64_t key_significant = key >> (64-m_significant);
-	auto iter = m_pos.find(key_significant);
-	if (iter == m_pos.end()) return "";
+	const size_t pos = data_position(*files, key);
 
-	auto pos_pair = iter->second;
-	size_t pos_in_posfile = pos_pair.first;
-	size_t len_in_posfile = pos_pair.second;
+	if (pos == string::npos) return "";
 
-	ifstream infile_pos(filename_pos(), ios::binary);
-	infile_pos.seekg(pos_in_posfile, ios::beg);
+	return data_at_position(*files, pos);
+}
 
-	const size_t record_len = Config::ht_key_size + sizeof(size_t);
-	const size_t byte_len = len_in_posfile * record_len;
-	const size_t pos_buffer_len = 200000;
-	char pos_buffer[pos_buffer_len];
-	if (byte_len > pos_buffer_len) {
-		throw LOG_ERROR_EXCEPTION("byte_len ("+to_string(byte_len)+") larger than pos_buffer_len ("+to_string(pos_buffer_len)+")");
-	}
+vector<string> HashTableShard::find_many(const vector<uint64_t> &keys) {
 
-	infile_pos.read(pos_buffer, byte_len);
-	infile_pos.close();
+	shared_ptr<const shard_files> files = current_files();
 
-	size_t pos = string::npos;
-	for (size_t i = 0; i < byte_len; i+= record_len) {
-		uint64_t tmp_key = *((uint64_t *)&pos_buffer[i]);
-		if (tmp_key == key) {
-			pos = *((size_t *)&pos_buffer[i + Config::ht_key_size]);
+	vector<string> values(keys.size());
+
+	// Read the pos file in the order of the positions of the keys.
+	vector<pair<size_t, size_t>> pos_order;
+	for (size_t i = 0; i < keys.size(); i++) {
+		auto iter = files->m_pos.find(keys[i] >> (64-m_significant));
+		if (iter != files->m_pos.end()) {
+			pos_order.emplace_back(iter->second.first, i);
 		}
 	}
-	if (pos == string::npos) return "";
+	sort(pos_order.begin(), pos_order.end());
+
+	vector<pair<size_t, size_t>> data_order;
+	for (const auto &item : pos_order) {
+		const size_t pos = data_position(*files, keys[item.second]);
+		if (pos != string::npos) {
+			data_order.emplace_back(pos, item.second);
+		}
+	}
+
+	// Then read the data file front to back.
+	sort(data_order.begin(), data_order.end());
 
-	return data_at_position(pos);
+	for (const auto &item : data_order) {
+		values[item.second] = data_at_position(*files, item.first);
+	}
+
+	return values;
 }
 
 string HashTableShard::filename_data() const {
@@ -93,7 +132,7 @@ size_t HashTableShard::shard_id() const {
 }
 
 size_t HashTableShard::size() const {
-	return m_size;
+	return current_files()->m_size;
 }
 
 size_t HashTableShard::file_size() const {
@@ -102,49 +141,211 @@ size_t HashTableShard::file_size() const {
 	return file_size;
 }
 
-void HashTableShard::load() {
-	m_loaded = true;
-	ifstream infile(filename_pos(), ios::binary);
+shared_mutex &HashTableShard::files_lock(const string &filename_data) {
+	return files_state(filename_data).m_lock;
+}
+
+atomic<uint64_t> &HashTableShard::files_version(const string &filename_data) {
+	return files_state(filename_data).m_version;
+}
+
+bool HashTableShard::replace_files(const string &filename_data, const string &filename_pos, const string &new_data,
+	const string &new_pos) {
+
+	recover_files(filename_data, filename_pos);
+
+	const string old_data = filename_data + ".old";
+	const string old_pos = filename_pos + ".old";
+	if (link(filename_data.c_str(), old_data.c_str()) != 0 || link(filename_pos.c_str(), old_pos.c_str()) != 0) {
+		LOG_INFO("could not link the old files of " + filename_data);
+		unlink(old_data.c_str());
+		return false;
+	}
+
+	bool replaced = false;
+	if (rename(new_pos.c_str(), filename_pos.c_str()) == 0) {
+		if (rename(new_data.c_str(), filename_data.c_str()) == 0) {
+			replaced = true;
+		} else if (rename(old_pos.c_str(), filename_pos.c_str()) != 0) {
+			// Leaves the .old links so recover_files can try again.
+			throw LOG_ERROR_EXCEPTION("could not roll back " + filename_pos + " after failing to rename " + new_data);
+		}
+	}
+
+	unlink(old_data.c_str());
+	unlink(old_pos.c_str());
+
+	if (replaced) {
+		files_version(filename_data)++;
+	} else {
+		LOG_INFO("could not rename " + new_data + " and " + new_pos + " into place");
+	}
+
+	return replaced;
+}
+
+void HashTableShard::recover_files(const string &filename_data, const string &filename_pos) {
+
+	const string old_data = filename_data + ".old";
+	const string old_pos = filename_pos + ".old";
+
+	struct stat st_old_pos;
+	if (::stat(old_pos.c_str(), &st_old_pos) != 0) {
+		unlink(old_data.c_str());
+		return;
+	}
+
+	// The data file is still the old one if it is the same file as the .old link, then the pos file is rolled back.
+	struct stat st_data, st_old_data;
+	if (::stat(filename_data.c_str(), &st_data) == 0 && ::stat(old_data.c_str(), &st_old_data) == 0 &&
+			st_data.st_ino == st_old_data.st_ino) {
+		if (rename(old_pos.c_str(), filename_pos.c_str()) != 0) {
+			throw LOG_ERROR_EXCEPTION("could not roll back " + filename_pos);
+		}
+		files_version(filename_data)++;
+		LOG_INFO("rolled back interrupted replace of " + filename_data);
+	} else {
+		unlink(old_pos.c_str());
+	}
+	unlink(old_data.c_str());
+}
+
+/*
+	Returns the files we have open, or opens them again if a writer in this process has changed them or, at most every
+	reopen_check_interval, if another process has renamed a new version into place. One thread opens the files while
+	the others keep serving the ones they have.
+*/
+shared_ptr<const HashTableShard::shard_files> HashTableShard::current_files() const {
+
+	shared_ptr<const shard_files> files;
+	{
+		lock_guard<mutex> guard(m_lock);
+		files = m_files;
+	}
+
+	const int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+	if (m_files_version.load() == files->m_version && now < m_next_check) {
+		return files;
+	}
+
+	unique_lock<mutex> reopen_lock(m_reopen_lock, try_to_lock);
+	if (!reopen_lock.owns_lock()) return files;
+
+	{
+		lock_guard<mutex> guard(m_lock);
+		files = m_files;
+	}
+
+	if (m_files_version.load() == files->m_version) {
+		if (now < m_next_check) return files;
+
+		m_next_check = now + chrono::duration_cast<chrono::steady_clock::duration>(reopen_check_interval).count();
+		struct stat st;
+		if (::stat(filename_data().c_str(), &st) != 0 || st.st_ino == files->m_inode) {
+			return files;
+		}
+	}
+
+	shared_ptr<const shard_files> new_files = open_files();
+
+	lock_guard<mutex> guard(m_lock);
+	m_files = new_files;
+
+	return new_files;
+}
+
+shared_ptr<const HashTableShard::shard_files> HashTableShard::open_files() const {
+
+	shared_ptr<shard_files> files = make_shared<shard_files>();
+
+	if (access((filename_pos() + ".old").c_str(), F_OK) == 0) {
+		unique_lock<shared_mutex> lock(files_lock(filename_data()));
+		recover_files(filename_data(), filename_pos());
+	}
+
+	// Writers hold the exclusive lock so the pos file is never read while it is rewritten.
+	shared_lock<shared_mutex> lock(files_lock(filename_data()));
+	files->m_version = m_files_version.load();
+	files->m_fd_data = open(filename_data().c_str(), O_RDONLY);
+	files->m_fd_pos = open(filename_pos().c_str(), O_RDONLY);
+
+	struct stat st;
+	if (files->m_fd_data >= 0 && fstat(files->m_fd_data, &st) == 0) {
+		files->m_inode = st.st_ino;
+	}
+
+	load(*files);
+
+	return files;
+}
+
+void HashTableShard::load(shard_files &files) const {
 	const size_t record_len = Config::ht_key_size + sizeof(size_t);
 	const size_t buffer_len = record_len * 10000;
 	char buffer[buffer_len];
 
 	vector<uint64_t> keys;
 	vector<size_t> positions;
-	if (infile.is_open()) {
+	if (files.m_fd_pos >= 0) {
 		size_t latest_pos = 0;
-		do {
-			infile.read(buffer, buffer_len);
-
-			size_t read_bytes = infile.gcount();
-
-			for (size_t i = 0; i < read_bytes; i += record_len) {
+		ssize_t read_bytes;
+		while ((read_bytes = pread(files.m_fd_pos, buffer, buffer_len, latest_pos)) > 0) {
+			for (size_t i = 0; i + record_len <= (size_t)read_bytes; i += record_len) {
 				keys.push_back(*((uint64_t *)&buffer[i]));
 				positions.push_back(latest_pos);
 				latest_pos += record_len;
 			}
-
-		} while (!infile.eof());
+			if ((size_t)read_bytes % record_len) break;
+		}
 	}
-	infile.close();
 
-	m_size = keys.size();
+	files.m_size = keys.size();
 
 	size_t idx = 0;
 	for (uint64_t key : keys) {
 		const uint64_t key_significant = key >> (64-m_significant);
-		if (m_pos.find(key_significant) == m_pos.end()) {
-			m_pos[key_significant] = make_pair(positions[idx], 0);
+		if (files.m_pos.find(key_significant) == files.m_pos.end()) {
+			files.m_pos[key_significant] = make_pair(positions[idx], 0);
 		}
-		m_pos[key_significant].second++;
+		files.m_pos[key_significant].second++;
 		idx++;
 	}
 
+	load_dictionary(files);
+
 	//LOG_INFO("Loaded shard " + to_string(m_shard_id));
 }
 
+/*
+	Optimized shards start with the dictionary record.
+*/
+void HashTableShard::load_dictionary(shard_files &files) const {
+	namespace codec = hash_table::dictionary_codec;
+
+	files.m_dictionary.clear();
+
+	if (files.m_fd_data < 0) return;
+
+	char header[Config::ht_key_size + sizeof(size_t)];
+	if (pread(files.m_fd_data, header, sizeof(header), 0) != sizeof(header)) return;
+	size_t data_len = *((size_t *)&header[Config::ht_key_size]);
+
+	if ((data_len & ~codec::len_mask) == codec::dictionary_flag) {
+		data_len &= codec::len_mask;
+		if (data_len > codec::max_dictionary_len) {
+			throw LOG_ERROR_EXCEPTION("dictionary larger than max_dictionary_len in " + filename_data());
+		}
+		files.m_dictionary.resize(data_len);
+		if (pread(files.m_fd_data, files.m_dictionary.data(), data_len, sizeof(header)) != (ssize_t)data_len) {
+			files.m_dictionary.clear();
+		}
+	}
+}
+
 void HashTableShard::print_all_items() {
 
+	shared_ptr<const shard_files> files = current_files();
+
 	ifstream infile(filename_pos(), ios::binary);
 	const size_t record_len = Config::ht_key_size + sizeof(size_t);
 	const size_t buffer_len = record_len * 10000;
@@ -168,37 +369,70 @@ void HashTableShard::print_all_items() {
 	infile.close();
 
 	for (size_t i = 0; i < keys.size(); i++) {
-		cout << keys[i] << " => " << data_at_position(positions[i]) << endl;
+		cout << keys[i] << " => " << data_at_position(*files, positions[i]) << endl;
 	}
 }
 
-string HashTableShard::data_at_position(size_t pos) {
+/*
+	Returns the position of the key in the data file or string::npos if the key is not in the shard.
+*/
+size_t HashTableShard::data_position(const shard_files &files, uint64_t key) const {
+
+	const uint64_t key_significant = key >> (64-m_significant);
+	auto iter = files.m_pos.find(key_significant);
+	if (iter == files.m_pos.end()) return string::npos;
+
+	auto pos_pair = iter->second;
+	size_t pos_in_posfile = pos_pair.first;
+	size_t len_in_posfile = pos_pair.second;
+
+	const size_t record_len = Config::ht_key_size + sizeof(size_t);
+	const size_t byte_len = len_in_posfile * record_len;
+	const size_t pos_buffer_len = 200000;
+	char pos_buffer[pos_buffer_len];
+	if (byte_len > pos_buffer_len) {
+		throw LOG_ERROR_EXCEPTION("byte_len ("+to_string(byte_len)+") larger than pos_buffer_len ("+to_string(pos_buffer_len)+")");
+	}
+
+	const ssize_t read_bytes = pread(files.m_fd_pos, pos_buffer, byte_len, pos_in_posfile);
+	if (read_bytes != (ssize_t)byte_len) return string::npos;
 
-	ifstream infile(filename_data(), ios::binary);
-	infile.seekg(pos, ios::beg);
+	size_t pos = string::npos;
+	for (size_t i = 0; i < byte_len; i+= record_len) {
+		uint64_t tmp_key = *((uint64_t *)&pos_buffer[i]);
+		if (tmp_key == key) {
+			pos = *((size_t *)&pos_buffer[i + Config::ht_key_size]);
+		}
+	}
+
+	return pos;
+}
 
-	// Read key
-	uint64_t read_key;
-	infile.read((char *)&read_key, sizeof(uint64_t));
+string HashTableShard::data_at_position(const shard_files &files, size_t pos) const {
 
-	// Read data length.
-	size_t data_len;
-	infile.read((char *)&data_len, sizeof(size_t));
+	namespace codec = hash_table::dictionary_codec;
 
-	char *buffer = new char[data_len];
+	const size_t offset = codec::position_offset(pos);
 
-	infile.read(buffer, data_len);
-	stringstream ss(string(buffer, data_len));
+	// Read key and data length.
+	char header[Config::ht_key_size + sizeof(size_t)];
+	if (pread(files.m_fd_data, header, sizeof(header), offset) != sizeof(header)) return "";
+	size_t data_len = *((size_t *)&header[Config::ht_key_size]);
 
-	boost::iostreams::filtering_istream decompress_stream;
-	decompress_stream.push(boost::iostreams::gzip_decompressor());
-	decompress_stream.push(ss);
+	const size_t flags = data_len & ~codec::len_mask;
+	data_len &= codec::len_mask;
 
-	stringstream decompressed;
-	decompressed << decompress_stream.rdbuf();
+	string buffer(data_len, '\0');
+	if (pread(files.m_fd_data, buffer.data(), data_len, offset + sizeof(header)) != (ssize_t)data_len) return "";
 
-	delete []buffer;
+	if (flags == codec::block_flag) {
+		string value;
+		if (!codec::decompress_value(buffer.data(), data_len, codec::position_index(pos), files.m_dictionary, value)) {
+			LOG_INFO("corrupt block at position " + to_string(offset) + " in " + filename_data());
+			return "";
+		}
+		return value;
+	}
 
-	return decompressed.str();
+	return codec::gzip_decompress(buffer.data(), data_len);
 }
-
@@ -32,8 +32,13 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include "HashTable.h"
 
@@ -46,6 +51,12 @@ public:
 
 	std::string find(uint64_t key);
 
+	/*
+		Finds all the keys with the shard files opened once and the reads ordered by file offset. The values are
+		returned in the same order as the keys, keys that are not found give empty strings.
+	*/
+	std::vector<std::string> find_many(const std::vector<uint64_t> &keys);
+
 	std::string filename_data() const;
 	std::string filename_pos() const;
 	size_t shard_id() const;
@@ -53,19 +64,71 @@ public:
 	size_t file_size() const;
 	void print_all_items();
 
+	/*
+		Held shared while the files of a shard are opened and exclusive while hash_table::compactor renames new files
+		into place, so a data file is never opened together with the pos file of another version.
+	*/
+	static std::shared_mutex &files_lock(const std::string &filename_data);
+
+	/*
+		Counts the changes to the files of a shard in this process, writers increase it while they hold the exclusive
+		files_lock so readers only open the files again when it has changed.
+	*/
+	static std::atomic<uint64_t> &files_version(const std::string &filename_data);
+
+	/*
+		Renames new_data and new_pos into place as the files of the shard, the caller holds the exclusive files_lock.
+		The old files are kept as .old hard links until both renames are done so a failed rename is rolled back and
+		a crash in between is rolled back or finished by recover_files. Returns false if the old files are kept.
+	*/
+	static bool replace_files(const std::string &filename_data, const std::string &filename_pos,
+		const std::string &new_data, const std::string &new_pos);
+
+	/*
+		Finishes a replace_files that did not complete, the caller holds the exclusive files_lock.
+	*/
+	static void recover_files(const std::string &filename_data, const std::string &filename_pos);
+
 private:
 
+	/*
+		The open files of the shard and what we loaded from them. Readers keep the files they started with so the
+		old version is served until the last reader is done with it.
+	*/
+	struct shard_files {
+		int m_fd_data = -1;
+		int m_fd_pos = -1;
+		uint64_t m_version = 0;
+		ino_t m_inode = 0;
+		size_t m_size = 0;
+
+		// Maps keys to positions in file.
+		std::unordered_map<uint64_t, std::pair<size_t, size_t>> m_pos;
+
+		// Compression dictionary of optimized shards, empty for shards with only gzip records.
+		std::string m_dictionary;
+
+		~shard_files();
+	};
+
 	const std::string m_db_name;
 	size_t m_shard_id;
-	bool m_loaded;
-	size_t m_size;
+	std::atomic<uint64_t> &m_files_version;
 
 	const int m_significant = 12;
 
-	// Maps keys to positions in file.
-	std::unordered_map<uint64_t, std::pair<size_t, size_t>> m_pos;
+	mutable std::mutex m_lock;
+	mutable std::shared_ptr<const shard_files> m_files;
+
+	// Time of the next check for files replaced by another process, and the lock of the thread opening the files.
+	mutable std::atomic<int64_t> m_next_check = 0;
+	mutable std::mutex m_reopen_lock;
 
-	void load();
-	std::string data_at_position(size_t pos);
+	std::shared_ptr<const shard_files> current_files() const;
+	std::shared_ptr<const shard_files> open_files() const;
+	void load(shard_files &files) const;
+	void load_dictionary(shard_files &files) const;
+	size_t data_position(const shard_files &files, uint64_t key) const;
+	std::string data_at_position(const shard_files &files, size_t pos) const;
 
 };
@@ -28,6 +28,9 @@
 #include "HashTableShardBuilder.h"
 #include "system/Logger.h"
 #include "file/File.h"
+#include "dictionary_codec.h"
+#include "HashTableShard.h"
+#include <shared_mutex>
 
 using namespace std;
 
@@ -46,6 +49,7 @@ bool HashTableShardBuilder::full() const {
 }
 
 void HashTableShardBuilder::write() {
+	unique_lock<shared_mutex> lock(HashTableShard::files_lock(filename_data()));
 	ofstream outfile(filename_data(), ios::binary | ios::app);
 	ofstream outfile_pos(filename_pos(), ios::binary | ios::app);
 
@@ -55,16 +59,7 @@ void HashTableShardBuilder::write() {
 		outfile.write((char *)&iter.first, Config::ht_key_size);
 
 		// Compress data
-		stringstream ss(iter.second);
-
-		boost::iostreams::filtering_istream compress_stream;
-		compress_stream.push(boost::iostreams::gzip_compressor());
-		compress_stream.push(ss);
-
-		stringstream compressed;
-		compressed << compress_stream.rdbuf();
-
-		string compressed_string(compressed.str());
+		const string compressed_string = hash_table::dictionary_codec::gzip_compress(iter.second);
 
 		const size_t data_len = compressed_string.size();
 		outfile.write((char *)&data_len, sizeof(size_t));
@@ -77,15 +72,19 @@ void HashTableShardBuilder::write() {
 	}
 
 	m_cache.clear();
+	HashTableShard::files_version(filename_data())++;
 }
 
 void HashTableShardBuilder::truncate() {
+	unique_lock<shared_mutex> lock(HashTableShard::files_lock(filename_data()));
 	ofstream outfile(filename_data(), ios::binary | ios::trunc);
 	ofstream outfile_pos(filename_pos(), ios::binary | ios::trunc);
+	HashTableShard::files_version(filename_data())++;
 }
 
 void HashTableShardBuilder::sort() {
 
+	unique_lock<shared_mutex> lock(HashTableShard::files_lock(filename_data()));
 	read_keys();
 
 	ofstream outfile_pos(filename_pos(), ios::binary | ios::trunc);
@@ -95,62 +94,127 @@ void HashTableShardBuilder::sort() {
 	}
 	outfile_pos.close();
 	m_sort_pos.clear();
+	HashTableShard::files_version(filename_data())++;
 }
 
+/*
+	Rewrites the shard without replaced values in the dictionary format. The data file is streamed twice in file order,
+	first to sample values for the dictionary and then to compress the live values again in blocks, so only the
+	positions, the samples and one block are kept in memory. The new files are written next to the old ones and
+	renamed into place. The exclusive files lock is held throughout so no other writer appends to the shard while it
+	is rewritten.
+*/
 void HashTableShardBuilder::optimize() {
 
-	ifstream infile(filename_data(), ios::binary);
+	namespace codec = hash_table::dictionary_codec;
 
-	if (!infile.is_open()) return;
+	unique_lock<shared_mutex> lock(HashTableShard::files_lock(filename_data()));
+	{
+		ifstream infile(filename_data(), ios::binary);
+		if (!infile.is_open()) return;
+	}
 
-	const size_t buffer_len = 1024*1024*20;
-	char *buffer = new char[buffer_len];
+	read_keys();
 
-	ofstream outfile_data(filename_data_tmp(), ios::binary | ios::trunc);
-	ofstream outfile_pos(filename_pos_tmp(), ios::binary | ios::trunc);
+	// Keep every sample_every:th live value and thin the samples out when they get larger than the trainer uses.
+	vector<pair<size_t, string>> samples;
+	size_t sample_every = 1;
+	size_t sample_len = 0;
+	read_live_values([&sample_every](size_t value_idx) {
+		return value_idx % sample_every == 0;
+	}, [&](size_t value_idx, uint64_t key, string &value) {
+		sample_len += value.size();
+		samples.emplace_back(value_idx, std::move(value));
+		if (sample_len > codec::max_sample_len) {
+			sample_every *= 2;
+			sample_len = 0;
+			size_t kept = 0;
+			for (auto &sample : samples) {
+				if (sample.first % sample_every == 0) {
+					sample_len += sample.second.size();
+					samples[kept++] = std::move(sample);
+				}
+			}
+			samples.resize(kept);
+		}
+	});
 
-	map<size_t, string> hash_map;
-	while (!infile.eof()) {
-		size_t key;
-		if (!infile.read((char *)&key, Config::ht_key_size)) break;
+	vector<string> sample_values;
+	for (auto &sample : samples) {
+		sample_values.push_back(std::move(sample.second));
+	}
+	samples.clear();
+	const string dictionary = codec::train(sample_values);
+	sample_values.clear();
 
-		size_t data_len;
-		if (!infile.read((char *)&data_len, sizeof(size_t))) break;
+	ofstream outfile_data(filename_data_tmp(), ios::binary | ios::trunc);
 
-		if (data_len > buffer_len) {
-			LOG_INFO("data_len " + to_string(data_len) + "is larger than buffer_len " + to_string(buffer_len) + " in file " + filename_data());
-			infile.seekg(data_len, ios::cur);
-			continue;
-		} else {
-			if (!infile.read(buffer, data_len)) break;
-		}
+	size_t last_pos = 0;
+	if (dictionary.size()) {
+		const size_t key = 0;
+		const size_t data_len = dictionary.size() | codec::dictionary_flag;
+		outfile_data.write((char *)&key, Config::ht_key_size);
+		outfile_data.write((char *)&data_len, sizeof(size_t));
+		outfile_data.write(dictionary.c_str(), dictionary.size());
 
-		hash_map[key] = string(buffer, data_len);
+		last_pos += dictionary.size() + Config::ht_key_size + sizeof(size_t);
 	}
 
-	size_t last_pos = 0;
-	for (const auto &iter : hash_map) {
-		const size_t key = iter.first;
-		const size_t data_len = iter.second.size();
+	// The positions of the live values are replaced with their positions in the new file.
+	vector<uint64_t> block_keys;
+	vector<string> block_values;
+	size_t block_len = 0;
+	auto write_block = [&]() {
+		if (block_keys.size() == 0) return;
+
+		const string compressed = codec::compress_block(block_keys, block_values, dictionary);
+		const size_t key = block_keys[0];
+		const size_t data_len = compressed.size() | codec::block_flag;
 		outfile_data.write((char *)&key, Config::ht_key_size);
 		outfile_data.write((char *)&data_len, sizeof(size_t));
-		outfile_data.write(iter.second.c_str(), data_len);
+		outfile_data.write(compressed.c_str(), compressed.size());
 
-		outfile_pos.write((char *)&key, Config::ht_key_size);
-		outfile_pos.write((char *)&last_pos, sizeof(size_t));
+		for (size_t i = 0; i < block_keys.size(); i++) {
+			m_sort_pos[block_keys[i]] = codec::make_position(last_pos, i);
+		}
 
-		last_pos += data_len + Config::ht_key_size + sizeof(size_t);
-	}
+		last_pos += compressed.size() + Config::ht_key_size + sizeof(size_t);
+		block_keys.clear();
+		block_values.clear();
+		block_len = 0;
+	};
 
+	read_live_values([](size_t) { return true; }, [&](size_t value_idx, uint64_t key, string &value) {
+		block_len += value.size();
+		block_keys.push_back(key);
+		block_values.push_back(std::move(value));
+
+		if (block_len >= codec::block_len || block_keys.size() >= codec::max_block_values) {
+			write_block();
+		}
+	});
+	write_block();
 	outfile_data.close();
+
+	ofstream outfile_pos(filename_pos_tmp(), ios::binary | ios::trunc);
+	for (const auto &iter : m_sort_pos) {
+		outfile_pos.write((char *)&iter.first, Config::ht_key_size);
+		outfile_pos.write((char *)&iter.second, sizeof(size_t));
+	}
 	outfile_pos.close();
+	m_sort_pos.clear();
 
-	File::copy_file(filename_data_tmp(), filename_data());
-	File::copy_file(filename_pos_tmp(), filename_pos());
-	File::delete_file(filename_data_tmp());
-	File::delete_file(filename_pos_tmp());
+	if (!outfile_data || !outfile_pos) {
+		File::delete_file(filename_data_tmp());
+		File::delete_file(filename_pos_tmp());
+		throw LOG_ERROR_EXCEPTION("Could not write optimized files for " + filename_data());
+	}
 
-	sort();
+	if (!HashTableShard::replace_files(filename_data(), filename_pos(), filename_data_tmp(), filename_pos_tmp())) {
+		File::delete_file(filename_data_tmp());
+		File::delete_file(filename_pos_tmp());
+		throw LOG_ERROR_EXCEPTION("Could not rename optimized files into place for " + filename_data());
+	}
 }
 
 void HashTableShardBuilder::add(uint64_t key, const string &value) {
@@ -179,6 +243,74 @@ string HashTableShardBuilder::filename_pos_tmp() const {
 	return "/mnt/" + to_string(disk_shard) + "/hash_table/ht_" + m_db_name + "_" + to_string(m_shard_id) + ".pos.tmp";
 }
 
+/*
+	Reads the data file in file order and calls on_value for every value that the positions in m_sort_pos still point
+	to. want_value gets the running number of live values and returns false to skip the value, on_value gets the
+	number, the key and the value.
+*/
+void HashTableShardBuilder::read_live_values(const function<bool(size_t)> &want_value,
+	const function<void(size_t, uint64_t, string &)> &on_value) const {
+
+	namespace codec = hash_table::dictionary_codec;
+
+	ifstream infile(filename_data(), ios::binary);
+	if (!infile.is_open()) return;
+
+	const size_t buffer_len = 1024*1024*20;
+	unique_ptr<char[]> buffer(new char[buffer_len]);
+
+	auto is_live = [this](uint64_t key, size_t position) {
+		auto iter = m_sort_pos.find(key);
+		return iter != m_sort_pos.end() && iter->second == position;
+	};
+
+	string dictionary;
+	size_t value_idx = 0;
+	size_t offset = 0;
+	while (!infile.eof()) {
+		size_t key = 0;
+		if (!infile.read((char *)&key, Config::ht_key_size)) break;
+
+		size_t data_len;
+		if (!infile.read((char *)&data_len, sizeof(size_t))) break;
+
+		const size_t flags = data_len & ~codec::len_mask;
+		data_len &= codec::len_mask;
+		const size_t record_offset = offset;
+		offset += Config::ht_key_size + sizeof(size_t) + data_len;
+
+		if (data_len > buffer_len) {
+			LOG_INFO("data_len " + to_string(data_len) + "is larger than buffer_len " + to_string(buffer_len) + " in file " + filename_data());
+			infile.seekg(data_len, ios::cur);
+			continue;
+		} else {
+			if (!infile.read(buffer.get(), data_len)) break;
+		}
+
+		if (flags == codec::dictionary_flag) {
+			dictionary = string(buffer.get(), data_len);
+		} else if (flags == codec::block_flag) {
+			vector<uint64_t> keys;
+			vector<string> values;
+			if (!codec::decompress_block(buffer.get(), data_len, dictionary, keys, values)) {
+				LOG_INFO("corrupt block in file " + filename_data());
+				continue;
+			}
+			for (size_t i = 0; i < keys.size(); i++) {
+				if (!is_live(keys[i], codec::make_position(record_offset, i))) continue;
+				if (want_value(value_idx)) on_value(value_idx, keys[i], values[i]);
+				value_idx++;
+			}
+		} else if (is_live(key, record_offset)) {
+			if (want_value(value_idx)) {
+				string value = codec::gzip_decompress(buffer.get(), data_len);
+				on_value(value_idx, key, value);
+			}
+			value_idx++;
+		}
+	}
+}
+
 void HashTableShardBuilder::read_keys() {
 	ifstream infile(filename_pos(), ios::binary);
 	const size_t record_len = Config::ht_key_size + sizeof(size_t);
@@ -29,6 +29,7 @@
 #include <iostream>
 #include <map>
 #include <mutex>
+#include <functional>
 
 #include "HashTable.h"
 
@@ -62,5 +63,7 @@ private:
 	std::mutex m_lock;
 
 	void read_keys();
+	void read_live_values(const std::function<bool(size_t)> &want_value,
+		const std::function<void(size_t, uint64_t, std::string &)> &on_value) const;
 
 };
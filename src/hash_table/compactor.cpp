@@ -0,0 +1,354 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "compactor.h"
+#include "config.h"
+#include "HashTableShard.h"
+#include "HashTableShardBuilder.h"
+#include "dictionary_codec.h"
+#include "system/Logger.h"
+#include "file/File.h"
+#include <fstream>
+#include <shared_mutex>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace hash_table {
+
+	namespace codec = dictionary_codec;
+
+	const size_t header_len = Config::ht_key_size + sizeof(size_t);
+
+	/*
+		Identifies the version of a shard file, 0 if the file does not exist.
+	*/
+	uint64_t file_version(const string &filename) {
+		struct stat st;
+		if (::stat(filename.c_str(), &st) != 0) return 0;
+		uint64_t version = st.st_ino;
+		version = (version * 0x9e3779b97f4a7c15ull) ^ st.st_size;
+		version = (version * 0x9e3779b97f4a7c15ull) ^ st.st_mtim.tv_sec;
+		version = (version * 0x9e3779b97f4a7c15ull) ^ st.st_mtim.tv_nsec;
+		return version | 1;
+	}
+
+	/*
+		Reads the pos file and returns the position of every key sorted by key. The last position of a key wins like
+		in HashTableShard::data_position.
+	*/
+	vector<pair<uint64_t, size_t>> read_positions(const string &filename, rate_limiter &limiter) {
+
+		vector<pair<uint64_t, size_t>> positions;
+
+		ifstream infile(filename, ios::binary);
+		const size_t buffer_len = header_len * 10000;
+		vector<char> buffer(buffer_len);
+		while (infile.read(buffer.data(), buffer_len) || infile.gcount()) {
+			const size_t read_bytes = infile.gcount();
+			for (size_t i = 0; i + header_len <= read_bytes; i += header_len) {
+				positions.emplace_back(*((uint64_t *)&buffer[i]), *((size_t *)&buffer[i + Config::ht_key_size]));
+			}
+			limiter.consume(read_bytes);
+		}
+
+		stable_sort(positions.begin(), positions.end(), [](const auto &a, const auto &b) {
+			return a.first < b.first;
+		});
+
+		vector<pair<uint64_t, size_t>> latest_positions;
+		for (size_t i = 0; i < positions.size(); i++) {
+			if (i + 1 < positions.size() && positions[i + 1].first == positions[i].first) continue;
+			latest_positions.push_back(positions[i]);
+		}
+
+		return latest_positions;
+	}
+
+	/*
+		Returns the sorted offsets of the records in the data file that some key points to.
+	*/
+	vector<size_t> live_offsets(const vector<pair<uint64_t, size_t>> &positions) {
+		vector<size_t> offsets;
+		for (const auto &iter : positions) {
+			offsets.push_back(codec::position_offset(iter.second));
+		}
+		sort(offsets.begin(), offsets.end());
+		offsets.erase(unique(offsets.begin(), offsets.end()), offsets.end());
+		return offsets;
+	}
+
+	/*
+		The dictionary record of optimized shards is always live, HashTableShard reads it from the start of the file.
+	*/
+	bool is_live(const vector<size_t> &offsets, size_t offset, size_t flags) {
+		return (flags == codec::dictionary_flag && offset == 0) || binary_search(offsets.begin(), offsets.end(), offset);
+	}
+
+	bool read_header(ifstream &infile, char *header, size_t &data_len, size_t &flags) {
+		if (!infile.read(header, header_len)) return false;
+		data_len = *((size_t *)&header[Config::ht_key_size]);
+		flags = data_len & ~codec::len_mask;
+		data_len &= codec::len_mask;
+		return true;
+	}
+
+	rate_limiter::rate_limiter(size_t bytes_per_second)
+	: m_bytes_per_second(bytes_per_second), m_start(chrono::steady_clock::now()) {
+	}
+
+	void rate_limiter::consume(size_t bytes) {
+		m_bytes += bytes;
+		if (m_bytes_per_second == 0) return;
+
+		this_thread::sleep_until(m_start + chrono::microseconds(m_bytes * 1000000 / m_bytes_per_second));
+	}
+
+	compactor::compactor(const string &db_name)
+	: m_db_name(db_name), m_bytes_per_second(Config::ht_compaction_mb_per_second * 1024 * 1024) {
+	}
+
+	compactor::~compactor() {
+		stop();
+	}
+
+	shard_stats compactor::stats(size_t shard_id) {
+
+		const uint64_t version = file_version(HashTableShardBuilder(m_db_name, shard_id).filename_data());
+		{
+			lock_guard<mutex> guard(m_lock);
+			auto iter = m_stats.find(shard_id);
+			if (iter != m_stats.end() && iter->second.m_version == version) return iter->second;
+		}
+
+		rate_limiter limiter(m_bytes_per_second);
+		const shard_stats stats = measure(shard_id, version, limiter);
+
+		lock_guard<mutex> guard(m_lock);
+		m_stats[shard_id] = stats;
+
+		return stats;
+	}
+
+	vector<size_t> compactor::pick_shards() {
+
+		const double min_ratio = Config::ht_compaction_garbage_percent / 100.0;
+
+		vector<pair<double, size_t>> candidates;
+		for (size_t shard_id = 0; shard_id < Config::ht_num_shards && !m_stopping; shard_id++) {
+			const shard_stats stats = this->stats(shard_id);
+			if (stats.m_dead_bytes > 0 && stats.garbage_ratio() >= min_ratio) {
+				candidates.emplace_back(stats.garbage_ratio(), shard_id);
+			}
+		}
+
+		sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) {
+			return a.first > b.first;
+		});
+
+		vector<size_t> shards;
+		for (const auto &candidate : candidates) {
+			shards.push_back(candidate.second);
+		}
+
+		return shards;
+	}
+
+	/*
+		Copies the live records to .compact files in the order of the data file so both files are read and written
+		front to back and only the headers of the dead records are read. The new files are renamed into place if the
+		shard did not change in the meantime.
+	*/
+	bool compactor::compact(size_t shard_id) {
+
+		HashTableShardBuilder shard(m_db_name, shard_id);
+		const string filename_data = shard.filename_data();
+		const string filename_pos = shard.filename_pos();
+		const string filename_data_compact = filename_data + ".compact";
+		const string filename_pos_compact = filename_pos + ".compact";
+
+		const uint64_t data_version = file_version(filename_data);
+		const uint64_t pos_version = file_version(filename_pos);
+		if (data_version == 0) return false;
+
+		rate_limiter limiter(m_bytes_per_second);
+
+		const vector<pair<uint64_t, size_t>> positions = read_positions(filename_pos, limiter);
+		const vector<size_t> offsets = live_offsets(positions);
+
+		ifstream infile(filename_data, ios::binary);
+		ofstream outfile_data(filename_data_compact, ios::binary | ios::trunc);
+
+		// Old and new offsets of the copied records.
+		vector<pair<size_t, size_t>> moved;
+
+		const size_t buffer_len = 1024*1024;
+		vector<char> buffer(buffer_len);
+		char header[header_len];
+		size_t data_len, flags;
+		size_t offset = 0;
+		size_t new_offset = 0;
+		bool complete = true;
+		while (complete && read_header(infile, header, data_len, flags)) {
+			limiter.consume(header_len);
+
+			if (!is_live(offsets, offset, flags)) {
+				infile.seekg(data_len, ios::cur);
+				offset += header_len + data_len;
+				continue;
+			}
+
+			outfile_data.write(header, header_len);
+			for (size_t left = data_len; left > 0 && complete; ) {
+				const size_t len = min(left, buffer_len);
+				if (!infile.read(buffer.data(), len)) {
+					complete = false;
+				} else {
+					outfile_data.write(buffer.data(), len);
+					limiter.consume(len * 2);
+					left -= len;
+				}
+			}
+
+			moved.emplace_back(offset, new_offset);
+			offset += header_len + data_len;
+			new_offset += header_len + data_len;
+		}
+		infile.close();
+		outfile_data.close();
+
+		ofstream outfile_pos(filename_pos_compact, ios::binary | ios::trunc);
+		for (const auto &iter : positions) {
+			const size_t old_offset = codec::position_offset(iter.second);
+			auto moved_iter = lower_bound(moved.begin(), moved.end(), make_pair(old_offset, (size_t)0));
+			if (moved_iter == moved.end() || moved_iter->first != old_offset) continue;
+
+			const size_t pos = codec::make_position(moved_iter->second, codec::position_index(iter.second));
+			outfile_pos.write((char *)&iter.first, Config::ht_key_size);
+			outfile_pos.write((char *)&pos, sizeof(size_t));
+		}
+		limiter.consume(positions.size() * header_len);
+		outfile_pos.close();
+
+		if (!complete || !outfile_data || !outfile_pos) {
+			LOG_INFO("could not compact " + filename_data);
+			File::delete_file(filename_data_compact);
+			File::delete_file(filename_pos_compact);
+			return false;
+		}
+
+		bool swapped = false;
+		{
+			unique_lock<shared_mutex> lock(HashTableShard::files_lock(filename_data));
+			if (file_version(filename_data) == data_version && file_version(filename_pos) == pos_version) {
+				swapped = HashTableShard::replace_files(filename_data, filename_pos, filename_data_compact,
+					filename_pos_compact);
+			}
+		}
+
+		if (!swapped) {
+			File::delete_file(filename_data_compact);
+			File::delete_file(filename_pos_compact);
+			return false;
+		}
+
+		LOG_INFO("compacted " + filename_data + " from " + to_string(offset) + " to " + to_string(new_offset) + " bytes");
+
+		shard_stats stats;
+		stats.m_file_size = new_offset;
+		stats.m_live_bytes = new_offset;
+		stats.m_version = file_version(filename_data);
+
+		lock_guard<mutex> guard(m_lock);
+		m_stats[shard_id] = stats;
+
+		return true;
+	}
+
+	size_t compactor::run() {
+		size_t compacted = 0;
+		for (size_t shard_id : pick_shards()) {
+			if (m_stopping) break;
+			if (compact(shard_id)) compacted++;
+		}
+		return compacted;
+	}
+
+	void compactor::start() {
+		m_stopping = false;
+		m_thread = thread([this]() {
+			while (!m_stopping) {
+				const size_t compacted = run();
+				if (compacted) {
+					LOG_INFO("compacted " + to_string(compacted) + " shards of " + m_db_name);
+				}
+
+				unique_lock<mutex> lock(m_lock);
+				m_stop_condition.wait_for(lock, chrono::seconds(Config::ht_compaction_interval), [this]() {
+					return m_stopping.load();
+				});
+			}
+		});
+	}
+
+	void compactor::stop() {
+		{
+			lock_guard<mutex> guard(m_lock);
+			m_stopping = true;
+		}
+		m_stop_condition.notify_all();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	shard_stats compactor::measure(size_t shard_id, uint64_t version, rate_limiter &limiter) const {
+
+		shard_stats stats;
+		stats.m_version = version;
+		if (version == 0) return stats;
+
+		HashTableShardBuilder shard(m_db_name, shard_id);
+		const vector<size_t> offsets = live_offsets(read_positions(shard.filename_pos(), limiter));
+
+		ifstream infile(shard.filename_data(), ios::binary);
+		char header[header_len];
+		size_t data_len, flags;
+		size_t offset = 0;
+		while (read_header(infile, header, data_len, flags)) {
+			limiter.consume(header_len);
+			if (is_live(offsets, offset, flags)) {
+				stats.m_live_bytes += header_len + data_len;
+			} else {
+				stats.m_dead_bytes += header_len + data_len;
+			}
+			infile.seekg(data_len, ios::cur);
+			offset += header_len + data_len;
+		}
+		stats.m_file_size = stats.m_live_bytes + stats.m_dead_bytes;
+
+		return stats;
+	}
+
+}
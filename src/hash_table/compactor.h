@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hash_table {
+
+	/*
+		Garbage in the data file of one shard. Records that no key in the pos file points to are dead, they are left
+		behind when HashTableShardBuilder appends new values for keys that are already in the shard.
+	*/
+	struct shard_stats {
+		size_t m_file_size = 0;
+		size_t m_live_bytes = 0;
+		size_t m_dead_bytes = 0;
+
+		// Inode, size and modification time of the data file we measured.
+		uint64_t m_version = 0;
+
+		double garbage_ratio() const { return m_file_size ? (double)m_dead_bytes / m_file_size : 0.0; }
+	};
+
+	/*
+		Limits the disk bandwidth of the compactor. consume sleeps when more bytes have passed than the rate allows
+		since the limiter was created, 0 bytes per second means no limit.
+	*/
+	class rate_limiter {
+
+	public:
+
+		explicit rate_limiter(size_t bytes_per_second);
+		void consume(size_t bytes);
+
+	private:
+
+		const size_t m_bytes_per_second;
+		const std::chrono::steady_clock::time_point m_start;
+		size_t m_bytes = 0;
+
+	};
+
+	/*
+		Online compaction of the shards of a hash table. The dead bytes of each shard are measured when its data file
+		has changed and the shards with more than Config::ht_compaction_garbage_percent garbage are compacted one at a
+		time, the most garbage first. The live records are copied as they are into new files in the order of the data
+		file while HashTableShard keeps serving the old files, then the new files are renamed into place.
+
+		Blocks of optimized shards are copied whole if any of their values is live, HashTableShardBuilder::optimize
+		is still needed to get rid of them. HashTableShardBuilder holds the exclusive files lock of the shard while it
+		writes, a shard that changes while it is compacted is left for the next pass.
+	*/
+	class compactor {
+
+	public:
+
+		explicit compactor(const std::string &db_name);
+		~compactor();
+
+		/*
+			Returns the dead bytes of the shard, measures the shard again if the data file has changed.
+		*/
+		shard_stats stats(size_t shard_id);
+
+		/*
+			Returns the shards with enough garbage to be compacted, the highest garbage ratio first.
+		*/
+		std::vector<size_t> pick_shards();
+
+		/*
+			Rewrites the shard without dead records. Returns false if there was nothing to compact or the shard
+			changed while we compacted it.
+		*/
+		bool compact(size_t shard_id);
+
+		/*
+			Compacts the picked shards, returns the number of compacted shards.
+		*/
+		size_t run();
+
+		/*
+			Runs a pass every Config::ht_compaction_interval seconds in a background thread until stop.
+		*/
+		void start();
+		void stop();
+
+	private:
+
+		const std::string m_db_name;
+		const size_t m_bytes_per_second;
+
+		std::mutex m_lock;
+		std::condition_variable m_stop_condition;
+		std::atomic<bool> m_stopping = false;
+		std::thread m_thread;
+
+		std::map<size_t, shard_stats> m_stats;
+
+		shard_stats measure(size_t shard_id, uint64_t version, rate_limiter &limiter) const;
+
+	};
+
+}
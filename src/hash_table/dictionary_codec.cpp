@@ -0,0 +1,385 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "dictionary_codec.h"
+#include "system/Logger.h"
+#include <zlib.h>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace std;
+
+namespace hash_table {
+
+	namespace dictionary_codec {
+
+		namespace {
+
+			// Length of the substrings we count, read as one uint64_t.
+			const size_t kmer_len = 8;
+			const size_t segment_len = 64;
+
+			void append_varint(string &out, uint64_t value) {
+				while (value >= 0x80) {
+					out.push_back((char)((value & 0x7f) | 0x80));
+					value >>= 7;
+				}
+				out.push_back((char)value);
+			}
+
+			bool read_varint(const string &in, size_t &pos, uint64_t &value) {
+				value = 0;
+				for (size_t shift = 0; shift < 64; shift += 7) {
+					if (pos >= in.size()) return false;
+					const uint8_t byte = in[pos++];
+					value |= (uint64_t)(byte & 0x7f) << shift;
+					if ((byte & 0x80) == 0) return true;
+				}
+				return false;
+			}
+
+			uint64_t read_kmer(const char *ptr) {
+				uint64_t kmer;
+				memcpy(&kmer, ptr, kmer_len);
+				return kmer;
+			}
+
+			/*
+				Inflates data with the given zlib window bits and dictionary. Returns false on corrupt input.
+			*/
+			bool inflate_all(const char *data, size_t len, int window_bits, const string &dictionary, string &out) {
+				z_stream stream;
+				memset(&stream, 0, sizeof(stream));
+				if (inflateInit2(&stream, window_bits) != Z_OK) return false;
+
+				if (dictionary.size() && window_bits < 0) {
+					if (inflateSetDictionary(&stream, (const Bytef *)dictionary.data(), dictionary.size()) != Z_OK) {
+						inflateEnd(&stream);
+						return false;
+					}
+				}
+
+				stream.next_in = (Bytef *)data;
+				stream.avail_in = len;
+
+				out.clear();
+				char buffer[16384];
+				int ret;
+				do {
+					stream.next_out = (Bytef *)buffer;
+					stream.avail_out = sizeof(buffer);
+					ret = inflate(&stream, Z_NO_FLUSH);
+					if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+						inflateEnd(&stream);
+						return false;
+					}
+					out.append(buffer, sizeof(buffer) - stream.avail_out);
+					if (ret == Z_BUF_ERROR && stream.avail_in == 0) break;
+				} while (ret != Z_STREAM_END);
+
+				inflateEnd(&stream);
+				return ret == Z_STREAM_END;
+			}
+
+			/*
+				Raw inflate stream that is reset for every block instead of allocating the zlib state again.
+			*/
+			class block_inflater {
+
+				public:
+					block_inflater() {
+						memset(&m_stream, 0, sizeof(m_stream));
+						m_initialized = inflateInit2(&m_stream, -MAX_WBITS) == Z_OK;
+					}
+
+					~block_inflater() {
+						if (m_initialized) inflateEnd(&m_stream);
+					}
+
+					bool start(const char *data, size_t len, const string &dictionary) {
+						if (!m_initialized || inflateReset(&m_stream) != Z_OK) return false;
+						if (dictionary.size() &&
+								inflateSetDictionary(&m_stream, (const Bytef *)dictionary.data(), dictionary.size()) != Z_OK) {
+							return false;
+						}
+						m_stream.next_in = (Bytef *)data;
+						m_stream.avail_in = len;
+						m_done = false;
+						return true;
+					}
+
+					/*
+						Appends at most max_len more bytes of the block to out. Returns false on corrupt or truncated
+						input.
+					*/
+					bool read(string &out, size_t max_len) {
+						const size_t old_size = out.size();
+						out.resize(old_size + max_len);
+						m_stream.next_out = (Bytef *)&out[old_size];
+						m_stream.avail_out = max_len;
+						const int ret = inflate(&m_stream, Z_NO_FLUSH);
+						out.resize(out.size() - m_stream.avail_out);
+						if (ret == Z_STREAM_END) m_done = true;
+						return ret == Z_STREAM_END || ret == Z_OK;
+					}
+
+					bool done() const { return m_done; }
+
+				private:
+					z_stream m_stream;
+					bool m_initialized = false;
+					bool m_done = false;
+
+			};
+
+			string deflate_all(const string &data, int window_bits, int level, const string &dictionary) {
+				z_stream stream;
+				memset(&stream, 0, sizeof(stream));
+				if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+					throw LOG_ERROR_EXCEPTION("deflateInit2 failed");
+				}
+				if (dictionary.size()) {
+					deflateSetDictionary(&stream, (const Bytef *)dictionary.data(), dictionary.size());
+				}
+
+				string out(deflateBound(&stream, data.size()), '\0');
+				stream.next_in = (Bytef *)data.data();
+				stream.avail_in = data.size();
+				stream.next_out = (Bytef *)out.data();
+				stream.avail_out = out.size();
+
+				const int ret = deflate(&stream, Z_FINISH);
+				out.resize(out.size() - stream.avail_out);
+				deflateEnd(&stream);
+
+				if (ret != Z_STREAM_END) {
+					throw LOG_ERROR_EXCEPTION("deflate did not finish");
+				}
+
+				return out;
+			}
+
+			/*
+				Parses the block header, returns the position of the first value or string::npos if the block is
+				corrupt.
+			*/
+			size_t read_block_header(const string &block, vector<uint64_t> &keys, vector<size_t> &lengths) {
+				size_t pos = 0;
+				uint64_t count;
+				if (!read_varint(block, pos, count) || count > block.size()) return string::npos;
+
+				keys.resize(count);
+				lengths.resize(count);
+				size_t total = 0;
+				for (size_t i = 0; i < count; i++) {
+					if (pos + sizeof(uint64_t) > block.size()) return string::npos;
+					memcpy(&keys[i], &block[pos], sizeof(uint64_t));
+					pos += sizeof(uint64_t);
+
+					uint64_t len;
+					if (!read_varint(block, pos, len)) return string::npos;
+					lengths[i] = len;
+					total += len;
+				}
+				if (pos + total != block.size()) return string::npos;
+
+				return pos;
+			}
+
+			enum class value_state { incomplete, corrupt, found };
+
+			/*
+				Finds the value at index from the first bytes of a block. Returns incomplete if the header is not
+				fully inflated yet.
+			*/
+			value_state find_value(const string &block, size_t index, size_t &value_pos, size_t &value_len) {
+				size_t pos = 0;
+				uint64_t count;
+				if (!read_varint(block, pos, count)) return value_state::incomplete;
+				if (count > max_block_values || index >= count) return value_state::corrupt;
+
+				size_t offset = 0;
+				for (size_t i = 0; i < count; i++) {
+					pos += sizeof(uint64_t);
+					uint64_t len;
+					if (pos > block.size() || !read_varint(block, pos, len)) return value_state::incomplete;
+					if (i < index) offset += len;
+					if (i == index) value_len = len;
+				}
+				value_pos = pos + offset;
+
+				return value_state::found;
+			}
+
+		}
+
+		string train(const vector<string> &samples, size_t dictionary_len) {
+
+			string all;
+			for (const string &sample : samples) {
+				if (all.size() + sample.size() > max_sample_len) break;
+				all.append(sample);
+				all.push_back('\n');
+			}
+
+			if (all.size() < min_sample_len || dictionary_len < segment_len) return "";
+
+			const size_t num_kmers = all.size() - kmer_len + 1;
+
+			unordered_map<uint64_t, uint32_t> frequency;
+			for (size_t i = 0; i < num_kmers; i++) {
+				frequency[read_kmer(&all[i])]++;
+			}
+
+			// Pick the best segment from each epoch and zero the frequency of its kmers so they are not picked again.
+			const size_t num_epochs = std::max<size_t>(1, std::min(dictionary_len / segment_len, all.size() / segment_len));
+			const size_t epoch_len = all.size() / num_epochs;
+			const size_t window_kmers = segment_len - kmer_len + 1;
+
+			vector<pair<uint64_t, size_t>> segments;
+			vector<uint32_t> epoch_frequency;
+			for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+				const size_t begin = epoch * epoch_len;
+				const size_t end = std::min(begin + epoch_len, all.size());
+				if (end - begin < segment_len) continue;
+
+				epoch_frequency.clear();
+				for (size_t i = begin; i + kmer_len <= end; i++) {
+					epoch_frequency.push_back(frequency[read_kmer(&all[i])]);
+				}
+
+				uint64_t score = 0;
+				for (size_t i = 0; i < window_kmers; i++) {
+					score += epoch_frequency[i];
+				}
+				uint64_t best_score = score;
+				size_t best_start = 0;
+				for (size_t i = 1; i + window_kmers <= epoch_frequency.size(); i++) {
+					score = score - epoch_frequency[i - 1] + epoch_frequency[i + window_kmers - 1];
+					if (score > best_score) {
+						best_score = score;
+						best_start = i;
+					}
+				}
+
+				// Kmers that only occur once are not worth storing.
+				if (best_score <= window_kmers) continue;
+
+				segments.emplace_back(best_score, begin + best_start);
+				for (size_t i = 0; i < window_kmers; i++) {
+					frequency[read_kmer(&all[begin + best_start + i])] = 0;
+				}
+			}
+
+			// Deflate encodes short distances cheaper so the most valuable segments go last.
+			std::sort(segments.begin(), segments.end());
+
+			string dictionary;
+			for (const auto &segment : segments) {
+				dictionary.append(all, segment.second, segment_len);
+			}
+			if (dictionary.size() > dictionary_len) {
+				dictionary.erase(0, dictionary.size() - dictionary_len);
+			}
+
+			return dictionary;
+		}
+
+		string compress_block(const vector<uint64_t> &keys, const vector<string> &values, const string &dictionary) {
+
+			string block;
+			append_varint(block, values.size());
+			for (size_t i = 0; i < values.size(); i++) {
+				block.append((const char *)&keys[i], sizeof(uint64_t));
+				append_varint(block, values[i].size());
+			}
+			for (const string &value : values) {
+				block.append(value);
+			}
+
+			return deflate_all(block, -MAX_WBITS, Z_BEST_COMPRESSION, dictionary);
+		}
+
+		bool decompress_block(const char *data, size_t len, const string &dictionary, vector<uint64_t> &keys,
+			vector<string> &values) {
+
+			string block;
+			if (!inflate_all(data, len, -MAX_WBITS, dictionary, block)) return false;
+
+			vector<size_t> lengths;
+			size_t pos = read_block_header(block, keys, lengths);
+			if (pos == string::npos) return false;
+
+			values.clear();
+			for (size_t len : lengths) {
+				values.emplace_back(block, pos, len);
+				pos += len;
+			}
+
+			return true;
+		}
+
+		bool decompress_value(const char *data, size_t len, size_t index, const string &dictionary, string &value) {
+
+			thread_local block_inflater inflater;
+			if (!inflater.start(data, len, dictionary)) return false;
+
+			// Inflate only up to the end of the value, the header is at most a few hundred bytes.
+			string block;
+			size_t value_pos = 0;
+			size_t value_len = 0;
+			value_state state = value_state::incomplete;
+			while (state != value_state::found || block.size() < value_pos + value_len) {
+				if (inflater.done()) return false;
+				const size_t read_len = state == value_state::found ?
+					std::min<size_t>(value_pos + value_len - block.size(), 65536) : 1024;
+				if (!inflater.read(block, read_len)) return false;
+
+				if (state == value_state::incomplete) {
+					state = find_value(block, index, value_pos, value_len);
+					// Deflate can not expand data more than 1032 times.
+					if (state == value_state::corrupt || value_len > len * 1032) return false;
+				}
+			}
+			value = block.substr(value_pos, value_len);
+
+			return true;
+		}
+
+		string gzip_compress(const string &value) {
+			return deflate_all(value, MAX_WBITS + 16, Z_DEFAULT_COMPRESSION, "");
+		}
+
+		string gzip_decompress(const char *data, size_t len) {
+			string value;
+			if (!inflate_all(data, len, MAX_WBITS + 16, "", value)) return "";
+			return value;
+		}
+
+	}
+
+}
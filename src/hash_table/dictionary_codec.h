@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+namespace hash_table {
+
+	/*
+		Value encoding of the hash table shard data files.
+
+		Every record in a data file is framed as [key][data_len][payload]. The two highest bits of data_len tell what
+		kind of record it is:
+
+		- no bits set: a single gzip compressed value, written by HashTableShardBuilder::write and by all shards
+		  written before the dictionary format.
+		- dictionary_flag: the shared compression dictionary of the shard, always the first record of an optimized
+		  data file.
+		- block_flag: a block of values compressed together with raw deflate using the shard dictionary. The payload
+		  decompresses to [varint count][count x (8 byte key, varint len)][values].
+
+		Positions in the pos file point to the start of a record, for block records the index of the value inside the
+		block is stored in the bits above position_bits.
+	*/
+	namespace dictionary_codec {
+
+		const uint64_t block_flag = 1ull << 63;
+		const uint64_t dictionary_flag = 1ull << 62;
+		const uint64_t len_mask = dictionary_flag - 1;
+
+		const size_t position_bits = 48;
+		const uint64_t position_mask = (1ull << position_bits) - 1;
+
+		// Deflate can only reference the last 32kb so larger dictionaries are useless.
+		const size_t max_dictionary_len = 32768;
+		const size_t max_sample_len = 1024*1024;
+		const size_t min_sample_len = 8192;
+
+		// Blocks are closed when they reach this many uncompressed bytes or values.
+		const size_t block_len = 4096;
+		const size_t max_block_values = 64;
+
+		inline size_t make_position(size_t offset, size_t index) { return offset | (index << position_bits); }
+		inline size_t position_offset(size_t position) { return position & position_mask; }
+		inline size_t position_index(size_t position) { return position >> position_bits; }
+
+		/*
+			Builds a dictionary from sample values. Picks the segments with the most frequent substrings (like the
+			cover algorithm of zstd) and puts the most valuable segments last where deflate reaches them cheapest.
+			Returns an empty dictionary if there is too little sample data for a dictionary to pay off.
+		*/
+		std::string train(const std::vector<std::string> &samples, size_t dictionary_len = max_dictionary_len);
+
+		std::string compress_block(const std::vector<uint64_t> &keys, const std::vector<std::string> &values,
+			const std::string &dictionary);
+
+		/*
+			Decompresses a block into keys and values, returns false if the block is corrupt.
+		*/
+		bool decompress_block(const char *data, size_t len, const std::string &dictionary, std::vector<uint64_t> &keys,
+			std::vector<std::string> &values);
+
+		/*
+			Decompresses only the value at index, returns false if the block is corrupt or index is out of range.
+		*/
+		bool decompress_value(const char *data, size_t len, size_t index, const std::string &dictionary,
+			std::string &value);
+
+		std::string gzip_compress(const std::string &value);
+		std::string gzip_decompress(const char *data, size_t len);
+
+	}
+
+}
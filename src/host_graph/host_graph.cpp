@@ -0,0 +1,382 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "host_graph.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/filesystem.hpp>
+#include "parser/URL.h"
+#include "link/Link.h"
+#include "indexer/run_file.h"
+#include "indexer/posting_codec.h"
+#include "system/Logger.h"
+
+using namespace std;
+
+namespace host_graph {
+
+	// Approximate memory used by one host in the unordered_map of build_hosts besides the host name.
+	const size_t host_entry_overhead = 64;
+
+	/*
+	 * Runs worker(thread_id, file) on every file with opts.m_num_threads threads.
+	 * */
+	void for_each_file(const vector<string> &files, const options &opts,
+		const function<void(size_t, const string &)> &worker, const function<void(size_t)> &done) {
+
+		atomic<size_t> next_file = 0;
+		vector<thread> threads;
+		for (size_t thread_id = 0; thread_id < opts.m_num_threads; thread_id++) {
+			threads.emplace_back([&, thread_id]() {
+				for (size_t i = next_file++; i < files.size(); i = next_file++) {
+					worker(thread_id, files[i]);
+					if (i % 100 == 0) {
+						LOG_INFO("host graph: " + to_string(i) + "/" + to_string(files.size()) + " files done");
+					}
+				}
+				done(thread_id);
+			});
+		}
+		for (thread &th : threads) {
+			th.join();
+		}
+	}
+
+	void for_each_line(const string &filename, const function<void(const string &)> &callback) {
+		ifstream infile(filename);
+		boost::iostreams::filtering_istream decompress_stream;
+		decompress_stream.push(boost::iostreams::gzip_decompressor());
+		decompress_stream.push(infile);
+
+		string line;
+		while (getline(decompress_stream, line)) {
+			callback(line);
+		}
+	}
+
+	/*
+	 * Host runs are sorted [uint64 hash][uint16 len][len bytes host] entries.
+	 * */
+	void write_host_run(const string &filename, const unordered_map<uint64_t, string> &hosts) {
+		vector<uint64_t> hashes;
+		hashes.reserve(hosts.size());
+		for (const auto &iter : hosts) {
+			hashes.push_back(iter.first);
+		}
+		sort(hashes.begin(), hashes.end());
+
+		ofstream writer(filename, ios::binary | ios::trunc);
+		if (!writer.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open run file (" + filename + ")");
+		}
+		for (uint64_t hash : hashes) {
+			const string &host = hosts.at(hash);
+			const uint16_t len = min<size_t>(host.size(), UINT16_MAX);
+			writer.write((const char *)&hash, sizeof(hash));
+			writer.write((const char *)&len, sizeof(len));
+			writer.write(host.data(), len);
+		}
+	}
+
+	bool read_host_entry(ifstream &reader, uint64_t &hash, string &host) {
+		uint16_t len;
+		if (!reader.read((char *)&hash, sizeof(hash))) return false;
+		if (!reader.read((char *)&len, sizeof(len))) return false;
+		host.resize(len);
+		return (bool)reader.read(host.data(), len);
+	}
+
+	string run_filename(const options &opts, const string &kind, size_t thread_id, size_t run) {
+		return opts.m_work_dir + "/host_graph_" + kind + "_" + to_string(thread_id) + "_" + to_string(run) + ".run";
+	}
+
+	size_t build_hosts(const vector<string> &url_files, const string &hosts_file, const string &ids_file,
+		const options &opts) {
+
+		const size_t buffer_bytes = opts.m_buffer_bytes / opts.m_num_threads;
+
+		vector<unordered_map<uint64_t, string>> buffers(opts.m_num_threads);
+		vector<size_t> buffer_sizes(opts.m_num_threads, 0);
+		vector<vector<string>> runs(opts.m_num_threads);
+
+		auto flush = [&](size_t thread_id) {
+			if (buffers[thread_id].empty()) return;
+			const string filename = run_filename(opts, "hosts", thread_id, runs[thread_id].size());
+			write_host_run(filename, buffers[thread_id]);
+			runs[thread_id].push_back(filename);
+			buffers[thread_id] = {};
+			buffer_sizes[thread_id] = 0;
+		};
+
+		for_each_file(url_files, opts, [&](size_t thread_id, const string &filename) {
+			auto &buffer = buffers[thread_id];
+			for_each_line(filename, [&](const string &line) {
+				const URL url(line.substr(0, line.find("\t")));
+				const uint64_t host_hash = url.host_hash();
+				if (buffer.count(host_hash)) return;
+
+				const string host = url.host();
+				buffer_sizes[thread_id] += host.size() + host_entry_overhead;
+				buffer.emplace(host_hash, host);
+				if (buffer_sizes[thread_id] >= buffer_bytes) {
+					flush(thread_id);
+				}
+			});
+		}, flush);
+
+		// Merge the runs, the id of every host is the number of smaller host hashes.
+		vector<string> run_files;
+		for (const auto &thread_runs : runs) {
+			run_files.insert(run_files.end(), thread_runs.begin(), thread_runs.end());
+		}
+
+		vector<unique_ptr<ifstream>> readers;
+		using heap_item = pair<pair<uint64_t, string>, size_t>;
+		auto hash_greater = [](const heap_item &a, const heap_item &b) { return a.first.first > b.first.first; };
+		priority_queue<heap_item, vector<heap_item>, decltype(hash_greater)> heap(hash_greater);
+
+		for (const string &filename : run_files) {
+			readers.push_back(make_unique<ifstream>(filename, ios::binary));
+			heap_item item;
+			item.second = readers.size() - 1;
+			if (read_host_entry(*readers.back(), item.first.first, item.first.second)) {
+				heap.push(item);
+			}
+		}
+
+		ofstream hosts_writer(hosts_file, ios::trunc);
+		ofstream ids_writer(ids_file, ios::binary | ios::trunc);
+
+		size_t num_hosts = 0;
+		uint64_t last_hash = 0;
+		while (!heap.empty()) {
+			heap_item item = heap.top();
+			heap.pop();
+
+			const uint64_t hash = item.first.first;
+			if (num_hosts == 0 || hash != last_hash) {
+				hosts_writer << num_hosts << '\t' << hash << '\t' << item.first.second << '\n';
+				ids_writer.write((const char *)&hash, sizeof(hash));
+				last_hash = hash;
+				num_hosts++;
+			}
+
+			if (read_host_entry(*readers[item.second], item.first.first, item.first.second)) {
+				heap.push(item);
+			}
+		}
+
+		readers.clear();
+		for (const string &filename : run_files) {
+			boost::filesystem::remove(filename);
+		}
+
+		return num_hosts;
+	}
+
+	host_ids::host_ids(const string &ids_file)
+	: m_file(ids_file) {
+		m_hashes = (const uint64_t *)m_file.data();
+		m_size = m_file.size() / sizeof(uint64_t);
+	}
+
+	bool host_ids::find(uint64_t host_hash, uint32_t &id) const {
+		const uint64_t *iter = lower_bound(m_hashes, m_hashes + m_size, host_hash);
+		if (iter == m_hashes + m_size || *iter != host_hash) return false;
+		id = iter - m_hashes;
+		return true;
+	}
+
+	/*
+	 * Edges are stored as target << 32 | source so sorting them groups the incoming edges of every host.
+	 * */
+	void write_edge_run(const string &filename, vector<uint64_t> &edges) {
+		sort(edges.begin(), edges.end());
+		edges.erase(unique(edges.begin(), edges.end()), edges.end());
+		indexer::write_run(filename, edges);
+	}
+
+	size_t build_edges(const vector<string> &link_files, const host_ids &ids, const string &adjacency_file,
+		const options &opts) {
+
+		const size_t buffer_len = max<size_t>(opts.m_buffer_bytes / opts.m_num_threads / sizeof(uint64_t), 1);
+
+		vector<vector<uint64_t>> buffers(opts.m_num_threads);
+		vector<vector<string>> runs(opts.m_num_threads);
+
+		auto flush = [&](size_t thread_id) {
+			if (buffers[thread_id].empty()) return;
+			const string filename = run_filename(opts, "edges", thread_id, runs[thread_id].size());
+			write_edge_run(filename, buffers[thread_id]);
+			runs[thread_id].push_back(filename);
+			buffers[thread_id].clear();
+		};
+
+		for_each_file(link_files, opts, [&](size_t thread_id, const string &filename) {
+			auto &buffer = buffers[thread_id];
+			for_each_line(filename, [&](const string &line) {
+				const Link::Link link(line);
+				uint32_t source;
+				uint32_t target;
+				if (ids.find(link.source_url().host_hash(), source) && ids.find(link.target_url().host_hash(), target)) {
+					buffer.push_back(((uint64_t)target << 32) | source);
+					if (buffer.size() >= buffer_len) {
+						flush(thread_id);
+					}
+				}
+			});
+		}, flush);
+
+		vector<string> run_files;
+		for (const auto &thread_runs : runs) {
+			run_files.insert(run_files.end(), thread_runs.begin(), thread_runs.end());
+		}
+
+		vector<unique_ptr<indexer::run_reader<uint64_t>>> readers;
+		using heap_item = pair<uint64_t, size_t>;
+		priority_queue<heap_item, vector<heap_item>, greater<heap_item>> heap;
+		for (const string &filename : run_files) {
+			readers.push_back(make_unique<indexer::run_reader<uint64_t>>(filename));
+			uint64_t edge;
+			if (readers.back()->next(edge)) {
+				heap.emplace(edge, readers.size() - 1);
+			}
+		}
+
+		ofstream writer(adjacency_file, ios::binary | ios::trunc);
+		if (!writer.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open adjacency file (" + adjacency_file + ")");
+		}
+
+		// The number of edges is written when we know it.
+		const uint64_t num_vertices = ids.size();
+		uint64_t num_edges = 0;
+		writer.write((const char *)&adjacency_magic, sizeof(uint64_t));
+		writer.write((const char *)&num_vertices, sizeof(uint64_t));
+		writer.write((const char *)&num_edges, sizeof(uint64_t));
+
+		uint32_t vertex = 0;
+		vector<uint32_t> sources;
+		string encoded;
+
+		auto write_vertex = [&]() {
+			encoded.clear();
+			indexer::posting_codec::encode_varint(sources.size(), encoded);
+			uint32_t last = 0;
+			for (uint32_t source : sources) {
+				indexer::posting_codec::encode_varint(source - last, encoded);
+				last = source;
+			}
+			writer.write(encoded.data(), encoded.size());
+			num_edges += sources.size();
+			sources.clear();
+			vertex++;
+		};
+
+		uint64_t last_edge = UINT64_MAX;
+		while (!heap.empty()) {
+			const heap_item item = heap.top();
+			heap.pop();
+
+			uint64_t next_edge;
+			if (readers[item.second]->next(next_edge)) {
+				heap.emplace(next_edge, item.second);
+			}
+
+			const uint64_t edge = item.first;
+			if (edge == last_edge) continue;
+			last_edge = edge;
+
+			const uint32_t target = edge >> 32;
+			while (vertex < target) {
+				write_vertex();
+			}
+			sources.push_back(edge & 0xFFFFFFFF);
+		}
+		while (vertex < num_vertices) {
+			write_vertex();
+		}
+
+		writer.seekp(2 * sizeof(uint64_t));
+		writer.write((const char *)&num_edges, sizeof(uint64_t));
+		writer.close();
+
+		readers.clear();
+		for (const string &filename : run_files) {
+			boost::filesystem::remove(filename);
+		}
+
+		return num_edges;
+	}
+
+	adjacency_reader::adjacency_reader(const string &adjacency_file)
+	: m_file(adjacency_file) {
+		const size_t header_len = 3 * sizeof(uint64_t);
+		const uint64_t *header = (const uint64_t *)m_file.data();
+		if (m_file.size() < header_len || header[0] != adjacency_magic) {
+			throw LOG_ERROR_EXCEPTION("Invalid adjacency file (" + adjacency_file + ")");
+		}
+		m_num_vertices = header[1];
+		m_num_edges = header[2];
+		rewind();
+	}
+
+	bool adjacency_reader::next(uint32_t &vertex, vector<uint32_t> &edges) {
+		edges.clear();
+		if (m_vertex >= m_num_vertices) return false;
+
+		uint64_t num_edges;
+		if (!indexer::posting_codec::decode_varint(m_file.data(), m_file.size(), m_pos, num_edges)) {
+			throw LOG_ERROR_EXCEPTION("Truncated adjacency file (" + m_file.path() + ")");
+		}
+
+		uint64_t source = 0;
+		for (size_t i = 0; i < num_edges; i++) {
+			uint64_t delta;
+			if (!indexer::posting_codec::decode_varint(m_file.data(), m_file.size(), m_pos, delta)) {
+				throw LOG_ERROR_EXCEPTION("Truncated adjacency file (" + m_file.path() + ")");
+			}
+			source += delta;
+			edges.push_back(source);
+		}
+
+		vertex = m_vertex++;
+		return true;
+	}
+
+	void adjacency_reader::rewind() {
+		m_pos = 3 * sizeof(uint64_t);
+		m_vertex = 0;
+	}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "utils/mmap_file.hpp"
+
+/*
+ * Builds the host graph for harmonic centrality from the url and link files. Hosts get dense ids in the order of
+ * their hashes and edges are deduplicated with an external sort, so memory use is bounded by m_buffer_bytes and not
+ * by the number of hosts or edges.
+ * */
+namespace host_graph {
+
+	struct options {
+		// Split between the threads, every thread writes a sorted run when its share is full.
+		size_t m_buffer_bytes = 1ull << 30;
+		size_t m_num_threads = 12;
+		// Directory for the temporary run files.
+		std::string m_work_dir = "/mnt";
+	};
+
+	/*
+	 * Reads the gzipped url files and writes hosts_file with "id\thash\thost" lines and ids_file with the sorted
+	 * uint64 host hashes. The id of a host is the position of its hash in ids_file. Returns the number of hosts.
+	 * */
+	size_t build_hosts(const std::vector<std::string> &url_files, const std::string &hosts_file,
+		const std::string &ids_file, const options &opts);
+
+	/*
+	 * Looks up host ids in the memory mapped ids file.
+	 * */
+	class host_ids {
+
+	public:
+
+		explicit host_ids(const std::string &ids_file);
+
+		size_t size() const { return m_size; }
+
+		/*
+		 * Returns false if the host is not in the graph.
+		 * */
+		bool find(uint64_t host_hash, uint32_t &id) const;
+
+	private:
+
+		utils::mmap_file m_file;
+		const uint64_t *m_hashes;
+		size_t m_size;
+
+	};
+
+	/*
+	 * Reads the gzipped link files and writes the deduplicated links between hosts in ids to adjacency_file. Returns
+	 * the number of edges.
+	 *
+	 * The file has the incoming edges of every host, sorted and delta encoded:
+	 * [uint64 adjacency_magic][uint64 num_vertices][uint64 num_edges]
+	 * and for every vertex in order [varint num_edges][varint first source][varint deltas to the previous source]
+	 * */
+	size_t build_edges(const std::vector<std::string> &link_files, const host_ids &ids,
+		const std::string &adjacency_file, const options &opts);
+
+	const uint64_t adjacency_magic = 0x31303044414a4448ull; // "HDJADJ01"
+
+	class adjacency_reader {
+
+	public:
+
+		/*
+		 * Maps the file, throws if it is not an adjacency file.
+		 * */
+		explicit adjacency_reader(const std::string &adjacency_file);
+
+		size_t num_vertices() const { return m_num_vertices; }
+		size_t num_edges() const { return m_num_edges; }
+
+		/*
+		 * Reads the sources of the next vertex, returns false after the last vertex.
+		 * */
+		bool next(uint32_t &vertex, std::vector<uint32_t> &edges);
+
+		void rewind();
+
+	private:
+
+		utils::mmap_file m_file;
+		size_t m_num_vertices;
+		size_t m_num_edges;
+		size_t m_pos;
+		uint32_t m_vertex;
+
+	};
+
+}
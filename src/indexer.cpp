@@ -39,14 +39,16 @@
 #include <iostream>
 #include <set>
 #include "urlstore/UrlStore.h"
+#include "memory/debugger.h"
 
 using namespace std;
 
 void help() {
 	cout << "Usage: ./tools [OPTION]..." << endl;
 	cout << "--split run splitter" << endl;
-	cout << "--harmonic-hosts create file /tmp/hosts.txt with hosts for harmonic centrality" << endl;
-	cout << "--harmonic-links create file /tmp/edges.txt for edges for harmonic centrality" << endl;
+	cout << "--harmonic-hosts create files /mnt/hosts.txt and /mnt/hosts.ids with hosts for harmonic centrality" << endl;
+	cout << "--harmonic-links create file /mnt/edges.adj for edges for harmonic centrality" << endl;
+	cout << "--harmonic-csr convert /mnt/edges.adj to /mnt/edges.csr for harmonic centrality" << endl;
 	cout << "--harmonic calculates harmonic centrality" << endl;
 }
 
@@ -61,6 +63,11 @@ int main(int argc, const char **argv) {
 		Config::read_config("/etc/alexandria.conf");
 	}
 
+	memory::enable_size_histogram(Config::memory_size_histogram);
+	if (Config::memory_profiler_sample_rate) {
+		memory::enable_heap_profiler(Config::memory_profiler_sample_rate);
+	}
+
 	if (argc < 2) {
 		help();
 		return 0;
@@ -91,6 +98,8 @@ int main(int argc, const char **argv) {
 		Tools::calculate_harmonic_hosts();
 	} else if (arg == "--harmonic-links") {
 		Tools::calculate_harmonic_links();
+	} else if (arg == "--harmonic-csr") {
+		Tools::calculate_harmonic_csr();
 	} else if (arg == "--harmonic") {
 		Tools::calculate_harmonic();
 	} else if (arg == "--host-hash") {
@@ -42,24 +42,31 @@ namespace indexer {
 		composite_index(const std::string &db_name, size_t num_shards, size_t hash_table_size);
 		~composite_index();
 
-		std::vector<data_record> find(uint64_t realm_key, uint64_t key) const;
+		typename index<data_record>::postings find(uint64_t realm_key, uint64_t key) const;
 	private:
 
 		std::string m_db_name;
 		size_t m_num_shards;
 		size_t m_hash_table_size;
+
+		// Shards are opened on first use and then kept mapped.
+		mutable std::mutex m_lock;
+		mutable std::vector<std::unique_ptr<index<data_record>>> m_shards;
+
+		const index<data_record> &shard(size_t shard_id) const;
 		
 	};
 
 	template<typename data_record>
 	composite_index<data_record>::composite_index(const std::string &db_name, size_t num_shards)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(Config::shard_hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(Config::shard_hash_table_size),
+		m_shards(num_shards)
 	{
 	}
 
 	template<typename data_record>
 	composite_index<data_record>::composite_index(const std::string &db_name, size_t num_shards, size_t hash_table_size)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size), m_shards(num_shards)
 	{
 	}
 
@@ -68,11 +75,19 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	std::vector<data_record> composite_index<data_record>::find(uint64_t realm_key, uint64_t key) const {
+	typename index<data_record>::postings composite_index<data_record>::find(uint64_t realm_key, uint64_t key) const {
 		const uint64_t composite_key = (realm_key << 32) | (key >> 32);
 		const size_t shard_id = composite_key % m_num_shards;
-		index<data_record> shard(m_db_name, shard_id, m_hash_table_size);
-		return shard.find(composite_key);
+		return shard(shard_id).find(composite_key);
+	}
+
+	template<typename data_record>
+	const index<data_record> &composite_index<data_record>::shard(size_t shard_id) const {
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_shards[shard_id]) {
+			m_shards[shard_id] = std::make_unique<index<data_record>>(m_db_name, shard_id, m_hash_table_size);
+		}
+		return *m_shards[shard_id];
 	}
 
 }
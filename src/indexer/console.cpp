@@ -32,6 +32,7 @@
 #include "transfer/Transfer.h"
 #include "domain_stats/domain_stats.h"
 #include "merger.h"
+#include "posting_cache.h"
 
 using namespace std;
 
@@ -117,6 +118,14 @@ namespace indexer {
 		}
 	}
 
+	void cmd_cache() {
+		const posting_cache::stats stats = posting_cache::instance().get_stats();
+		cout << "size: " << stats.m_size << " of " << stats.m_capacity << " bytes" << endl;
+		cout << "hits: " << stats.m_hits << " misses: " << stats.m_misses << " hit rate: " << stats.hit_rate() << endl;
+		cout << "insertions: " << stats.m_insertions << " evictions: " << stats.m_evictions << " rejections: " <<
+			stats.m_rejections << " invalidations: " << stats.m_invalidations << endl;
+	}
+
 	void cmd_harmonic(const vector<string> &args) {
 		if (args.size() < 2) return;
 		float harmonic = domain_stats::harmonic_centrality(URL(args[1]));
@@ -157,6 +166,11 @@ namespace indexer {
 
 		//idx_tree.truncate();
 
+		if (Config::posting_cache_warm_up_file.size()) {
+			const size_t num_queries = idx_tree.warm_up(Config::posting_cache_warm_up_file);
+			LOG_INFO("Warmed up posting cache with " + to_string(num_queries) + " queries");
+		}
+
 		string input;
 		while (cout << "# " && getline(cin, input)) {
 
@@ -175,6 +189,8 @@ namespace indexer {
 				vector<string> query_words(args.begin() + 1, args.end());
 				const string query = boost::algorithm::join(query_words, " ");
 				cmd_search(idx_tree, query);
+			} else if (cmd == "cache") {
+				cmd_cache();
 			} else if (cmd == "quit") {
 				break;
 			}
@@ -26,8 +26,39 @@
 
 #pragma once
 
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <typeinfo>
+#include "utils/mmap_file.hpp"
+#include "posting_codec.h"
+#include "posting_cache.h"
+#include "config.h"
+#include "system/Logger.h"
+
 namespace indexer {
 
+	/*
+	 * Counts the files index_builder has published in this process. Readers check their files when it changes and
+	 * otherwise at most every reopen_check_interval, so files replaced by another process are noticed within that.
+	 * */
+	inline std::atomic<uint64_t> files_published = 0;
+	const std::chrono::milliseconds reopen_check_interval(1000);
+
+	/*
+	 * Reader for the files written by index_builder. The .keys and .data files are memory mapped once and find is
+	 * answered with a direct lookup in the page directory followed by a binary search in the sorted key array of
+	 * the page. The builder replaces the files with rename so the reader detects the new files and remaps them.
+	 *
+	 * Results are kept in posting_cache tagged with the generation of the files so they are dropped when the files
+	 * are replaced.
+	 * */
 	template<typename data_record>
 	class index {
 
@@ -37,24 +68,66 @@ namespace indexer {
 		index(const std::string &db_name, size_t id, size_t hash_table_size);
 		~index();
 
-		std::vector<data_record> find(uint64_t key) const;
-		std::vector<data_record> find(uint64_t key, size_t &total_found) const;
+		/*
+		 * Records of one key. The vector is shared with posting_cache so a cache hit is returned without copying
+		 * the records, it is kept alive by the pointer even if the entry is evicted.
+		 * */
+		using postings = std::shared_ptr<const std::vector<data_record>>;
+
+		postings find(uint64_t key) const;
+		postings find(uint64_t key, size_t &total_found) const;
 
 		/*
 		 * Returns inverse document frequency (idf) for the last search.
 		 * */
 		float get_idf(size_t documents_with_term) const;
-		size_t get_document_count() const { return m_unique_count; }
+		size_t get_document_count() const { return current_mapping()->m_unique_count; }
+
+		/*
+		 * Maps the files again if index_builder has replaced them since we mapped them, without waiting for
+		 * reopen_check_interval.
+		 * */
+		void reopen_if_changed() const;
 
 	private:
 
+		struct mapping {
+			std::unique_ptr<utils::mmap_file> m_data;
+			std::unique_ptr<utils::mmap_file> m_keys;
+			size_t m_unique_count = 0;
+			uint64_t m_format = posting_codec::format_raw;
+			uint64_t m_generation = 0;
+			bool m_meta_valid = true;
+		};
+
+		struct cached_postings {
+			std::vector<data_record> m_records;
+			size_t m_total_found;
+		};
+
 		std::string m_db_name;
 		size_t m_id;
 		const size_t m_hash_table_size;
-		size_t m_unique_count = 0;
 
-		size_t read_key_pos(uint64_t key) const;
-		void read_meta();
+		mutable std::mutex m_lock;
+		mutable std::shared_ptr<const mapping> m_mapping;
+
+		// Value of files_published and the time of our last check of the files.
+		mutable std::atomic<uint64_t> m_checked_published = 0;
+		mutable std::atomic<int64_t> m_next_check = 0;
+		mutable std::mutex m_reopen_lock;
+
+		// Identifies this shard in posting_cache.
+		const uint64_t m_cache_id;
+
+		std::vector<data_record> find_in_mapping(const mapping &map, uint64_t key, size_t &total_found) const;
+		uint64_t cache_id() const;
+		std::shared_ptr<const mapping> current_mapping(bool force_check = false) const;
+		std::shared_ptr<const mapping> open_mapping() const;
+		bool files_match(const mapping &map) const;
+		std::shared_ptr<const mapping> open_first_mapping() const;
+		size_t read_key_pos(const mapping &map, uint64_t key) const;
+		void read_meta(mapping &map) const;
 		std::string mountpoint() const;
 		std::string filename() const;
 		std::string key_filename() const;
@@ -64,14 +137,14 @@ namespace indexer {
 
 	template<typename data_record>
 	index<data_record>::index(const std::string &db_name, size_t id)
-	: m_db_name(db_name), m_id(id), m_hash_table_size(Config::shard_hash_table_size) {
-		read_meta();
+	: m_db_name(db_name), m_id(id), m_hash_table_size(Config::shard_hash_table_size), m_cache_id(cache_id()) {
+		m_mapping = open_first_mapping();
 	}
 
 	template<typename data_record>
 	index<data_record>::index(const std::string &db_name, size_t id, size_t hash_table_size)
-	: m_db_name(db_name), m_id(id), m_hash_table_size(hash_table_size) {
-		read_meta();
+	: m_db_name(db_name), m_id(id), m_hash_table_size(hash_table_size), m_cache_id(cache_id()) {
+		m_mapping = open_first_mapping();
 	}
 
 	template<typename data_record>
@@ -79,70 +152,119 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	std::vector<data_record> index<data_record>::find(uint64_t key) const {
+	typename index<data_record>::postings index<data_record>::find(uint64_t key) const {
 		size_t total;
 		return find(key, total);
 	}
 
 	template<typename data_record>
-	std::vector<data_record> index<data_record>::find(uint64_t key, size_t &total_found) const {
+	typename index<data_record>::postings index<data_record>::find(uint64_t key, size_t &total_found) const {
+
+		// Holding the shared pointer keeps the mapping alive even if another thread remaps.
+		std::shared_ptr<const mapping> map = current_mapping();
+
+		posting_cache &cache = posting_cache::instance();
+		if (!cache.enabled()) {
+			return std::make_shared<const std::vector<data_record>>(find_in_mapping(*map, key, total_found));
+		}
+
+		auto cached = std::static_pointer_cast<const cached_postings>(cache.find(m_cache_id, key, map->m_generation));
+		if (cached) {
+			total_found = cached->m_total_found;
+			// Shares ownership of the cache entry.
+			return postings(cached, &cached->m_records);
+		}
+
+		auto entry = std::make_shared<cached_postings>();
+		entry->m_records = find_in_mapping(*map, key, entry->m_total_found);
+		total_found = entry->m_total_found;
+
+		const size_t bytes = sizeof(cached_postings) + entry->m_records.size() * sizeof(data_record);
+		postings ret(entry, &entry->m_records);
+		cache.insert(m_cache_id, key, map->m_generation, std::move(entry), bytes);
+
+		return ret;
+	}
+
+	template<typename data_record>
+	std::vector<data_record> index<data_record>::find_in_mapping(const mapping &map, uint64_t key,
+		size_t &total_found) const {
+
+		total_found = 0;
 
-		size_t key_pos = read_key_pos(key);
+		const size_t key_pos = read_key_pos(map, key);
 
 		if (key_pos == SIZE_MAX) {
 			return {};
 		}
 
-		// Read page.
-		std::ifstream reader(filename(), std::ios::binary);
-		reader.seekg(key_pos);
-		size_t num_keys;
-		reader.read((char *)&num_keys, sizeof(size_t));
+		const char *data = map.m_data->data();
+		const size_t data_size = map.m_data->size();
+
+		if (key_pos + sizeof(size_t) > data_size) {
+			return {};
+		}
 
-		std::unique_ptr<uint64_t[]> keys_allocator = std::make_unique<uint64_t[]>(num_keys);
-		uint64_t *keys = keys_allocator.get();
-		reader.read((char *)keys, num_keys * sizeof(uint64_t));
+		// Read page header.
+		size_t num_keys;
+		memcpy(&num_keys, &data[key_pos], sizeof(size_t));
 
-		size_t key_data_pos = SIZE_MAX;
-		for (size_t i = 0; i < num_keys; i++) {
-			if (keys[i] == key) {
-				key_data_pos = i;
-			}
+		const size_t header_len = sizeof(size_t) + num_keys * sizeof(uint64_t) * 4;
+		if (num_keys == 0 || key_pos + header_len > data_size) {
+			return {};
 		}
 
-		if (key_data_pos == SIZE_MAX) {
+		// The keys in each page are written in ascending order by index_builder::save_file.
+		const uint64_t *keys = (const uint64_t *)&data[key_pos + sizeof(size_t)];
+		const uint64_t *key_iter = std::lower_bound(keys, keys + num_keys, key);
+
+		if (key_iter == keys + num_keys || *key_iter != key) {
 			return {};
 		}
 
-		char buffer[64];
+		const size_t key_data_pos = key_iter - keys;
 
-		// Read position and length.
-		reader.seekg(key_pos + 8 + num_keys * 8 + key_data_pos * 8, std::ios::beg);
-		reader.read(buffer, 8);
-		size_t pos = *((size_t *)(&buffer[0]));
+		const size_t *positions = (const size_t *)(keys + num_keys);
+		const size_t *lengths = positions + num_keys;
+		const size_t *totals = lengths + num_keys;
 
-		reader.seekg(key_pos + 8 + (num_keys * 8)*2 + key_data_pos * 8, std::ios::beg);
-		reader.read(buffer, 8);
-		size_t len = *((size_t *)(&buffer[0]));
+		const size_t pos = positions[key_data_pos];
+		const size_t len = lengths[key_data_pos];
+		const size_t data_pos = key_pos + header_len + pos;
 
-		reader.seekg(key_pos + 8 + (num_keys * 8)*3 + key_data_pos * 8, std::ios::beg);
-		reader.read(buffer, 8);
-		total_found = *((size_t *)(&buffer[0]));
+		if (data_pos + len > data_size) {
+			return {};
+		}
 
-		reader.seekg(key_pos + 8 + (num_keys * 8)*4 + pos, std::ios::beg);
+		total_found = totals[key_data_pos];
 
-		size_t num_records = len / sizeof(data_record);
+		if constexpr (posting_codec::is_compressible<data_record>()) {
+			if (posting_codec::is_compressed<data_record>(map.m_format)) {
+				std::vector<data_record> ret;
+				if (!posting_codec::decode(&data[data_pos], len, ret)) {
+					return {};
+				}
+				return ret;
+			}
+		}
+
+		const size_t num_records = len / sizeof(data_record);
 
 		std::vector<data_record> ret(num_records);
-		reader.read((char *)ret.data(), sizeof(data_record) * num_records);
+		memcpy((char *)ret.data(), &data[data_pos], sizeof(data_record) * num_records);
 
 		return ret;
 	}
 
+	template<typename data_record>
+	uint64_t index<data_record>::cache_id() const {
+		return std::hash<std::string>{}(m_db_name + "/" + std::to_string(m_id)) ^ typeid(data_record).hash_code();
+	}
+
 	template<typename data_record>
 	float index<data_record>::get_idf(size_t documents_with_term) const {
 		if (documents_with_term) {
-			const size_t documents_in_corpus = m_unique_count;
+			const size_t documents_in_corpus = get_document_count();
 			float idf = log((float)documents_in_corpus / documents_with_term);
 			return idf;
 		}
@@ -150,44 +272,145 @@ namespace indexer {
 		return 0.0f;
 	}
 
+	template<typename data_record>
+	void index<data_record>::reopen_if_changed() const {
+		current_mapping(true);
+	}
+
+	/*
+	 * Returns the current mapping. The files are only checked when index_builder has published files in this
+	 * process or reopen_check_interval has passed. The data file is the last file index_builder renames into place
+	 * so if it has changed we map everything again, one thread does that while the others keep the old mapping.
+	 * */
+	template<typename data_record>
+	std::shared_ptr<const typename index<data_record>::mapping> index<data_record>::current_mapping(
+		bool force_check) const {
+
+		std::shared_ptr<const mapping> map;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			map = m_mapping;
+		}
+
+		const uint64_t published = files_published.load();
+		const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+		if (!force_check && published == m_checked_published && now < m_next_check) {
+			return map;
+		}
+
+		std::unique_lock<std::mutex> reopen_lock(m_reopen_lock, std::try_to_lock);
+		if (!reopen_lock.owns_lock()) {
+			if (!force_check) return map;
+			reopen_lock.lock();
+		}
+
+		m_checked_published = published;
+		m_next_check = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			reopen_check_interval).count();
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			map = m_mapping;
+		}
+
+		if (!map->m_data->is_stale()) {
+			return map;
+		}
+
+		std::shared_ptr<const mapping> new_map = open_mapping();
+		if (!files_match(*new_map) || !new_map->m_meta_valid) {
+			// Keep serving the old files until the files on disk are from the same merge again.
+			m_next_check = 0;
+			return map;
+		}
+
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_mapping = new_map;
+
+		return new_map;
+	}
+
+	template<typename data_record>
+	std::shared_ptr<const typename index<data_record>::mapping> index<data_record>::open_mapping() const {
+		// The keys are mapped first so a merge that publishes between the two is caught by files_match.
+		std::shared_ptr<mapping> map;
+		for (size_t attempt = 0; attempt < 100; attempt++) {
+			map = std::make_shared<mapping>();
+			map->m_keys = std::make_unique<utils::mmap_file>(key_filename());
+			map->m_data = std::make_unique<utils::mmap_file>(filename());
+			read_meta(*map);
+			if (files_match(*map) && map->m_meta_valid) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// Mix in the version of the data file in case we mapped it between the meta file and the data file being
+		// replaced.
+		map->m_generation = (map->m_generation * 0x9e3779b97f4a7c15ull) ^ map->m_data->version();
+
+		return map;
+	}
+
+	/*
+	 * Returns false if the trailer of the keys file says that it was written with another data file than the one we
+	 * mapped. Keys files without trailer are from before the trailer was added and always match.
+	 * */
+	template<typename data_record>
+	bool index<data_record>::files_match(const mapping &map) const {
+
+		uint64_t data_inode, data_size;
+		if (!map.m_keys->is_open() || !posting_codec::read_keys_trailer(map.m_keys->data(), map.m_keys->size(),
+				m_hash_table_size, data_inode, data_size)) {
+			return true;
+		}
+
+		return map.m_data->is_open() && data_inode == map.m_data->inode() && data_size == map.m_data->size();
+	}
+
 	/*
 	 * Reads the exact position of the key, returns SIZE_MAX if the key was not found.
 	 * */
 	template<typename data_record>
-	size_t index<data_record>::read_key_pos(uint64_t key) const {
+	size_t index<data_record>::read_key_pos(const mapping &map, uint64_t key) const {
 
 		if (m_hash_table_size == 0) return 0;
 
 		const size_t hash_pos = key % m_hash_table_size;
 
-		std::ifstream key_reader(key_filename(), std::ios::binary);
-
-		key_reader.seekg(hash_pos * sizeof(size_t));
+		if ((hash_pos + 1) * sizeof(size_t) > map.m_keys->size()) {
+			return SIZE_MAX;
+		}
 
 		size_t pos;
-		key_reader.read((char *)&pos, sizeof(size_t));
+		memcpy(&pos, &map.m_keys->data()[hash_pos * sizeof(size_t)], sizeof(size_t));
 
 		return pos;
 	}
 
 	/*
-	 * Reads the count of unique recprds from the count file and puts it in the m_unique_count member.
+	 * Without a mapping to fall back on the files have to be readable.
 	 * */
 	template<typename data_record>
-	void index<data_record>::read_meta() {
-		struct meta {
-			size_t unique_count;
-		};
+	std::shared_ptr<const typename index<data_record>::mapping> index<data_record>::open_first_mapping() const {
+		std::shared_ptr<const mapping> map = open_mapping();
+		if (!map->m_meta_valid) {
+			throw LOG_ERROR_EXCEPTION("Invalid meta file " + meta_filename());
+		}
+		return map;
+	}
 
-		meta m;
+	/*
+	 * Reads the count of unique records and the page format from the meta file. A shard without meta file has raw
+	 * pages, a meta file with a short or unknown header leaves the mapping invalid.
+	 * */
+	template<typename data_record>
+	void index<data_record>::read_meta(mapping &map) const {
 
 		std::ifstream meta_reader(meta_filename(), std::ios::binary);
 
 		if (meta_reader.is_open()) {
-			meta_reader.read((char *)(&m), sizeof(meta));
+			map.m_meta_valid = posting_codec::read_meta_header(meta_reader, map.m_format, map.m_unique_count,
+				map.m_generation);
 		}
-
-		m_unique_count = m.unique_count;
 	}
 
 	template<typename data_record>
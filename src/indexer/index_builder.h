@@ -29,10 +29,15 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <queue>
 #include <cstring>
 #include <cassert>
 #include <boost/filesystem.hpp>
+#include <sys/stat.h>
+#include "index.h"
 #include "merger.h"
+#include "posting_codec.h"
+#include "run_file.h"
 #include "algorithm/HyperLogLog.h"
 #include "config.h"
 #include "system/Logger.h"
@@ -81,9 +86,9 @@ namespace indexer {
 
 		const size_t m_max_cache_file_size = 300 * 1000 * 1000; // 200mb.
 		const size_t m_max_num_keys = 10000;
-		const size_t m_buffer_len = Config::ft_shard_builder_buffer_len;
-		char *m_buffer;
+		const size_t m_run_len = Config::ft_merge_run_len;
 		std::mutex m_lock;
+		std::shared_ptr<merger::builder_state> m_merger;
 
 		// Caches
 		std::vector<uint64_t> m_keys;
@@ -98,12 +103,69 @@ namespace indexer {
 		float m_avg_document_size = 0.0f;
 		size_t m_unique_document_count = 0;
 
-		void read_append_cache();
+		// Page format of the data file on disk, read from the meta file.
+		uint64_t m_format = posting_codec::format_raw;
+
+		// Bumped every time new files are published so readers can invalidate cached postings.
+		uint64_t m_generation = 0;
+
+		/*
+		 * Entry in the sorted runs of the external sort. Runs are ordered by page, key and record.
+		 * */
+		struct run_entry {
+			uint64_t m_key;
+			data_record m_record;
+		};
+
+		/*
+		 * Posting list being merged. Records arrive ordered so equal records are summed as they come in.
+		 * */
+		struct merged_list {
+			uint64_t m_key = 0;
+			std::vector<data_record> m_records;
+			data_record m_pending;
+			bool m_has_pending = false;
+			size_t m_unique_count = 0;
+			std::shared_ptr<Algorithm::HyperLogLog<size_t>> m_total_counter;
+		};
+
+		/*
+		 * Reads the current data file one page at a time as a sorted run.
+		 * */
+		struct data_file_cursor {
+			std::ifstream m_reader;
+			std::vector<uint64_t> m_keys;
+			std::vector<std::vector<data_record>> m_lists;
+			size_t m_key_id = 0;
+			size_t m_record_id = 0;
+		};
+
+		size_t buffered_bytes();
 		void read_data_to_cache();
 		bool read_page(std::ifstream &reader);
+		bool read_page(std::ifstream &reader, std::vector<uint64_t> &keys,
+			std::vector<std::vector<data_record>> &lists, bool &corrupt);
+		bool read_compressed_page_data(std::ifstream &reader, const std::vector<size_t> &lens,
+			std::vector<std::vector<data_record>> &lists);
+		void sort_append_cache(std::vector<std::unique_ptr<run_reader<run_entry>>> &runs,
+			std::vector<std::string> &run_files);
+		void add_run(std::vector<run_entry> &run, bool in_memory, std::vector<std::unique_ptr<run_reader<run_entry>>> &runs,
+			std::vector<std::string> &run_files);
+		bool next_from_data_file(data_file_cursor &cursor, run_entry &entry);
+		void merge_runs(std::vector<std::unique_ptr<run_reader<run_entry>>> &runs,
+			std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll);
+		void add_to_list(merged_list &list, const data_record &record);
+		void keep_in_list(merged_list &list, const data_record &record);
+		void finish_list(merged_list &list);
+		void truncate_by_score(std::vector<data_record> &records) const;
+		bool entry_less(const run_entry &a, const run_entry &b) const;
+		uint64_t page_for_key(uint64_t key) const;
 		void save_file();
+		void open_files(std::ofstream &writer, std::ofstream &key_writer);
+		void publish_files();
 		void write_key(std::ofstream &key_writer, uint64_t key, size_t page_pos);
-		size_t write_page(std::ofstream &writer, const std::vector<uint64_t> &keys);
+		size_t write_page(std::ofstream &writer, const std::vector<uint64_t> &keys,
+			const std::vector<const std::vector<data_record> *> &lists, const std::vector<size_t> &totals);
 		bool use_key_file() const;
 		void reset_key_file(std::ofstream &key_writer);
 		void sort_cache();
@@ -112,6 +174,7 @@ namespace indexer {
 		size_t total_results_for_key(uint64_t key);
 		void count_unique(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll);
 		void read_meta(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll);
+		void read_counter(std::ifstream &infile, std::unique_ptr<Algorithm::HyperLogLog<size_t>> &counter) const;
 		void save_meta(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll) const;
 		void calculate_avg_document_size();
 
@@ -121,39 +184,40 @@ namespace indexer {
 		std::string key_filename() const;
 		std::string target_filename() const;
 		std::string meta_filename() const;
+		std::string run_filename(size_t run) const;
 
 	};
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id)
 	: m_db_name(db_name), m_id(id), m_hash_table_size(Config::shard_hash_table_size), m_max_results(Config::ft_max_results_per_section) {
-		merger::register_merger((size_t)this, [this]() {merge();});
-		merger::register_appender((size_t)this, [this]() {append();});
+		m_merger = merger::register_builder((size_t)this, m_id % 8, [this]() {return buffered_bytes();},
+			[this]() {append();}, [this]() {merge();});
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id, size_t hash_table_size)
 	: m_db_name(db_name), m_id(id), m_hash_table_size(hash_table_size), m_max_results(Config::ft_max_results_per_section) {
-		merger::register_merger((size_t)this, [this]() {append();});
-		merger::register_appender((size_t)this, [this]() {append();});
+		m_merger = merger::register_builder((size_t)this, m_id % 8, [this]() {return buffered_bytes();},
+			[this]() {append();}, [this]() {append();});
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::index_builder(const std::string &db_name, size_t id, size_t hash_table_size, size_t max_results)
 	: m_db_name(db_name), m_id(id), m_hash_table_size(hash_table_size), m_max_results(max_results) {
-		merger::register_merger((size_t)this, [this]() {append();});
-		merger::register_appender((size_t)this, [this]() {append();});
+		m_merger = merger::register_builder((size_t)this, m_id % 8, [this]() {return buffered_bytes();},
+			[this]() {append();}, [this]() {append();});
 	}
 
 	template<typename data_record>
 	index_builder<data_record>::~index_builder() {
-		merger::deregister_merger((size_t)this);
+		merger::deregister_builder((size_t)this);
 	}
 
 	template<typename data_record>
 	void index_builder<data_record>::add(uint64_t key, const data_record &record) {
 
-		indexer::merger::lock();
+		m_merger->wait_while_flushing();
 
 		m_lock.lock();
 
@@ -170,6 +234,8 @@ namespace indexer {
 	template<typename data_record>
 	void index_builder<data_record>::append() {
 
+		std::lock_guard<std::mutex> lock(m_lock);
+
 		assert(m_records.size() == m_keys.size());
 
 		std::ofstream record_writer(cache_filename(), std::ios::binary | std::ios::app);
@@ -202,11 +268,22 @@ namespace indexer {
 			std::unique_ptr<Algorithm::HyperLogLog<size_t>> hll = std::make_unique<Algorithm::HyperLogLog<size_t>>();
 
 			read_meta(hll);
-			read_append_cache();
-			count_unique(hll);
-			sort_cache();
-			save_file();
+
+			std::vector<std::unique_ptr<run_reader<run_entry>>> runs;
+			std::vector<std::string> run_files;
+			sort_append_cache(runs, run_files);
+			merge_runs(runs, hll);
+
+			// The meta file goes first, publish_files renames the new data file into place last.
+			m_generation++;
 			save_meta(hll);
+			publish_files();
+
+			runs.clear();
+			for (const std::string &run_file : run_files) {
+				boost::filesystem::remove(run_file);
+			}
+
 			truncate_cache_files();
 		}
 
@@ -221,6 +298,15 @@ namespace indexer {
 
 	}
 
+	/*
+	 * Estimated memory held by the records added since the last append.
+	 * */
+	template<typename data_record>
+	size_t index_builder<data_record>::buffered_bytes() {
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_keys.capacity() * sizeof(uint64_t) + m_records.capacity() * sizeof(data_record);
+	}
+
 	/*
 		Deletes ALL data from this shard.
 	*/
@@ -229,11 +315,35 @@ namespace indexer {
 		create_directories();
 		truncate_cache_files();
 
+		// Remove before truncating so that mapped readers keep their old inode instead of reading a truncated file.
+		boost::filesystem::remove(target_filename());
+		boost::filesystem::remove(key_filename());
+
 		std::ofstream target_writer(target_filename(), std::ios::trunc);
 		target_writer.close();
 
-		std::ofstream meta_writer(meta_filename(), std::ios::trunc);
+		// Keep the generation increasing so cached postings of the old files are not served for the new ones. A broken
+		// meta file is replaced anyway, readers mix the generation with the version of the data file.
+		{
+			std::ifstream meta_reader(meta_filename(), std::ios::binary);
+			size_t unique_count;
+			if (!meta_reader.is_open() ||
+					!posting_codec::read_meta_header(meta_reader, m_format, unique_count, m_generation)) {
+				m_generation = 0;
+			}
+		}
+		m_generation++;
+		m_format = posting_codec::current_format;
+
+		std::ofstream meta_writer(meta_filename() + ".tmp", std::ios::binary | std::ios::trunc);
+		if (!meta_writer.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
+		}
+		posting_codec::write_meta_header(meta_writer, 0, m_generation);
 		meta_writer.close();
+		boost::filesystem::rename(meta_filename() + ".tmp", meta_filename());
+
+		files_published++;
 	}
 
 	/*
@@ -282,6 +392,9 @@ namespace indexer {
 		}
 
 		sort_cache();
+		// The file is written in the current format so the meta header has to be updated too.
+		m_generation++;
+		save_meta(hll);
 		save_file();
 	}
 
@@ -320,15 +433,135 @@ namespace indexer {
 		return log((val1 / val2) + 1.0f);
 	}
 
+	/*
+	 * Reads the file into RAM.
+	 * */
 	template<typename data_record>
-	void index_builder<data_record>::read_append_cache() {
+	void index_builder<data_record>::read_data_to_cache() {
 
 		m_cache = std::map<uint64_t, std::vector<data_record>>{};
 
-		// Read the current file.
-		read_data_to_cache();
+		std::ifstream reader(target_filename(), std::ios::binary);
+		if (!reader.is_open()) return;
+
+		while (read_page(reader)) {
+		}
+	}
+
+	template<typename data_record>
+	bool index_builder<data_record>::read_page(std::ifstream &reader) {
+
+		std::vector<uint64_t> keys;
+		std::vector<std::vector<data_record>> lists;
+		bool corrupt = false;
+
+		if (!read_page(reader, keys, lists, corrupt)) {
+			if (corrupt) {
+				m_cache = std::map<uint64_t, std::vector<data_record>>{};
+			}
+			return false;
+		}
+
+		for (size_t i = 0; i < keys.size(); i++) {
+			m_result_sizes[keys[i]] = lists[i].size();
+			m_cache[keys[i]] = std::move(lists[i]);
+		}
+
+		return true;
+	}
+
+	/*
+	 * Reads the next page from the data file. Returns false at the end of the file or if the page is corrupt.
+	 * */
+	template<typename data_record>
+	bool index_builder<data_record>::read_page(std::ifstream &reader, std::vector<uint64_t> &keys,
+		std::vector<std::vector<data_record>> &lists, bool &corrupt) {
+
+		corrupt = false;
+
+		uint64_t num_keys = 0;
+		reader.read((char *)&num_keys, sizeof(uint64_t));
+
+		if (reader.eof()) return false;
+
+		// Read the keys.
+		keys.resize(num_keys);
+		reader.read((char *)keys.data(), num_keys * sizeof(uint64_t));
+
+		// Skip the positions, the data of the keys is stored in the same order as the keys.
+		reader.seekg(num_keys * sizeof(size_t), std::ios::cur);
+
+		// Read the lengths.
+		std::vector<size_t> lens(num_keys);
+		reader.read((char *)lens.data(), num_keys * sizeof(size_t));
+
+		// Skip the totals.
+		reader.seekg(num_keys * sizeof(size_t), std::ios::cur);
+
+		if (!reader) {
+			LOG_INFO("Page header stopped before end. Ignoring shard " + std::to_string(m_id));
+			corrupt = true;
+			return false;
+		}
+
+		lists.clear();
+		lists.resize(num_keys);
+
+		if constexpr (posting_codec::is_compressible<data_record>()) {
+			if (posting_codec::is_compressed<data_record>(m_format)) {
+				if (!read_compressed_page_data(reader, lens, lists)) {
+					corrupt = true;
+					return false;
+				}
+				return true;
+			}
+		}
+
+		for (size_t key_id = 0; key_id < num_keys; key_id++) {
+			lists[key_id].resize(lens[key_id] / sizeof(data_record));
+			reader.read((char *)lists[key_id].data(), lists[key_id].size() * sizeof(data_record));
+
+			if ((size_t)reader.gcount() != lists[key_id].size() * sizeof(data_record)) {
+				LOG_INFO("Data stopped before end. Ignoring shard " + std::to_string(m_id));
+				corrupt = true;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template<typename data_record>
+	bool index_builder<data_record>::read_compressed_page_data(std::ifstream &reader, const std::vector<size_t> &lens,
+		std::vector<std::vector<data_record>> &lists) {
+
+		std::string encoded;
+		for (size_t key_id = 0; key_id < lens.size(); key_id++) {
+			encoded.resize(lens[key_id]);
+			reader.read(encoded.data(), lens[key_id]);
+
+			if ((size_t)reader.gcount() != lens[key_id]) {
+				LOG_INFO("Data stopped before end. Ignoring shard " + std::to_string(m_id));
+				return false;
+			}
+
+			if (!posting_codec::decode(encoded.data(), encoded.size(), lists[key_id])) {
+				LOG_INFO("Corrupt page data. Ignoring shard " + std::to_string(m_id));
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/*
+	 * Reads the append cache in chunks of m_run_len records, sorts each chunk and writes it to disk as a run. The
+	 * last chunk is kept in memory.
+	 * */
+	template<typename data_record>
+	void index_builder<data_record>::sort_append_cache(std::vector<std::unique_ptr<run_reader<run_entry>>> &runs,
+		std::vector<std::string> &run_files) {
 
-		// Read the cache into memory.
 		std::ifstream reader(cache_filename(), std::ios::binary);
 		if (!reader.is_open()) {
 			throw LOG_ERROR_EXCEPTION("Could not open full text shard (" + cache_filename() + "). Error: " + std::string(strerror(errno)));
@@ -340,204 +573,357 @@ namespace indexer {
 		}
 
 		const size_t buffer_len = 100000;
-		const size_t buffer_size = sizeof(data_record) * buffer_len;
-		const size_t key_buffer_size = sizeof(uint64_t) * buffer_len;
-
-		std::unique_ptr<char[]> buffer_allocator;
-		try {
-			buffer_allocator = std::make_unique<char[]>(buffer_size);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << buffer_size << " bytes" << std::endl;
-			return;
+		std::vector<data_record> records(buffer_len);
+		std::vector<uint64_t> keys(buffer_len);
+
+		std::vector<run_entry> run;
+		run.reserve(std::min(m_run_len, buffer_len));
+
+		while (reader && key_reader) {
+
+			reader.read((char *)records.data(), buffer_len * sizeof(data_record));
+			key_reader.read((char *)keys.data(), buffer_len * sizeof(uint64_t));
+
+			const size_t num_records = std::min(reader.gcount() / sizeof(data_record),
+				key_reader.gcount() / sizeof(uint64_t));
+
+			for (size_t i = 0; i < num_records; i++) {
+				m_document_sizes[records[i].m_value]++;
+				run.push_back(run_entry{keys[i], records[i]});
+
+				if (run.size() >= m_run_len) {
+					add_run(run, false, runs, run_files);
+				}
+			}
 		}
 
-		std::unique_ptr<char[]> key_buffer_allocator;
-		try {
-			key_buffer_allocator = std::make_unique<char[]>(key_buffer_size);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << key_buffer_size << " bytes" << std::endl;
-			return;
+		if (run.size()) {
+			add_run(run, true, runs, run_files);
 		}
+	}
 
-		char *buffer = buffer_allocator.get();
-		char *key_buffer = key_buffer_allocator.get();
+	template<typename data_record>
+	void index_builder<data_record>::add_run(std::vector<run_entry> &run, bool in_memory,
+		std::vector<std::unique_ptr<run_reader<run_entry>>> &runs, std::vector<std::string> &run_files) {
+
+		std::sort(run.begin(), run.end(), [this](const run_entry &a, const run_entry &b) {
+			return entry_less(a, b);
+		});
+
+		if (in_memory) {
+			runs.push_back(std::make_unique<run_reader<run_entry>>(std::move(run)));
+		} else {
+			const std::string filename = run_filename(run_files.size());
+			write_run(filename, run);
+			run_files.push_back(filename);
+			runs.push_back(std::make_unique<run_reader<run_entry>>(filename));
+		}
 
-		reader.seekg(0, std::ios::beg);
+		run.clear();
+	}
 
-		while (!reader.eof()) {
+	/*
+	 * The data file is written in the same order as the runs so it is read as one more run.
+	 * */
+	template<typename data_record>
+	bool index_builder<data_record>::next_from_data_file(data_file_cursor &cursor, run_entry &entry) {
 
-			reader.read(buffer, buffer_size);
-			key_reader.read(key_buffer, key_buffer_size);
+		if (!cursor.m_reader.is_open()) return false;
 
-			const size_t read_bytes = reader.gcount();
-			const size_t num_records = read_bytes / sizeof(data_record);
+		while (cursor.m_key_id == cursor.m_keys.size() ||
+				cursor.m_record_id == cursor.m_lists[cursor.m_key_id].size()) {
 
-			for (size_t i = 0; i < num_records; i++) {
-				const data_record *record = (data_record *)&buffer[i * sizeof(data_record)];
-				const uint64_t key = *((uint64_t *)&key_buffer[i * sizeof(uint64_t)]);
-				m_document_sizes[record->m_value]++;
-				m_cache[key].push_back(*record);
+			if (cursor.m_key_id < cursor.m_keys.size()) {
+				cursor.m_key_id++;
+				cursor.m_record_id = 0;
+				continue;
+			}
+
+			bool corrupt;
+			cursor.m_key_id = 0;
+			cursor.m_record_id = 0;
+			if (!read_page(cursor.m_reader, cursor.m_keys, cursor.m_lists, corrupt)) {
+				cursor.m_keys.clear();
+				cursor.m_lists.clear();
+				cursor.m_reader.close();
+				return false;
 			}
 		}
+
+		entry.m_key = cursor.m_keys[cursor.m_key_id];
+		entry.m_record = cursor.m_lists[cursor.m_key_id][cursor.m_record_id++];
+
+		return true;
 	}
 
 	/*
-	 * Reads the file into RAM.
+	 * K-way merge of the current data file and the sorted runs into new data and key files. Only the page being
+	 * written and the posting list being merged are held in memory.
 	 * */
 	template<typename data_record>
-	void index_builder<data_record>::read_data_to_cache() {
+	void index_builder<data_record>::merge_runs(std::vector<std::unique_ptr<run_reader<run_entry>>> &runs,
+		std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll) {
 
-		m_cache = std::map<uint64_t, std::vector<data_record>>{};
+		std::ofstream writer;
+		std::ofstream key_writer;
+		open_files(writer, key_writer);
 
-		std::ifstream reader(target_filename(), std::ios::binary);
-		if (!reader.is_open()) return;
+		data_file_cursor cursor;
+		cursor.m_reader.open(target_filename(), std::ios::binary);
 
-		reader.seekg(0, std::ios::end);
-		const size_t file_size = reader.tellg();
-		if (file_size == 0) return;
-		reader.seekg(0, std::ios::beg);
-
-		std::unique_ptr<char[]> buffer_allocator;
-		try {
-			buffer_allocator = std::make_unique<char[]>(m_buffer_len);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << m_buffer_len << " bytes" << std::endl;
-			return;
+		// The data file is source number runs.size().
+		auto next_from_source = [this, &runs, &cursor](size_t source, run_entry &entry) {
+			if (source == runs.size()) return next_from_data_file(cursor, entry);
+			return runs[source]->next(entry);
+		};
+
+		using heap_item = std::pair<run_entry, size_t>;
+		auto greater = [this](const heap_item &a, const heap_item &b) {
+			return entry_less(b.first, a.first);
+		};
+		std::priority_queue<heap_item, std::vector<heap_item>, decltype(greater)> heap(greater);
+
+		for (size_t source = 0; source <= runs.size(); source++) {
+			run_entry entry;
+			if (next_from_source(source, entry)) {
+				heap.emplace(entry, source);
+			}
 		}
-		m_buffer = buffer_allocator.get();
-		while (read_page(reader)) {
+
+		std::vector<uint64_t> page_keys;
+		std::vector<std::vector<data_record>> page_lists;
+		std::vector<size_t> page_totals;
+
+		auto write_current_page = [&]() {
+			std::vector<const std::vector<data_record> *> lists;
+			for (const auto &list : page_lists) {
+				lists.push_back(&list);
+			}
+			const size_t page_pos = write_page(writer, page_keys, lists, page_totals);
+			if (use_key_file()) {
+				write_key(key_writer, page_for_key(page_keys[0]), page_pos);
+			}
+			page_keys.clear();
+			page_lists.clear();
+			page_totals.clear();
+		};
+
+		auto finish_current_list = [&](merged_list &list) {
+			finish_list(list);
+			page_keys.push_back(list.m_key);
+			page_totals.push_back(m_result_counters.count(list.m_key) ? m_result_counters[list.m_key]->size() :
+				list.m_unique_count);
+			page_lists.push_back(std::move(list.m_records));
+		};
+
+		merged_list list;
+		bool has_list = false;
+
+		while (!heap.empty()) {
+			const heap_item item = heap.top();
+			heap.pop();
+
+			run_entry next;
+			if (next_from_source(item.second, next)) {
+				heap.emplace(next, item.second);
+			}
+
+			const run_entry &entry = item.first;
+			hll->insert(entry.m_record.m_value);
+
+			if (has_list && entry.m_key != list.m_key) {
+				const uint64_t page = page_for_key(list.m_key);
+				finish_current_list(list);
+				if (page_for_key(entry.m_key) != page) {
+					write_current_page();
+				}
+				has_list = false;
+			}
+
+			if (!has_list) {
+				list = merged_list{};
+				list.m_key = entry.m_key;
+				has_list = true;
+			}
+
+			add_to_list(list, entry.m_record);
 		}
+
+		if (has_list) {
+			finish_current_list(list);
+			write_current_page();
+		}
+
+		m_unique_document_count = hll->size();
+
+		writer.close();
+		key_writer.close();
 	}
 
+	/*
+	 * Records arrive in order so equal records are next to each other. The last one is kept as pending until we
+	 * know that no more records are equal to it.
+	 * */
 	template<typename data_record>
-	bool index_builder<data_record>::read_page(std::ifstream &reader) {
-
-		char buffer[64];
+	void index_builder<data_record>::add_to_list(merged_list &list, const data_record &record) {
+		if (list.m_has_pending && list.m_pending == record) {
+			list.m_pending += record;
+			return;
+		}
+		if (list.m_has_pending) {
+			keep_in_list(list, list.m_pending);
+		}
+		list.m_pending = record;
+		list.m_has_pending = true;
+	}
 
-		reader.read(buffer, 8);
+	/*
+	 * Same truncation as sort_record_list but without holding the whole list. When the list gets longer than
+	 * m_max_results we start counting the total with a hyper log log counter and the list is truncated by score
+	 * every time it reaches twice m_max_results.
+	 * */
+	template<typename data_record>
+	void index_builder<data_record>::keep_in_list(merged_list &list, const data_record &record) {
 
-		if (reader.eof()) return false;
+		list.m_unique_count++;
+		list.m_records.push_back(record);
 
-		uint64_t num_keys = *((uint64_t *)(&buffer[0]));
+		if (list.m_total_counter) {
+			list.m_total_counter->insert(record.m_value);
+		} else if (list.m_unique_count > m_max_results) {
+			list.m_total_counter = get_total_counter_for_key(list.m_key);
+			for (const data_record &kept : list.m_records) {
+				list.m_total_counter->insert(kept.m_value);
+			}
+		}
 
-		std::unique_ptr<char[]> vector_buffer_allocator;
-		try {
-			vector_buffer_allocator = std::make_unique<char[]>(num_keys * 8);
-		} catch (std::bad_alloc &exception) {
-			std::cout << "bad_alloc detected: " << exception.what() << " file: " << __FILE__ << " line: " << __LINE__ << std::endl;
-			std::cout << "tried to allocate: " << num_keys << " keys" << std::endl;
-			return false;
+		if (list.m_records.size() > 2 * m_max_results) {
+			truncate_by_score(list.m_records);
 		}
+	}
 
-		char *vector_buffer = vector_buffer_allocator.get();
+	template<typename data_record>
+	void index_builder<data_record>::finish_list(merged_list &list) {
 
-		// Read the keys.
-		reader.read(vector_buffer, num_keys * 8);
-		std::vector<uint64_t> keys;
-		for (size_t i = 0; i < num_keys; i++) {
-			keys.push_back(*((uint64_t *)(&vector_buffer[i*8])));
+		if (list.m_has_pending) {
+			keep_in_list(list, list.m_pending);
+			list.m_has_pending = false;
 		}
 
-		// Read the positions.
-		reader.read(vector_buffer, num_keys * 8);
-		std::vector<size_t> positions;
-		for (size_t i = 0; i < num_keys; i++) {
-			positions.push_back(*((size_t *)(&vector_buffer[i*8])));
+		if (list.m_records.size() > m_max_results) {
+			truncate_by_score(list.m_records);
+			// Order by value.
+			std::sort(list.m_records.begin(), list.m_records.end());
 		}
+	}
 
-		// Read the lengths.
-		reader.read(vector_buffer, num_keys * 8);
-		std::vector<size_t> lens;
-		size_t data_size = 0;
-		for (size_t i = 0; i < num_keys; i++) {
-			size_t len = *((size_t *)(&vector_buffer[i*8]));
-			m_result_sizes[keys[i]] = len / sizeof(data_record);
-			lens.push_back(len);
-			data_size += len;
-		}
-
-		// Read the totals.
-		reader.read(vector_buffer, num_keys * 8);
-
-		if (data_size == 0) return true;
-
-		// Read the data.
-		size_t total_read_data = 0;
-		size_t key_id = 0;
-		size_t num_records_for_key = lens[key_id] / sizeof(data_record);
-		while (total_read_data < data_size) {
-			const size_t to_read_now = std::min(m_buffer_len, data_size - total_read_data);
-			reader.read(m_buffer, to_read_now);
-			const size_t read_len = reader.gcount();
-
-			if (read_len == 0) {
-				LOG_INFO("Data stopped before end. Ignoring shard " + m_id);
-				m_cache = std::map<uint64_t, std::vector<data_record>>{};
-				break;
-			}
+	/*
+	 * Keeps the m_max_results records with highest score.
+	 * */
+	template<typename data_record>
+	void index_builder<data_record>::truncate_by_score(std::vector<data_record> &records) const {
+		std::nth_element(records.begin(), records.begin() + m_max_results, records.end(),
+			[](const data_record &a, const data_record &b) {
+				return a.m_score > b.m_score;
+			});
+		records.resize(m_max_results);
+	}
 
-			total_read_data += read_len;
+	template<typename data_record>
+	bool index_builder<data_record>::entry_less(const run_entry &a, const run_entry &b) const {
+		const uint64_t page_a = page_for_key(a.m_key);
+		const uint64_t page_b = page_for_key(b.m_key);
+		if (page_a != page_b) return page_a < page_b;
+		if (a.m_key != b.m_key) return a.m_key < b.m_key;
+		return a.m_record < b.m_record;
+	}
 
-			size_t num_records = read_len / sizeof(data_record);
-			for (size_t i = 0; i < num_records; i++) {
-				while (num_records_for_key == 0 && key_id < num_keys) {
-					key_id++;
-					num_records_for_key = lens[key_id] / sizeof(data_record);
-				}
+	template<typename data_record>
+	uint64_t index_builder<data_record>::page_for_key(uint64_t key) const {
+		if (m_hash_table_size) {
+			return key % m_hash_table_size;
+		}
+		return 0;
+	}
+
+	template<typename data_record>
+	void index_builder<data_record>::save_file() {
 
-				if (num_records_for_key > 0) {
+		std::ofstream writer;
+		std::ofstream key_writer;
+		open_files(writer, key_writer);
 
-					const data_record *record = (data_record *)&m_buffer[i * sizeof(data_record)];
-					
-					m_cache[keys[key_id]].push_back(*record);
+		// Iterating the sorted cache gives ascending keys within each page, index::find relies on that.
+		std::map<uint64_t, std::vector<uint64_t>> pages;
+		for (auto &iter : m_cache) {
+			pages[page_for_key(iter.first)].push_back(iter.first);
+		}
 
-					num_records_for_key--;
-				}
+		for (const auto &iter : pages) {
+			std::vector<const std::vector<data_record> *> lists;
+			std::vector<size_t> totals;
+			for (uint64_t key : iter.second) {
+				lists.push_back(&m_cache[key]);
+				totals.push_back(total_results_for_key(key));
+			}
+			const size_t page_pos = write_page(writer, iter.second, lists, totals);
+			if (use_key_file()) {
+				write_key(key_writer, iter.first, page_pos);
 			}
 		}
 
-		return true;
+		writer.close();
+		key_writer.close();
+
+		publish_files();
 	}
 
+	/*
+	 * Opens temporary files for the new data and key files. publish_files renames them into place.
+	 * */
 	template<typename data_record>
-	void index_builder<data_record>::save_file() {
+	void index_builder<data_record>::open_files(std::ofstream &writer, std::ofstream &key_writer) {
 
-		std::ofstream writer(target_filename(), std::ios::binary | std::ios::trunc);
+		writer.open(target_filename() + ".tmp", std::ios::binary | std::ios::trunc);
 		if (!writer.is_open()) {
 			throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
 		}
 
-		const bool open_keyfile = use_key_file();
-
-		std::ofstream key_writer;
-		if (open_keyfile) {
-			key_writer.open(key_filename(), std::ios::binary | std::ios::trunc);
+		if (use_key_file()) {
+			key_writer.open(key_filename() + ".tmp", std::ios::binary | std::ios::trunc);
 			if (!key_writer.is_open()) {
 				throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
 			}
 
 			reset_key_file(key_writer);
 		}
+	}
 
-		std::map<uint64_t, std::vector<uint64_t>> pages;
-		for (auto &iter : m_cache) {
-			if (m_hash_table_size) {
-				pages[iter.first % m_hash_table_size].push_back(iter.first);
-			} else {
-				pages[0].push_back(iter.first);
+	/*
+	 * Readers that have the old files mapped keep reading them until they notice that the data file has been
+	 * replaced, so the data file is renamed last. The keys file gets the inode and size of the new data file in its
+	 * trailer, rename keeps the inode so a reader can check that it mapped a keys file and a data file that belong
+	 * together.
+	 * */
+	template<typename data_record>
+	void index_builder<data_record>::publish_files() {
+		if (use_key_file()) {
+			struct stat st;
+			if (stat((target_filename() + ".tmp").c_str(), &st) != 0) {
+				throw LOG_ERROR_EXCEPTION("Could not stat full text shard. Error: " + std::string(strerror(errno)));
 			}
-		}
 
-		for (const auto &iter : pages) {
-			const size_t page_pos = write_page(writer, iter.second);
-			writer.flush();
-			if (open_keyfile) {
-				write_key(key_writer, iter.first, page_pos);
-			}
+			std::ofstream key_writer(key_filename() + ".tmp", std::ios::binary | std::ios::in | std::ios::out);
+			key_writer.seekp(m_hash_table_size * sizeof(uint64_t));
+			posting_codec::write_keys_trailer(key_writer, st.st_ino, st.st_size);
+			key_writer.close();
+
+			boost::filesystem::rename(key_filename() + ".tmp", key_filename());
 		}
+		boost::filesystem::rename(target_filename() + ".tmp", target_filename());
+
+		m_format = posting_codec::current_format;
+		files_published++;
 	}
 
 	template<typename data_record>
@@ -550,10 +936,12 @@ namespace indexer {
 	}
 
 	/*
-	 * Writes the page with keys, appending it to the file stream writer. Takes data from m_cache.
+	 * Writes the page with keys, appending it to the file stream writer. lists and totals hold the records and the
+	 * total number of results for each key.
 	 * */
 	template<typename data_record>
-	size_t index_builder<data_record>::write_page(std::ofstream &writer, const std::vector<uint64_t> &keys) {
+	size_t index_builder<data_record>::write_page(std::ofstream &writer, const std::vector<uint64_t> &keys,
+		const std::vector<const std::vector<data_record> *> &lists, const std::vector<size_t> &totals) {
 
 		const size_t page_pos = writer.tellp();
 
@@ -562,30 +950,39 @@ namespace indexer {
 		writer.write((char *)&num_keys, 8);
 		writer.write((char *)keys.data(), keys.size() * 8);
 
+		// Compressed records are encoded for the whole page first since we need the lengths in the header.
+		std::string encoded;
 		std::vector<size_t> v_pos;
 		std::vector<size_t> v_len;
-		std::vector<size_t> v_tot;
 
 		size_t pos = 0;
-		for (uint64_t key : keys) {
+		for (const std::vector<data_record> *records : lists) {
 
 			// Store position and length
-			size_t len = m_cache[key].size() * sizeof(data_record);
-			
+			size_t len = records->size() * sizeof(data_record);
+			if constexpr (posting_codec::is_compressible<data_record>()) {
+				const size_t encoded_start = encoded.size();
+				posting_codec::encode(*records, encoded);
+				len = encoded.size() - encoded_start;
+			}
+
 			v_pos.push_back(pos);
 			v_len.push_back(len);
-			v_tot.push_back(total_results_for_key(key));
 
 			pos += len;
 		}
-		
+
 		writer.write((char *)v_pos.data(), keys.size() * 8);
 		writer.write((char *)v_len.data(), keys.size() * 8);
-		writer.write((char *)v_tot.data(), keys.size() * 8);
+		writer.write((char *)totals.data(), keys.size() * 8);
 
 		// Write data.
-		for (uint64_t key : keys) {
-			writer.write((char *)m_cache[key].data(), sizeof(data_record) * m_cache[key].size());
+		if constexpr (posting_codec::is_compressible<data_record>()) {
+			writer.write(encoded.data(), encoded.size());
+		} else {
+			for (const std::vector<data_record> *records : lists) {
+				writer.write((char *)records->data(), sizeof(data_record) * records->size());
+			}
 		}
 
 		return page_pos;
@@ -695,21 +1092,19 @@ namespace indexer {
 	template<typename data_record>
 	void index_builder<data_record>::read_meta(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll) {
 
-		struct meta {
-			size_t unique_count;
-		};
-
 		std::ifstream infile(meta_filename(), std::ios::binary);
 
-		infile.seekg(0, std::ios::end);
-		//size_t meta_file_size = infile.tellg();
-
 		m_document_sizes.clear();
 		m_result_counters.clear();
+		m_format = posting_codec::format_raw;
+		m_generation = 0;
 
 		if (infile.is_open()) {
-			infile.seekg(sizeof(meta));
-			infile.read(hll->data(), hll->data_size());
+			size_t unique_count;
+			if (!posting_codec::read_meta_header(infile, m_format, unique_count, m_generation)) {
+				throw LOG_ERROR_EXCEPTION("Invalid meta file " + meta_filename());
+			}
+			read_counter(infile, hll);
 
 			size_t num_docs = 0;
 			infile.read((char *)(&num_docs), sizeof(size_t));
@@ -726,48 +1121,67 @@ namespace indexer {
 			infile.read((char *)(&num_total_counters), sizeof(size_t));
 			for (size_t i = 0; i < num_total_counters; i++) {
 				uint64_t key = 0;
-				std::shared_ptr<Algorithm::HyperLogLog<size_t>> ptr =
-					std::make_shared<Algorithm::HyperLogLog<size_t>>();
+				std::unique_ptr<Algorithm::HyperLogLog<size_t>> counter;
 				infile.read((char *)(&key), sizeof(uint64_t));
-				infile.read(ptr->data(), ptr->data_size());
-				m_result_counters[key] = ptr;
+				read_counter(infile, counter);
+				m_result_counters[key] = std::move(counter);
 			}
 		}
 	}
 
+	/*
+	 * Meta files before format_compact_counters store the counters as raw registers.
+	 * */
 	template<typename data_record>
-	void index_builder<data_record>::save_meta(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll) const {
+	void index_builder<data_record>::read_counter(std::ifstream &infile,
+		std::unique_ptr<Algorithm::HyperLogLog<size_t>> &counter) const {
 
-		struct meta {
-			size_t unique_count;
-		};
+		if (m_format >= posting_codec::format_compact_counters) {
+			counter = std::make_unique<Algorithm::HyperLogLog<size_t>>();
+			counter->deserialize(infile);
+			return;
+		}
 
-		meta m;
+		std::vector<char> registers(Algorithm::HyperLogLog<size_t>::legacy_registers_len);
+		infile.read(registers.data(), registers.size());
+		counter = std::make_unique<Algorithm::HyperLogLog<size_t>>(registers.data());
+	}
 
-		m.unique_count = hll->size();
+	/*
+	 * Writes the meta file next to the old one and renames it into place so readers never see it half written.
+	 * */
+	template<typename data_record>
+	void index_builder<data_record>::save_meta(std::unique_ptr<Algorithm::HyperLogLog<size_t>> &hll) const {
 
-		std::ofstream outfile(meta_filename(), std::ios::binary | std::ios::trunc);
+		std::ofstream outfile(meta_filename() + ".tmp", std::ios::binary | std::ios::trunc);
+		if (!outfile.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open full text shard. Error: " + std::string(strerror(errno)));
+		}
 
-		if (outfile.is_open()) {
-			outfile.write((char *)(&m), sizeof(m));
-			outfile.write(hll->data(), hll->data_size());
+		posting_codec::write_meta_header(outfile, hll->size(), m_generation);
+		hll->serialize(outfile);
 
-			// Write document sizes.
-			const size_t num_docs = m_document_sizes.size();
-			outfile.write((char *)(&num_docs), sizeof(size_t));
-			for (const auto &iter : m_document_sizes) {
-				outfile.write((char *)(&iter.first), sizeof(uint64_t));
-				outfile.write((char *)(&iter.second), sizeof(size_t));
-			}
+		// Write document sizes.
+		const size_t num_docs = m_document_sizes.size();
+		outfile.write((char *)(&num_docs), sizeof(size_t));
+		for (const auto &iter : m_document_sizes) {
+			outfile.write((char *)(&iter.first), sizeof(uint64_t));
+			outfile.write((char *)(&iter.second), sizeof(size_t));
+		}
 
-			// Write total counters.
-			const size_t num_total_counters = m_result_counters.size();
-			outfile.write((char *)(&num_total_counters), sizeof(size_t));
-			for (const auto &iter : m_result_counters) {
-				outfile.write((char *)(&iter.first), sizeof(uint64_t));
-				outfile.write(iter.second->data(), iter.second->data_size());
-			}
+		// Write total counters.
+		const size_t num_total_counters = m_result_counters.size();
+		outfile.write((char *)(&num_total_counters), sizeof(size_t));
+		for (const auto &iter : m_result_counters) {
+			outfile.write((char *)(&iter.first), sizeof(uint64_t));
+			iter.second->serialize(outfile);
+		}
+
+		outfile.close();
+		if (!outfile) {
+			throw LOG_ERROR_EXCEPTION("Could not write meta file " + meta_filename());
 		}
+		boost::filesystem::rename(meta_filename() + ".tmp", meta_filename());
 	}
 
 	template<typename data_record>
@@ -809,4 +1223,10 @@ namespace indexer {
 		return "/mnt/" + mountpoint() + "/full_text/" + m_db_name + "/" + std::to_string(m_id) + ".meta";
 	}
 
+	template<typename data_record>
+	std::string index_builder<data_record>::run_filename(size_t run) const {
+		return "/mnt/" + mountpoint() + "/full_text/" + m_db_name + "/" + std::to_string(m_id) + ".run." +
+			std::to_string(run);
+	}
+
 }
@@ -30,6 +30,7 @@
 #include "link/Link.h"
 #include "algorithm/Algorithm.h"
 #include "utils/thread_pool.hpp"
+#include "text/tokenizer.h"
 
 using namespace std;
 
@@ -114,16 +115,12 @@ namespace indexer {
 
 				uint64_t link_hash = source_url.link_hash(target_url, link_text);
 
-				vector<string> words = Text::get_expanded_full_text_words(link_text);
-				for (const string &word : words) {
-
-					const uint64_t word_hash = Hash::str(word);
-
-					link_record rec(link_hash, source_harmonic);
-					rec.m_source_domain = source_url.host_hash();
-					rec.m_target_hash = target_url.hash();
-					m_link_index_builder->add(word_hash, rec);
-				}
+				link_record rec(link_hash, source_harmonic);
+				rec.m_source_domain = source_url.host_hash();
+				rec.m_target_hash = target_url.hash();
+				text::for_each_expanded_full_text_word(link_text, [this, &rec](const text::word &word) {
+					m_link_index_builder->add(word.hash(), rec);
+				});
 			}
 			if (m_url_to_domain->has_domain(target_url.host_hash())) {
 				URL source_url(col_values[0], col_values[1]);
@@ -137,16 +134,12 @@ namespace indexer {
 
 				uint64_t link_hash = source_url.domain_link_hash(target_url, link_text);
 
-				vector<string> words = Text::get_expanded_full_text_words(link_text);
-				for (const string &word : words) {
-
-					const uint64_t word_hash = Hash::str(word);
-
-					domain_link_record rec(link_hash, source_harmonic);
-					rec.m_source_domain = source_url.host_hash();
-					rec.m_target_domain = target_url.host_hash();
-					m_domain_link_index_builder->add(word_hash, rec);
-				}
+				domain_link_record rec(link_hash, source_harmonic);
+				rec.m_source_domain = source_url.host_hash();
+				rec.m_target_domain = target_url.host_hash();
+				text::for_each_expanded_full_text_word(link_text, [this, &rec](const text::word &word) {
+					m_domain_link_index_builder->add(word.hash(), rec);
+				});
 			}
 		}
 	}
@@ -211,6 +204,31 @@ namespace indexer {
 		return res;
 	}
 
+	size_t index_tree::warm_up(const std::vector<std::string> &queries) {
+		for (const string &query : queries) {
+			find(query);
+		}
+		return queries.size();
+	}
+
+	size_t index_tree::warm_up(const std::string &filename) {
+		ifstream infile(filename);
+		if (!infile.is_open()) {
+			LOG_INFO("Could not open warm up file " + filename);
+			return 0;
+		}
+
+		vector<string> queries;
+		string line;
+		while (getline(infile, line)) {
+			if (Text::trim(line).size()) {
+				queries.push_back(line);
+			}
+		}
+
+		return warm_up(queries);
+	}
+
 	std::vector<return_record> index_tree::find_recursive(const string &query, size_t level_num,
 		const std::vector<size_t> &keys, const vector<link_record> &links,
 		const vector<domain_link_record> &domain_links) {
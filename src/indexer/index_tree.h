@@ -59,6 +59,12 @@ namespace indexer {
 
 		std::vector<return_record> find(const std::string &query);
 
+		/*
+			Runs the queries once so their posting lists are loaded into posting_cache. Returns the number of queries.
+		*/
+		size_t warm_up(const std::vector<std::string> &queries);
+		size_t warm_up(const std::string &filename);
+
 	private:
 
 		std::unique_ptr<sharded_index_builder<link_record>> m_link_index_builder;
@@ -28,6 +28,8 @@
 #include "domain_stats/domain_stats.h"
 #include "composite_index.h"
 #include "sharded_index.h"
+#include "algorithm/intersection.h"
+#include "text/tokenizer.h"
 
 using namespace std;
 
@@ -41,65 +43,34 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	std::vector<return_record> level::intersection(const vector<vector<data_record>> &input) const {
+	std::vector<return_record> level::intersection(const vector<shared_ptr<const vector<data_record>>> &input) const {
 
 		if (input.size() == 0) return {};
 
-		size_t shortest_vector_position = 0;
-		size_t shortest_len = SIZE_MAX;
-		size_t iter_index = 0;
-		for (const vector<data_record> &vec : input) {
-			if (shortest_len > vec.size()) {
-				shortest_len = vec.size();
-				shortest_vector_position = iter_index;
-			}
-			iter_index++;
+		vector<std::span<const data_record>> spans;
+		for (const auto &records : input) {
+			spans.emplace_back(*records);
 		}
 
-		vector<size_t> positions(input.size(), 0);
-		vector<return_record> intersection;
-
-		while (positions[shortest_vector_position] < shortest_len) {
-
-			bool all_equal = true;
-			data_record value = input[shortest_vector_position][positions[shortest_vector_position]];
-
-			float score_sum = 0.0f;
-			size_t iter_index = 0;
-			for (const vector<data_record> &vec : input) {
-				const size_t len = vec.size();
-
-				size_t *pos = &(positions[iter_index]);
-				while (*pos < len && value.m_value > vec[*pos].m_value) {
-					(*pos)++;
-				}
-				if (*pos < len && value.m_value == vec[*pos].m_value) {
-					score_sum += vec[*pos].m_score;
-				}
-				if (((*pos < len) && (value.m_value < vec[*pos].m_value)) || *pos >= len) {
-					all_equal = false;
-					break;
-				}
-				iter_index++;
-			}
-			if (all_equal) {
-				intersection.emplace_back(generic_record(
-					input[shortest_vector_position][positions[shortest_vector_position]].m_value,
-					score_sum / input.size()
-					));
-			}
+		// Sum the scores of the matching records and return the average.
+		vector<data_record> intersected = ::algorithm::intersection<data_record>(spans, [](data_record &a, const data_record &b) {
+			a.m_score += b.m_score;
+		});
 
-			positions[shortest_vector_position]++;
+		vector<return_record> intersection;
+		intersection.reserve(intersected.size());
+		for (const data_record &record : intersected) {
+			intersection.emplace_back(generic_record(record.m_value, record.m_score / input.size()));
 		}
 
 		return intersection;
 	}
 
 	template<typename data_record>
-	std::vector<return_record> level::summed_union(const vector<vector<data_record>> &input) const {
+	std::vector<return_record> level::summed_union(const vector<shared_ptr<const vector<data_record>>> &input) const {
 		vector<return_record> records;
-		for (const vector<data_record> &vec : input) {
-			for (const data_record &rec : vec) {
+		for (const auto &vec : input) {
+			for (const data_record &rec : *vec) {
 				records.push_back(return_record(rec.m_value, rec.m_score));
 			}
 		}
@@ -128,7 +99,8 @@ namespace indexer {
 		}
 	}
 
-	domain_level::domain_level() {
+	domain_level::domain_level()
+	: m_index(std::make_unique<sharded_index<domain_record>>("domain", 1024)) {
 		clean_up();
 	}
 
@@ -143,10 +115,9 @@ namespace indexer {
 	}
 
 	void domain_level::add_document(size_t id, const string &doc) {
-		std::vector<std::string> words = Text::get_full_text_words(doc);
-		for (std::string &word : words) {
-			m_builder->add(Hash::str(word), domain_record(id));
-		}
+		text::for_each_full_text_word(doc, [this, id](const text::word &word) {
+			m_builder->add(word.hash(), domain_record(id));
+		});
 	}
 
 	void domain_level::add_index_file(const std::string &local_path,
@@ -172,10 +143,9 @@ namespace indexer {
 			const string site_colon = "site:" + url.host() + " site:www." + url.host() + " " + url.host() + " " + url.domain_without_tld();
 
 			for (size_t col : cols) {
-				vector<string> words = Text::get_full_text_words(col_values[col]);
-				for (const string &word : words) {
-					m_builder->add(Hash::str(word), domain_record(domain_hash, harmonic));
-				}
+				text::for_each_full_text_word(col_values[col], [this, domain_hash, harmonic](const text::word &word) {
+					m_builder->add(word.hash(), domain_record(domain_hash, harmonic));
+				});
 			}
 		}
 	}
@@ -196,15 +166,10 @@ namespace indexer {
 	std::vector<return_record> domain_level::find(const string &query, const std::vector<size_t> &keys,
 		const vector<link_record> &links, const vector<domain_link_record> &domain_links) {
 
-		std::vector<std::string> words = Text::get_full_text_words(query);
-		
-		sharded_index<domain_record> idx("domain", 1024);
-
-		std::vector<std::vector<domain_record>> results;
-		for (const string &word : words) {
-			size_t token = Hash::str(word);
-			results.push_back(idx.find(token));
-		}
+		std::vector<std::shared_ptr<const std::vector<domain_record>>> results;
+		text::for_each_full_text_word(query, [this, &results](const text::word &word) {
+			results.push_back(m_index->find(word.hash()));
+		});
 		std::vector<return_record> intersected = intersection(results);
 		apply_domain_links(domain_links, intersected);
 		sort_and_get_top_results(intersected, 100); // Pick top 100 domains.
@@ -244,7 +209,8 @@ namespace indexer {
 		return applied_links;
 	}
 
-	url_level::url_level() {
+	url_level::url_level()
+	: m_index(std::make_unique<composite_index<url_record>>("url", 10007)) {
 		clean_up();
 	}
 
@@ -282,10 +248,9 @@ namespace indexer {
 			add_data(url_hash, col_values[0] + "\t" + col_values[1]);
 
 			for (size_t col : cols) {
-				vector<string> words = Text::get_full_text_words(col_values[col]);
-				for (const string &word : words) {
-					m_builder->add(domain_hash, Hash::str(word), url_record(url_hash));
-				}
+				text::for_each_full_text_word(col_values[col], [this, domain_hash, url_hash](const text::word &word) {
+					m_builder->add(domain_hash, word.hash(), url_record(url_hash));
+				});
 			}
 		}
 	}
@@ -303,15 +268,15 @@ namespace indexer {
 	std::vector<return_record> url_level::find(const string &query, const std::vector<size_t> &keys,
 		const vector<link_record> &links, const vector<domain_link_record> &domain_links) {
 
-		std::vector<std::string> words = Text::get_full_text_words(query);
+		std::vector<size_t> tokens;
+		text::for_each_full_text_word(query, [&tokens](const text::word &word) {
+			tokens.push_back(word.hash());
+		});
 		std::vector<return_record> all_results;
 		for (size_t key : keys) {
-			composite_index<url_record> idx("url", 10007);
-
-			std::vector<std::vector<url_record>> results;
-			for (const string &word : words) {
-				size_t token = Hash::str(word);
-				results.push_back(idx.find(key, token));
+			std::vector<std::shared_ptr<const std::vector<url_record>>> results;
+			for (size_t token : tokens) {
+				results.push_back(m_index->find(key, token));
 			}
 			std::vector<return_record> intersected = intersection(results);
 			apply_url_links(links, intersected);
@@ -354,7 +319,8 @@ namespace indexer {
 		return applied_links;
 	}
 
-	snippet_level::snippet_level() {
+	snippet_level::snippet_level()
+	: m_index(std::make_unique<composite_index<snippet_record>>("snippet", 10007)) {
 		clean_up();
 	}
 
@@ -414,15 +380,15 @@ namespace indexer {
 	std::vector<return_record> snippet_level::find(const string &query, const std::vector<size_t> &keys,
 		const vector<link_record> &links, const vector<domain_link_record> &domain_links) {
 
-		std::vector<std::string> words = Text::get_full_text_words(query);
+		std::vector<size_t> tokens;
+		text::for_each_full_text_word(query, [&tokens](const text::word &word) {
+			tokens.push_back(word.hash());
+		});
 		std::vector<return_record> all_results;
 		for (size_t key : keys) {
-			composite_index<snippet_record> idx("snippet", 10007);
-
-			std::vector<std::vector<snippet_record>> results;
-			for (const string &word : words) {
-				size_t token = Hash::str(word);
-				results.push_back(idx.find(key, token));
+			std::vector<std::shared_ptr<const std::vector<snippet_record>>> results;
+			for (size_t token : tokens) {
+				results.push_back(m_index->find(key, token));
 			}
 			std::vector<return_record> summed_results = summed_union(results);
 			sort_and_get_top_results(summed_results, 2); // Pick top 2 snippets.
@@ -35,6 +35,9 @@
 #include "composite_index_builder.h"
 #include "sharded_index_builder.h"
 #include "index.h"
+#include "generic_record.h"
+#include "sharded_index.h"
+#include "composite_index.h"
 
 namespace indexer {
 
@@ -43,45 +46,6 @@ namespace indexer {
 
 	std::string level_to_str(level_type lvl);
 
-	/*
-	This is the base class for the record stored on disk. Needs to be small!
-	*/
-	#pragma pack(4)
-	class generic_record {
-
-		public:
-		uint64_t m_value;
-		float m_score;
-		uint32_t m_count = 1;
-
-		generic_record() : m_value(0), m_score(0.0f) {};
-		generic_record(uint64_t value) : m_value(value), m_score(0.0f) {};
-		generic_record(uint64_t value, float score) : m_value(value), m_score(score) {};
-
-		size_t count() const { return (size_t)m_count; }
-
-		bool operator==(const generic_record &b) const {
-			return m_value == b.m_value;
-		}
-
-		bool operator<(const generic_record &b) const {
-			return m_value < b.m_value;
-		}
-
-		generic_record operator+(const generic_record &b) const {
-			generic_record sum;
-			sum.m_value = m_value;
-			sum.m_count = m_count + b.m_count;
-			return sum;
-		}
-
-		generic_record &operator+=(const generic_record &b) {
-			m_count += b.m_count;
-			return *this;
-		}
-
-	};
-
 	/*
 	This is the returned record from the index_tree. It contains more data than the stored record.
 	*/
@@ -120,10 +84,12 @@ namespace indexer {
 
 		protected:
 		template<typename data_record>
-		std::vector<return_record> intersection(const std::vector<std::vector<data_record>> &input) const;
+		std::vector<return_record> intersection(
+			const std::vector<std::shared_ptr<const std::vector<data_record>>> &input) const;
 
 		template<typename data_record>
-		std::vector<return_record> summed_union(const std::vector<std::vector<data_record>> &input) const;
+		std::vector<return_record> summed_union(
+			const std::vector<std::shared_ptr<const std::vector<data_record>>> &input) const;
 
 		template<typename data_record>
 		void sort_and_get_top_results(std::vector<data_record> &input, size_t num_results) const;
@@ -143,6 +109,7 @@ namespace indexer {
 	class domain_level: public level {
 		private:
 		std::shared_ptr<sharded_index_builder<domain_record>> m_builder;
+		std::unique_ptr<sharded_index<domain_record>> m_index;
 		public:
 		domain_level();
 		level_type get_type() const;
@@ -166,6 +133,7 @@ namespace indexer {
 	class url_level: public level {
 		private:
 		std::shared_ptr<composite_index_builder<url_record>> m_builder;
+		std::unique_ptr<composite_index<url_record>> m_index;
 		public:
 		url_level();
 		level_type get_type() const;
@@ -189,6 +157,7 @@ namespace indexer {
 	class snippet_level: public level {
 		private:
 		std::shared_ptr<composite_index_builder<snippet_record>> m_builder;
+		std::unique_ptr<composite_index<snippet_record>> m_index;
 		public:
 		snippet_level();
 		level_type get_type() const;
@@ -25,10 +25,13 @@
  */
 
 #include "merger.h"
+#include "config.h"
 #include "memory/memory.h"
 #include "memory/debugger.h"
 #include "utils/thread_pool.hpp"
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -38,102 +41,194 @@ namespace indexer {
 
 	namespace merger {
 
-		bool is_merging = false;
-		map<size_t, std::function<void()>> mergers;
-		map<size_t, std::function<void()>> appenders;
+		builder_state::builder_state(size_t id, size_t disk, std::function<size_t()> memory_usage,
+			std::function<void()> append, std::function<void()> merge)
+		: m_id(id), m_disk(disk), m_memory_usage(memory_usage), m_append(append), m_merge(merge) {
+		}
 
-		void wait_for_merges() {
-			while (is_merging) {
-				std::this_thread::sleep_for(100ms);
-			}
+		void builder_state::wait_while_flushing() {
+			if (!m_flushing.load(memory_order_acquire)) return;
+
+			unique_lock<mutex> lock(m_lock);
+			m_condition.wait(lock, [this]() { return !m_flushing.load(memory_order_acquire); });
 		}
 
-		void lock() {
-			if (is_merging) {
-				wait_for_merges();
+		bool builder_state::run_flush(const std::function<void()> &fun) {
+			{
+				unique_lock<mutex> lock(m_lock);
+				m_condition.wait(lock, [this]() { return !m_flushing.load(memory_order_acquire); });
+				if (m_deregistered) return false;
+				m_flushing.store(true, memory_order_release);
 			}
-		}
 
-		void register_appender(size_t id, std::function<void()> append) {
-			appenders[id] = append;
+			fun();
+
+			{
+				lock_guard<mutex> lock(m_lock);
+				m_flushing.store(false, memory_order_release);
+			}
+			m_condition.notify_all();
+
+			return true;
 		}
 
-		void register_merger(size_t id, std::function<void()> merge) {
-			mergers[id] = merge;
+		void builder_state::deregister() {
+			unique_lock<mutex> lock(m_lock);
+			m_condition.wait(lock, [this]() { return !m_flushing.load(memory_order_acquire); });
+			m_deregistered = true;
 		}
 
-		void deregister_merger(size_t id) {
-			appenders.erase(id);
-			mergers.erase(id);
+		mutex builders_lock;
+		map<size_t, shared_ptr<builder_state>> builders;
+
+		shared_ptr<builder_state> register_builder(size_t id, size_t disk, std::function<size_t()> memory_usage,
+			std::function<void()> append, std::function<void()> merge) {
+
+			auto state = make_shared<builder_state>(id, disk, memory_usage, append, merge);
+
+			lock_guard<mutex> lock(builders_lock);
+			builders[id] = state;
+
+			return state;
 		}
 
-		bool merge_thread_is_running = true;
-		thread merge_thread_obj;
+		void deregister_builder(size_t id) {
+			shared_ptr<builder_state> state;
+			{
+				lock_guard<mutex> lock(builders_lock);
+				auto iter = builders.find(id);
+				if (iter == builders.end()) return;
+				state = iter->second;
+				builders.erase(iter);
+			}
+			state->deregister();
+		}
 
-		void append_all() {
-			is_merging = true;
-			this_thread::sleep_for(1000ms);
+		vector<shared_ptr<builder_state>> registered_builders() {
+			vector<shared_ptr<builder_state>> states;
+			lock_guard<mutex> lock(builders_lock);
+			for (auto &iter : builders) {
+				states.push_back(iter.second);
+			}
+			return states;
+		}
 
-			size_t available_memory = memory::get_total_memory();
+		/*
+		 * Runs the job for every builder with one thread pool per disk. The builders are queued by the memory they
+		 * hold, largest first.
+		 * */
+		void run_per_disk(const vector<shared_ptr<builder_state>> &states,
+			const std::function<void(builder_state &)> &job) {
 
-			std::cout << "APPENDING ALL: " << appenders.size() << " mergers allocated memory: " << memory::allocated_memory() << " limit is: " << (available_memory * 5) << std::endl;
-			
-			utils::thread_pool pool(24);
+			map<size_t, vector<pair<size_t, shared_ptr<builder_state>>>> by_disk;
+			for (const shared_ptr<builder_state> &state : states) {
+				by_disk[state->disk()].emplace_back(state->memory_usage(), state);
+			}
 
-			for (auto &iter : appenders) {
-				pool.enqueue([iter]() {
-					iter.second();
+			vector<unique_ptr<utils::thread_pool>> pools;
+			for (auto &iter : by_disk) {
+				auto &disk_states = iter.second;
+				sort(disk_states.begin(), disk_states.end(), [](const auto &a, const auto &b) {
+					return a.first > b.first;
 				});
+
+				pools.push_back(make_unique<utils::thread_pool>(max<size_t>(1, Config::merger_threads_per_disk)));
+				for (auto &disk_state : disk_states) {
+					shared_ptr<builder_state> state = disk_state.second;
+					pools.back()->enqueue([state, &job]() {
+						job(*state);
+					});
+				}
+			}
+
+			for (auto &pool : pools) {
+				pool->run_all();
 			}
+		}
+
+		void append_largest(size_t max_memory) {
 
-			pool.run_all();
+			const vector<shared_ptr<builder_state>> states = registered_builders();
+
+			std::cout << "APPENDING LARGEST: " << states.size() << " builders allocated memory: "
+				<< memory::allocated_memory() << " target is: " << max_memory << std::endl;
+
+			run_per_disk(states, [max_memory](builder_state &state) {
+				if (memory::allocated_memory() < max_memory) return;
+				if (state.memory_usage() == 0) return;
+				state.append();
+			});
 
 			cout << "done... allocated memory: " << memory::allocated_memory() << endl;
+		}
+
+		void append_all() {
+
+			const vector<shared_ptr<builder_state>> states = registered_builders();
+
+			std::cout << "APPENDING ALL: " << states.size() << " builders allocated memory: "
+				<< memory::allocated_memory() << std::endl;
+
+			run_per_disk(states, [](builder_state &state) {
+				state.append();
+			});
 
-			is_merging = false;
+			cout << "done... allocated memory: " << memory::allocated_memory() << endl;
 		}
 
 		void merge_all() {
-			is_merging = true;
-			this_thread::sleep_for(1000ms);
 
-			size_t available_memory = memory::get_total_memory();
+			const vector<shared_ptr<builder_state>> states = registered_builders();
 
-			std::cout << "MERGING ALL: " << mergers.size() << " mergers allocated memory: " << memory::allocated_memory() << " limit is: " << (available_memory * 0.5) << std::endl;
-			
-			utils::thread_pool pool(24);
+			std::cout << "MERGING ALL: " << states.size() << " builders allocated memory: "
+				<< memory::allocated_memory() << std::endl;
 
-			for (auto &iter : mergers) {
-				pool.enqueue([iter]() {
-					iter.second();
-				});
-			}
-
-			pool.run_all();
+			run_per_disk(states, [](builder_state &state) {
+				state.merge();
+			});
 
 			cout << "done... allocated memory: " << memory::allocated_memory() << endl;
-
-			is_merging = false;
 		}
 
+		mutex merge_thread_lock;
+		condition_variable merge_thread_condition;
+		bool merge_thread_is_running = false;
+		thread merge_thread_obj;
+
+		/*
+		 * Starts flushing when half of the memory is allocated and stops when 40% is, so the largest builders are
+		 * written and the rest keep indexing.
+		 * */
 		void merge_thread() {
 			memory::update();
-			size_t available_memory = memory::get_total_memory();
+			const size_t available_memory = memory::get_total_memory();
+
+			unique_lock<mutex> lock(merge_thread_lock);
 			while (merge_thread_is_running) {
+				// Aggregates the per thread allocation counters.
 				if (memory::allocated_memory() > available_memory * 0.5) {
-					append_all();
+					lock.unlock();
+					append_largest(available_memory * 0.4);
+					lock.lock();
 				}
-				this_thread::sleep_for(100ms);
+				merge_thread_condition.wait_for(lock, 100ms, []() { return !merge_thread_is_running; });
 			}
 		}
 
 		void start_merge_thread() {
-			merge_thread_is_running = true;
-			merge_thread_obj = std::move(thread(merge_thread));
+			{
+				lock_guard<mutex> lock(merge_thread_lock);
+				merge_thread_is_running = true;
+			}
+			merge_thread_obj = thread(merge_thread);
 		}
 
 		void stop_merge_thread() {
-			merge_thread_is_running = false;
+			{
+				lock_guard<mutex> lock(merge_thread_lock);
+				merge_thread_is_running = false;
+			}
+			merge_thread_condition.notify_all();
 			merge_thread_obj.join();
 			append_all();
 			merge_all();
@@ -28,16 +28,72 @@
 
 #include <iostream>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 using namespace std;
 
 namespace indexer {
 
 	namespace merger {
-		void lock();
-		void register_merger(size_t id, std::function<void()> merge);
-		void register_appender(size_t id, std::function<void()> append);
-		void deregister_merger(size_t id);
+
+		/*
+		 * A builder registered with the merge scheduler. memory_usage returns the estimated number of bytes the builder
+		 * holds in memory, append flushes them to the cache files on its disk and merge merges the cache files into
+		 * the index.
+		 * */
+		class builder_state {
+		public:
+			builder_state(size_t id, size_t disk, std::function<size_t()> memory_usage, std::function<void()> append,
+				std::function<void()> merge);
+
+			/*
+			 * Called by add(), blocks only while this builder is being flushed.
+			 * */
+			void wait_while_flushing();
+
+			size_t id() const { return m_id; }
+			size_t disk() const { return m_disk; }
+			size_t memory_usage() const { return m_memory_usage(); }
+
+			/*
+			 * Runs append or merge with add() callers held back. Returns false if the builder was deregistered.
+			 * */
+			bool run_flush(const std::function<void()> &fun);
+			bool append() { return run_flush(m_append); }
+			bool merge() { return run_flush(m_merge); }
+
+			/*
+			 * Waits for a running flush to finish and prevents new ones.
+			 * */
+			void deregister();
+
+		private:
+			const size_t m_id;
+			const size_t m_disk;
+			std::function<size_t()> m_memory_usage;
+			std::function<void()> m_append;
+			std::function<void()> m_merge;
+
+			std::mutex m_lock;
+			std::condition_variable m_condition;
+			std::atomic<bool> m_flushing = false;
+			bool m_deregistered = false;
+		};
+
+		std::shared_ptr<builder_state> register_builder(size_t id, size_t disk, std::function<size_t()> memory_usage,
+			std::function<void()> append, std::function<void()> merge);
+		void deregister_builder(size_t id);
+
+		/*
+		 * Flushes the builders with the most data in memory first until the allocated memory is below max_memory.
+		 * Every disk runs at most Config::merger_threads_per_disk flushes at a time.
+		 * */
+		void append_largest(size_t max_memory);
+		void append_all();
+		void merge_all();
 
 		void start_merge_thread();
 		void stop_merge_thread();
@@ -0,0 +1,235 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "posting_cache.h"
+#include "config.h"
+
+namespace indexer {
+
+	namespace {
+		uint64_t mix(uint64_t x) {
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdull;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ull;
+			x ^= x >> 33;
+			return x;
+		}
+	}
+
+	posting_cache::frequency_sketch::frequency_sketch(size_t width)
+	: m_counters(width * 4, 0), m_mask(width - 1), m_sample_size(width * 10) {
+	}
+
+	size_t posting_cache::frequency_sketch::index(uint64_t hash, size_t row) const {
+		// Each row uses 16 different bits of the hash.
+		return row * (m_mask + 1) + ((hash >> (row * 16)) & m_mask);
+	}
+
+	void posting_cache::frequency_sketch::increment(uint64_t hash) {
+		bool added = false;
+		for (size_t row = 0; row < 4; row++) {
+			uint8_t &counter = m_counters[index(hash, row)];
+			if (counter < 15) {
+				counter++;
+				added = true;
+			}
+		}
+		if (added && ++m_additions >= m_sample_size) {
+			reset();
+		}
+	}
+
+	size_t posting_cache::frequency_sketch::estimate(uint64_t hash) const {
+		size_t min = 15;
+		for (size_t row = 0; row < 4; row++) {
+			min = std::min<size_t>(min, m_counters[index(hash, row)]);
+		}
+		return min;
+	}
+
+	void posting_cache::frequency_sketch::reset() {
+		for (uint8_t &counter : m_counters) {
+			counter >>= 1;
+		}
+		m_additions /= 2;
+	}
+
+	posting_cache::posting_cache(size_t capacity, size_t num_shards)
+	: m_capacity(0), m_num_shards(num_shards) {
+		set_capacity(capacity);
+	}
+
+	posting_cache::~posting_cache() {
+	}
+
+	posting_cache &posting_cache::instance() {
+		static posting_cache cache(Config::posting_cache_mb * 1024ull * 1024ull);
+		return cache;
+	}
+
+	std::shared_ptr<const void> posting_cache::find(uint64_t index_id, uint64_t key, uint64_t generation) {
+
+		if (!enabled()) return nullptr;
+
+		const uint64_t hash = entry_hash(index_id, key);
+		shard &s = shard_for(hash);
+
+		std::lock_guard<std::mutex> guard(s.m_lock);
+		s.m_sketch.increment(hash);
+
+		auto iter = s.m_entries.find(hash);
+		if (iter == s.m_entries.end() || iter->second->m_index_id != index_id || iter->second->m_key != key) {
+			m_misses++;
+			return nullptr;
+		}
+
+		if (iter->second->m_generation != generation) {
+			erase(s, iter->second);
+			m_invalidations++;
+			m_misses++;
+			return nullptr;
+		}
+
+		// Move to the front of the LRU list.
+		s.m_lru.splice(s.m_lru.begin(), s.m_lru, iter->second);
+		m_hits++;
+
+		return s.m_lru.front().m_value;
+	}
+
+	bool posting_cache::insert(uint64_t index_id, uint64_t key, uint64_t generation, std::shared_ptr<const void> value,
+		size_t bytes) {
+
+		const size_t capacity = shard_capacity();
+		if (bytes > capacity) {
+			if (enabled()) m_rejections++;
+			return false;
+		}
+
+		const uint64_t hash = entry_hash(index_id, key);
+		shard &s = shard_for(hash);
+
+		std::lock_guard<std::mutex> guard(s.m_lock);
+
+		auto existing = s.m_entries.find(hash);
+		if (existing != s.m_entries.end()) {
+			erase(s, existing->second);
+		}
+
+		if (s.m_size + bytes > capacity) {
+			// Only evict if the candidate is more popular than every entry it would push out.
+			const size_t candidate_frequency = s.m_sketch.estimate(hash);
+			size_t freed = 0;
+			for (auto iter = s.m_lru.rbegin(); iter != s.m_lru.rend() && s.m_size - freed + bytes > capacity; iter++) {
+				if (s.m_sketch.estimate(entry_hash(iter->m_index_id, iter->m_key)) >= candidate_frequency) {
+					m_rejections++;
+					return false;
+				}
+				freed += iter->m_bytes;
+			}
+			evict_to(s, capacity - bytes);
+		}
+
+		s.m_lru.push_front(entry{index_id, key, generation, std::move(value), bytes});
+		s.m_entries[hash] = s.m_lru.begin();
+		s.m_size += bytes;
+		m_insertions++;
+
+		return true;
+	}
+
+	void posting_cache::set_capacity(size_t capacity) {
+		// The shards are allocated the first time the cache is enabled so a disabled cache costs nothing.
+		if (capacity && m_shards.empty()) {
+			for (size_t i = 0; i < m_num_shards; i++) {
+				m_shards.emplace_back(std::make_unique<shard>());
+			}
+		}
+		m_capacity = capacity;
+		const size_t per_shard = shard_capacity();
+		for (auto &s : m_shards) {
+			std::lock_guard<std::mutex> guard(s->m_lock);
+			evict_to(*s, per_shard);
+		}
+	}
+
+	void posting_cache::clear() {
+		for (auto &s : m_shards) {
+			std::lock_guard<std::mutex> guard(s->m_lock);
+			s->m_lru.clear();
+			s->m_entries.clear();
+			s->m_size = 0;
+		}
+	}
+
+	posting_cache::stats posting_cache::get_stats() const {
+		stats ret;
+		ret.m_hits = m_hits;
+		ret.m_misses = m_misses;
+		ret.m_insertions = m_insertions;
+		ret.m_evictions = m_evictions;
+		ret.m_rejections = m_rejections;
+		ret.m_invalidations = m_invalidations;
+		ret.m_capacity = m_capacity;
+		for (auto &s : m_shards) {
+			std::lock_guard<std::mutex> guard(s->m_lock);
+			ret.m_size += s->m_size;
+		}
+		return ret;
+	}
+
+	uint64_t posting_cache::entry_hash(uint64_t index_id, uint64_t key) {
+		return mix(index_id ^ mix(key));
+	}
+
+	posting_cache::shard &posting_cache::shard_for(uint64_t hash) {
+		// The sketch rows use the bits of the hash directly so pick the shard from a remixed hash.
+		return *m_shards[mix(hash) % m_shards.size()];
+	}
+
+	size_t posting_cache::shard_capacity() const {
+		if (m_shards.empty()) return 0;
+		return m_capacity / m_shards.size();
+	}
+
+	void posting_cache::erase(shard &s, std::list<entry>::iterator iter) {
+		s.m_size -= iter->m_bytes;
+		s.m_entries.erase(entry_hash(iter->m_index_id, iter->m_key));
+		s.m_lru.erase(iter);
+	}
+
+	/*
+	 * Evicts from the back of the LRU list until the shard holds at most size bytes.
+	 * */
+	void posting_cache::evict_to(shard &s, size_t size) {
+		while (s.m_size > size && s.m_lru.size()) {
+			erase(s, std::prev(s.m_lru.end()));
+			m_evictions++;
+		}
+	}
+
+}
@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+namespace indexer {
+
+	/*
+	 * Process wide cache of posting lists read by index::find, see documentation/caching.md.
+	 *
+	 * The cache is split in shards with their own lock, LRU list and byte budget. A new list is only admitted when
+	 * the shard is full if it has been requested more often than the lists it would evict (TinyLFU). Request
+	 * frequencies are estimated with a count-min sketch of 4 bit counters that is halved regularly so old
+	 * popularity fades.
+	 *
+	 * Entries are tagged with the generation of the index files they were read from. A lookup with another
+	 * generation drops the entry, so everything cached from a shard is invalidated when index_builder::merge
+	 * publishes new files.
+	 *
+	 * Values are type erased, the caller decides what it stores for an index_id.
+	 * */
+	class posting_cache {
+
+	public:
+
+		struct stats {
+			size_t m_hits = 0;
+			size_t m_misses = 0;
+			size_t m_insertions = 0;
+			size_t m_evictions = 0;
+			size_t m_rejections = 0;
+			size_t m_invalidations = 0;
+			size_t m_size = 0;
+			size_t m_capacity = 0;
+
+			double hit_rate() const { return (m_hits + m_misses) ? (double)m_hits / (m_hits + m_misses) : 0.0; }
+		};
+
+		posting_cache(size_t capacity, size_t num_shards = 16);
+		~posting_cache();
+
+		/*
+		 * The cache used by index, sized by Config::posting_cache_mb. Disabled when the size is 0.
+		 * */
+		static posting_cache &instance();
+
+		bool enabled() const { return m_capacity > 0; }
+
+		/*
+		 * Returns the cached value or nullptr. Counts the request for the admission policy.
+		 * */
+		std::shared_ptr<const void> find(uint64_t index_id, uint64_t key, uint64_t generation);
+
+		/*
+		 * Offers a value of the given size in bytes to the cache. Returns false if it was not admitted.
+		 * */
+		bool insert(uint64_t index_id, uint64_t key, uint64_t generation, std::shared_ptr<const void> value,
+			size_t bytes);
+
+		/*
+		 * Changes the byte budget, evicting entries if needed. 0 disables the cache and drops everything. Enabling the
+		 * cache the first time is not safe while other threads use it.
+		 * */
+		void set_capacity(size_t capacity);
+		void clear();
+
+		stats get_stats() const;
+
+	private:
+
+		struct entry {
+			uint64_t m_index_id;
+			uint64_t m_key;
+			uint64_t m_generation;
+			std::shared_ptr<const void> m_value;
+			size_t m_bytes;
+		};
+
+		/*
+		 * Count-min sketch with 4 rows of 4 bit counters.
+		 * */
+		class frequency_sketch {
+		public:
+			explicit frequency_sketch(size_t width);
+			void increment(uint64_t hash);
+			size_t estimate(uint64_t hash) const;
+		private:
+			std::vector<uint8_t> m_counters;
+			size_t m_mask;
+			size_t m_additions = 0;
+			size_t m_sample_size;
+			size_t index(uint64_t hash, size_t row) const;
+			void reset();
+		};
+
+		struct shard {
+			std::mutex m_lock;
+			std::list<entry> m_lru;
+			std::unordered_map<uint64_t, std::list<entry>::iterator> m_entries;
+			size_t m_size = 0;
+			frequency_sketch m_sketch;
+
+			shard() : m_sketch(4096) {}
+		};
+
+		std::atomic<size_t> m_capacity;
+		const size_t m_num_shards;
+		std::vector<std::unique_ptr<shard>> m_shards;
+
+		std::atomic<size_t> m_hits = 0;
+		std::atomic<size_t> m_misses = 0;
+		std::atomic<size_t> m_insertions = 0;
+		std::atomic<size_t> m_evictions = 0;
+		std::atomic<size_t> m_rejections = 0;
+		std::atomic<size_t> m_invalidations = 0;
+
+		// Non copyable
+		posting_cache(const posting_cache &);
+		posting_cache &operator=(const posting_cache &);
+
+		static uint64_t entry_hash(uint64_t index_id, uint64_t key);
+		shard &shard_for(uint64_t hash);
+		size_t shard_capacity() const;
+		void erase(shard &s, std::list<entry>::iterator iter);
+		void evict_to(shard &s, size_t size);
+
+	};
+
+}
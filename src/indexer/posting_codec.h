@@ -0,0 +1,244 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include "generic_record.h"
+
+namespace indexer {
+
+	/*
+	 * Encoding of the record lists stored in the .data pages and of the header of the .meta file.
+	 *
+	 * Format 0 stores the records raw. Format 1 compresses lists of records that have the same layout as
+	 * generic_record like this:
+	 *
+	 * [varint num_records][num_records varint value deltas][num_records bfloat16 scores][num_records varint counts]
+	 *
+	 * The values are sorted so the first delta is the value itself and the rest are differences to the previous
+	 * value. Other record types are stored raw also in format 1.
+	 *
+	 * Meta files written before format 1 start with the unique document count. Newer meta files start with
+	 * meta_magic, the format version and then the unique document count. Meta files starting with
+	 * meta_magic_generation also store the generation that index_builder bumps every time it publishes new files.
+	 *
+	 * Format 2 pages are the same as format 1 but the hyper log log counters in the meta file are stored with
+	 * HyperLogLog::serialize instead of as 2^15 raw registers each.
+	 *
+	 * The .keys file can end with a trailer after the hash table: keys_magic followed by the inode and the size of
+	 * the .data file it was written with. index_builder renames the two files one at a time so the reader uses the
+	 * trailer to tell if it opened files from two different merges.
+	 * */
+	namespace posting_codec {
+
+		const uint64_t meta_magic = 0x41544d4c58454c41ull;
+		const uint64_t meta_magic_generation = 0x41544d4c58454c42ull;
+		const uint64_t keys_magic = 0x41544d4c58454c43ull;
+		const size_t keys_trailer_len = 3 * sizeof(uint64_t);
+		const uint64_t format_raw = 0;
+		const uint64_t format_compressed = 1;
+		const uint64_t format_compact_counters = 2;
+		const uint64_t current_format = format_compact_counters;
+
+		template<typename data_record>
+		constexpr bool is_compressible() {
+			return std::is_base_of_v<generic_record, data_record> && sizeof(data_record) == sizeof(generic_record);
+		}
+
+		template<typename data_record>
+		constexpr bool is_compressed(uint64_t format) {
+			return format >= format_compressed && is_compressible<data_record>();
+		}
+
+		inline void encode_varint(uint64_t value, std::string &dest) {
+			while (value >= 0x80) {
+				dest.push_back((char)((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			dest.push_back((char)value);
+		}
+
+		/*
+		 * Decodes a varint at position pos and moves pos past it. Returns false if the data ends before the varint.
+		 * */
+		inline bool decode_varint(const char *data, size_t len, size_t &pos, uint64_t &value) {
+			value = 0;
+			for (size_t shift = 0; shift < 64 && pos < len; shift += 7) {
+				const uint8_t byte = (uint8_t)data[pos++];
+				value |= (uint64_t)(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			return false;
+		}
+
+		/*
+		 * Scores are stored as bfloat16, the upper 16 bits of the float rounded to nearest even. This keeps the
+		 * exponent so ordering is preserved and the relative error is below 0.4%.
+		 * */
+		inline uint16_t quantize_score(float score) {
+			uint32_t bits;
+			memcpy(&bits, &score, sizeof(bits));
+			bits += 0x7FFF + ((bits >> 16) & 1);
+			return (uint16_t)(bits >> 16);
+		}
+
+		inline float dequantize_score(uint16_t quantized) {
+			const uint32_t bits = (uint32_t)quantized << 16;
+			float score;
+			memcpy(&score, &bits, sizeof(score));
+			return score;
+		}
+
+		/*
+		 * Appends the encoded records to dest. The records must be sorted by m_value.
+		 * */
+		template<typename data_record>
+		void encode(const std::vector<data_record> &records, std::string &dest) {
+			static_assert(is_compressible<data_record>());
+
+			encode_varint(records.size(), dest);
+
+			uint64_t last_value = 0;
+			for (const data_record &record : records) {
+				encode_varint(record.m_value - last_value, dest);
+				last_value = record.m_value;
+			}
+
+			for (const data_record &record : records) {
+				const uint16_t score = quantize_score(record.m_score);
+				dest.append((const char *)&score, sizeof(score));
+			}
+
+			for (const data_record &record : records) {
+				encode_varint(record.m_count, dest);
+			}
+		}
+
+		/*
+		 * Decodes len bytes of encoded records into dest. Returns false if the data is corrupt.
+		 * */
+		template<typename data_record>
+		bool decode(const char *data, size_t len, std::vector<data_record> &dest) {
+			static_assert(is_compressible<data_record>());
+
+			size_t pos = 0;
+			uint64_t num_records;
+			if (!decode_varint(data, len, pos, num_records)) return false;
+
+			// Every record takes at least four bytes.
+			if (num_records > len / 4) return false;
+
+			const size_t offset = dest.size();
+			dest.resize(offset + num_records);
+			data_record *records = dest.data() + offset;
+
+			uint64_t value = 0;
+			for (size_t i = 0; i < num_records; i++) {
+				uint64_t delta;
+				if (!decode_varint(data, len, pos, delta)) return false;
+				value += delta;
+				records[i].m_value = value;
+			}
+
+			if (pos + num_records * sizeof(uint16_t) > len) return false;
+			for (size_t i = 0; i < num_records; i++) {
+				uint16_t score;
+				memcpy(&score, &data[pos], sizeof(score));
+				pos += sizeof(score);
+				records[i].m_score = dequantize_score(score);
+			}
+
+			for (size_t i = 0; i < num_records; i++) {
+				uint64_t count;
+				if (!decode_varint(data, len, pos, count)) return false;
+				records[i].m_count = (uint32_t)count;
+			}
+
+			return true;
+		}
+
+		/*
+		 * Reads the meta header and leaves the stream positioned after it. Gives format_raw for old meta files and
+		 * generation 0 for meta files without a generation. Returns false if the header is cut short or has a format
+		 * we do not know.
+		 * */
+		inline bool read_meta_header(std::istream &reader, uint64_t &format, size_t &unique_count, uint64_t &generation) {
+			format = format_raw;
+			unique_count = 0;
+			generation = 0;
+
+			uint64_t first = 0;
+			if (!reader.read((char *)&first, sizeof(uint64_t))) return false;
+
+			if (first != meta_magic && first != meta_magic_generation) {
+				unique_count = first;
+				return true;
+			}
+
+			if (!reader.read((char *)&format, sizeof(uint64_t))) return false;
+			if (!reader.read((char *)&unique_count, sizeof(size_t))) return false;
+			if (first == meta_magic_generation && !reader.read((char *)&generation, sizeof(uint64_t))) return false;
+
+			return format <= current_format;
+		}
+
+		inline void write_meta_header(std::ostream &writer, size_t unique_count, uint64_t generation) {
+			writer.write((const char *)&meta_magic_generation, sizeof(uint64_t));
+			writer.write((const char *)&current_format, sizeof(uint64_t));
+			writer.write((const char *)&unique_count, sizeof(size_t));
+			writer.write((const char *)&generation, sizeof(uint64_t));
+		}
+
+		inline void write_keys_trailer(std::ostream &writer, uint64_t data_inode, uint64_t data_size) {
+			writer.write((const char *)&keys_magic, sizeof(uint64_t));
+			writer.write((const char *)&data_inode, sizeof(uint64_t));
+			writer.write((const char *)&data_size, sizeof(uint64_t));
+		}
+
+		/*
+		 * Returns false if the keys file has no trailer.
+		 * */
+		inline bool read_keys_trailer(const char *keys, size_t len, size_t hash_table_size, uint64_t &data_inode,
+			uint64_t &data_size) {
+			const size_t pos = hash_table_size * sizeof(uint64_t);
+			if (len != pos + keys_trailer_len) return false;
+
+			uint64_t magic;
+			memcpy(&magic, &keys[pos], sizeof(uint64_t));
+			if (magic != keys_magic) return false;
+
+			memcpy(&data_inode, &keys[pos + sizeof(uint64_t)], sizeof(uint64_t));
+			memcpy(&data_size, &keys[pos + 2 * sizeof(uint64_t)], sizeof(uint64_t));
+			return true;
+		}
+
+	}
+
+}
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <type_traits>
+#include "system/Logger.h"
+
+namespace indexer {
+
+	/*
+	 * Sorted runs for the external sort in index_builder::merge. A run is a flat file of fixed size entries, the
+	 * reader only keeps buffer_len entries in memory. The last run of a merge is usually small so it can also be
+	 * read directly from memory without touching the disk.
+	 * */
+	template<typename entry>
+	class run_reader {
+
+		static_assert(std::is_trivially_copyable<entry>::value, "run entries are written to disk as raw bytes");
+
+	public:
+
+		run_reader(const std::string &filename, size_t buffer_len = 65536);
+		explicit run_reader(std::vector<entry> &&entries);
+
+		/*
+		 * Reads the next entry, returns false at the end of the run.
+		 * */
+		bool next(entry &e);
+
+	private:
+
+		std::ifstream m_reader;
+		std::vector<entry> m_buffer;
+		size_t m_pos = 0;
+		size_t m_len = 0;
+		const size_t m_buffer_len;
+		const bool m_from_file;
+
+		void fill();
+
+	};
+
+	template<typename entry>
+	void write_run(const std::string &filename, const std::vector<entry> &entries) {
+		std::ofstream writer(filename, std::ios::binary | std::ios::trunc);
+		if (!writer.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open run file (" + filename + "). Error: " +
+				std::string(strerror(errno)));
+		}
+		writer.write((const char *)entries.data(), entries.size() * sizeof(entry));
+	}
+
+	template<typename entry>
+	run_reader<entry>::run_reader(const std::string &filename, size_t buffer_len)
+	: m_reader(filename, std::ios::binary), m_buffer_len(buffer_len), m_from_file(true) {
+		if (!m_reader.is_open()) {
+			throw LOG_ERROR_EXCEPTION("Could not open run file (" + filename + "). Error: " +
+				std::string(strerror(errno)));
+		}
+	}
+
+	template<typename entry>
+	run_reader<entry>::run_reader(std::vector<entry> &&entries)
+	: m_buffer(std::move(entries)), m_len(m_buffer.size()), m_buffer_len(0), m_from_file(false) {
+	}
+
+	template<typename entry>
+	bool run_reader<entry>::next(entry &e) {
+		if (m_pos == m_len) {
+			if (!m_from_file) return false;
+			fill();
+			if (m_len == 0) return false;
+		}
+		e = m_buffer[m_pos++];
+		return true;
+	}
+
+	template<typename entry>
+	void run_reader<entry>::fill() {
+		m_buffer.resize(m_buffer_len);
+		m_reader.read((char *)m_buffer.data(), m_buffer_len * sizeof(entry));
+		m_len = m_reader.gcount() / sizeof(entry);
+		m_pos = 0;
+		if (m_len == 0) {
+			// Release the buffer as soon as the run is exhausted.
+			m_buffer = std::vector<entry>{};
+		}
+	}
+
+}
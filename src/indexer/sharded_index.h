@@ -41,7 +41,7 @@ namespace indexer {
 		sharded_index(const std::string &db_name, size_t num_shards, size_t hash_table_size);
 		~sharded_index();
 
-		std::vector<data_record> find(uint64_t key) const;
+		typename index<data_record>::postings find(uint64_t key) const;
 		std::vector<data_record> find(const std::vector<uint64_t> &keys) const;
 
 	private:
@@ -50,17 +50,24 @@ namespace indexer {
 		size_t m_num_shards;
 		size_t m_hash_table_size;
 
+		// Shards are opened on first use and then kept mapped.
+		mutable std::mutex m_lock;
+		mutable std::vector<std::unique_ptr<index<data_record>>> m_shards;
+
+		const index<data_record> &shard(size_t shard_id) const;
+
 	};
 
 	template<typename data_record>
 	sharded_index<data_record>::sharded_index(const std::string &db_name, size_t num_shards)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(Config::shard_hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(Config::shard_hash_table_size),
+		m_shards(num_shards)
 	{
 	}
 
 	template<typename data_record>
 	sharded_index<data_record>::sharded_index(const std::string &db_name, size_t num_shards, size_t hash_table_size)
-	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size)
+	: m_db_name(db_name), m_num_shards(num_shards), m_hash_table_size(hash_table_size), m_shards(num_shards)
 	{
 
 	}
@@ -70,21 +77,31 @@ namespace indexer {
 	}
 
 	template<typename data_record>
-	std::vector<data_record> sharded_index<data_record>::find(uint64_t key) const {
+	typename index<data_record>::postings sharded_index<data_record>::find(uint64_t key) const {
 		const size_t shard_id = key % m_num_shards;
-		index<data_record> idx(m_db_name, shard_id, m_hash_table_size);
-		return idx.find(key);
+		return shard(shard_id).find(key);
 	}
 
 	template<typename data_record>
 	std::vector<data_record> sharded_index<data_record>::find(const std::vector<uint64_t> &keys) const {
 
-		std::vector<std::vector<data_record>> results;
+		std::vector<typename index<data_record>::postings> results;
+		std::vector<std::span<const data_record>> spans;
 		for (uint64_t key : keys) {
 			results.emplace_back(find(key));
+			spans.emplace_back(*results.back());
 		}
 
-		return ::algorithm::intersection(results);
+		return ::algorithm::intersection<data_record>(spans, [](data_record &a, const data_record &b) {});
+	}
+
+	template<typename data_record>
+	const index<data_record> &sharded_index<data_record>::shard(size_t shard_id) const {
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_shards[shard_id]) {
+			m_shards[shard_id] = std::make_unique<index<data_record>>(m_db_name, shard_id, m_hash_table_size);
+		}
+		return *m_shards[shard_id];
 	}
 
 }
@@ -25,6 +25,7 @@
  */
 
 #include "snippet.h"
+#include "text/tokenizer.h"
 
 namespace indexer {
 
@@ -37,11 +38,10 @@ namespace indexer {
 	}
 
 	std::vector<size_t> snippet::tokens() const {
-		std::vector<std::string> words = Text::get_full_text_words(m_text);
 		std::vector<size_t> tokens;
-		for (const std::string &word : words) {
-			tokens.push_back(Hash::str(word));
-		}
+		text::for_each_full_text_word(m_text, [&tokens](const text::word &word) {
+			tokens.push_back(word.hash());
+		});
 		return tokens;
 	}
 
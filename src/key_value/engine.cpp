@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "engine.h"
+#include "leveldb_engine.h"
+#include "hash_log_engine.h"
+#include "system/Logger.h"
+
+using namespace std;
+
+namespace key_value {
+
+	void write_batch::put(const string &key, const string &value) {
+		m_ops.push_back(op{key, value, false});
+	}
+
+	void write_batch::remove(const string &key) {
+		m_ops.push_back(op{key, "", true});
+	}
+
+	vector<optional<string>> engine::multi_get(const vector<string> &keys, const snapshot *snap) const {
+		vector<optional<string>> values(keys.size());
+		string value;
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (get(keys[i], value, snap)) values[i] = value;
+		}
+		return values;
+	}
+
+	void engine::put(const string &key, const string &value) {
+		write_batch batch;
+		batch.put(key, value);
+		write(batch);
+	}
+
+	void engine::remove(const string &key) {
+		write_batch batch;
+		batch.remove(key);
+		write(batch);
+	}
+
+	void engine::scan_prefix(const string &prefix, const scan_function &fun, const snapshot *snap) const {
+		// The first key after all keys with the prefix, empty if the prefix is only 0xff bytes.
+		string end = prefix;
+		while (end.size() && (uint8_t)end.back() == 0xff) end.pop_back();
+		if (end.size()) end.back()++;
+
+		scan(prefix, end, fun, snap);
+	}
+
+	unique_ptr<engine> open_engine(const string &type, const string &path) {
+		if (type == engine_leveldb) return make_unique<leveldb_engine>(path);
+		if (type == engine_hash_log) return make_unique<hash_log_engine>(path);
+		throw LOG_ERROR_EXCEPTION("Unknown key value engine: " + type);
+	}
+
+}
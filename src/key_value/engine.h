@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <functional>
+
+namespace key_value {
+
+	const std::string engine_leveldb = "leveldb";
+	const std::string engine_hash_log = "hash_log";
+
+	/*
+	 * A consistent view of an engine. Reads with a snapshot do not see writes made after it was taken and the engine
+	 * keeps what the snapshot reads until it is destroyed.
+	 * */
+	class snapshot {
+		public:
+			virtual ~snapshot() {}
+	};
+
+	class write_batch {
+		public:
+			struct op {
+				std::string m_key;
+				std::string m_value;
+				bool m_remove;
+			};
+
+			void put(const std::string &key, const std::string &value);
+			void remove(const std::string &key);
+			void clear() { m_ops.clear(); }
+
+			bool empty() const { return m_ops.empty(); }
+			size_t size() const { return m_ops.size(); }
+			const std::vector<op> &ops() const { return m_ops; }
+
+		private:
+			std::vector<op> m_ops;
+	};
+
+	// Returns false to stop the scan.
+	using scan_function = std::function<bool(std::string_view key, std::string_view value)>;
+
+	class engine {
+		public:
+			virtual ~engine() {}
+
+			virtual bool get(const std::string &key, std::string &value, const snapshot *snap = nullptr) const = 0;
+			virtual std::vector<std::optional<std::string>> multi_get(const std::vector<std::string> &keys,
+				const snapshot *snap = nullptr) const;
+
+			// The ops of a batch are applied in order and all at once.
+			virtual void write(const write_batch &batch) = 0;
+			void put(const std::string &key, const std::string &value);
+			void remove(const std::string &key);
+
+			/*
+			 * Calls fun for every key in [start, end), an empty end has no upper bound. Engines without key order visit
+			 * the keys in any order. fun must not write to the engine.
+			 * */
+			virtual void scan(const std::string &start, const std::string &end, const scan_function &fun,
+				const snapshot *snap = nullptr) const = 0;
+			void scan_prefix(const std::string &prefix, const scan_function &fun, const snapshot *snap = nullptr) const;
+
+			virtual std::shared_ptr<const snapshot> get_snapshot() = 0;
+
+			/*
+			 * Compaction hooks. needs_compaction is cheap and can be called after every write, compact blocks until the
+			 * engine has reclaimed its space.
+			 * */
+			virtual bool needs_compaction() const = 0;
+			virtual void compact() = 0;
+	};
+
+	std::unique_ptr<engine> open_engine(const std::string &type, const std::string &path);
+
+}
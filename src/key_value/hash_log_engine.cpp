@@ -0,0 +1,441 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "hash_log_engine.h"
+#include "hash/Hash.h"
+#include "system/Logger.h"
+#include <unordered_map>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace key_value {
+
+	class hash_log_snapshot : public snapshot {
+		public:
+			hash_log_snapshot(uint64_t end, shared_ptr<atomic<size_t>> count)
+			: m_end(end), m_count(count) {
+				(*m_count)++;
+			}
+			~hash_log_snapshot() {
+				(*m_count)--;
+			}
+
+			const uint64_t m_end;
+
+		private:
+			shared_ptr<atomic<size_t>> m_count;
+	};
+
+	hash_log_engine::hash_log_engine(const string &path)
+	: m_path(path), m_slots(min_capacity, slot{0, no_offset, 0, false, false}),
+	  m_snapshots(make_shared<atomic<size_t>>(0)) {
+		boost::filesystem::create_directories(m_path);
+		open_log();
+		recover();
+	}
+
+	hash_log_engine::~hash_log_engine() {
+		if (m_fd >= 0) close(m_fd);
+	}
+
+	bool hash_log_engine::get(const string &key, string &value, const snapshot *snap) const {
+		shared_lock lock(m_index_lock);
+
+		const size_t idx = find(key, hash(key));
+		if (m_slots[idx].m_offset == no_offset) return false;
+
+		uint64_t offset = m_slots[idx].m_offset;
+		if (snap != nullptr) {
+			offset = version_at(offset, static_cast<const hash_log_snapshot *>(snap)->m_end);
+			if (offset == no_offset) return false;
+		}
+
+		record_header header;
+		if (!read_header(offset, header) || header.m_value_len == tombstone) return false;
+		return read_value(offset, header, value);
+	}
+
+	void hash_log_engine::write(const write_batch &batch) {
+		lock_guard write_lock(m_write_lock);
+
+		struct pending {
+			const string *m_key;
+			uint64_t m_hash;
+			uint64_t m_offset;
+			record_header m_header;
+		};
+		vector<pending> records;
+		unordered_map<string, uint64_t> batch_offsets;
+		string buffer;
+
+		for (const auto &op : batch.ops()) {
+			const uint64_t h = hash(op.m_key);
+			const uint64_t offset = m_end + buffer.size();
+
+			// Only writers change the index and they hold m_write_lock so it can be read without the index lock.
+			uint64_t prev = no_offset;
+			auto iter = batch_offsets.find(op.m_key);
+			if (iter != batch_offsets.end()) {
+				prev = iter->second;
+			} else {
+				prev = m_slots[find(op.m_key, h)].m_offset;
+			}
+			batch_offsets[op.m_key] = offset;
+
+			const uint32_t value_len = op.m_remove ? tombstone : (uint32_t)op.m_value.size();
+			const record_header header = {(uint32_t)op.m_key.size(), value_len, prev};
+			buffer.append((const char *)&header, sizeof(header));
+			buffer.append(op.m_key);
+			if (!op.m_remove) buffer.append(op.m_value);
+
+			records.push_back(pending{&op.m_key, h, offset, header});
+		}
+
+		write_all(m_fd, buffer, m_end);
+
+		unique_lock lock(m_index_lock);
+		for (const pending &record : records) {
+			set_slot(*record.m_key, record.m_hash, record.m_offset, record.m_header);
+		}
+		m_end += buffer.size();
+	}
+
+	void hash_log_engine::scan(const string &start, const string &end, const scan_function &fun,
+			const snapshot *snap) const {
+		shared_lock lock(m_index_lock);
+
+		string key, value;
+		for (const slot &entry : m_slots) {
+			if (entry.m_offset == no_offset) continue;
+
+			uint64_t offset = entry.m_offset;
+			if (snap != nullptr) {
+				offset = version_at(offset, static_cast<const hash_log_snapshot *>(snap)->m_end);
+				if (offset == no_offset) continue;
+			}
+
+			record_header header;
+			if (!read_header(offset, header) || header.m_value_len == tombstone) continue;
+			if (!read_key(offset, header, key)) continue;
+			if (key < start || (end.size() && key >= end)) continue;
+			if (!read_value(offset, header, value)) continue;
+
+			if (!fun(key, value)) return;
+		}
+	}
+
+	/*
+	 * Takes the write lock so a snapshot is never taken while compact is rewriting the log.
+	 * */
+	shared_ptr<const snapshot> hash_log_engine::get_snapshot() {
+		lock_guard write_lock(m_write_lock);
+		return make_shared<hash_log_snapshot>(m_end, m_snapshots);
+	}
+
+	bool hash_log_engine::needs_compaction() const {
+		shared_lock lock(m_index_lock);
+		return m_dead_bytes >= min_compaction_bytes && m_dead_bytes > m_live_bytes;
+	}
+
+	/*
+	 * Copies the latest version of every key to a new log and swaps it in. Readers keep using the old log until the
+	 * swap, writers wait for the whole compaction.
+	 * */
+	void hash_log_engine::compact() {
+		lock_guard write_lock(m_write_lock);
+		if (*m_snapshots > 0) return;
+
+		const string compact_filename = log_filename() + ".compact";
+		const int fd = open(compact_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			throw LOG_ERROR_EXCEPTION("Could not open " + compact_filename + ": " + strerror(errno));
+		}
+
+		size_t num_keys = 0;
+		for (const slot &entry : m_slots) {
+			if (entry.m_offset != no_offset && !entry.m_removed) num_keys++;
+		}
+		size_t capacity = min_capacity;
+		while (num_keys * 10 > capacity * 7) capacity *= 2;
+
+		vector<slot> slots(capacity, slot{0, no_offset, 0, false, false});
+		uint64_t end = 0;
+		size_t live_bytes = 0;
+		string buffer, key, value;
+
+		for (const slot &entry : m_slots) {
+			if (entry.m_offset == no_offset || entry.m_removed) continue;
+
+			record_header header;
+			if (!read_header(entry.m_offset, header) || !read_key(entry.m_offset, header, key) ||
+				!read_value(entry.m_offset, header, value)) {
+				close(fd);
+				throw LOG_ERROR_EXCEPTION("Could not read record at " + to_string(entry.m_offset) + " in " +
+					log_filename());
+			}
+
+			header.m_prev = no_offset;
+			place(slots, slot{entry.m_hash, end + buffer.size(), entry.m_size, entry.m_fixed, false});
+			buffer.append((const char *)&header, sizeof(header));
+			buffer.append(key);
+			buffer.append(value);
+			live_bytes += entry.m_size;
+
+			if (buffer.size() >= 16ull * 1024ull * 1024ull) {
+				write_all(fd, buffer, end);
+				end += buffer.size();
+				buffer.clear();
+			}
+		}
+		write_all(fd, buffer, end);
+		end += buffer.size();
+
+		unique_lock lock(m_index_lock);
+		if (rename(compact_filename.c_str(), log_filename().c_str()) != 0) {
+			close(fd);
+			throw LOG_ERROR_EXCEPTION("Could not rename " + compact_filename + ": " + strerror(errno));
+		}
+		close(m_fd);
+		m_fd = fd;
+		m_end = end;
+		m_slots.swap(slots);
+		m_num_keys = num_keys;
+		m_live_bytes = live_bytes;
+		m_dead_bytes = 0;
+	}
+
+	size_t hash_log_engine::size() const {
+		shared_lock lock(m_index_lock);
+		size_t num_keys = 0;
+		for (const slot &entry : m_slots) {
+			if (entry.m_offset != no_offset && !entry.m_removed) num_keys++;
+		}
+		return num_keys;
+	}
+
+	size_t hash_log_engine::live_bytes() const {
+		shared_lock lock(m_index_lock);
+		return m_live_bytes;
+	}
+
+	size_t hash_log_engine::dead_bytes() const {
+		shared_lock lock(m_index_lock);
+		return m_dead_bytes;
+	}
+
+	string hash_log_engine::log_filename() const {
+		return m_path + "/data.log";
+	}
+
+	void hash_log_engine::open_log() {
+		m_fd = open(log_filename().c_str(), O_RDWR | O_CREAT, 0644);
+		if (m_fd < 0) {
+			throw LOG_ERROR_EXCEPTION("Could not open " + log_filename() + ": " + strerror(errno));
+		}
+	}
+
+	/*
+	 * Reads the headers and keys of the log in large chunks, values are skipped. A record cut off at the end of the
+	 * log by a crash is truncated away.
+	 * */
+	void hash_log_engine::recover() {
+
+		struct stat st;
+		if (fstat(m_fd, &st) != 0) {
+			throw LOG_ERROR_EXCEPTION("Could not stat " + log_filename() + ": " + strerror(errno));
+		}
+		const uint64_t file_size = st.st_size;
+
+		const size_t chunk_size = 4ull * 1024ull * 1024ull;
+		string buffer;
+		uint64_t buffer_start = 0;
+		auto data_at = [&](uint64_t pos, size_t len) -> const char * {
+			if (pos >= buffer_start && pos + len <= buffer_start + buffer.size()) return &buffer[pos - buffer_start];
+			buffer.resize(max(len, chunk_size));
+			const ssize_t bytes = pread(m_fd, buffer.data(), buffer.size(), pos);
+			buffer.resize(bytes > 0 ? bytes : 0);
+			buffer_start = pos;
+			if (buffer.size() < len) return nullptr;
+			return buffer.data();
+		};
+
+		uint64_t pos = 0;
+		while (pos + sizeof(record_header) <= file_size) {
+			const char *data = data_at(pos, sizeof(record_header));
+			if (data == nullptr) break;
+			record_header header;
+			memcpy(&header, data, sizeof(header));
+
+			const uint64_t value_len = header.m_value_len == tombstone ? 0 : header.m_value_len;
+			const uint64_t record_size = sizeof(record_header) + header.m_key_len + value_len;
+			if (pos + record_size > file_size) break;
+
+			data = data_at(pos + sizeof(record_header), header.m_key_len);
+			if (data == nullptr) break;
+			const string key(data, header.m_key_len);
+
+			set_slot(key, hash(key), pos, header);
+			pos += record_size;
+		}
+
+		if (pos < file_size) {
+			LOG_INFO("Truncating " + to_string(file_size - pos) + " bytes at the end of " + log_filename());
+			if (ftruncate(m_fd, pos) != 0) {
+				throw LOG_ERROR_EXCEPTION("Could not truncate " + log_filename() + ": " + strerror(errno));
+			}
+		}
+		m_end = pos;
+	}
+
+	/*
+	 * Fixed 64 bit keys are their own hash.
+	 * */
+	uint64_t hash_log_engine::hash(const string &key) {
+		if (key.size() == sizeof(uint64_t)) {
+			uint64_t h;
+			memcpy(&h, key.data(), sizeof(h));
+			return h;
+		}
+		return Hash::murmur_hash(key.c_str(), key.size());
+	}
+
+	static size_t first_slot(uint64_t h, size_t num_slots) {
+		// Finalizer of murmur hash 3, the raw hash of fixed keys can be anything.
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return h & (num_slots - 1);
+	}
+
+	void hash_log_engine::place(vector<slot> &slots, const slot &entry) {
+		size_t idx = first_slot(entry.m_hash, slots.size());
+		while (slots[idx].m_offset != no_offset) {
+			idx = (idx + 1) & (slots.size() - 1);
+		}
+		slots[idx] = entry;
+	}
+
+	/*
+	 * Returns the slot of the key or the empty slot where it should be inserted.
+	 * */
+	size_t hash_log_engine::find(const string &key, uint64_t h) const {
+		const bool fixed = key.size() == sizeof(uint64_t);
+		size_t idx = first_slot(h, m_slots.size());
+		string stored_key;
+		while (m_slots[idx].m_offset != no_offset) {
+			const slot &entry = m_slots[idx];
+			if (entry.m_hash == h && entry.m_fixed == fixed) {
+				if (fixed) return idx;
+				record_header header;
+				if (read_header(entry.m_offset, header) && read_key(entry.m_offset, header, stored_key) &&
+					stored_key == key) return idx;
+			}
+			idx = (idx + 1) & (m_slots.size() - 1);
+		}
+		return idx;
+	}
+
+	/*
+	 * Points the key to a new record and moves the space of the record it replaces to the garbage.
+	 * */
+	void hash_log_engine::set_slot(const string &key, uint64_t h, uint64_t offset, const record_header &header) {
+
+		const bool removed = header.m_value_len == tombstone;
+		const uint32_t size = sizeof(record_header) + header.m_key_len + (removed ? 0 : header.m_value_len);
+
+		size_t idx = find(key, h);
+		if (m_slots[idx].m_offset == no_offset) {
+			if ((m_num_keys + 1) * 10 > m_slots.size() * 7) {
+				grow();
+				idx = find(key, h);
+			}
+			m_num_keys++;
+		} else {
+			m_dead_bytes += m_slots[idx].m_size;
+			if (!m_slots[idx].m_removed) m_live_bytes -= m_slots[idx].m_size;
+		}
+
+		m_slots[idx] = slot{h, offset, size, key.size() == sizeof(uint64_t), removed};
+		if (removed) {
+			m_dead_bytes += size;
+		} else {
+			m_live_bytes += size;
+		}
+	}
+
+	void hash_log_engine::grow() {
+		vector<slot> slots(m_slots.size() * 2, slot{0, no_offset, 0, false, false});
+		for (const slot &entry : m_slots) {
+			if (entry.m_offset != no_offset) place(slots, entry);
+		}
+		m_slots.swap(slots);
+	}
+
+	void hash_log_engine::write_all(int fd, const string &data, uint64_t offset) const {
+		size_t written = 0;
+		while (written < data.size()) {
+			const ssize_t bytes = pwrite(fd, data.data() + written, data.size() - written, offset + written);
+			if (bytes < 0) {
+				if (errno == EINTR) continue;
+				throw LOG_ERROR_EXCEPTION("Could not write to " + log_filename() + ": " + strerror(errno));
+			}
+			written += bytes;
+		}
+	}
+
+	bool hash_log_engine::read_header(uint64_t offset, record_header &header) const {
+		return pread(m_fd, &header, sizeof(header), offset) == sizeof(header);
+	}
+
+	bool hash_log_engine::read_key(uint64_t offset, const record_header &header, string &key) const {
+		key.resize(header.m_key_len);
+		return pread(m_fd, key.data(), header.m_key_len, offset + sizeof(record_header)) == header.m_key_len;
+	}
+
+	bool hash_log_engine::read_value(uint64_t offset, const record_header &header, string &value) const {
+		value.resize(header.m_value_len);
+		return pread(m_fd, value.data(), header.m_value_len, offset + sizeof(record_header) + header.m_key_len) ==
+			header.m_value_len;
+	}
+
+	/*
+	 * Follows the versions of a key back to the latest one written before end.
+	 * */
+	uint64_t hash_log_engine::version_at(uint64_t offset, uint64_t end) const {
+		record_header header;
+		while (offset != no_offset && offset >= end) {
+			if (!read_header(offset, header)) return no_offset;
+			offset = header.m_prev;
+		}
+		return offset;
+	}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "engine.h"
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace key_value {
+
+	/*
+	 * Append only log with an in memory hash index, for stores that only do point lookups.
+	 *
+	 * All writes are appended to data.log in the engine directory as [key_len][value_len][prev][key][value] where
+	 * prev is the offset of the previous version of the key. The index is an open addressing table from a 64 bit hash
+	 * of the key to the offset of its latest version. Keys of exactly 8 bytes are used as their own hash and are never
+	 * compared with the key in the log, other keys are hashed and verified against the log.
+	 *
+	 * A snapshot is the size of the log when it was taken, reads with it follow prev to the last version written
+	 * before that. Overwritten and removed records are garbage until compact rewrites the log with only the latest
+	 * versions, this waits for snapshots to be released. The index is rebuilt from the log when the engine is opened.
+	 *
+	 * Scans visit the keys in index order, not in key order.
+	 * */
+	class hash_log_engine : public engine {
+		public:
+			explicit hash_log_engine(const std::string &path);
+			~hash_log_engine();
+
+			bool get(const std::string &key, std::string &value, const snapshot *snap = nullptr) const override;
+			void write(const write_batch &batch) override;
+			void scan(const std::string &start, const std::string &end, const scan_function &fun,
+				const snapshot *snap = nullptr) const override;
+			std::shared_ptr<const snapshot> get_snapshot() override;
+
+			bool needs_compaction() const override;
+			void compact() override;
+
+			size_t size() const;
+			size_t live_bytes() const;
+			size_t dead_bytes() const;
+
+		private:
+			struct record_header {
+				uint32_t m_key_len;
+				uint32_t m_value_len;
+				uint64_t m_prev;
+			};
+
+			struct slot {
+				uint64_t m_hash;
+				uint64_t m_offset;
+				uint32_t m_size;
+				bool m_fixed;
+				bool m_removed;
+			};
+
+			static constexpr uint32_t tombstone = 0xFFFFFFFF;
+			static constexpr uint64_t no_offset = 0xFFFFFFFFFFFFFFFFull;
+			static constexpr size_t min_capacity = 1024;
+			static constexpr size_t min_compaction_bytes = 64ull * 1024ull * 1024ull;
+
+			const std::string m_path;
+			int m_fd = -1;
+			uint64_t m_end = 0;
+
+			std::vector<slot> m_slots;
+			size_t m_num_keys = 0;
+			size_t m_live_bytes = 0;
+			size_t m_dead_bytes = 0;
+
+			// Writers hold m_write_lock for the whole write and the index lock only while they update the index.
+			std::mutex m_write_lock;
+			mutable std::shared_mutex m_index_lock;
+			std::shared_ptr<std::atomic<size_t>> m_snapshots;
+
+			std::string log_filename() const;
+			void open_log();
+			void recover();
+
+			static uint64_t hash(const std::string &key);
+			static void place(std::vector<slot> &slots, const slot &entry);
+			size_t find(const std::string &key, uint64_t h) const;
+			void set_slot(const std::string &key, uint64_t h, uint64_t offset, const record_header &header);
+			void grow();
+			void write_all(int fd, const std::string &data, uint64_t offset) const;
+
+			bool read_header(uint64_t offset, record_header &header) const;
+			bool read_key(uint64_t offset, const record_header &header, std::string &key) const;
+			bool read_value(uint64_t offset, const record_header &header, std::string &value) const;
+			uint64_t version_at(uint64_t offset, uint64_t end) const;
+
+	};
+
+}
@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "leveldb_engine.h"
+#include "leveldb/write_batch.h"
+#include "system/Logger.h"
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+
+using namespace std;
+
+namespace key_value {
+
+	class leveldb_snapshot : public snapshot {
+		public:
+			leveldb_snapshot(leveldb::DB *db) : m_db(db), m_snapshot(db->GetSnapshot()) {}
+			~leveldb_snapshot() { m_db->ReleaseSnapshot(m_snapshot); }
+
+			leveldb::DB *m_db;
+			const leveldb::Snapshot *m_snapshot;
+	};
+
+	static leveldb::ReadOptions read_options(const snapshot *snap) {
+		leveldb::ReadOptions options;
+		if (snap != nullptr) options.snapshot = static_cast<const leveldb_snapshot *>(snap)->m_snapshot;
+		return options;
+	}
+
+	leveldb_engine::leveldb_engine(const string &path) {
+		leveldb::Options options;
+		options.create_if_missing = true;
+		options.write_buffer_size = 1024ull * 1024ull * 1024ull;
+		options.max_open_files = 100000;
+		leveldb::Status status = leveldb::DB::Open(options, path, &m_db);
+		if (!status.ok()) {
+			throw LOG_ERROR_EXCEPTION("Could not open database: " + path + " " + status.ToString());
+		}
+	}
+
+	leveldb_engine::~leveldb_engine() {
+		delete m_db;
+	}
+
+	bool leveldb_engine::get(const string &key, string &value, const snapshot *snap) const {
+		return m_db->Get(read_options(snap), key, &value).ok();
+	}
+
+	/*
+	 * Reads the keys in sorted order from one snapshot so neighbouring keys share blocks.
+	 * */
+	vector<optional<string>> leveldb_engine::multi_get(const vector<string> &keys, const snapshot *snap) const {
+
+		shared_ptr<const snapshot> own_snapshot;
+		if (snap == nullptr) {
+			own_snapshot = make_shared<leveldb_snapshot>(m_db);
+			snap = own_snapshot.get();
+		}
+		const leveldb::ReadOptions options = read_options(snap);
+
+		vector<size_t> order(keys.size());
+		iota(order.begin(), order.end(), 0);
+		sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+			return keys[a] < keys[b];
+		});
+
+		vector<optional<string>> values(keys.size());
+		string value;
+		for (size_t idx : order) {
+			if (m_db->Get(options, keys[idx], &value).ok()) values[idx] = value;
+		}
+		return values;
+	}
+
+	void leveldb_engine::write(const write_batch &batch) {
+		leveldb::WriteBatch leveldb_batch;
+		for (const auto &op : batch.ops()) {
+			if (op.m_remove) {
+				leveldb_batch.Delete(op.m_key);
+			} else {
+				leveldb_batch.Put(op.m_key, op.m_value);
+			}
+		}
+		leveldb::Status status = m_db->Write(leveldb::WriteOptions(), &leveldb_batch);
+		if (!status.ok()) {
+			cerr << status.ToString() << endl;
+		}
+	}
+
+	void leveldb_engine::scan(const string &start, const string &end, const scan_function &fun,
+			const snapshot *snap) const {
+
+		leveldb::ReadOptions options = read_options(snap);
+		options.fill_cache = false;
+		unique_ptr<leveldb::Iterator> it(m_db->NewIterator(options));
+
+		for (it->Seek(start); it->Valid(); it->Next()) {
+			const leveldb::Slice key = it->key();
+			if (end.size() && key.compare(end) >= 0) break;
+			const leveldb::Slice value = it->value();
+			if (!fun(string_view(key.data(), key.size()), string_view(value.data(), value.size()))) break;
+		}
+	}
+
+	shared_ptr<const snapshot> leveldb_engine::get_snapshot() {
+		return make_shared<leveldb_snapshot>(m_db);
+	}
+
+	void leveldb_engine::compact() {
+		m_db->CompactRange(nullptr, nullptr);
+	}
+
+}
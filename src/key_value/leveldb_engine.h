@@ -0,0 +1,60 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "engine.h"
+#include "leveldb/db.h"
+
+namespace key_value {
+
+	/*
+	 * Engine on top of https://github.com/google/leveldb with a large write buffer for bulk inserts. Keys are kept in
+	 * order so scans are sorted.
+	 * */
+	class leveldb_engine : public engine {
+		public:
+			explicit leveldb_engine(const std::string &path);
+			~leveldb_engine();
+
+			bool get(const std::string &key, std::string &value, const snapshot *snap = nullptr) const override;
+			std::vector<std::optional<std::string>> multi_get(const std::vector<std::string> &keys,
+				const snapshot *snap = nullptr) const override;
+			void write(const write_batch &batch) override;
+			void scan(const std::string &start, const std::string &end, const scan_function &fun,
+				const snapshot *snap = nullptr) const override;
+			std::shared_ptr<const snapshot> get_snapshot() override;
+
+			// leveldb compacts in its own background thread.
+			bool needs_compaction() const override { return false; }
+			void compact() override;
+
+		private:
+			leveldb::DB *m_db;
+
+	};
+
+}
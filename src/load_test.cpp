@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <signal.h>
+#include "config.h"
+#include "system/Logger.h"
+#include "load_test/load_test.h"
+
+using namespace std;
+
+/*
+ * Usage: load_test [--documents=n] [--requests=n] [--concurrency=n] [--zipf=s] [--address=host:port] [--output=file]
+ * */
+int main(int argc, const char **argv) {
+
+	struct sigaction act{SIG_IGN};
+	sigaction(SIGPIPE, &act, NULL);
+
+	Logger::start_logger_thread();
+
+	if (getenv("ALEXANDRIA_CONFIG") != NULL) {
+		Config::read_config(getenv("ALEXANDRIA_CONFIG"));
+	} else {
+		Config::read_config("/etc/alexandria.conf");
+	}
+
+	load_test::options opts;
+	string output;
+
+	for (int i = 1; i < argc; i++) {
+		const string arg(argv[i]);
+		const size_t eq = arg.find('=');
+		const string key = arg.substr(0, eq);
+		const string value = eq == string::npos ? "" : arg.substr(eq + 1);
+
+		try {
+			if (key == "--documents") opts.m_documents = stoull(value);
+			else if (key == "--requests") opts.m_requests = stoull(value);
+			else if (key == "--concurrency") opts.m_concurrency = max<size_t>(1, stoull(value));
+			else if (key == "--zipf") opts.m_zipf_exponent = stod(value);
+			else if (key == "--address") opts.m_address = value;
+			else if (key == "--output") output = value;
+			else {
+				cout << "usage: " << argv[0] << " [--documents=n] [--requests=n] [--concurrency=n] [--zipf=s]"
+					" [--address=host:port] [--output=file]" << endl;
+				return 1;
+			}
+		} catch (const exception &error) {
+			cout << "invalid value for " << key << ": " << value << endl;
+			return 1;
+		}
+	}
+
+	int ret;
+	if (output.size()) {
+		ofstream out(output, ios::trunc);
+		ret = load_test::run(opts, out);
+	} else {
+		ret = load_test::run(opts, cout);
+	}
+
+	Logger::join_logger_thread();
+
+	return ret;
+}
@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "fcgi_client.h"
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+namespace load_test {
+
+	namespace fcgi {
+
+		const uint8_t version = 1;
+		const uint8_t type_begin_request = 1;
+		const uint8_t type_end_request = 3;
+		const uint8_t type_params = 4;
+		const uint8_t type_stdin = 5;
+		const uint8_t type_stdout = 6;
+		const uint16_t role_responder = 1;
+		const size_t max_content_len = 65535;
+
+		void append_record(string &out, uint8_t type, uint16_t request_id, const string &content) {
+			const uint8_t padding = (8 - content.size() % 8) % 8;
+			out += (char)version;
+			out += (char)type;
+			out += (char)(request_id >> 8);
+			out += (char)(request_id & 0xFF);
+			out += (char)(content.size() >> 8);
+			out += (char)(content.size() & 0xFF);
+			out += (char)padding;
+			out += (char)0;
+			out += content;
+			out.append(padding, '\0');
+		}
+
+		void append_length(string &out, size_t len) {
+			if (len < 128) {
+				out += (char)len;
+			} else {
+				out += (char)((len >> 24) | 0x80);
+				out += (char)((len >> 16) & 0xFF);
+				out += (char)((len >> 8) & 0xFF);
+				out += (char)(len & 0xFF);
+			}
+		}
+
+		string encode_params(const params &parameters) {
+			string out;
+			for (const auto &param : parameters) {
+				append_length(out, param.first.size());
+				append_length(out, param.second.size());
+				out += param.first;
+				out += param.second;
+			}
+			return out;
+		}
+
+		string encode_request(uint16_t request_id, const params &parameters) {
+			string out;
+
+			string begin(8, '\0');
+			begin[0] = (char)(role_responder >> 8);
+			begin[1] = (char)(role_responder & 0xFF);
+			append_record(out, type_begin_request, request_id, begin);
+
+			const string encoded = encode_params(parameters);
+			for (size_t pos = 0; pos < encoded.size(); pos += max_content_len) {
+				append_record(out, type_params, request_id, encoded.substr(pos, max_content_len));
+			}
+			append_record(out, type_params, request_id, "");
+			append_record(out, type_stdin, request_id, "");
+
+			return out;
+		}
+
+		int connect_to(const string &address) {
+
+			const size_t colon = address.rfind(':');
+
+			if (colon == string::npos) {
+				sockaddr_un addr;
+				memset(&addr, 0, sizeof(addr));
+				addr.sun_family = AF_UNIX;
+				if (address.size() >= sizeof(addr.sun_path)) return -1;
+				strcpy(addr.sun_path, address.c_str());
+
+				const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+				if (fd < 0) return -1;
+				if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+					close(fd);
+					return -1;
+				}
+				return fd;
+			}
+
+			addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+
+			addrinfo *result;
+			const string host = colon == 0 ? "127.0.0.1" : address.substr(0, colon);
+			if (getaddrinfo(host.c_str(), address.substr(colon + 1).c_str(), &hints, &result) != 0) return -1;
+
+			int fd = -1;
+			for (addrinfo *info = result; info != nullptr; info = info->ai_next) {
+				fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+				if (fd < 0) continue;
+				if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) break;
+				close(fd);
+				fd = -1;
+			}
+			freeaddrinfo(result);
+
+			return fd;
+		}
+
+		bool write_all(int fd, const string &data) {
+			size_t written = 0;
+			while (written < data.size()) {
+				const ssize_t ret = write(fd, data.data() + written, data.size() - written);
+				if (ret <= 0) return false;
+				written += ret;
+			}
+			return true;
+		}
+
+		bool read_all(int fd, char *buffer, size_t len) {
+			size_t total = 0;
+			while (total < len) {
+				const ssize_t ret = read(fd, buffer + total, len - total);
+				if (ret <= 0) return false;
+				total += ret;
+			}
+			return true;
+		}
+
+		bool get(const string &address, const string &uri, string &body) {
+
+			const int fd = connect_to(address);
+			if (fd < 0) return false;
+
+			const size_t question = uri.find('?');
+			const params parameters = {
+				{"REQUEST_METHOD", "GET"},
+				{"REQUEST_URI", uri},
+				{"QUERY_STRING", question == string::npos ? "" : uri.substr(question + 1)},
+				{"SERVER_PROTOCOL", "HTTP/1.1"},
+				{"GATEWAY_INTERFACE", "CGI/1.1"}
+			};
+
+			const uint16_t request_id = 1;
+			bool ok = write_all(fd, encode_request(request_id, parameters));
+
+			string response;
+			bool ended = false;
+			while (ok && !ended) {
+				unsigned char header[8];
+				if (!read_all(fd, (char *)header, 8)) break;
+
+				const size_t content_len = (header[4] << 8) | header[5];
+				string content(content_len + header[6], '\0');
+				if (!read_all(fd, content.data(), content.size())) break;
+				content.resize(content_len);
+
+				if (header[1] == type_stdout) {
+					response += content;
+				} else if (header[1] == type_end_request) {
+					ended = true;
+				}
+			}
+
+			close(fd);
+
+			if (!ended) return false;
+
+			const size_t header_end = response.find("\r\n\r\n");
+			body = header_end == string::npos ? response : response.substr(header_end + 4);
+
+			return true;
+		}
+
+	}
+
+}
@@ -0,0 +1,63 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+namespace load_test {
+
+	/*
+	 * Minimal FastCGI client. Every request uses its own connection like nginx does without keep alive, so the
+	 * worker sees exactly the same traffic as in production.
+	 * */
+	namespace fcgi {
+
+		using params = std::vector<std::pair<std::string, std::string>>;
+
+		/*
+		 * Sends a GET request for uri to the FastCGI server at address ("host:port" or the path of a unix socket).
+		 * Returns false if the connection failed or the server did not complete the request. body is the response
+		 * without the CGI headers.
+		 * */
+		bool get(const std::string &address, const std::string &uri, std::string &body);
+
+		/*
+		 * Encodes a complete responder request with the given parameters and an empty stdin.
+		 * */
+		std::string encode_request(uint16_t request_id, const params &parameters);
+
+		/*
+		 * Encodes name value pairs as in the FastCGI PARAMS stream.
+		 * */
+		std::string encode_params(const params &parameters);
+
+	}
+
+}
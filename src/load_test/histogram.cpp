@@ -0,0 +1,107 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace load_test {
+
+	histogram::histogram(size_t precision)
+	: m_precision(precision), m_sub_buckets(1ull << precision),
+		m_counts((65 - precision) * (1ull << precision), 0) {
+	}
+
+	void histogram::record(uint64_t value) {
+		m_counts[bucket_index(value)]++;
+		m_count++;
+		m_sum += value;
+		m_min = std::min(m_min, value);
+		m_max = std::max(m_max, value);
+	}
+
+	void histogram::merge(const histogram &other) {
+		if (other.m_precision != m_precision) {
+			// Different layouts, record every bucket by its upper bound.
+			for (const bucket &b : other.buckets()) {
+				m_counts[bucket_index(b.m_upper)] += b.m_count;
+			}
+		} else {
+			for (size_t i = 0; i < m_counts.size(); i++) {
+				m_counts[i] += other.m_counts[i];
+			}
+		}
+		m_count += other.m_count;
+		m_sum += other.m_sum;
+		m_min = std::min(m_min, other.m_min);
+		m_max = std::max(m_max, other.m_max);
+	}
+
+	uint64_t histogram::percentile(double p) const {
+		if (m_count == 0) return 0;
+
+		const size_t rank = std::max<size_t>(1, (size_t)std::ceil(p / 100.0 * m_count));
+		size_t seen = 0;
+		for (size_t i = 0; i < m_counts.size(); i++) {
+			seen += m_counts[i];
+			if (seen >= rank) {
+				return std::min(bucket_upper(i), m_max);
+			}
+		}
+
+		return m_max;
+	}
+
+	std::vector<histogram::bucket> histogram::buckets() const {
+		std::vector<bucket> ret;
+		for (size_t i = 0; i < m_counts.size(); i++) {
+			if (m_counts[i]) {
+				ret.push_back(bucket{bucket_upper(i), m_counts[i]});
+			}
+		}
+		return ret;
+	}
+
+	/*
+	 * For values >= 2^precision the index is shift * 2^precision + (value >> shift) where shift makes the
+	 * mantissa (value >> shift) land in [2^precision, 2^(precision + 1)). This continues the exact buckets below
+	 * 2^precision without gaps.
+	 * */
+	size_t histogram::bucket_index(uint64_t value) const {
+		if (value < m_sub_buckets) return value;
+		const size_t msb = 63 - __builtin_clzll(value);
+		const size_t shift = msb - m_precision;
+		return shift * m_sub_buckets + (value >> shift);
+	}
+
+	uint64_t histogram::bucket_upper(size_t index) const {
+		if (index < 2 * m_sub_buckets) return index;
+		const size_t shift = index / m_sub_buckets - 1;
+		const uint64_t mantissa = index - shift * m_sub_buckets;
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace load_test {
+
+	/*
+	 * Log-linear histogram in the style of HdrHistogram. Values below 2^precision are counted exactly, larger
+	 * values are bucketed by their highest bit and then linearly in 2^precision sub buckets so the relative error
+	 * stays below 2^-precision for every value.
+	 * */
+	class histogram {
+
+	public:
+
+		explicit histogram(size_t precision = 7);
+
+		void record(uint64_t value);
+		void merge(const histogram &other);
+
+		size_t count() const { return m_count; }
+		uint64_t min() const { return m_count ? m_min : 0; }
+		uint64_t max() const { return m_max; }
+		double mean() const { return m_count ? (double)m_sum / m_count : 0.0; }
+
+		/*
+		 * Returns the highest value that is equivalent to the value at percentile p (0 - 100).
+		 * */
+		uint64_t percentile(double p) const;
+
+		struct bucket {
+			uint64_t m_upper;
+			size_t m_count;
+		};
+
+		/*
+		 * Returns the non empty buckets in ascending order.
+		 * */
+		std::vector<bucket> buckets() const;
+
+	private:
+
+		const size_t m_precision;
+		const uint64_t m_sub_buckets;
+		std::vector<size_t> m_counts;
+
+		size_t m_count = 0;
+		uint64_t m_min = UINT64_MAX;
+		uint64_t m_max = 0;
+		uint64_t m_sum = 0;
+
+		size_t bucket_index(uint64_t value) const;
+		uint64_t bucket_upper(size_t index) const;
+
+	};
+
+}
@@ -0,0 +1,286 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "load_test.h"
+#include "zipf.h"
+#include "fcgi_client.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include "json.hpp"
+#include "parser/Parser.h"
+#include "api/Worker.h"
+#include "system/SubSystem.h"
+#include "system/Logger.h"
+#include "full_text/FullText.h"
+#include "full_text/FullTextIndexerRunner.h"
+#include "hash_table/HashTableHelper.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace load_test {
+
+	const vector<string> syllables = {"ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo", "be", "da", "fe", "go", "hu",
+		"ji", "ly", "po"};
+
+	string synthetic_word(size_t rank) {
+		// Offset by 16 so every word has at least two syllables.
+		size_t n = rank + 16;
+		string word;
+		while (n) {
+			word = syllables[n % 16] + word;
+			n /= 16;
+		}
+		return word;
+	}
+
+	string synthetic_text(zipf_distribution &words, mt19937_64 &gen, size_t num_words) {
+		string text;
+		for (size_t i = 0; i < num_words; i++) {
+			if (i) text += " ";
+			text += synthetic_word(words(gen));
+		}
+		return text;
+	}
+
+	string synthetic_host(size_t document) {
+		return "site" + to_string(document % 250) + ".com";
+	}
+
+	void write_corpus(const string &dir, const options &opts) {
+
+		mt19937_64 gen(opts.m_seed);
+		zipf_distribution words(opts.m_vocabulary, opts.m_zipf_exponent);
+
+		ofstream corpus(dir + "/corpus.tsv", ios::trunc);
+		for (size_t i = 0; i < opts.m_documents; i++) {
+			corpus << "http://" << synthetic_host(i) << "/page" << i << ".html" << "\t"
+				<< synthetic_text(words, gen, 4) << "\t"
+				<< synthetic_text(words, gen, 3) << "\t"
+				<< synthetic_text(words, gen, 12) << "\t"
+				<< synthetic_text(words, gen, 80) << "\n";
+		}
+
+		// The harmonic centrality of the hosts scales the scores, give them a spread like the real domain index.
+		ofstream domain_index(dir + "/domain_info.tsv", ios::trunc);
+		for (size_t i = 0; i < 250; i++) {
+			domain_index << "com.site" << i << "\t" << (1.0 / (i + 1)) << "\n";
+		}
+
+		ofstream dictionary(dir + "/dictionary.tsv", ios::trunc);
+		for (size_t rank = 0; rank < opts.m_vocabulary; rank++) {
+			dictionary << synthetic_word(rank) << "\n";
+		}
+	}
+
+	vector<string> query_log(const options &opts) {
+
+		mt19937_64 gen(opts.m_seed + 1);
+		zipf_distribution words(opts.m_vocabulary, opts.m_zipf_exponent);
+		zipf_distribution popularity(opts.m_queries, opts.m_zipf_exponent);
+
+		vector<string> unique_queries;
+		for (size_t i = 0; i < opts.m_queries; i++) {
+			unique_queries.push_back(synthetic_text(words, gen, 1 + gen() % 3));
+		}
+
+		vector<string> queries;
+		for (size_t i = 0; i < opts.m_requests; i++) {
+			queries.push_back(unique_queries[popularity(gen)]);
+		}
+
+		return queries;
+	}
+
+	report replay(const string &address, const vector<string> &queries, const options &opts) {
+
+		report rep;
+		mutex report_lock;
+		atomic<size_t> next_query = 0;
+
+		const auto start = chrono::steady_clock::now();
+
+		vector<thread> threads;
+		for (size_t i = 0; i < opts.m_concurrency; i++) {
+			threads.emplace_back([&]() {
+				histogram latency;
+				size_t errors = 0;
+				string body;
+				for (size_t query = next_query++; query < queries.size(); query = next_query++) {
+					const auto request_start = chrono::steady_clock::now();
+					const bool ok = fcgi::get(address, "/?q=" + Parser::urlencode(queries[query]), body);
+					const auto elapsed = chrono::steady_clock::now() - request_start;
+
+					if (ok) {
+						latency.record(chrono::duration_cast<chrono::microseconds>(elapsed).count());
+					} else {
+						errors++;
+					}
+				}
+
+				lock_guard<mutex> guard(report_lock);
+				rep.m_latency.merge(latency);
+				rep.m_errors += errors;
+			});
+		}
+
+		for (thread &t : threads) {
+			t.join();
+		}
+
+		rep.m_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		rep.m_requests = rep.m_latency.count();
+
+		return rep;
+	}
+
+	string report_to_json(const report &rep, const options &opts) {
+
+		json message;
+		message["requests"] = rep.m_requests;
+		message["errors"] = rep.m_errors;
+		message["concurrency"] = opts.m_concurrency;
+		message["documents"] = opts.m_documents;
+		message["zipf_exponent"] = opts.m_zipf_exponent;
+		message["seconds"] = rep.m_seconds;
+		message["throughput_rps"] = rep.m_seconds > 0.0 ? rep.m_requests / rep.m_seconds : 0.0;
+
+		const histogram &latency = rep.m_latency;
+		message["latency_us"]["min"] = latency.min();
+		message["latency_us"]["mean"] = latency.mean();
+		message["latency_us"]["p50"] = latency.percentile(50.0);
+		message["latency_us"]["p90"] = latency.percentile(90.0);
+		message["latency_us"]["p99"] = latency.percentile(99.0);
+		message["latency_us"]["p999"] = latency.percentile(99.9);
+		message["latency_us"]["max"] = latency.max();
+
+		message["histogram"] = json::array();
+		for (const histogram::bucket &b : latency.buckets()) {
+			message["histogram"].push_back({{"le_us", b.m_upper}, {"count", b.m_count}});
+		}
+
+		return message.dump(1, '\t');
+	}
+
+	/*
+	 * The index files live under /mnt like all other index files so they are named with a prefix that is unique
+	 * for this process and removed when we are done.
+	 * */
+	void remove_index_files(const string &index_prefix) {
+		for (size_t i = 0; i < 8; i++) {
+			for (const string &dir : vector<string>{"full_text", "hash_table", "output"}) {
+				const boost::filesystem::path path("/mnt/" + to_string(i) + "/" + dir);
+				if (!boost::filesystem::is_directory(path)) continue;
+
+				vector<boost::filesystem::path> to_remove;
+				for (const auto &entry : boost::filesystem::directory_iterator(path)) {
+					if (entry.path().filename().string().find(index_prefix) != string::npos) {
+						to_remove.push_back(entry.path());
+					}
+				}
+				for (const auto &file : to_remove) {
+					boost::filesystem::remove_all(file);
+				}
+			}
+		}
+	}
+
+	void build_index(const string &dir, const string &index_prefix) {
+
+		const string main_index = index_prefix + "main_index";
+
+		FullText::truncate_url_to_domain(main_index);
+		for (const string &name : vector<string>{"main_index", "link_index", "domain_link_index"}) {
+			FullText::truncate_index(index_prefix + name);
+			HashTableHelper::truncate(index_prefix + name);
+		}
+
+		SubSystem sub_system(dir + "/domain_info.tsv", dir + "/dictionary.tsv");
+		FullTextIndexerRunner indexer(main_index, main_index, &sub_system);
+		indexer.run({dir + "/corpus.tsv"});
+	}
+
+	bool wait_for_server(const string &address) {
+		string body;
+		for (size_t i = 0; i < 600; i++) {
+			if (fcgi::get(address, "/?s=", body)) return true;
+			this_thread::sleep_for(100ms);
+		}
+		return false;
+	}
+
+	int run(const options &opts, ostream &out) {
+
+		const vector<string> queries = query_log(opts);
+
+		if (opts.m_address.size()) {
+			out << report_to_json(replay(opts.m_address, queries, opts), opts) << endl;
+			return 0;
+		}
+
+		const boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+			boost::filesystem::unique_path("alexandria-load-test-%%%%-%%%%");
+		boost::filesystem::create_directories(dir);
+
+		const string index_prefix = "load_test_" + to_string(getpid()) + "_";
+		const string address = (dir / "worker.sock").string();
+
+		LOG_INFO("Building synthetic index in " + dir.string());
+		write_corpus(dir.string(), opts);
+		build_index(dir.string(), index_prefix);
+
+		thread server([&address, &index_prefix]() {
+			Worker::start_server(address, index_prefix);
+		});
+
+		int ret = 1;
+		if (wait_for_server(address)) {
+			// Warm up the page cache and the posting caches before measuring.
+			options warm_up = opts;
+			warm_up.m_requests = min(opts.m_requests, opts.m_queries);
+			replay(address, query_log(warm_up), warm_up);
+
+			out << report_to_json(replay(address, queries, opts), opts) << endl;
+			ret = 0;
+		} else {
+			LOG_INFO("Worker did not start on " + address);
+		}
+
+		Worker::stop_server();
+		server.join();
+
+		remove_index_files(index_prefix);
+		boost::filesystem::remove_all(dir);
+
+		return ret;
+	}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+/*
+ * End to end load test of the FastCGI search worker. Builds a synthetic corpus and index, starts the worker on a
+ * unix socket and replays a Zipf distributed query log at fixed concurrency. The latencies are reported as json so
+ * runs on different commits can be compared.
+ * */
+namespace load_test {
+
+	struct options {
+		size_t m_documents = 20000;
+		size_t m_vocabulary = 5000;
+		// Number of unique queries in the query log.
+		size_t m_queries = 1000;
+		size_t m_requests = 2000;
+		size_t m_concurrency = 8;
+		double m_zipf_exponent = 1.0;
+		uint64_t m_seed = 1;
+		// Run against an already running server instead of building an index and starting a worker.
+		std::string m_address;
+	};
+
+	struct report {
+		size_t m_requests = 0;
+		size_t m_errors = 0;
+		double m_seconds = 0.0;
+		// Latencies in microseconds.
+		histogram m_latency;
+	};
+
+	/*
+	 * Deterministic word for a rank in the vocabulary, made of syllables so the tokenizer keeps it as one word.
+	 * */
+	std::string synthetic_word(size_t rank);
+
+	/*
+	 * Writes corpus.tsv in the column layout of the warc parser output together with domain_info.tsv and
+	 * dictionary.tsv for SubSystem.
+	 * */
+	void write_corpus(const std::string &dir, const options &opts);
+
+	/*
+	 * Returns opts.m_requests queries. The queries are drawn from a log of opts.m_queries unique queries with Zipf
+	 * distributed popularity and the words of each query are Zipf distributed over the vocabulary.
+	 * */
+	std::vector<std::string> query_log(const options &opts);
+
+	/*
+	 * Sends the queries to the worker at address with opts.m_concurrency connections in flight.
+	 * */
+	report replay(const std::string &address, const std::vector<std::string> &queries, const options &opts);
+
+	std::string report_to_json(const report &rep, const options &opts);
+
+	/*
+	 * Runs the whole load test and writes the json report to out. Returns non zero if the test could not run.
+	 * */
+	int run(const options &opts, std::ostream &out);
+
+}
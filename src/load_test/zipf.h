@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+namespace load_test {
+
+	/*
+	 * Samples ranks in [0, n) where rank k has probability proportional to 1 / (k + 1)^exponent. Query logs and
+	 * word frequencies both follow this distribution roughly with an exponent close to 1.
+	 * */
+	class zipf_distribution {
+
+	public:
+
+		zipf_distribution(size_t n, double exponent)
+		: m_cdf(n) {
+			double sum = 0.0;
+			for (size_t k = 0; k < n; k++) {
+				sum += 1.0 / std::pow((double)(k + 1), exponent);
+				m_cdf[k] = sum;
+			}
+			for (double &p : m_cdf) {
+				p /= sum;
+			}
+		}
+
+		template<typename generator>
+		size_t operator()(generator &gen) {
+			const double u = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+			const size_t rank = std::lower_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin();
+			return std::min(rank, m_cdf.size() - 1);
+		}
+
+	private:
+
+		std::vector<double> m_cdf;
+
+	};
+
+}
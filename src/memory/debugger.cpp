@@ -24,19 +24,140 @@
  * SOFTWARE.
  */
 
+#include "debugger.h"
 #include <iostream>
 #include <new>
 #include <cstdlib>
+#include <cstring>
 #include <array>
-#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <execinfo.h>
+#include <unistd.h>
 
 using namespace std;
 
 namespace memory {
 
-	mutex lock;
-	size_t mem_counter;
-	size_t ptr_counter;
+	/*
+	 * Every thread updates its own cache line aligned shard with relaxed atomics so allocations on different threads
+	 * never contend on a lock. Threads are assigned shards round robin so with more threads than shards some of them
+	 * share, which is still correct. Memory freed on another thread than it was allocated on makes a shard negative,
+	 * only the sum over all shards is meaningful.
+	 * */
+	const size_t num_shards = 64;
+
+	struct alignas(64) shard {
+		atomic<int64_t> m_bytes;
+		atomic<int64_t> m_pointers;
+		atomic<uint64_t> m_size_classes[num_size_classes];
+	};
+
+	shard shards[num_shards];
+	atomic<size_t> next_shard;
+	atomic<bool> histogram_enabled;
+
+	// Constant initialized so the thread locals are usable inside operator new without an init guard.
+	thread_local size_t shard_id = num_shards;
+	thread_local size_t sample_counter = 0;
+	thread_local bool in_profiler = false;
+
+	const size_t max_frames = 16;
+	const size_t skip_frames = 2; // record_sample and operator new.
+	const size_t num_sites = 4096;
+	const size_t max_probes = 64;
+	const size_t max_dump = 64;
+
+	struct profile_site {
+		atomic<uint64_t> m_hash;
+		atomic<size_t> m_count;
+		atomic<size_t> m_bytes;
+		atomic<size_t> m_depth;
+		void *m_frames[max_frames];
+	};
+
+	profile_site sites[num_sites];
+	atomic<size_t> sample_rate;
+	atomic<size_t> dropped_samples;
+
+	inline shard &local_shard() {
+		if (shard_id == num_shards) {
+			shard_id = next_shard.fetch_add(1, memory_order_relaxed) % num_shards;
+		}
+		return shards[shard_id];
+	}
+
+	inline size_t size_class(size_t n) {
+		return n == 0 ? 0 : 64 - __builtin_clzll(n);
+	}
+
+	uint64_t hash_frames(void **frames, size_t depth) {
+		uint64_t h = 14695981039346656037ull;
+		for (size_t i = 0; i < depth; i++) {
+			h ^= (uint64_t)frames[i];
+			h *= 1099511628211ull;
+		}
+		return h == 0 ? 1 : h;
+	}
+
+	/*
+	 * Records a sampled allocation in the open addressing table of sites. Nothing here may allocate with operator new,
+	 * backtrace only mallocs on its first call which enable_heap_profiler takes care of.
+	 * */
+	__attribute__((noinline)) void record_sample(size_t n, size_t rate) {
+
+		if (in_profiler) return;
+		in_profiler = true;
+
+		void *frames[max_frames + skip_frames];
+		const int captured = backtrace(frames, max_frames + skip_frames);
+		const size_t depth = captured > (int)skip_frames ? captured - skip_frames : 0;
+		void **stack = frames + skip_frames;
+		const uint64_t h = hash_frames(stack, depth);
+
+		for (size_t i = 0; i < max_probes; i++) {
+			profile_site &site = sites[(h + i) % num_sites];
+			uint64_t current = site.m_hash.load(memory_order_acquire);
+			if (current == 0) {
+				if (site.m_hash.compare_exchange_strong(current, h, memory_order_acq_rel)) {
+					memcpy(site.m_frames, stack, depth * sizeof(void *));
+					site.m_depth.store(depth, memory_order_release);
+					current = h;
+				}
+			}
+			if (current == h) {
+				site.m_count.fetch_add(rate, memory_order_relaxed);
+				site.m_bytes.fetch_add(n * rate, memory_order_relaxed);
+				in_profiler = false;
+				return;
+			}
+		}
+
+		dropped_samples.fetch_add(1, memory_order_relaxed);
+		in_profiler = false;
+	}
+
+	__attribute__((always_inline)) inline void count_allocation(size_t n) {
+		shard &s = local_shard();
+		s.m_bytes.fetch_add(n, memory_order_relaxed);
+		s.m_pointers.fetch_add(1, memory_order_relaxed);
+
+		if (histogram_enabled.load(memory_order_relaxed)) {
+			s.m_size_classes[size_class(n)].fetch_add(1, memory_order_relaxed);
+		}
+
+		const size_t rate = sample_rate.load(memory_order_relaxed);
+		if (rate && ++sample_counter >= rate) {
+			sample_counter = 0;
+			record_sample(n, rate);
+		}
+	}
+
+	inline void count_deallocation(size_t n) {
+		shard &s = local_shard();
+		s.m_bytes.fetch_sub(n, memory_order_relaxed);
+		s.m_pointers.fetch_sub(1, memory_order_relaxed);
+	}
 
 	bool debugger_enabled() {
 		return false;
@@ -55,69 +176,213 @@ namespace memory {
 	}
 
 	size_t allocated_memory() {
-		return mem_counter;
+		int64_t sum = 0;
+		for (const shard &s : shards) {
+			sum += s.m_bytes.load(memory_order_relaxed);
+		}
+		return sum > 0 ? sum : 0;
 	}
 
 	size_t num_allocated() {
-		return ptr_counter;
+		int64_t sum = 0;
+		for (const shard &s : shards) {
+			sum += s.m_pointers.load(memory_order_relaxed);
+		}
+		return sum > 0 ? sum : 0;
 	}
-}
 
-//https://en.cppreference.com/w/cpp/memory/new/operator_new
-void *operator new(size_t n) {
+	void enable_size_histogram(bool enabled) {
+		histogram_enabled.store(enabled, memory_order_relaxed);
+	}
 
-	void *m = malloc(n + sizeof(size_t));
+	array<size_t, num_size_classes> size_histogram() {
+		array<size_t, num_size_classes> histogram{};
+		for (const shard &s : shards) {
+			for (size_t i = 0; i < num_size_classes; i++) {
+				histogram[i] += s.m_size_classes[i].load(memory_order_relaxed);
+			}
+		}
+		return histogram;
+	}
 
-	if (m) {
-		memory::lock.lock();
-		memory::mem_counter += n;
-		memory::ptr_counter++;
-		memory::lock.unlock();
-		static_cast<size_t *>(m)[0] = n;
-		return &(static_cast<size_t *>(m)[1]);
+	void handle_profiler_signal(int) {
+		dump_heap_profile(STDERR_FILENO);
 	}
 
-	throw bad_alloc();
-}
+	/*
+	 * Clears the recorded sites and starts sampling. The signal handler dumps the profile to stderr.
+	 * */
+	void enable_heap_profiler(size_t rate, int signal) {
 
-void *operator new[](size_t n) {
+		sample_rate.store(0, memory_order_relaxed);
+
+		// The first call to backtrace loads libgcc which allocates.
+		void *frames[1];
+		backtrace(frames, 1);
 
-	void *m = malloc(n + sizeof(size_t));
+		for (profile_site &site : sites) {
+			site.m_count.store(0, memory_order_relaxed);
+			site.m_bytes.store(0, memory_order_relaxed);
+			site.m_depth.store(0, memory_order_relaxed);
+			site.m_hash.store(0, memory_order_release);
+		}
+		dropped_samples.store(0, memory_order_relaxed);
 
-	if (m) {
-		memory::lock.lock();
-		memory::mem_counter += n;
-		memory::ptr_counter++;
-		memory::lock.unlock();
-		static_cast<size_t *>(m)[0] = n;
-		return &(static_cast<size_t *>(m)[1]);
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = handle_profiler_signal;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(signal, &action, nullptr);
+
+		sample_rate.store(rate, memory_order_relaxed);
 	}
 
-	throw bad_alloc();
-}
+	void disable_heap_profiler() {
+		sample_rate.store(0, memory_order_relaxed);
+	}
 
-void operator delete(void *p) noexcept {
+	vector<heap_profile_site> heap_profile() {
+		vector<heap_profile_site> profile;
+		for (const profile_site &site : sites) {
+			const uint64_t h = site.m_hash.load(memory_order_acquire);
+			const size_t depth = site.m_depth.load(memory_order_acquire);
+			if (h == 0) continue;
+			profile.push_back(heap_profile_site{h, site.m_count.load(memory_order_relaxed),
+				site.m_bytes.load(memory_order_relaxed), vector<void *>(site.m_frames, site.m_frames + depth)});
+		}
+		sort(profile.begin(), profile.end(), [](const heap_profile_site &a, const heap_profile_site &b) {
+			return a.m_bytes > b.m_bytes;
+		});
+		return profile;
+	}
+
+	/*
+	 * Formats without allocating since this runs in the signal handler, only write and backtrace_symbols_fd are used.
+	 * */
+	class signal_safe_writer {
+	public:
+		explicit signal_safe_writer(int fd) : m_fd(fd) {}
+		~signal_safe_writer() { flush(); }
+
+		signal_safe_writer &operator<<(const char *str) {
+			while (*str) put(*str++);
+			return *this;
+		}
+
+		signal_safe_writer &operator<<(size_t value) {
+			char digits[24];
+			size_t len = 0;
+			do {
+				digits[len++] = '0' + value % 10;
+				value /= 10;
+			} while (value);
+			while (len) put(digits[--len]);
+			return *this;
+		}
+
+		void flush() {
+			size_t written = 0;
+			while (written < m_len) {
+				const ssize_t ret = write(m_fd, m_buffer + written, m_len - written);
+				if (ret <= 0) break;
+				written += ret;
+			}
+			m_len = 0;
+		}
+
+	private:
+		int m_fd;
+		char m_buffer[512];
+		size_t m_len = 0;
+
+		void put(char c) {
+			if (m_len == sizeof(m_buffer)) flush();
+			m_buffer[m_len++] = c;
+		}
+	};
+
+	void dump_heap_profile(int fd, size_t limit) {
+
+		limit = min(limit, max_dump);
+
+		// Partial insertion sort of the site indexes by bytes, the table is too large to copy on the signal stack.
+		size_t top[max_dump];
+		size_t num_top = 0;
+		for (size_t i = 0; i < num_sites; i++) {
+			if (sites[i].m_hash.load(memory_order_acquire) == 0) continue;
+			const size_t bytes = sites[i].m_bytes.load(memory_order_relaxed);
+			size_t pos = num_top < limit ? num_top++ : limit;
+			while (pos > 0 && sites[top[pos - 1]].m_bytes.load(memory_order_relaxed) < bytes) {
+				if (pos < limit) top[pos] = top[pos - 1];
+				pos--;
+			}
+			if (pos < limit) top[pos] = i;
+		}
+
+		signal_safe_writer out(fd);
+		out << "heap profile, allocated: " << allocated_memory() << " bytes in " << num_allocated() << " pointers"
+			<< ", sample rate: " << sample_rate.load(memory_order_relaxed) << ", dropped samples: "
+			<< dropped_samples.load(memory_order_relaxed) << "\n";
+
+		for (size_t i = 0; i < num_top; i++) {
+			const profile_site &site = sites[top[i]];
+			out << "#" << i << " bytes: " << site.m_bytes.load(memory_order_relaxed) << " allocations: "
+				<< site.m_count.load(memory_order_relaxed) << "\n";
+			out.flush();
+			backtrace_symbols_fd((void *const *)site.m_frames, site.m_depth.load(memory_order_acquire), fd);
+		}
+
+		if (histogram_enabled.load(memory_order_relaxed)) {
+			out << "size histogram:\n";
+			const array<size_t, num_size_classes> histogram = size_histogram();
+			for (size_t i = 0; i < num_size_classes; i++) {
+				if (histogram[i] == 0) continue;
+				out << "<" << (i < 64 ? ((size_t)1 << i) : SIZE_MAX) << " bytes: " << histogram[i] << "\n";
+			}
+		}
+	}
+
+	// Inlined into operator new so the sampled stacks always start two frames above the caller.
+	__attribute__((always_inline)) inline void *allocate(size_t n) {
 
-	void *realp = &(static_cast<size_t *>(p)[-1]);
-	const size_t n = static_cast<size_t *>(p)[-1];
+		void *m = malloc(n + sizeof(size_t));
 
-	memory::lock.lock();
-	memory::mem_counter -= n;
-	memory::ptr_counter--;
-	memory::lock.unlock();
+		if (m) {
+			count_allocation(n);
+			static_cast<size_t *>(m)[0] = n;
+			return &(static_cast<size_t *>(m)[1]);
+		}
 
-	free(realp);
+		throw bad_alloc();
+	}
+
+	inline void deallocate(void *p) {
+
+		if (p == nullptr) return;
+
+		void *realp = &(static_cast<size_t *>(p)[-1]);
+		const size_t n = static_cast<size_t *>(p)[-1];
+
+		count_deallocation(n);
+
+		free(realp);
+	}
 }
 
-void operator delete[](void *p) noexcept {
+//https://en.cppreference.com/w/cpp/memory/new/operator_new
+void *operator new(size_t n) {
+	return memory::allocate(n);
+}
 
-	void *realp = &(static_cast<size_t *>(p)[-1]);
-	const size_t n = static_cast<size_t *>(p)[-1];
+void *operator new[](size_t n) {
+	return memory::allocate(n);
+}
 
-	memory::lock.lock();
-	memory::mem_counter -= n;
-	memory::ptr_counter--;
-	memory::lock.unlock();
+void operator delete(void *p) noexcept {
+	memory::deallocate(p);
+}
 
-	free(realp);
+void operator delete[](void *p) noexcept {
+	memory::deallocate(p);
 }
@@ -24,9 +24,42 @@
  * SOFTWARE.
  */
 
+#pragma once
+
 #include <iostream>
+#include <array>
+#include <vector>
+#include <csignal>
 
 namespace memory {
+
+	/*
+	 * Allocations are counted in per thread shards without locking. The totals are aggregated from the shards when
+	 * read, the merge thread does that every 100ms to decide when to append.
+	 * */
 	size_t allocated_memory(); // Returns number of allocated bytes.
 	size_t num_allocated(); // Returns number of allocated pointers.
+
+	/*
+	 * Size class i counts allocations of size [2^(i-1), 2^i), class 0 counts zero sized allocations.
+	 * */
+	const size_t num_size_classes = 65;
+	void enable_size_histogram(bool enabled);
+	std::array<size_t, num_size_classes> size_histogram(); // Returns number of allocations per size class.
+
+	struct heap_profile_site {
+		uint64_t m_hash;
+		size_t m_count; // Estimated number of allocations, the number of samples times the sample rate.
+		size_t m_bytes; // Estimated number of allocated bytes.
+		std::vector<void *> m_frames;
+	};
+
+	/*
+	 * Samples one in sample_rate allocations and records them by the hash of their call stack. The top allocation
+	 * sites are written to stderr when the process receives the signal.
+	 * */
+	void enable_heap_profiler(size_t sample_rate, int signal = SIGUSR2);
+	void disable_heap_profiler();
+	std::vector<heap_profile_site> heap_profile(); // Returns the recorded sites sorted by bytes, descending.
+	void dump_heap_profile(int fd, size_t limit = 20);
 }
@@ -37,23 +37,26 @@ const vector<string> non_content_tags{"script", "noscript", "style", "embed", "l
 	"iframe", "head", "meta", "link", "object", "aside", "channel", "img"};
 
 HtmlParser::HtmlParser()
-: m_long_str_buf_len(Config::html_parser_long_text_len)
+: m_long_text_len(Config::html_parser_long_text_len)
 {
-	m_long_str_buf = new char[m_long_str_buf_len];
+	m_text.reserve(m_long_text_len + 1);
 }
 
 HtmlParser::~HtmlParser() {
-	delete [] m_long_str_buf;
 }
 
-void HtmlParser::parse(const string &html) {
+void HtmlParser::parse(string_view html) {
 	parse(html, "");
 }
 
-void HtmlParser::parse(const string &html, const string &url) {
+/*
+ * Parses the document in one pass over the tokens. Title, h1 and link texts are collected without the tags inside
+ * them, the body text gets a space for every tag. The text starts at the first </h1> or at <body> if there is none
+ * before it. Entities are decoded and ISO-8859-1 converted to UTF-8 as the text is appended.
+ * */
+void HtmlParser::parse(string_view html, const string &url) {
 
 	m_should_insert = false;
-	m_should_insert = false;
 
 	parse_url(url, m_host, m_path, "");
 
@@ -61,7 +64,6 @@ void HtmlParser::parse(const string &html, const string &url) {
 	m_h1.clear();
 	m_meta.clear();
 	m_text.clear();
-	m_invisible_pos.clear();
 	m_links.clear();
 	m_internal_links.clear();
 
@@ -71,95 +73,124 @@ void HtmlParser::parse(const string &html, const string &url) {
 		return;
 	}
 
-	find_scripts(html);
-	find_styles(html);
-	sort_invisible();
-	find_links(html, url);
+	bool in_title = false;
+	bool in_h1 = false;
+	bool in_link = false;
+	bool in_text = false;
+	bool found_title = false;
+	bool found_h1 = false;
+	bool found_meta = false;
+	bool found_h1_end = false;
+	bool link_nofollow = false;
+
+	parser::html_tokenizer tokenizer(html);
+	parser::html_token token;
+	while (tokenizer.next(token)) {
+
+		if (token.m_type == parser::html_token_type::text) {
+			if (in_title) append_text(m_title, token.m_text, HTML_PARSER_MAX_TITLE_LEN + 2);
+			if (in_h1) append_text(m_h1, token.m_text, HTML_PARSER_MAX_H1_LEN + 2);
+			if (in_link) append_text(m_link_text, token.m_text, HTML_PARSER_CLEANBUF_LEN);
+			if (in_text) append_text(m_text, token.m_text, m_long_text_len);
+			continue;
+		}
 
-	m_title = get_tag_content(html, "<title", "</title>");
-	m_h1 = get_tag_content(html, "<h1", "</h1>");
-	m_meta = get_meta_tag(html);
-	m_text = get_text_content(html);
+		// Insert a space, because we don't want to concatenate words.
+		if (in_text) append_space(m_text, m_long_text_len);
+
+		if (token.m_type == parser::html_token_type::start_tag) {
+			if (token.is("a")) {
+				if (!in_link && token.has_attribute("href")) {
+					in_link = true;
+					m_link_href = token.attribute("href");
+					link_nofollow = token.attribute("rel").find("nofollow") != string_view::npos;
+					m_link_text.clear();
+				}
+			} else if (token.is("title")) {
+				in_title = !found_title;
+				found_title = true;
+			} else if (token.is("h1")) {
+				in_h1 = !found_h1;
+				found_h1 = true;
+			} else if (token.is("meta")) {
+				if (!found_meta) found_meta = parse_meta(token);
+			} else if (token.is("body")) {
+				in_text = true;
+			}
+		} else {
+			if (token.is("a")) {
+				if (in_link) {
+					in_link = false;
+					finish_text(m_link_text);
+					parse_link(m_link_href, link_nofollow, m_link_text, url);
+				}
+			} else if (token.is("title")) {
+				in_title = false;
+			} else if (token.is("h1")) {
+				in_h1 = false;
+				if (!found_h1_end) {
+					found_h1_end = true;
+					in_text = true;
+					m_text.clear();
+				}
+			}
+		}
+	}
 
-	Text::trim_punct(m_meta);
+	// Unclosed title and h1 are ignored.
+	if (in_title) m_title.clear();
+	if (in_h1) m_h1.clear();
 
-	if (m_encoding == ENC_ISO_8859_1) {
-		iso_to_utf8(m_title);
-		iso_to_utf8(m_h1);
-		iso_to_utf8(m_meta);
-		iso_to_utf8(m_text);
-	}
+	finish_text(m_title);
+	finish_text(m_h1);
+	finish_text(m_meta);
+	// Only texts shorter than the clean buffer are trimmed, same as before the single pass parser.
+	if (m_text.size() < HTML_PARSER_CLEANBUF_LEN) finish_text(m_text);
 
-	clean_text(m_title);
 	if (m_title.size() == 0 || is_exotic_language(m_title) || m_title.size() > HTML_PARSER_MAX_TITLE_LEN) return;
 	m_should_insert = true;
 
-	clean_text(m_h1);
-	clean_text(m_meta);
-	clean_text(m_text);
-
 	if (m_h1.size() > HTML_PARSER_MAX_H1_LEN) {
 		m_should_insert = false;
 		return;
 	}
 }
 
-void HtmlParser::find_scripts(const string &html) {
-	size_t pos = 0;
-	pair<size_t, size_t> tag(0, 0);
-	while (pos != string::npos) {
-		tag = find_tag(html, "<script", "</script>", tag.second);
-		if (tag.second == string::npos) {
-			break;
+/*
+ * Reads the content of description meta tags, name="description", property="og:description" and similar.
+ * */
+bool HtmlParser::parse_meta(const parser::html_token &token) {
+
+	const string_view suffix = "description";
+
+	bool is_description = false;
+	bool has_content = false;
+	string_view content;
+
+	string_view attributes = token.m_attributes;
+	string_view name, value;
+	while (parser::next_attribute(attributes, name, value)) {
+		if (parser::iequals(name, "content")) {
+			has_content = true;
+			content = value;
+		} else if (value.size() >= suffix.size() && value.substr(value.size() - suffix.size()) == suffix) {
+			is_description = true;
 		}
-		m_invisible_pos.push_back(tag);
 	}
-}
 
-void HtmlParser::find_styles(const string &html) {
-	size_t pos = 0;
-	pair<size_t, size_t> tag(0, 0);
-	while (pos != string::npos) {
-		tag = find_tag(html, "<style", "</style>", tag.second);
-		if (tag.second == string::npos) {
-			break;
-		}
-		m_invisible_pos.push_back(tag);
-	}
-}
+	if (!is_description || !has_content) return false;
 
-void HtmlParser::find_links(const string &html, const string &base_url) {
-	size_t pos = 0;
-	pair<size_t, size_t> tag(0, 0);
-	while (pos != string::npos) {
-		tag = find_tag(html, "<a ", "</a>", tag.second);
-		if (tag.second == string::npos) {
-			break;
-		}
+	append_text(m_meta, content, HTML_PARSER_CLEANBUF_LEN);
 
-		parse_link(html.substr(tag.first, tag.second - tag.first), base_url);
-	}
+	return true;
 }
 
-int HtmlParser::parse_link(const string &link, const string &base_url) {
-	const string href_key = "href=\"";
-	const size_t key_len = href_key.size();
-	const size_t href_start = link.find(href_key);
-	if (href_start == string::npos) return ::Parser::ERROR;
-	const size_t href_end = link.find("\"", href_start + key_len);
-	if (href_end == string::npos) return ::Parser::ERROR;
-	string href = link.substr(href_start + key_len, href_end - href_start - key_len);
-
-	const string rel_key = "rel=\"";
-	const size_t rel_key_len = rel_key.size();
-	const size_t rel_start = link.find(rel_key);
-	bool nofollow = false;
-	if (rel_start != string::npos) {
-		// "rel=" present in string
-		const size_t rel_end = link.find("\"", rel_start + key_len);
-		const string rel = link.substr(rel_start + rel_key_len, rel_end - rel_start - rel_key_len);
-		if (rel.find("nofollow") != string::npos) nofollow = true;
-	}
+int HtmlParser::parse_link(const string &href, bool nofollow, const string &text, const string &base_url) {
+
+	if (text.empty()) return ::Parser::ERROR;
+
+	// Relative links resolve to our own host and are ignored below, so skip the url parsing for them.
+	if (!is_absolute_url(href)) return ::Parser::OK;
 
 	string host;
 	string path;
@@ -171,23 +202,24 @@ int HtmlParser::parse_link(const string &link, const string &base_url) {
 		return ::Parser::OK;
 	}
 
-	const size_t content_start = link.find(">", href_end) + 1;
-	if (content_start == string::npos) return ::Parser::ERROR;
-	const size_t content_end = link.find("</a>", content_start);
-	string content = link.substr(content_start, content_end - content_start);
-
-	if (m_encoding == ENC_ISO_8859_1) {
-		iso_to_utf8(content);
-	}
-	clean_text(content);
-
-	if (content == "") return ::Parser::ERROR;
-
-	m_links.push_back(HtmlLink(m_host, m_path, host, path, nofollow, content));
+	m_links.push_back(HtmlLink(m_host, m_path, host, path, nofollow, text));
 
 	return ::Parser::OK;
 }
 
+/*
+ * Returns true if the url has a scheme or starts with // so it can point to another host.
+ * */
+bool HtmlParser::is_absolute_url(string_view url) {
+	if (url.starts_with("//")) return true;
+	for (size_t i = 0; i < url.size(); i++) {
+		const char c = url[i];
+		if (c == ':') return i > 0;
+		if (!isalnum((unsigned char)c) && c != '+' && c != '-' && c != '.') return false;
+	}
+	return false;
+}
+
 int HtmlParser::parse_url(const string &url, string &host, string &path, const string &base_url) {
 	CURLU *h = curl_url();
 	if (!h) return ::Parser::ERROR;
@@ -245,35 +277,94 @@ void HtmlParser::remove_www(string &path) {
 	Text::trim(path);
 }
 
-void HtmlParser::parse_encoding(const string &html) {
+void HtmlParser::parse_encoding(string_view html) {
 	m_encoding = ENC_UTF_8;
-	const size_t pos_start = html.find("charset=");
-	if (pos_start == string::npos || pos_start > 1024) return;
 
-	string encoding = html.substr(pos_start, 40);
-	encoding = Text::lower_case(encoding);
+	// Only the start of the document is searched.
+	const string_view key = "charset=";
+	const size_t pos_start = html.substr(0, 1024 + key.size()).find(key);
+	if (pos_start == string::npos) return;
+
+	char encoding[40];
+	const size_t len = min(sizeof(encoding), html.size() - pos_start);
+	for (size_t i = 0; i < len; i++) {
+		encoding[i] = tolower((unsigned char)html[pos_start + i]);
+	}
+	const string_view encoding_view(encoding, len);
 
-	const size_t utf8_start = encoding.find("utf-8");
-	const size_t iso88591_start = encoding.find("iso-8859-1");
-	if (utf8_start != string::npos) m_encoding = ENC_UTF_8;
-	else if (iso88591_start != string::npos) m_encoding = ENC_ISO_8859_1;
+	if (encoding_view.find("utf-8") != string::npos) m_encoding = ENC_UTF_8;
+	else if (encoding_view.find("iso-8859-1") != string::npos) m_encoding = ENC_ISO_8859_1;
 	else m_encoding = ENC_UNKNOWN;
 }
 
-void HtmlParser::iso_to_utf8(string &str) {
-	string str_out;
-	for (std::string::iterator it = str.begin(); it != str.end(); ++it)
-	{
-		uint8_t ch = *it;
-		if (ch < 0x80) {
-			str_out.push_back(ch);
+/*
+ * Appends text with entities decoded and whitespace collapsed to single spaces, stops at max_len bytes.
+ * */
+void HtmlParser::append_text(string &out, string_view text, size_t max_len) {
+
+	const char *str = text.data();
+	const size_t len = text.size();
+	char decoded[8];
+
+	const bool convert_iso = m_encoding == ENC_ISO_8859_1;
+
+	for (size_t i = 0; i < len && out.size() < max_len; ) {
+
+		// Plain characters are appended in one go.
+		size_t run = i;
+		while (run < len && !needs_decoding(str[run], convert_iso)) run++;
+		if (run > i) {
+			const size_t run_len = min(run - i, max_len - out.size());
+			out.append(str + i, run_len);
+			i += run_len;
+			continue;
 		}
-		else {
-			str_out.push_back(0xc0 | ch >> 6);
-			str_out.push_back(0x80 | (ch & 0x3f));
+
+		const unsigned char ch = str[i];
+		if (ch == '&') {
+			size_t decoded_len;
+			const size_t consumed = decode_html_entity_utf8(str + i, len - i, decoded, &decoded_len);
+			if (consumed) {
+				for (size_t j = 0; j < decoded_len; j++) {
+					append_char(out, decoded[j]);
+				}
+				i += consumed;
+				continue;
+			}
+		}
+		if (ch >= 0x80 && convert_iso) {
+			out.push_back(0xc0 | ch >> 6);
+			out.push_back(0x80 | (ch & 0x3f));
+		} else {
+			append_char(out, ch);
 		}
+		i++;
 	}
-	str = str_out;
+}
+
+inline bool HtmlParser::needs_decoding(char c, bool convert_iso) {
+	const unsigned char ch = c;
+	return ch == '&' || isspace(ch) || (ch >= 0x80 && convert_iso);
+}
+
+inline void HtmlParser::append_char(string &out, char c) {
+	if (isspace((unsigned char)c)) {
+		if (!out.empty() && out.back() != ' ') out.push_back(' ');
+	} else {
+		out.push_back(c);
+	}
+}
+
+inline void HtmlParser::append_space(string &out, size_t max_len) {
+	if (!out.empty() && out.back() != ' ' && out.size() < max_len) out.push_back(' ');
+}
+
+/*
+ * Trims whitespace and punctuation from both ends.
+ * */
+inline void HtmlParser::finish_text(string &out) {
+	Text::ltrim(out);
+	Text::rtrim(out);
 }
 
 string HtmlParser::title() {
@@ -335,157 +426,6 @@ string HtmlParser::url_tld(const string &url) {
 	return response;
 }
 
-inline pair<size_t, size_t> HtmlParser::find_tag(const string &html, const string &tag_start, const string &tag_end,
-	size_t pos) {
-	size_t pos_start = html.find(tag_start, pos);
-	if (pos_start == string::npos) return pair<size_t, size_t>(string::npos, string::npos);
-
-	const size_t pos_end = html.find(tag_end, pos_start);
-	if (pos_end == string::npos) return pair<size_t, size_t>(string::npos, string::npos);
-	return pair<size_t, size_t>(pos_start, pos_end + tag_end.size());
-}
-
-string HtmlParser::get_tag_content(const string &html, const string &tag_start, const string &tag_end) {
-	size_t pos_start = html.find(tag_start);
-	if (pos_start == string::npos || is_invisible(pos_start)) return "";
-	pos_start = html.find(">", pos_start);
-
-	const size_t pos_end = html.find(tag_end, pos_start);
-	const size_t len = pos_end - pos_start;
-	if (pos_end == string::npos) return "";
-	return (string)html.substr(pos_start + 1, len - 1);
-}
-
-string HtmlParser::get_meta_tag(const string &html) {
-	size_t pos_start = 0;
-	while ((pos_start = html.find("<meta", pos_start + 1)) != string::npos)  {
-		const size_t pos_end = html.find(">", pos_start);
-		const size_t pos_description = html.find("description\"", pos_start);
-		if (pos_description < pos_end) {
-			const size_t pos_end_tag = html.find(">", pos_description);
-			const size_t pos_start_tag = html.rfind("<", pos_description);
-
-			const string s = "content=";
-			const size_t content_start = html.find(s, pos_start_tag);
-			if (content_start != string::npos && content_start <= pos_end_tag) {
-				return (string)html.substr(content_start + s.size(), pos_end_tag - content_start - s.size() - 1);
-			}
-		}
-	}
-	return "";
-}
-
-void HtmlParser::clean_text(string &str) {
-	strip_tags(str);
-	if (str.size() >= HTML_PARSER_CLEANBUF_LEN) return;
-	decode_html_entities_utf8(m_clean_buff, str.c_str());
-	str = m_clean_buff;
-	strip_whitespace(str);
-	Text::trim(str);
-}
-
-void HtmlParser::strip_tags(string &html) {
-	const int len = html.size();
-	bool copy = true;
-	bool last_was_space = false;
-	int i = 0, j = 0;
-	const char *html_s = html.c_str();
-	for (; i < len; i++) {
-		if (html_s[i] == '<') copy = false;
-		if (isspace(html_s[i])) {
-			html[j] = ' ';
-			if (copy && !last_was_space) j++;
-			last_was_space = true;
-		} else {
-			html[j] = html_s[i];
-			if (copy) j++;
-			last_was_space = false;
-		}
-		if (html_s[i] == '>') copy = true;
-	}
-	html.resize(j);
-}
-
-void HtmlParser::strip_whitespace(string &html) {
-	const int len = html.size();
-	bool last_was_space = false;
-	int i = 0, j = 0;
-	const char *html_s = html.c_str();
-	for (; i < len; i++) {
-		if (isspace(html_s[i])) {
-			html[j] = ' ';
-			if (!last_was_space) j++;
-			last_was_space = true;
-		} else {
-			html[j] = html_s[i];
-			j++;
-			last_was_space = false;
-		}
-	}
-	html.resize(j);
-}
-
-/*
- * This function returns the text content of the html by first trying to fetch content after the first <h1>...</h1> tag. If no h1 tag is present
- * it tries to fetch content from the start of the <body>
- * */
-string HtmlParser::get_text_content(const string &html) {
-	size_t pos_start = html.find("</h1>");
-
-	// Start from body if no h1 is present
-	if (pos_start == string::npos || is_invisible(pos_start)) {
-		pos_start = html.find("<body");
-	}
-	if (pos_start == string::npos || is_invisible(pos_start)) {
-		return "";
-	}
-
-	const size_t len = html.size();
-	bool copy = true;
-	bool ignore = false;
-	bool last_was_space = false;
-	size_t i = pos_start, j = 0;
-
-	auto interval = m_invisible_pos.begin();
-	const auto invisible_end = m_invisible_pos.end();
-	while (interval != m_invisible_pos.end() && interval->first < pos_start) {
-		interval++;
-	}
-
-	const char *html_s = html.c_str();
-
-	for (; i < len && j < m_long_str_buf_len; i++) {
-		if (html_s[i] == '<') {
-			if (interval != invisible_end && interval->first == i) {
-				// Skip the whole invisible tag.
-				i = interval->second - 1;
-				interval++;
-				continue;
-			}
-			// Insert a space, because we don't want to concatenate words.
-			m_long_str_buf[j] = ' ';
-			if (copy && !last_was_space) j++;
-			last_was_space = true;
-
-			copy = false;
-		}
-		if (isspace(html_s[i])) {
-			if (j < m_long_str_buf_len) m_long_str_buf[j] = ' ';
-			if (copy && !last_was_space) j++;
-			last_was_space = true;
-		} else {
-			if (j < m_long_str_buf_len) m_long_str_buf[j] = html_s[i];
-			if (copy) j++;
-			last_was_space = false;
-		}
-		if (!ignore && html_s[i] == '>') copy = true;
-	}
-
-	string text(m_long_str_buf, j);
-
-	return text;
-}
-
 bool HtmlParser::is_exotic_language_debug(const string &str) const {
 	const size_t len = str.size();
 	const char *cstr = str.c_str();
@@ -553,17 +493,3 @@ bool HtmlParser::is_exotic_language(const string &str) const {
 
 	return false;
 }
-
-void HtmlParser::sort_invisible() {
-	sort(m_invisible_pos.begin(), m_invisible_pos.end(), [](const pair<int, int>& lhs, const pair<int, int>& rhs) {
-		return lhs.first < rhs.first;
-	});
-}
-
-inline bool HtmlParser::is_invisible(size_t pos) {
-	for (const auto &interval : m_invisible_pos) {
-		if (interval.first <= pos && pos < interval.second) return true;
-	}
-	return false;
-}
-
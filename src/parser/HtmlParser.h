@@ -27,6 +27,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <iostream>
@@ -36,6 +37,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include "HtmlLink.h"
+#include "html_tokenizer.h"
 #include "parser/Unicode.h"
 
 #define HTML_PARSER_LONG_TEXT_LEN 1000
@@ -56,8 +58,8 @@ public:
 	HtmlParser();
 	~HtmlParser();
 
-	void parse(const std::string &html, const std::string &url);
-	void parse(const std::string &html);
+	void parse(std::string_view html, const std::string &url);
+	void parse(std::string_view html);
 
 	std::string title();
 	std::string meta();
@@ -76,11 +78,9 @@ private:
 
 	std::vector<HtmlLink> m_links;
 	std::vector<HtmlLink> m_internal_links;
-	std::vector<std::pair<size_t, size_t>> m_invisible_pos;
 
 	char m_clean_buff[HTML_PARSER_CLEANBUF_LEN];
-	const size_t m_long_str_buf_len;
-	char *m_long_str_buf;
+	const size_t m_long_text_len;
 	unsigned char m_encoding_buffer[HTML_PARSER_ENCODING_BUFFER_LEN];
 	bool m_should_insert;
 	int m_encoding = ENC_UNKNOWN;
@@ -90,28 +90,24 @@ private:
 	std::string m_meta;
 	std::string m_text;
 
+	// Link being parsed.
+	std::string m_link_href;
+	std::string m_link_text;
+
 	std::string m_host;
 	std::string m_path;
 
-	void find_scripts(const std::string &html);
-	void find_styles(const std::string &html);
-	void find_links(const std::string &html, const std::string &base_url);
-
-	int parse_link(const std::string &link, const std::string &base_url);
+	int parse_link(const std::string &href, bool nofollow, const std::string &text, const std::string &base_url);
+	bool is_absolute_url(std::string_view url);
 	int parse_url(const std::string &url, std::string &host, std::string &path, const std::string &base_url);
 	inline void remove_www(std::string &path);
-	void parse_encoding(const std::string &html);
-	void iso_to_utf8(std::string &text);
-
-	inline std::pair<size_t, size_t> find_tag(const std::string &html, const std::string &tag_start, const std::string &tag_end,
-		size_t pos);
-	std::string get_tag_content(const std::string &html, const std::string &tag_start, const std::string &tag_end);
-	std::string get_meta_tag(const std::string &html);
-	void clean_text(std::string &str);
-	void strip_whitespace(std::string &html);
-	void strip_tags(std::string &html);
-	std::string get_text_content(const std::string &html);
-	void sort_invisible();
-	inline bool is_invisible(size_t pos);
+	void parse_encoding(std::string_view html);
+	bool parse_meta(const parser::html_token &token);
+
+	void append_text(std::string &out, std::string_view text, size_t max_len);
+	inline bool needs_decoding(char c, bool convert_iso);
+	inline void append_char(std::string &out, char c);
+	inline void append_space(std::string &out, size_t max_len);
+	inline void finish_text(std::string &out);
 
 };
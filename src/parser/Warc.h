@@ -3,12 +3,9 @@
 
 #include <iostream>
 #include "HtmlParser.h"
-#include "zlib.h"
+#include "warc_reader.h"
 #include "parser/Parser.h"
 
-#define WARC_PARSER_ZLIB_IN 1024*1024*16
-#define WARC_PARSER_ZLIB_OUT 1024*1024*16
-
 namespace Warc {
 
 	using std::string;
@@ -21,34 +18,27 @@ namespace Warc {
 			~Parser();
 
 			bool parse_stream(std::istream &stream);
+
+			/*
+			 * Parses a local gzipped warc file. Files with one gzip member per record are split in num_threads parts
+			 * that are inflated and parsed in parallel, the results are in the same order as parse_stream gives.
+			 * */
+			bool parse_file(const std::string &path, size_t num_threads);
+
 			const string &result() const { return m_result; };
 			const string &link_result() const { return m_links; };
 			const string &internal_link_result() const { return m_internal_links; };
 
 		private:
 
-			int m_cur_offset = 0;
-			bool m_continue_inflate = false;
 			std::string m_result;
 			std::string m_links;
 			std::string m_internal_links;
 			HtmlParser m_html_parser;
+			parser::warc_reader m_reader;
 
-			char *m_z_buffer_in;
-			char *m_z_buffer_out;
-
-			z_stream m_zstream; /* decompression stream */
-
-			size_t m_handled = 0;
-			size_t m_num_handled = 0;
-			string m_current_record;
-
-			int unzip_record(char *data, int size);
-			int unzip_chunk(int bytes_in);
-
-			void handle_record_chunk(char *data, int len);
-			void parse_record(const std::string &warc_header, const std::string &warc_record);
-			std::string get_warc_header(const std::string &record);
+			void parse_records(parser::warc_reader &reader);
+			void parse_record(const parser::warc_record &record);
 			size_t http_response_code(const string &http_header);
 
 	};
@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 using namespace std;
 
@@ -388,3 +389,42 @@ size_t decode_html_entities_utf8(char *dest, const char *src)
 
 	return (size_t)(to - dest);
 }
+
+size_t decode_html_entity_utf8(const char *src, size_t src_len, char *dest, size_t *dest_len)
+{
+	char name[16];
+	size_t end = 1;
+	while(end < src_len && end < sizeof name && src[end] != ';') ++end;
+	if(end >= src_len || end >= sizeof name || src[end] != ';') return 0;
+
+	memcpy(name, src + 1, end);
+	name[end] = 0;
+
+	if(name[0] == '#')
+	{
+		char *tail = NULL;
+		bool hex = name[1] == 'x' || name[1] == 'X';
+		const char *digits = name + (hex ? 2 : 1);
+		if(!isxdigit((unsigned char)*digits)) return 0;
+
+		int errno_save = errno;
+		errno = 0;
+		unsigned long cp = strtoul(digits, &tail, hex ? 16 : 10);
+
+		bool fail = errno || *tail != ';' || cp == 0 || cp > UNICODE_MAX;
+		errno = errno_save;
+		if(fail) return 0;
+
+		*dest_len = putc_utf8(cp, dest);
+		return end + 1;
+	}
+
+	const char *entity = get_named_entity(name);
+	if(!entity) return 0;
+
+	size_t len = strlen(entity);
+	memcpy(dest, entity, len);
+	*dest_len = len;
+
+	return end + 1;
+}
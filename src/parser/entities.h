@@ -17,4 +17,14 @@ extern size_t decode_html_entities_utf8(char *dest, const char *src);
 	The function returns the length of the decoded string.
 */
 
+extern size_t decode_html_entity_utf8(const char *src, size_t src_len, char *dest, size_t *dest_len);
+/*	Decodes the single entity at the start of <src>, which begins with '&',
+	into <dest> which should hold at least 8 characters. At most <src_len>
+	characters of <src> are read and it does not have to be terminated.
+
+	The function returns the number of characters consumed from <src> and
+	stores the decoded length in <dest_len>, or returns 0 if <src> does not
+	start with a valid entity.
+*/
+
 #endif
@@ -0,0 +1,242 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "html_tokenizer.h"
+#include <cstring>
+
+using namespace std;
+
+namespace parser {
+
+	inline bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+	}
+
+	inline bool is_alpha(char c) {
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+	}
+
+	inline char to_lower(char c) {
+		return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+	}
+
+	bool iequals(string_view str, string_view lower) {
+		if (str.size() != lower.size()) return false;
+		for (size_t i = 0; i < str.size(); i++) {
+			if (to_lower(str[i]) != lower[i]) return false;
+		}
+		return true;
+	}
+
+	bool next_attribute(string_view &attributes, string_view &name, string_view &value) {
+
+		const size_t len = attributes.size();
+		size_t pos = 0;
+		while (pos < len && (is_space(attributes[pos]) || attributes[pos] == '/')) pos++;
+		if (pos == len) {
+			attributes = string_view();
+			return false;
+		}
+
+		const size_t name_start = pos;
+		while (pos < len && !is_space(attributes[pos]) && attributes[pos] != '/' && (attributes[pos] != '=' ||
+			pos == name_start)) {
+			pos++;
+		}
+		name = attributes.substr(name_start, pos - name_start);
+
+		while (pos < len && is_space(attributes[pos])) pos++;
+
+		value = string_view();
+		if (pos < len && attributes[pos] == '=') {
+			pos++;
+			while (pos < len && is_space(attributes[pos])) pos++;
+			if (pos < len && (attributes[pos] == '"' || attributes[pos] == '\'')) {
+				const size_t value_start = pos + 1;
+				const size_t value_end = min(attributes.find(attributes[pos], value_start), len);
+				value = attributes.substr(value_start, value_end - value_start);
+				pos = min(value_end + 1, len);
+			} else {
+				const size_t value_start = pos;
+				while (pos < len && !is_space(attributes[pos])) pos++;
+				value = attributes.substr(value_start, pos - value_start);
+			}
+		}
+
+		attributes.remove_prefix(pos);
+
+		return true;
+	}
+
+	bool html_token::is(string_view lower_name) const {
+		return iequals(m_name, lower_name);
+	}
+
+	string_view html_token::attribute(string_view lower_name) const {
+		string_view attributes = m_attributes;
+		string_view name, value;
+		while (next_attribute(attributes, name, value)) {
+			if (iequals(name, lower_name)) return value;
+		}
+		return string_view();
+	}
+
+	bool html_token::has_attribute(string_view lower_name) const {
+		string_view attributes = m_attributes;
+		string_view name, value;
+		while (next_attribute(attributes, name, value)) {
+			if (iequals(name, lower_name)) return true;
+		}
+		return false;
+	}
+
+	html_tokenizer::html_tokenizer(string_view html)
+	: m_html(html) {
+	}
+
+	bool html_tokenizer::next(html_token &token) {
+
+		if (!m_raw_text_tag.empty()) skip_raw_text();
+
+		const size_t len = m_html.size();
+
+		while (m_pos < len) {
+
+			if (!is_tag_start(m_pos)) break;
+
+			const char type = m_html[m_pos + 1];
+			if (type == '!' || type == '?') {
+				// Comments end with -->, doctypes, cdata and processing instructions with the first >.
+				const bool comment = m_html.compare(m_pos, 4, "<!--") == 0;
+				const size_t end = comment ? m_html.find("-->", m_pos + 4) : m_html.find('>', m_pos + 2);
+				m_pos = end == string_view::npos ? len : end + (comment ? 3 : 1);
+				continue;
+			}
+
+			const bool end_tag = type == '/';
+			const size_t name_start = m_pos + (end_tag ? 2 : 1);
+			size_t name_end = name_start;
+			while (name_end < len && !is_space(m_html[name_end]) && m_html[name_end] != '/' && m_html[name_end] != '>') {
+				name_end++;
+			}
+			const size_t tag_end = find_tag_end(name_end);
+
+			token.m_type = end_tag ? html_token_type::end_tag : html_token_type::start_tag;
+			token.m_name = m_html.substr(name_start, name_end - name_start);
+			token.m_attributes = end_tag ? string_view() : m_html.substr(name_end, tag_end - name_end);
+			token.m_text = string_view();
+			token.m_self_closing = tag_end < len && tag_end > name_end && m_html[tag_end - 1] == '/';
+
+			m_pos = tag_end < len ? tag_end + 1 : len;
+
+			if (!end_tag && !token.m_self_closing) {
+				if (token.is("script")) m_raw_text_tag = "script";
+				else if (token.is("style")) m_raw_text_tag = "style";
+			}
+
+			return true;
+		}
+
+		if (m_pos >= len) return false;
+
+		// Text up to the next tag, a < that does not start a tag is text.
+		size_t end = m_pos + 1;
+		while (end < len) {
+			const char *next = (const char *)memchr(m_html.data() + end, '<', len - end);
+			if (next == nullptr) {
+				end = len;
+				break;
+			}
+			end = next - m_html.data();
+			if (is_tag_start(end)) break;
+			end++;
+		}
+
+		token.m_type = html_token_type::text;
+		token.m_name = string_view();
+		token.m_attributes = string_view();
+		token.m_text = m_html.substr(m_pos, end - m_pos);
+		token.m_self_closing = false;
+
+		m_pos = end;
+
+		return true;
+	}
+
+	void html_tokenizer::skip_raw_text() {
+
+		const size_t len = m_html.size();
+		const size_t tag_len = m_raw_text_tag.size();
+
+		size_t pos = m_pos;
+		while ((pos = m_html.find("</", pos)) != string_view::npos) {
+			const size_t after = pos + 2 + tag_len;
+			if (iequals(m_html.substr(pos + 2, tag_len), m_raw_text_tag) &&
+				(after >= len || is_space(m_html[after]) || m_html[after] == '>' || m_html[after] == '/')) {
+				break;
+			}
+			pos += 2;
+		}
+
+		m_pos = pos == string_view::npos ? len : pos;
+		m_raw_text_tag = string_view();
+	}
+
+	bool html_tokenizer::is_tag_start(size_t pos) const {
+		if (m_html[pos] != '<' || pos + 1 >= m_html.size()) return false;
+		const char next = m_html[pos + 1];
+		if (is_alpha(next) || next == '!' || next == '?') return true;
+		return next == '/' && pos + 2 < m_html.size() && is_alpha(m_html[pos + 2]);
+	}
+
+	/*
+	 * Returns the position of the > closing the tag. A > inside a quoted attribute value does not close it unless the
+	 * quote is never closed.
+	 * */
+	size_t html_tokenizer::find_tag_end(size_t pos) const {
+
+		const size_t len = m_html.size();
+
+		while (pos < len) {
+			const char c = m_html[pos];
+			if (c == '>') return pos;
+			pos++;
+			if (c != '=') continue;
+
+			while (pos < len && is_space(m_html[pos])) pos++;
+			if (pos < len && (m_html[pos] == '"' || m_html[pos] == '\'')) {
+				const size_t close = m_html.find(m_html[pos], pos + 1);
+				if (close == string_view::npos) {
+					return min(m_html.find('>', pos), len);
+				}
+				pos = close + 1;
+			}
+		}
+
+		return len;
+	}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string_view>
+
+namespace parser {
+
+	enum class html_token_type { start_tag, end_tag, text };
+
+	/*
+	 * A token of the document being tokenized. All views point into the document, nothing is copied and entities are
+	 * not decoded.
+	 * */
+	struct html_token {
+		html_token_type m_type;
+		std::string_view m_name; // Tag name as written in the document.
+		std::string_view m_attributes; // Everything between the tag name and the closing >.
+		std::string_view m_text;
+		bool m_self_closing = false;
+
+		/*
+		 * Compares the tag name case insensitively, lower_name has to be lower case.
+		 * */
+		bool is(std::string_view lower_name) const;
+
+		/*
+		 * Returns the value of the attribute without quotes or an empty view if the tag does not have it.
+		 * */
+		std::string_view attribute(std::string_view lower_name) const;
+		bool has_attribute(std::string_view lower_name) const;
+	};
+
+	/*
+	 * Reads the next attribute from attributes and removes it from the view. Returns false when there are no more.
+	 * */
+	bool next_attribute(std::string_view &attributes, std::string_view &name, std::string_view &value);
+
+	bool iequals(std::string_view str, std::string_view lower);
+
+	/*
+	 * Single pass tokenizer emitting start tags, end tags and text. Comments, doctypes and processing instructions are
+	 * skipped and so is the content of script and style elements. Never allocates.
+	 * */
+	class html_tokenizer {
+
+	public:
+		explicit html_tokenizer(std::string_view html);
+
+		/*
+		 * Reads the next token, returns false at the end of the document.
+		 * */
+		bool next(html_token &token);
+
+	private:
+		std::string_view m_html;
+		size_t m_pos = 0;
+
+		// Set after a script or style start tag, the content up to the matching end tag is skipped.
+		std::string_view m_raw_text_tag;
+
+		void skip_raw_text();
+		bool is_tag_start(size_t pos) const;
+		size_t find_tag_end(size_t pos) const;
+
+	};
+
+}
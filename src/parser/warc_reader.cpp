@@ -0,0 +1,275 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "warc_reader.h"
+#include "system/Logger.h"
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+
+using namespace std;
+
+namespace parser {
+
+	string_view warc_record::header(string_view name) const {
+
+		string_view lines = m_header;
+		while (lines.size()) {
+			const size_t line_end = lines.find("\r\n");
+			const string_view line = lines.substr(0, line_end);
+			lines = line_end == string_view::npos ? string_view() : lines.substr(line_end + 2);
+
+			if (line.size() <= name.size() || line[name.size()] != ':') continue;
+			if (strncasecmp(line.data(), name.data(), name.size()) != 0) continue;
+
+			string_view value = line.substr(name.size() + 1);
+			while (value.size() && value.front() == ' ') value.remove_prefix(1);
+			while (value.size() && value.back() == ' ') value.remove_suffix(1);
+			return value;
+		}
+
+		return string_view();
+	}
+
+	string_view warc_record::http_header() const {
+		return m_content.substr(0, m_content.find("\r\n\r\n"));
+	}
+
+	string_view warc_record::http_body() const {
+		const size_t pos = m_content.find("\r\n\r\n");
+		if (pos == string_view::npos) return string_view();
+		return m_content.substr(pos + 4);
+	}
+
+	warc_reader::warc_reader()
+	: m_buffer(new char[WARC_READER_BUFFER_LEN]) {
+		memset(&m_zstream, 0, sizeof(m_zstream));
+		if (inflateInit2(&m_zstream, 16 + MAX_WBITS) != Z_OK) {
+			throw LOG_ERROR_EXCEPTION("inflateInit2 failed");
+		}
+	}
+
+	warc_reader::~warc_reader() {
+		inflateEnd(&m_zstream);
+	}
+
+	void warc_reader::set_input(istream &stream) {
+		if (!m_input) m_input.reset(new char[WARC_READER_INPUT_LEN]);
+		m_stream = &stream;
+	}
+
+	void warc_reader::set_input(const char *data, size_t len) {
+		m_stream = nullptr;
+		m_memory = data;
+		m_memory_len = len;
+	}
+
+	bool warc_reader::next(warc_record &record) {
+
+		m_begin += m_consumed;
+		m_consumed = 0;
+
+		while (true) {
+			const char *buffer = m_buffer.get();
+
+			// Records are followed by an empty line.
+			while (m_begin < m_end && (buffer[m_begin] == '\r' || buffer[m_begin] == '\n')) m_begin++;
+			if (m_scanned < m_begin) m_scanned = m_begin;
+
+			const size_t pos = string_view(buffer + m_scanned, m_end - m_scanned).find("\r\n\r\n");
+			if (pos == string_view::npos) {
+				// The end of the header can be split over the next fill.
+				m_scanned = max(m_begin, m_end < 3 ? 0 : m_end - 3);
+				if (!fill()) return false;
+				continue;
+			}
+
+			const size_t header_len = m_scanned + pos - m_begin;
+			const string_view header(buffer + m_begin, header_len);
+			record.m_header = header;
+
+			const string_view content_len_str = record.header("Content-Length");
+			size_t content_len = 0;
+			const auto [ptr, ec] = from_chars(content_len_str.data(), content_len_str.data() + content_len_str.size(),
+				content_len);
+			if (!header.starts_with("WARC/") || ec != errc() || content_len_str.empty()) {
+				// Not a record, skip the block.
+				m_begin += header_len + 4;
+				continue;
+			}
+
+			const size_t record_len = header_len + 4 + content_len;
+			while (m_end - m_begin < record_len) {
+				if (!fill()) return false;
+			}
+
+			buffer = m_buffer.get();
+			record.m_header = string_view(buffer + m_begin, header_len);
+			record.m_content = string_view(buffer + m_begin + header_len + 4, content_len);
+			m_consumed = record_len;
+
+			return true;
+		}
+	}
+
+	bool warc_reader::read_input() {
+
+		if (m_stream != nullptr) {
+			m_stream->read(m_input.get(), WARC_READER_INPUT_LEN);
+			const size_t bytes_read = m_stream->gcount();
+			if (bytes_read == 0) return false;
+
+			m_zstream.next_in = (Bytef *)m_input.get();
+			m_zstream.avail_in = bytes_read;
+			return true;
+		}
+
+		if (m_memory_len == 0) return false;
+
+		// avail_in is 32 bits.
+		const size_t len = min<size_t>(m_memory_len, 1ull << 30);
+		m_zstream.next_in = (Bytef *)m_memory;
+		m_zstream.avail_in = len;
+		m_memory += len;
+		m_memory_len -= len;
+
+		return true;
+	}
+
+	/*
+	 * Inflates more data into the buffer. The unread data is moved to the front if there is no room at the end, the
+	 * buffer is only grown when it is full of unread data. Returns false when there is no more input.
+	 * */
+	bool warc_reader::fill() {
+
+		if (m_error) return false;
+
+		if (m_end == m_capacity) {
+			if (m_begin > 0) {
+				memmove(m_buffer.get(), m_buffer.get() + m_begin, m_end - m_begin);
+				m_end -= m_begin;
+				m_scanned -= m_begin;
+				m_begin = 0;
+			} else {
+				char *buffer = new char[m_capacity * 2];
+				memcpy(buffer, m_buffer.get(), m_end);
+				m_buffer.reset(buffer);
+				m_capacity *= 2;
+			}
+		}
+
+		while (true) {
+			if (m_zstream.avail_in == 0 && !read_input()) return false;
+
+			m_zstream.next_out = (Bytef *)(m_buffer.get() + m_end);
+			m_zstream.avail_out = m_capacity - m_end;
+
+			const int ret = inflate(&m_zstream, Z_NO_FLUSH);
+			const size_t produced = m_capacity - m_end - m_zstream.avail_out;
+			m_end += produced;
+			m_bytes_inflated += produced;
+
+			if (ret == Z_STREAM_END) {
+				// The next gzip member starts right after this one.
+				inflateReset(&m_zstream);
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				LOG_INFO("invalid gzip data in warc, inflate returned " + to_string(ret));
+				m_error = true;
+				return produced > 0;
+			}
+
+			if (produced > 0) return true;
+		}
+	}
+
+	/*
+	 * Returns true if data starts with a complete gzip member holding the start of a WARC record. The whole member is
+	 * inflated so the crc is checked, a random 1f 8b in compressed data does not pass.
+	 * */
+	bool is_warc_member(const char *data, size_t len) {
+
+		if (len < 18 || (unsigned char)data[0] != 0x1f || (unsigned char)data[1] != 0x8b || data[2] != 8 ||
+			(data[3] & 0xe0)) {
+			return false;
+		}
+
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) return false;
+
+		const size_t out_len = 1 << 16;
+		unique_ptr<char[]> out(new char[out_len]);
+
+		stream.next_in = (Bytef *)data;
+		stream.avail_in = min<size_t>(len, 1ull << 30);
+
+		bool first = true;
+		int ret;
+		do {
+			stream.next_out = (Bytef *)out.get();
+			stream.avail_out = out_len;
+			ret = inflate(&stream, Z_NO_FLUSH);
+			if (first) {
+				const size_t produced = out_len - stream.avail_out;
+				if (produced < 5 || memcmp(out.get(), "WARC/", 5) != 0) break;
+				first = false;
+			}
+		} while (ret == Z_OK);
+
+		inflateEnd(&stream);
+
+		return !first && ret == Z_STREAM_END;
+	}
+
+	vector<pair<size_t, size_t>> warc_member_ranges(const char *data, size_t len, size_t num_ranges) {
+
+		vector<pair<size_t, size_t>> ranges;
+
+		size_t start = 0;
+		for (size_t i = 1; i < num_ranges; i++) {
+			size_t pos = max(len / num_ranges * i, start + 1);
+			bool found = false;
+			while (pos < len) {
+				const char *magic = (const char *)memchr(data + pos, 0x1f, len - pos);
+				if (magic == nullptr) break;
+				pos = magic - data;
+				if (is_warc_member(magic, len - pos)) {
+					found = true;
+					break;
+				}
+				pos++;
+			}
+			if (!found) break;
+
+			ranges.emplace_back(start, pos);
+			start = pos;
+		}
+		ranges.emplace_back(start, len);
+
+		return ranges;
+	}
+
+}
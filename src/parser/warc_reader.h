@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "zlib.h"
+
+#define WARC_READER_INPUT_LEN 1024*1024
+#define WARC_READER_BUFFER_LEN 1024*1024*4
+
+namespace parser {
+
+	/*
+	 * A record read by warc_reader. The views point into the buffer of the reader and are valid until the next call
+	 * to warc_reader::next.
+	 * */
+	struct warc_record {
+		std::string_view m_header; // WARC header lines, without the empty line ending them.
+		std::string_view m_content; // Content block, for responses it is the http header followed by the body.
+
+		/*
+		 * Returns the value of the WARC header with name or an empty view if there is none. Names are case insensitive.
+		 * */
+		std::string_view header(std::string_view name) const;
+		std::string_view type() const { return header("WARC-Type"); }
+
+		std::string_view http_header() const;
+		std::string_view http_body() const;
+	};
+
+	/*
+	 * Streaming reader for gzipped WARC files. The compressed input is inflated into one buffer that is reused for
+	 * all records, only the unread tail is moved to the front when the buffer is full. The buffer only grows for
+	 * records larger than it. Records are returned as views into the buffer so nothing is copied. Files with many
+	 * gzip members, one per record like common crawl, are read as one stream.
+	 * */
+	class warc_reader {
+
+	public:
+		warc_reader();
+		~warc_reader();
+
+		/*
+		 * Sets where compressed data is read from. The input can be changed between records, the reader keeps its
+		 * state so a file can be fed in parts. Memory input is not copied and has to outlive the reader.
+		 * */
+		void set_input(std::istream &stream);
+		void set_input(const char *data, size_t len);
+
+		/*
+		 * Reads the next record. Returns false when the input runs out before a complete record, a record cut at the
+		 * end of the input is returned after more input is given with set_input.
+		 * */
+		bool next(warc_record &record);
+
+		/*
+		 * True if the input was not valid gzip. The reader stops at the first error.
+		 * */
+		bool error() const { return m_error; }
+
+		size_t bytes_inflated() const { return m_bytes_inflated; }
+
+	private:
+
+		// Non copyable, the z_stream points into the buffers.
+		warc_reader(const warc_reader &);
+		warc_reader &operator=(const warc_reader &);
+
+		z_stream m_zstream;
+		bool m_error = false;
+		size_t m_bytes_inflated = 0;
+
+		std::istream *m_stream = nullptr;
+		std::unique_ptr<char[]> m_input;
+		const char *m_memory = nullptr;
+		size_t m_memory_len = 0;
+
+		std::unique_ptr<char[]> m_buffer;
+		size_t m_capacity = WARC_READER_BUFFER_LEN;
+		size_t m_begin = 0; // Start of unread data.
+		size_t m_end = 0; // End of inflated data.
+		size_t m_scanned = 0; // Everything before this is searched for the end of the header.
+		size_t m_consumed = 0; // Length of the record returned last, skipped on the next call.
+
+		bool read_input();
+		bool fill();
+
+	};
+
+	/*
+	 * Splits gzipped data into at most num_ranges ranges of about the same size. Each range starts on a gzip member
+	 * that holds the start of a WARC record, so the ranges can be read with separate readers in parallel. Data with
+	 * a single member is returned as one range.
+	 * */
+	std::vector<std::pair<size_t, size_t>> warc_member_ranges(const char *data, size_t len, size_t num_ranges);
+
+}
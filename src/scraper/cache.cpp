@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cache.h"
+#include "scraper.h"
+
+using namespace std;
+
+namespace Scraper {
+
+	dns_cache::dns_cache(size_t ttl)
+	: m_ttl(ttl) {
+		m_share = curl_share_init();
+		curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, lock);
+		curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, unlock);
+		curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	}
+
+	dns_cache::~dns_cache() {
+		curl_share_cleanup(m_share);
+	}
+
+	void dns_cache::attach(CURL *curl) const {
+		curl_easy_setopt(curl, CURLOPT_SHARE, m_share);
+		curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)m_ttl);
+	}
+
+	void dns_cache::lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userptr) {
+		static_cast<dns_cache *>(userptr)->m_locks[data].lock();
+	}
+
+	void dns_cache::unlock(CURL *curl, curl_lock_data data, void *userptr) {
+		static_cast<dns_cache *>(userptr)->m_locks[data].unlock();
+	}
+
+	robots_cache::robots_cache(size_t ttl, size_t max_domains)
+	: m_ttl(ttl), m_max_domains(max(max_domains, (size_t)1)) {
+	}
+
+	shared_ptr<const robots_rules> robots_cache::get(const string &domain, size_t now) {
+		lock_guard<mutex> lock(m_lock);
+		auto iter = m_entries.find(domain);
+		if (iter == m_entries.end() || iter->second.m_expires <= now) {
+			m_misses++;
+			return nullptr;
+		}
+		m_hits++;
+		return iter->second.m_rules;
+	}
+
+	bool robots_cache::contains(const string &domain, size_t now) {
+		lock_guard<mutex> lock(m_lock);
+		auto iter = m_entries.find(domain);
+		return iter != m_entries.end() && iter->second.m_expires > now;
+	}
+
+	void robots_cache::put(const string &domain, shared_ptr<const robots_rules> rules, size_t fetched_at) {
+		lock_guard<mutex> lock(m_lock);
+		if (m_entries.count(domain) == 0) {
+			make_room(fetched_at);
+		}
+		m_entries[domain] = entry{rules, fetched_at + m_ttl};
+	}
+
+	void robots_cache::load(const vector<UrlStore::RobotsData> &datas, size_t now) {
+		for (const UrlStore::RobotsData &data : datas) {
+			if (data.m_domain.empty() || data.m_fetch_failed || data.m_fetched_at + m_ttl <= now) continue;
+			put(data.m_domain, make_shared<robots_rules>(data.m_robots, user_agent_token()), data.m_fetched_at);
+		}
+	}
+
+	size_t robots_cache::size() {
+		lock_guard<mutex> lock(m_lock);
+		return m_entries.size();
+	}
+
+	void robots_cache::make_room(size_t now) {
+		if (m_entries.size() < m_max_domains) return;
+
+		for (auto iter = m_entries.begin(); iter != m_entries.end(); ) {
+			if (iter->second.m_expires <= now) {
+				iter = m_entries.erase(iter);
+			} else {
+				iter++;
+			}
+		}
+
+		// Nothing expired, drop about a tenth so this does not run on every insert.
+		if (m_entries.size() >= m_max_domains) {
+			size_t to_drop = max(m_max_domains / 10, (size_t)1);
+			for (auto iter = m_entries.begin(); iter != m_entries.end() && to_drop; to_drop--) {
+				iter = m_entries.erase(iter);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <curl/curl.h>
+#include "robots_rules.h"
+#include "urlstore/RobotsData.h"
+
+namespace Scraper {
+
+	/*
+	 * Resolved addresses shared by the curl handles of all scrapers through a curl share handle. Entries are dropped by
+	 * curl after ttl seconds so addresses that move are picked up again.
+	 * */
+	class dns_cache {
+		public:
+
+			explicit dns_cache(size_t ttl);
+			~dns_cache();
+
+			void attach(CURL *curl) const;
+
+		private:
+
+			CURLSH *m_share;
+			size_t m_ttl;
+			std::mutex m_locks[CURL_LOCK_DATA_LAST];
+
+			static void lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userptr);
+			static void unlock(CURL *curl, curl_lock_data data, void *userptr);
+
+	};
+
+	/*
+	 * Parsed robots.txt rules per domain, kept for ttl seconds after the file was fetched. RobotsData from the url store
+	 * is the backing tier, load() adds the records that are still fresh and whose last fetch did not fail. When the cache is full the expired entries are
+	 * dropped first and then arbitrary ones.
+	 * */
+	class robots_cache {
+		public:
+
+			robots_cache(size_t ttl, size_t max_domains);
+
+			std::shared_ptr<const robots_rules> get(const std::string &domain, size_t now);
+			bool contains(const std::string &domain, size_t now);
+			void put(const std::string &domain, std::shared_ptr<const robots_rules> rules, size_t fetched_at);
+			void load(const std::vector<UrlStore::RobotsData> &datas, size_t now);
+
+			size_t size();
+			size_t hits() const { return m_hits; }
+			size_t misses() const { return m_misses; }
+
+		private:
+
+			struct entry {
+				std::shared_ptr<const robots_rules> m_rules;
+				size_t m_expires;
+			};
+
+			std::mutex m_lock;
+			std::unordered_map<std::string, entry> m_entries;
+			size_t m_ttl;
+			size_t m_max_domains;
+			std::atomic<size_t> m_hits = 0;
+			std::atomic<size_t> m_misses = 0;
+
+			void make_room(size_t now);
+
+	};
+
+}
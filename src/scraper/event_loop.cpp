@@ -0,0 +1,455 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "event_loop.h"
+#include "urlstore/UrlStore.h"
+#include "system/Logger.h"
+#include "config.h"
+#include <chrono>
+
+using namespace std;
+
+namespace Scraper {
+
+	/*
+	 * The politeness delays are 15 to 45 seconds with the default timeout so one turn of the wheel covers them.
+	 * */
+	const size_t wheel_slots = 1024;
+	const size_t wheel_tick_ms = 100;
+	const size_t max_poll_ms = 1000;
+
+	// Number of domains looked up in the url store with each request.
+	const size_t domain_data_batch = 10000;
+
+	size_t now_ms() {
+		return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	ip_limiter::ip_limiter(size_t max_per_ip)
+	: m_max_per_ip(max(max_per_ip, (size_t)1)) {
+	}
+
+	bool ip_limiter::try_acquire(const string &ip) {
+		lock_guard<mutex> lock(m_lock);
+		size_t &in_flight = m_in_flight[ip];
+		if (in_flight >= m_max_per_ip) return false;
+		in_flight++;
+		return true;
+	}
+
+	void ip_limiter::release(const string &ip) {
+		lock_guard<mutex> lock(m_lock);
+		auto iter = m_in_flight.find(ip);
+		if (--(iter->second) == 0) m_in_flight.erase(iter);
+	}
+
+	event_loop::event_loop(store *store, ip_limiter *limiter, dns_cache *dns, robots_cache *robots)
+	: m_store(store), m_limiter(limiter), m_dns(dns), m_robots(robots), m_wheel(wheel_slots, wheel_tick_ms, now_ms()) {
+		m_multi = curl_multi_init();
+	}
+
+	event_loop::~event_loop() {
+		stop();
+		m_ready.clear();
+		m_backlog.clear();
+		m_waiting.clear();
+		m_domains.clear();
+		m_finished.clear();
+		curl_multi_cleanup(m_multi);
+		curl_slist_free_all(m_connect_to);
+	}
+
+	void event_loop::push_urls(const string &domain, const UrlStore::DomainData &domain_data, const vector<URL> &urls) {
+		m_size++;
+		m_incoming_lock.lock();
+		m_incoming.emplace_back(domain, domain_data, urls);
+		m_incoming_lock.unlock();
+		curl_multi_wakeup(m_multi);
+	}
+
+	/*
+	 * Entries on the format of CURLOPT_CONNECT_TO, used to send all requests to a local server in the tests.
+	 * */
+	void event_loop::set_connect_to(const vector<string> &connect_to) {
+		for (const string &entry : connect_to) {
+			m_connect_to = curl_slist_append(m_connect_to, entry.c_str());
+		}
+	}
+
+	void event_loop::start_thread() {
+		m_running = true;
+		m_thread = std::move(thread([this]() {
+			this->run();
+		}));
+	}
+
+	void event_loop::stop() {
+		m_running = false;
+		curl_multi_wakeup(m_multi);
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	void event_loop::gather_statistics(stats &stats) {
+		lock_guard<mutex> lock(m_lock);
+		for (const auto &scraper : m_finished) {
+			stats.count_finished(*scraper);
+		}
+		m_finished.clear();
+		for (const auto &iter : m_domains) {
+			stats.count_unfinished(*(iter.second->m_scraper));
+		}
+	}
+
+	void event_loop::run() {
+
+		unique_lock<mutex> lock(m_lock);
+
+		while (m_running) {
+
+			if (m_max_connects != m_max_domains) {
+				// Room for one idle connection per active domain so it survives the politeness delay.
+				m_max_connects = m_max_domains;
+				curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS, (long)m_max_connects);
+			}
+
+			take_incoming();
+			activate_domains();
+
+			m_wheel.advance(now_ms(), [this](domain *d) {
+				m_ready.push_back(d);
+			});
+			start_ready();
+
+			int running_handles;
+			curl_multi_perform(m_multi, &running_handles);
+			read_done();
+			start_ready();
+
+			size_t timeout_ms = max_poll_ms;
+			if (m_waiting.size()) {
+				timeout_ms = wheel_tick_ms;
+			}
+			if (!m_wheel.empty()) {
+				timeout_ms = min(timeout_ms, m_wheel.ms_until_next_tick(now_ms()));
+			}
+
+			lock.unlock();
+			curl_multi_poll(m_multi, nullptr, 0, (int)timeout_ms, nullptr);
+			lock.lock();
+		}
+
+		for (const auto &iter : m_domains) {
+			if (iter.second->m_in_flight) {
+				curl_multi_remove_handle(m_multi, iter.second->m_scraper->curl_handle());
+				iter.second->m_in_flight = false;
+			}
+		}
+	}
+
+	void event_loop::take_incoming() {
+		vector<tuple<string, UrlStore::DomainData, vector<URL>>> incoming;
+		m_incoming_lock.lock();
+		incoming.swap(m_incoming);
+		m_incoming_lock.unlock();
+
+		for (auto &[domain_name, domain_data, urls] : incoming) {
+			auto iter = m_domains.find(domain_name);
+			if (iter == m_domains.end()) {
+				auto d = make_unique<domain>();
+				d->m_loop = this;
+				d->m_scraper = make_unique<scraper>(domain_name, m_store);
+				d->m_scraper->set_timeout(m_timeout);
+				d->m_scraper->set_domain_data(domain_data);
+				d->m_scraper->set_robots_cache(m_robots);
+				m_dns->attach(d->m_scraper->curl_handle());
+				m_backlog.push_back(d.get());
+				iter = m_domains.emplace(domain_name, std::move(d)).first;
+				m_size++;
+			}
+			for (const URL &url : urls) {
+				iter->second->m_scraper->push_url(url);
+			}
+			m_size--;
+		}
+	}
+
+	void event_loop::activate_domains() {
+		while (m_backlog.size() && m_num_active < m_max_domains) {
+			m_ready.push_back(m_backlog.front());
+			m_backlog.pop_front();
+			m_num_active++;
+		}
+	}
+
+	/*
+	 * Domains waiting for a slot on their ip go first, then the domains that are done with their politeness delay.
+	 * */
+	void event_loop::start_ready() {
+		for (auto iter = m_waiting.begin(); iter != m_waiting.end(); ) {
+			while (iter->second.size() && m_limiter->try_acquire(iter->first)) {
+				domain *d = iter->second.front();
+				iter->second.pop_front();
+				start_request(d);
+			}
+			if (iter->second.empty()) {
+				iter = m_waiting.erase(iter);
+			} else {
+				iter++;
+			}
+		}
+
+		while (m_ready.size()) {
+			domain *d = m_ready.front();
+			m_ready.pop_front();
+
+			if (d->m_ip.empty() || m_limiter->try_acquire(d->m_ip)) {
+				start_request(d);
+			} else {
+				m_waiting[d->m_ip].push_back(d);
+			}
+		}
+	}
+
+	/*
+	 * The slot for the ip of the domain is already acquired if the ip is known.
+	 * */
+	void event_loop::start_request(domain *d) {
+		scraper *s = d->m_scraper.get();
+
+		if (!d->m_robots_done && s->load_cached_robots()) {
+			d->m_robots_done = true;
+		}
+
+		if (d->m_retry) {
+			// The request for m_url was deferred by check_ip.
+			d->m_retry = false;
+		} else if (!d->m_robots_done) {
+			d->m_url = s->robots_url();
+		} else if (!s->next_url(d->m_url)) {
+			if (d->m_ip.size()) m_limiter->release(d->m_ip);
+			finish(d);
+			return;
+		}
+
+		s->prepare_request(d->m_url);
+		curl_easy_setopt(s->curl_handle(), CURLOPT_PRIVATE, d);
+		curl_easy_setopt(s->curl_handle(), CURLOPT_PREREQFUNCTION, check_ip);
+		curl_easy_setopt(s->curl_handle(), CURLOPT_PREREQDATA, d);
+		if (m_connect_to) curl_easy_setopt(s->curl_handle(), CURLOPT_CONNECT_TO, m_connect_to);
+		curl_multi_add_handle(m_multi, s->curl_handle());
+
+		d->m_in_flight = true;
+		d->m_counted_ip = d->m_ip;
+	}
+
+	void event_loop::read_done() {
+		CURLMsg *msg;
+		int msgs_left;
+		while ((msg = curl_multi_info_read(m_multi, &msgs_left))) {
+			if (msg->msg != CURLMSG_DONE) continue;
+
+			CURL *curl = msg->easy_handle;
+			const CURLcode res = msg->data.result;
+			char *priv = nullptr;
+			curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+			curl_multi_remove_handle(m_multi, curl);
+
+			request_done(reinterpret_cast<domain *>(priv), res);
+		}
+	}
+
+	void event_loop::request_done(domain *d, CURLcode res) {
+		scraper *s = d->m_scraper.get();
+
+		d->m_in_flight = false;
+		if (d->m_counted_ip.size()) m_limiter->release(d->m_counted_ip);
+		d->m_counted_ip.clear();
+
+		if (d->m_deferred) {
+			d->m_deferred = false;
+			d->m_retry = true;
+			m_waiting[d->m_ip].push_back(d);
+			return;
+		}
+
+		if (!d->m_robots_done) {
+			s->handle_robots_response(d->m_url, res);
+			d->m_robots_done = true;
+		} else {
+			s->handle_response(d->m_url, res);
+		}
+
+		if (s->size() == 0) {
+			finish(d);
+			return;
+		}
+
+		const size_t delay_ms = s->politeness_delay_ms();
+		if (delay_ms) {
+			m_wheel.schedule(d, delay_ms);
+		} else {
+			m_ready.push_back(d);
+		}
+	}
+
+	/*
+	 * Called by curl when the connection is ready, before the request is sent. The first request of a domain and
+	 * redirects to other hosts only get their slot here, when the ip is known.
+	 * */
+	int event_loop::check_ip(void *clientp, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port,
+			int conn_local_port) {
+		domain *d = static_cast<domain *>(clientp);
+		const string ip(conn_primary_ip);
+		if (ip == d->m_counted_ip) return CURL_PREREQFUNC_OK;
+
+		if (d->m_counted_ip.size()) {
+			d->m_loop->m_limiter->release(d->m_counted_ip);
+			d->m_counted_ip.clear();
+		}
+
+		d->m_ip = ip;
+		if (!d->m_loop->m_limiter->try_acquire(ip)) {
+			d->m_deferred = true;
+			return CURL_PREREQFUNC_ABORT;
+		}
+		d->m_counted_ip = ip;
+
+		return CURL_PREREQFUNC_OK;
+	}
+
+	void event_loop::finish(domain *d) {
+		auto iter = m_domains.find(d->m_scraper->domain());
+		m_finished.push_back(std::move(d->m_scraper));
+		m_domains.erase(iter);
+		m_num_active--;
+		m_size--;
+	}
+
+	engine::engine(store *store, size_t num_threads, size_t max_per_ip)
+	: m_limiter(max_per_ip), m_dns(Config::scraper_dns_ttl),
+	m_robots(Config::scraper_robots_ttl, Config::scraper_robots_cache_size) {
+		for (size_t i = 0; i < max(num_threads, (size_t)1); i++) {
+			m_loops.emplace_back(make_unique<event_loop>(store, &m_limiter, &m_dns, &m_robots));
+		}
+	}
+
+	engine::~engine() {
+		for (auto &loop : m_loops) {
+			loop->stop();
+		}
+	}
+
+	void engine::set_timeout(size_t timeout) {
+		for (auto &loop : m_loops) {
+			loop->set_timeout(timeout);
+		}
+	}
+
+	void engine::set_max_domains(size_t max_domains) {
+		for (auto &loop : m_loops) {
+			loop->set_max_domains(max((size_t)1, max_domains / m_loops.size()));
+		}
+	}
+
+	void engine::set_connect_to(const vector<string> &connect_to) {
+		for (auto &loop : m_loops) {
+			loop->set_connect_to(connect_to);
+		}
+	}
+
+	void engine::start_threads() {
+		for (auto &loop : m_loops) {
+			loop->start_thread();
+		}
+	}
+
+	/*
+	 * Groups the urls by host and hands them to the event loop of the host. The domain data of all hosts and the stored
+	 * robots.txt of hosts missing in the robots cache are fetched from the url store in batches here, instead of with
+	 * blocking requests per domain on the event loops.
+	 * */
+	void engine::push_urls(const vector<string> &urls) {
+		map<string, vector<URL>> urls_by_host;
+		for (const string &url_str : urls) {
+			URL url(url_str);
+			urls_by_host[url.host()].push_back(url);
+		}
+
+		vector<string> hosts;
+		for (const auto &iter : urls_by_host) {
+			hosts.push_back(iter.first);
+		}
+
+		for (size_t begin = 0; begin < hosts.size(); begin += domain_data_batch) {
+			const size_t end = min(hosts.size(), begin + domain_data_batch);
+			const vector<string> batch(hosts.begin() + begin, hosts.begin() + end);
+
+			vector<UrlStore::DomainData> domain_datas;
+			if (UrlStore::get_many(batch, domain_datas) == UrlStore::ERROR || domain_datas.size() != batch.size()) {
+				LOG_INFO("Could not download domain data");
+				domain_datas.assign(batch.size(), UrlStore::DomainData());
+			}
+
+			const size_t now = time(nullptr);
+			vector<string> missing_robots;
+			for (const string &host : batch) {
+				if (!m_robots.contains(host, now)) missing_robots.push_back(host);
+			}
+			vector<UrlStore::RobotsData> robots_datas;
+			if (missing_robots.size() && UrlStore::get_many(missing_robots, robots_datas) == UrlStore::OK) {
+				m_robots.load(robots_datas, now);
+			}
+
+			for (size_t i = 0; i < batch.size(); i++) {
+				const size_t loop_id = std::hash<string>{}(batch[i]) % m_loops.size();
+				m_loops[loop_id]->push_urls(batch[i], domain_datas[i], urls_by_host[batch[i]]);
+			}
+		}
+	}
+
+	size_t engine::size() const {
+		size_t size = 0;
+		for (const auto &loop : m_loops) {
+			size += loop->size();
+		}
+		return size;
+	}
+
+	void engine::wait() const {
+		while (size()) {
+			this_thread::sleep_for(100ms);
+		}
+	}
+
+	void engine::gather_statistics(stats &stats, size_t urls_in_queue) {
+		stats.start_count(urls_in_queue);
+		for (auto &loop : m_loops) {
+			loop->gather_statistics(stats);
+		}
+		stats.end_count();
+	}
+
+}
@@ -0,0 +1,181 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <deque>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <curl/curl.h>
+#include "scraper.h"
+#include "store.h"
+#include "timer_wheel.h"
+#include "cache.h"
+
+namespace Scraper {
+
+	/*
+	 * Counts the requests in flight per ip address over all event loops.
+	 * */
+	class ip_limiter {
+		public:
+
+			explicit ip_limiter(size_t max_per_ip);
+
+			bool try_acquire(const std::string &ip);
+			void release(const std::string &ip);
+
+		private:
+
+			std::mutex m_lock;
+			std::map<std::string, size_t> m_in_flight;
+			size_t m_max_per_ip;
+
+	};
+
+	/*
+	 * Scrapes many domains on one thread with a curl multi handle. Every domain is a scraper without a thread of its
+	 * own. A domain has at most one request in flight and waits in a timer wheel for its politeness delay between
+	 * requests. The curl easy handle of the scraper is reused for all its requests so the connection to the host is
+	 * kept alive in the connection pool of the multi handle.
+	 *
+	 * Requests in flight to the same ip address are limited by the ip_limiter shared by all loops. The ip is checked when
+	 * curl has connected, before the request is sent. A request over the limit is aborted there and the domain waits
+	 * for its ip, the waiting domains are retried every tick of the wheel.
+	 *
+	 * Resolved addresses and parsed robots.txt rules are shared by all loops, robots.txt is only fetched for domains
+	 * missing in the robots_cache.
+	 * */
+	class event_loop {
+		public:
+
+			event_loop(store *store, ip_limiter *limiter, dns_cache *dns, robots_cache *robots);
+			~event_loop();
+
+			/*
+			 * Thread safe. The urls are handed over to the loop thread.
+			 * */
+			void push_urls(const std::string &domain, const UrlStore::DomainData &domain_data, const std::vector<URL> &urls);
+
+			void set_timeout(size_t timeout) { m_timeout = timeout; }
+			void set_max_domains(size_t max_domains) { m_max_domains = max_domains; }
+			void set_connect_to(const std::vector<std::string> &connect_to);
+			void start_thread();
+			void stop();
+
+			/*
+			 * Number of domains that are not finished, including the ones waiting to be activated.
+			 * */
+			size_t size() const { return m_size; }
+			void gather_statistics(stats &stats);
+
+		private:
+
+			struct domain {
+				event_loop *m_loop;
+				std::unique_ptr<scraper> m_scraper;
+				std::string m_ip;
+				std::string m_counted_ip;
+				URL m_url;
+				bool m_robots_done = false;
+				bool m_in_flight = false;
+				bool m_deferred = false;
+				bool m_retry = false;
+			};
+
+			store *m_store;
+			ip_limiter *m_limiter;
+			dns_cache *m_dns;
+			robots_cache *m_robots;
+			CURLM *m_multi;
+			struct curl_slist *m_connect_to = nullptr;
+			std::thread m_thread;
+			std::mutex m_lock;
+			std::atomic<bool> m_running = false;
+			std::atomic<size_t> m_size = 0;
+			std::atomic<size_t> m_max_domains = 1000;
+			size_t m_max_connects = 0;
+			size_t m_timeout = 30;
+			size_t m_num_active = 0;
+
+			std::mutex m_incoming_lock;
+			std::vector<std::tuple<std::string, UrlStore::DomainData, std::vector<URL>>> m_incoming;
+
+			std::map<std::string, std::unique_ptr<domain>> m_domains;
+			std::deque<domain *> m_backlog;
+			std::deque<domain *> m_ready;
+			std::map<std::string, std::deque<domain *>> m_waiting;
+			std::vector<std::unique_ptr<scraper>> m_finished;
+			timer_wheel<domain *> m_wheel;
+
+			void run();
+			void take_incoming();
+			void activate_domains();
+			void start_ready();
+			void start_request(domain *d);
+			void read_done();
+			void request_done(domain *d, CURLcode res);
+			void finish(domain *d);
+
+			static int check_ip(void *clientp, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port,
+				int conn_local_port);
+
+	};
+
+	/*
+	 * Spreads domains over a fixed number of event loops by the hash of the host.
+	 * */
+	class engine {
+		public:
+
+			engine(store *store, size_t num_threads, size_t max_per_ip);
+			~engine();
+
+			void set_timeout(size_t timeout);
+			void set_max_domains(size_t max_domains);
+			void set_connect_to(const std::vector<std::string> &connect_to);
+			void start_threads();
+			void push_urls(const std::vector<std::string> &urls);
+			size_t size() const;
+			void wait() const;
+			void gather_statistics(stats &stats, size_t urls_in_queue);
+			robots_cache &robots() { return m_robots; }
+
+		private:
+
+			ip_limiter m_limiter;
+			dns_cache m_dns;
+			robots_cache m_robots;
+			std::vector<std::unique_ptr<event_loop>> m_loops;
+
+	};
+
+}
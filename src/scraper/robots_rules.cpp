@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "robots_rules.h"
+#include "robots.h"
+#include <strings.h>
+
+using namespace std;
+
+namespace Scraper {
+
+	/*
+	 * Collects the rules of the groups that apply to the user agent, following RobotsMatcher::HandleUserAgent.
+	 * */
+	class robots_rules_handler : public googlebot::RobotsParseHandler {
+		public:
+
+			robots_rules_handler(robots_rules &rules, const string &user_agent_token)
+			: m_rules(rules), m_user_agent_token(user_agent_token) {
+			}
+
+			void HandleRobotsStart() override {}
+			void HandleRobotsEnd() override {}
+			void HandleSitemap(int line_num, absl::string_view value) override {}
+			void HandleUnknownAction(int line_num, absl::string_view action, absl::string_view value) override {}
+
+			void HandleUserAgent(int line_num, absl::string_view value) override {
+				if (m_seen_separator) {
+					m_seen_specific = m_seen_global = m_seen_separator = false;
+				}
+
+				if (value.size() >= 1 && value[0] == '*' && (value.size() == 1 || isspace((unsigned char)value[1]))) {
+					m_seen_global = true;
+				} else if (strcasecmp(extract_user_agent(value).c_str(), m_user_agent_token.c_str()) == 0) {
+					m_seen_specific = true;
+					m_rules.m_seen_specific = true;
+				}
+			}
+
+			void HandleAllow(int line_num, absl::string_view value) override {
+				add_rule(string(value.data(), value.size()), true);
+
+				// index.htm and index.html are normalized to the directory like googlebot does.
+				const string pattern(value.data(), value.size());
+				const size_t slash_pos = pattern.find_last_of('/');
+				if (slash_pos != string::npos && pattern.compare(slash_pos, 10, "/index.htm") == 0) {
+					add_rule(pattern.substr(0, slash_pos + 1) + "$", true);
+				}
+			}
+
+			void HandleDisallow(int line_num, absl::string_view value) override {
+				add_rule(string(value.data(), value.size()), false);
+			}
+
+		private:
+
+			robots_rules &m_rules;
+			const string m_user_agent_token;
+			bool m_seen_global = false;
+			bool m_seen_specific = false;
+			bool m_seen_separator = false;
+
+			void add_rule(const string &pattern, bool allow) {
+				if (!m_seen_global && !m_seen_specific) return;
+				m_seen_separator = true;
+				if (m_seen_specific) {
+					m_rules.m_specific.push_back({pattern, allow});
+				} else {
+					m_rules.m_global.push_back({pattern, allow});
+				}
+			}
+
+			static string extract_user_agent(absl::string_view user_agent) {
+				size_t len = 0;
+				while (len < user_agent.size() && (isalpha((unsigned char)user_agent[len]) || user_agent[len] == '-' ||
+						user_agent[len] == '_')) {
+					len++;
+				}
+				return string(user_agent.data(), len);
+			}
+
+	};
+
+	/*
+	 * Gives access to the pattern matching of googlebot so wildcards and $ behave the same.
+	 * */
+	class longest_match_strategy : public googlebot::RobotsMatchStrategy {
+		public:
+
+			int MatchAllow(absl::string_view path, absl::string_view pattern) override {
+				return Matches(path, pattern) ? pattern.length() : -1;
+			}
+
+			int MatchDisallow(absl::string_view path, absl::string_view pattern) override {
+				return Matches(path, pattern) ? pattern.length() : -1;
+			}
+
+	};
+
+	robots_rules::robots_rules(const string &robots_txt, const string &user_agent_token) {
+		robots_rules_handler handler(*this, user_agent_token);
+		googlebot::ParseRobotsTxt(robots_txt, &handler);
+	}
+
+	bool robots_rules::allowed(const URL &url) const {
+		return allowed_path(googlebot::GetPathParamsQuery(url.str()));
+	}
+
+	bool robots_rules::allowed_path(const string &path) const {
+		longest_match_strategy strategy;
+
+		auto priorities = [&strategy, &path](const vector<rule> &rules, int &allow, int &disallow) {
+			for (const rule &r : rules) {
+				if (r.m_allow) {
+					allow = max(allow, strategy.MatchAllow(path, r.m_pattern));
+				} else {
+					disallow = max(disallow, strategy.MatchDisallow(path, r.m_pattern));
+				}
+			}
+		};
+
+		int allow = -1;
+		int disallow = -1;
+		priorities(m_specific, allow, disallow);
+		if (allow > 0 || disallow > 0) {
+			return disallow <= allow;
+		}
+
+		// A group for the user agent without any non empty rule allows everything.
+		if (m_seen_specific) return true;
+
+		allow = -1;
+		disallow = -1;
+		priorities(m_global, allow, disallow);
+		if (allow > 0 || disallow > 0) {
+			return disallow <= allow;
+		}
+
+		return true;
+	}
+
+}
@@ -0,0 +1,64 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "parser/URL.h"
+
+namespace Scraper {
+
+	/*
+	 * The rules of a robots.txt that apply to one user agent. The file is parsed once with googlebot::ParseRobotsTxt and
+	 * urls are matched with the same precedence as googlebot::RobotsMatcher. A group naming the user agent replaces the
+	 * global (*) group, the longest matching pattern wins and allow wins ties.
+	 * */
+	class robots_rules {
+		public:
+
+			robots_rules(const std::string &robots_txt, const std::string &user_agent_token);
+
+			bool allowed(const URL &url) const;
+			bool allowed_path(const std::string &path) const;
+			size_t size() const { return m_specific.size() + m_global.size(); }
+
+		private:
+
+			struct rule {
+				std::string m_pattern;
+				bool m_allow;
+			};
+
+			std::vector<rule> m_specific;
+			std::vector<rule> m_global;
+			bool m_seen_specific = false;
+
+			friend class robots_rules_handler;
+
+	};
+
+}
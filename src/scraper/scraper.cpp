@@ -25,6 +25,8 @@
  */
 
 #include "scraper.h"
+#include "event_loop.h"
+#include "config.h"
 #include "parser/HtmlParser.h"
 #include "system/datetime.h"
 #include "text/Text.h"
@@ -52,18 +54,6 @@ namespace Scraper {
 		if (m_thread.joinable()) m_thread.join();
 	}
 
-	void stats::gather_statistics(const map<string, unique_ptr<scraper>> &scrapers, size_t urls_in_queue) {
-		start_count(urls_in_queue);
-		for (const auto &iter : scrapers) {
-			if (iter.second->finished()) {
-				count_finished(*(iter.second));
-			} else {
-				count_unfinished(*(iter.second));
-			}
-		}
-		end_count();
-	}
-
 	void stats::start_thread(size_t timeout) {
 		m_timeout = timeout;
 		m_thread = std::move(thread([this]() {
@@ -148,24 +138,53 @@ namespace Scraper {
 	void scraper::run() {
 
 		download_domain_data();
-		download_robots();
+		if (!load_cached_robots()) {
+			download_robots();
+		}
 
-		while (m_queue.size()) {
-			URL url = filter_url(m_queue.front());
-			m_queue.pop();
-			if (robots_allow_url(url)) {
-				if (m_timeout) {
-					this_thread::sleep_for(std::chrono::seconds(m_timeout/2 + (rand() % m_timeout)));
-				}
-				handle_url(url);
-			}
-			if (m_consecutive_error_count > 20) break;
+		URL url;
+		while (next_url(url)) {
+			this_thread::sleep_for(std::chrono::milliseconds(politeness_delay_ms()));
+			handle_url(url);
 		}
 
 		m_finished = true;
 	}
 
-	void scraper::handle_url(const URL &url) {
+	void scraper::set_domain_data(const UrlStore::DomainData &domain_data) {
+		m_domain_data = domain_data;
+		m_domain_data.m_domain = m_domain;
+	}
+
+	bool scraper::load_cached_robots() {
+		if (m_robots_cache == nullptr) return false;
+		m_robots_rules = m_robots_cache->get(m_domain, time(nullptr));
+		return m_robots_rules != nullptr;
+	}
+
+	URL scraper::robots_url() {
+		return filter_url(URL("http://" + m_domain + "/robots.txt"));
+	}
+
+	/*
+	 * Pops urls from the queue until one is allowed by robots.txt. Returns false when the queue is empty or when the
+	 * domain keeps failing.
+	 * */
+	bool scraper::next_url(URL &url) {
+		while (m_queue.size() && m_consecutive_error_count <= 20) {
+			url = filter_url(m_queue.front());
+			m_queue.pop();
+			if (robots_allow_url(url)) return true;
+		}
+		return false;
+	}
+
+	size_t scraper::politeness_delay_ms() const {
+		if (m_timeout == 0) return 0;
+		return (m_timeout/2 + (rand() % m_timeout)) * 1000;
+	}
+
+	void scraper::prepare_request(const URL &url) {
 		m_buffer.resize(0);
 		curl_easy_setopt(m_curl, CURLOPT_USERAGENT, user_agent().c_str());
 		curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, 1l);
@@ -173,10 +192,16 @@ namespace Scraper {
 		curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, curl_string_reader);
 		curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
 		curl_easy_setopt(m_curl, CURLOPT_URL, url.str().c_str());
-		curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30);
+		curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30l);
 		curl_easy_setopt(m_curl, CURLOPT_ERRORBUFFER, m_curl_error_buffer);
+	}
+
+	void scraper::handle_url(const URL &url) {
+		prepare_request(url);
+		handle_response(url, curl_easy_perform(m_curl));
+	}
 
-		CURLcode res = curl_easy_perform(m_curl);
+	void scraper::handle_response(const URL &url, CURLcode res) {
 
 		if (res == CURLE_OK) {
 			m_consecutive_error_count = 0;
@@ -214,11 +239,6 @@ namespace Scraper {
 			/*
 			 * Handle everything here: https://curl.se/libcurl/c/libcurl-errors.html
 			 * */
-			vector<CURLcode> domain_errors = {
-				CURLE_COULDNT_RESOLVE_HOST,
-				CURLE_COULDNT_CONNECT,
-			};
-
 			handle_curl_error(url, res, string(m_curl_error_buffer));
 
 			if (res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_COULDNT_CONNECT) {
@@ -335,55 +355,51 @@ namespace Scraper {
 	}
 
 	void scraper::download_robots() {
-		const URL robots_path = filter_url(URL("http://" + m_domain + "/robots.txt"));
-		m_robots_content = simple_get(robots_path);
-
-		scraper::upload_robots_txt(m_robots_content);
+		const URL url = robots_url();
+		prepare_request(url);
+		handle_robots_response(url, curl_easy_perform(m_curl));
 	}
 
-	bool scraper::robots_allow_url(const URL &url) const {
-		googlebot::RobotsMatcher matcher;
-		bool allowed = matcher.OneAgentAllowedByRobots(m_robots_content, user_agent_token(), url.str());
-		return allowed;
-	}
-
-	string scraper::simple_get(const URL &url) {
-		curl_easy_setopt(m_curl, CURLOPT_USERAGENT, user_agent().c_str());
-		curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, 1l);
-		curl_easy_setopt(m_curl, CURLOPT_MAXREDIRS, 5l);
-		curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, curl_string_reader);
-		curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
-		curl_easy_setopt(m_curl, CURLOPT_URL, url.str().c_str());
-		curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30);
-		curl_easy_setopt(m_curl, CURLOPT_ERRORBUFFER, m_curl_error_buffer);
-
-		m_buffer.resize(0);
-		CURLcode res = curl_easy_perform(m_curl);
+	/*
+	 * A robots.txt answered with 4xx allows everything. A 5xx answer or a failed request disallows everything for this
+	 * run and is stored as a failed fetch, so it is neither cached nor loaded from the url store by other runs.
+	 * */
+	void scraper::handle_robots_response(const URL &url, CURLcode res) {
+		long response_code = 0;
 		if (res == CURLE_OK) {
-			long response_code;
-			char *new_url_str = nullptr;
 			curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &response_code);
-			curl_easy_getinfo(m_curl, CURLINFO_EFFECTIVE_URL, &new_url_str);
 
 			check_for_captcha_block(m_buffer, response_code);
 		} else {
 			/*
 			 * Handle everything here: https://curl.se/libcurl/c/libcurl-errors.html
 			 * */
-			vector<CURLcode> domain_errors = {
-				CURLE_COULDNT_RESOLVE_HOST,
-				CURLE_COULDNT_CONNECT,
-			};
-
 			handle_curl_error(url, res, string(m_curl_error_buffer));
 
 			if (res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_COULDNT_CONNECT) {
 				mark_all_urls_with_error(10000 + res);
-			} else {
 			}
 		}
 
-		return m_buffer;
+		if (res == CURLE_OK && response_code < 500) {
+			const string robots_content = response_code >= 400 ? "" : m_buffer;
+			const size_t fetched_at = time(nullptr);
+			m_robots_rules = make_shared<robots_rules>(robots_content, user_agent_token());
+			if (m_robots_cache != nullptr) {
+				m_robots_cache->put(m_domain, m_robots_rules, fetched_at);
+			}
+			upload_robots_txt(robots_content, fetched_at);
+		} else {
+			m_robots_rules = make_shared<robots_rules>("User-agent: *\nDisallow: /\n", user_agent_token());
+			upload_robots_fetch_failed();
+		}
+
+		m_buffer.resize(0);
+		m_buffer.shrink_to_fit();
+	}
+
+	bool scraper::robots_allow_url(const URL &url) const {
+		return m_robots_rules == nullptr || m_robots_rules->allowed(url);
 	}
 
 	void scraper::upload_domain_info() {
@@ -397,10 +413,19 @@ namespace Scraper {
 		}
 	}
 
-	void scraper::upload_robots_txt(const string &robots_content) {
+	void scraper::upload_robots_txt(const string &robots_content, size_t fetched_at) {
 		UrlStore::RobotsData data;
 		data.m_domain = m_domain;
 		data.m_robots = robots_content;
+		data.m_fetched_at = fetched_at;
+
+		m_store->add_robots_data(data);
+	}
+
+	void scraper::upload_robots_fetch_failed() {
+		UrlStore::RobotsData data;
+		data.m_domain = m_domain;
+		data.m_fetch_failed = true;
 
 		m_store->add_robots_data(data);
 	}
@@ -463,68 +488,35 @@ namespace Scraper {
 	}
 
 	void run_scraper_on_urls(const vector<string> &input_urls) {
-		size_t max_scrapers = 1000;
 		Scraper::store store;
 		Scraper::stats stats;
-		map<string, unique_ptr<scraper>> scrapers;
+		Scraper::engine engine(&store, Config::scraper_threads, Config::scraper_max_per_ip);
 
+		engine.set_max_domains(1000);
+		engine.start_threads();
 		stats.start_thread(60); // Report statistics every minute.
 
 		vector<string> urls = input_urls;
-		while (urls.size() || scrapers.size()) {
+		while (urls.size() || engine.size()) {
 
 			LOG_INFO("Starting scrapers with: " + to_string(urls.size()) + " urls");
 
-			size_t new_max_scrapers = read_max_scrapers();
-			if (new_max_scrapers) {
-				max_scrapers = new_max_scrapers;
+			size_t max_scrapers = read_max_scrapers();
+			if (max_scrapers) {
+				engine.set_max_domains(max_scrapers);
 			}
 
-			vector<string> unhandled_urls;
-
-			for (const string &url_str : urls) {
-				URL url(url_str);
-
-				if (scrapers.count(url.host()) == 0) {
-					if (scrapers.size() >= max_scrapers) {
-						unhandled_urls.push_back(url_str);
-					} else {
-						scrapers[url.host()] = make_unique<scraper>(url.host(), &store);
-						scrapers[url.host()]->push_url(url);
-					}
-				} else {
-					scrapers[url.host()]->push_url(url);
-				}
-			}
-			// Start scrapers.
-			for (auto &iter : scrapers) {
-				if (!iter.second->started()) {
-					iter.second->start_thread();
-				}
-			}
-			
-			// Wait for some scrapers to finish before we assign new scrapers again.
-			while (scrapers.size() > max_scrapers * 0.8) {
-				stats.gather_statistics(scrapers, urls.size());
-				for (auto iter = scrapers.begin(); iter != scrapers.end(); ) {
-					if (iter->second->finished()) {
-						iter = scrapers.erase(iter);
-					} else {
-						iter++;
-					}
-				}
-				this_thread::sleep_for(1000ms);
-			}
-			stats.gather_statistics(scrapers, urls.size());
-			urls = unhandled_urls;
+			// Domains over the limit wait in the backlog of the event loops.
+			engine.push_urls(urls);
+			engine.gather_statistics(stats, 0);
 
-			// Check for new urls and append them.
-			vector<string> new_urls = download_scraper_urls();
-			urls.insert(urls.end(), new_urls.begin(), new_urls.end());
+			// Check for new urls.
+			urls = download_scraper_urls();
 
 			if (urls.size() == 0) {
 				// We don't have any new urls. Just sleep a bit before checking again.
 				std::this_thread::sleep_for(std::chrono::seconds(60));
+				engine.gather_statistics(stats, 0);
 			}
 		}
 		
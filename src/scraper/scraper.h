@@ -24,11 +24,14 @@
  * SOFTWARE.
  */
 
+#pragma once
+
 #include <iostream>
 #include <queue>
 #include <curl/curl.h>
-#include "robots.h"
 #include "store.h"
+#include "cache.h"
+#include "robots_rules.h"
 #include "parser/URL.h"
 #include "urlstore/DomainData.h"
 #include "urlstore/RobotsData.h"
@@ -61,6 +64,21 @@ namespace Scraper {
 			size_t size() const { return m_queue.size(); }
 			bool blocked() const { return m_blocked; }
 
+			/*
+			 * Used by the event_loop to drive the scraper without a thread of its own. The request is set up on the
+			 * curl easy handle of the scraper and the result is handed back when the transfer is done.
+			 * */
+			CURL *curl_handle() const { return m_curl; }
+			void set_domain_data(const UrlStore::DomainData &domain_data);
+			void set_robots_cache(robots_cache *robots_cache) { m_robots_cache = robots_cache; }
+			bool load_cached_robots();
+			URL robots_url();
+			bool next_url(URL &url);
+			size_t politeness_delay_ms() const;
+			void prepare_request(const URL &url);
+			void handle_response(const URL &url, CURLcode res);
+			void handle_robots_response(const URL &url, CURLcode res);
+
 		private:
 			std::thread m_thread;
 			bool m_started = false;
@@ -76,9 +94,9 @@ namespace Scraper {
 			CURL *m_curl;
 			store *m_store;
 			std::queue<URL> m_queue;
-			googlebot::RobotsMatcher m_robots;
+			std::shared_ptr<const robots_rules> m_robots_rules;
+			robots_cache *m_robots_cache = nullptr;
 			UrlStore::DomainData m_domain_data;
-			std::string m_robots_content;
 			size_t m_num_total = 0;
 			size_t m_num_www = 0;
 			size_t m_num_https = 0;
@@ -95,9 +113,9 @@ namespace Scraper {
 			void download_domain_data();
 			void download_robots();
 			bool robots_allow_url(const URL &url) const;
-			std::string simple_get(const URL &url);
 			void upload_domain_info();
-			void upload_robots_txt(const std::string &robots_content);
+			void upload_robots_txt(const std::string &robots_content, size_t fetched_at);
+			void upload_robots_fetch_failed();
 			URL filter_url(const URL &url);
 
 		public:
@@ -109,7 +127,6 @@ namespace Scraper {
 		public:
 			stats();
 			~stats();
-			void gather_statistics(const std::map<std::string, std::unique_ptr<scraper>> &scrapers, size_t urls_in_queue);
 			void start_thread(size_t timeout);
 			void start_count(size_t urls_in_queue);
 			void end_count();
@@ -24,6 +24,8 @@
  * SOFTWARE.
  */
 
+#pragma once
+
 #include "urlstore/UrlStore.h"
 #include "urlstore/UrlData.h"
 #include "urlstore/DomainData.h"
@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace Scraper {
+
+	/*
+	 * Hashed timer wheel. Items are put in the slot their deadline falls in and carry the number of full turns of the
+	 * wheel left before they expire, so scheduling and expiring are O(1) no matter how many items are waiting.
+	 * Time is given by the caller in milliseconds and only moves forward.
+	 * */
+	template<typename T>
+	class timer_wheel {
+		public:
+
+			timer_wheel(size_t num_slots, size_t tick_ms, size_t now_ms);
+
+			void schedule(const T &item, size_t delay_ms);
+
+			/*
+			 * Moves the wheel to now_ms and calls fun(item) for every item that expired on the way.
+			 * */
+			template<typename F>
+			void advance(size_t now_ms, F fun);
+
+			size_t size() const { return m_size; }
+			bool empty() const { return m_size == 0; }
+			size_t ms_until_next_tick(size_t now_ms) const;
+
+		private:
+
+			struct entry {
+				T m_item;
+				size_t m_rounds;
+			};
+
+			std::vector<std::vector<entry>> m_slots;
+			std::vector<entry> m_expired;
+			size_t m_tick_ms;
+			size_t m_time_ms;
+			size_t m_current = 0;
+			size_t m_size = 0;
+
+	};
+
+	template<typename T>
+	timer_wheel<T>::timer_wheel(size_t num_slots, size_t tick_ms, size_t now_ms)
+	: m_slots(num_slots), m_tick_ms(tick_ms), m_time_ms(now_ms) {
+	}
+
+	template<typename T>
+	void timer_wheel<T>::schedule(const T &item, size_t delay_ms) {
+		// Always at least one tick so an item never expires in the advance call that scheduled it.
+		const size_t ticks = std::max<size_t>(1, (delay_ms + m_tick_ms - 1) / m_tick_ms);
+		const size_t slot = (m_current + ticks) % m_slots.size();
+		m_slots[slot].push_back(entry{item, (ticks - 1) / m_slots.size()});
+		m_size++;
+	}
+
+	template<typename T>
+	template<typename F>
+	void timer_wheel<T>::advance(size_t now_ms, F fun) {
+		while (m_time_ms + m_tick_ms <= now_ms) {
+			m_time_ms += m_tick_ms;
+			m_current = (m_current + 1) % m_slots.size();
+
+			std::vector<entry> &slot = m_slots[m_current];
+			size_t kept = 0;
+			for (entry &e : slot) {
+				if (e.m_rounds == 0) {
+					m_expired.push_back(e);
+				} else {
+					e.m_rounds--;
+					slot[kept++] = e;
+				}
+			}
+			slot.resize(kept);
+			m_size -= m_expired.size();
+
+			// The callback may schedule new items, so it runs after the slot is consistent again.
+			for (const entry &e : m_expired) {
+				fun(e.m_item);
+			}
+			m_expired.clear();
+		}
+	}
+
+	template<typename T>
+	size_t timer_wheel<T>::ms_until_next_tick(size_t now_ms) const {
+		if (m_time_ms + m_tick_ms <= now_ms) return 0;
+		return m_time_ms + m_tick_ms - now_ms;
+	}
+
+}
@@ -41,6 +41,7 @@ namespace SearchEngine {
 		metric.m_links_handled = 0;
 		metric.m_link_domain_matches = 0;
 		metric.m_link_url_matches = 0;
+		metric.m_query_cpu_time = 0.0;
 	}
 
 	vector<FullTextRecord> search_deduplicate(SearchAllocation::Storage<FullTextRecord> *storage,
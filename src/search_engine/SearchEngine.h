@@ -42,6 +42,8 @@
 #include "hash/Hash.h"
 #include "sort/Sort.h"
 #include "algorithm/Algorithm.h"
+#include "algorithm/intersection.h"
+#include "utils/query_pool.hpp"
 #include "SearchAllocation.h"
 #include <cassert>
 
@@ -231,62 +233,28 @@ namespace SearchEngine {
 			return;
 		}
 
+		vector<span<const DataRecord>> inputs;
 		size_t shortest_vector_position = 0;
-		size_t shortest_len = SIZE_MAX;
-		{
-			size_t iter_index = 0;
-			for (FullTextResultSet<DataRecord> *result_set : result_sets) {
-				if (shortest_len > result_set->size()) {
-					shortest_len = result_set->size();
-					shortest_vector_position = iter_index;
-				}
-				iter_index++;
+		for (size_t i = 0; i < result_sets.size(); i++) {
+			inputs.emplace_back(result_sets[i]->section_pointer(sections[i]), result_sets[i]->size());
+			if (inputs[i].size() < inputs[shortest_vector_position].size()) {
+				shortest_vector_position = i;
 			}
 		}
 
-		vector<size_t> positions(result_sets.size(), 0);
-
-		const DataRecord *shortest_data = result_sets[shortest_vector_position]->section_pointer(sections[shortest_vector_position]);
-
-		while (positions[shortest_vector_position] < shortest_len) {
-
-			bool all_equal = true;
-			uint64_t value = shortest_data[positions[shortest_vector_position]].m_value;
-
+		::algorithm::intersection_positions<DataRecord>(inputs, [&](const vector<size_t> &positions) {
 			float score_sum = 0.0f;
-			size_t iter_index = 0;
-			for (FullTextResultSet<DataRecord> *result_set : result_sets) {
-				const DataRecord *data_arr = result_set->section_pointer(sections[iter_index]);
-				const size_t len = result_set->size();
-
-				size_t *pos = &(positions[iter_index]);
-				
-				// this is a linear search.
-				while (*pos < len && value > data_arr[*pos].m_value) {
-					(*pos)++;
-				}
-
-				if (*pos < len && value == data_arr[*pos].m_value) {
-					const float score = data_arr[*pos].m_score;
-					score_sum += score;
-				}
-				if ((*pos < len && value < data_arr[*pos].m_value) || *pos >= len) {
-					all_equal = false;
-					break;
-				}
-				iter_index++;
+			for (size_t i = 0; i < inputs.size(); i++) {
+				score_sum += inputs[i][positions[i]].m_score;
 			}
-			if (all_equal) {
-				dest.push_back(shortest_data[positions[shortest_vector_position]]);
-				dest.back().m_score = score_sum / result_sets.size();
-			}
-
-			positions[shortest_vector_position]++;
-		}
+			dest.push_back(inputs[shortest_vector_position][positions[shortest_vector_position]]);
+			dest.back().m_score = score_sum / result_sets.size();
+		});
 	}
 
 	template<typename DataRecord>
-	void calculate_intersection(const vector<FullTextResultSet<DataRecord> *> &result_sets, FullTextResultSet<DataRecord> *dest) {
+	void calculate_intersection(const vector<FullTextResultSet<DataRecord> *> &result_sets, FullTextResultSet<DataRecord> *dest,
+		struct SearchMetric &metric) {
 
 		for (FullTextResultSet<DataRecord> *result : result_sets) {
 			if (result->size() == 0) return;
@@ -325,33 +293,28 @@ namespace SearchEngine {
 			sorted_result_sets[i]->read_to_section(maximum[i]);
 		}
 
-		size_t idx = 0;
-		const size_t num_threads = 8;
-
-		ThreadPool pool(num_threads);
+		// Intersect the partitions on the process wide query pool. Each partition combines different sections so the
+		// partial results are disjoint and can be merged in a single pass.
 		vector<vector<DataRecord>> results(partitions.size());
-		std::vector<std::future<vector<DataRecord>>> thread_results;
-		for (const vector<int> &partition : partitions) {
-			thread_results.emplace_back(pool.enqueue([sorted_result_sets, partition]() {
-				vector<DataRecord> result;
-				value_intersection(sorted_result_sets, partition, result);
-				return result;
-			}));
-			idx++;
+		utils::query_pool::query query;
+		for (size_t i = 0; i < partitions.size(); i++) {
+			query.submit([&sorted_result_sets, &partitions, &results, i]() {
+				value_intersection(sorted_result_sets, partitions[i], results[i]);
+			});
 		}
-		idx = 0;
-		for (auto && result: thread_results) {
-			results[idx] = result.get();
-			idx++;
+		query.wait();
+		metric.m_query_cpu_time += query.cpu_time();
+
+		size_t total = 0;
+		for (const vector<DataRecord> &result : results) {
+			total += result.size();
 		}
-		// merge
-		vector<DataRecord> merged_vec;
-		Sort::merge_arrays(results, [](const DataRecord &a, const DataRecord &b) {
-			return a.m_value < b.m_value;
-		}, merged_vec);
+		assert(total <= dest->max_size());
 
-		// copy.
-		dest->copy_vector(merged_vec);
+		const size_t merged = Sort::merge_arrays_k_way(results, [](const DataRecord &a, const DataRecord &b) {
+			return a.m_value < b.m_value;
+		}, dest->data_pointer());
+		dest->resize(merged);
 	}
 
 	template<typename DataRecord>
@@ -510,7 +473,7 @@ namespace SearchEngine {
 			// We need to calculate the intersection of the given results.
 			flat_result = storage->intersected_result;
 			flat_result->resize(0);
-			calculate_intersection<DataRecord>(result_vector, flat_result);
+			calculate_intersection<DataRecord>(result_vector, flat_result, metric);
 
 			set_total_found<DataRecord>(result_vector, metric, (double)flat_result->size() / largest_result(result_vector));
 		} else {
@@ -548,7 +511,7 @@ namespace SearchEngine {
 			// We need to calculate the intersection of the given results.
 			flat_result = storage->intersected_result;
 			flat_result->resize(0);
-			calculate_intersection<DataRecord>(result_vector, flat_result);
+			calculate_intersection<DataRecord>(result_vector, flat_result, metric);
 
 			set_total_found<DataRecord>(result_vector, metric, (double)flat_result->size() / largest_result(result_vector));
 		} else {
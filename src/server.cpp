@@ -33,6 +33,7 @@
 #include "system/Logger.h"
 #include "api/Worker.h"
 #include "hash_table/HashTableHelper.h"
+#include "hash_table/compactor.h"
 #include "full_text/FullText.h"
 #include "full_text/FullTextRecord.h"
 #include "system/Profiler.h"
@@ -79,10 +80,15 @@ int main(int argc, const char **argv) {
 
 		//Worker::start_urlstore_server();
 
+		hash_table::compactor compactor("main_index");
+		compactor.start();
+
 		cout << "starting download server" << endl;
 		Worker::start_download_server();
 		Worker::start_server();
 
+		compactor.stop();
+
 	} else if (argc == 1 && !FullText::is_indexed()) {
 
 		Worker::Status status;
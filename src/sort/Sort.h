@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <span>
+#include <algorithm>
 
 namespace Sort {
 
@@ -129,4 +130,47 @@ namespace Sort {
 		merge_array_range(arrays, 0, arrays.size() - 1, compare, res);
 	}
 
+	/*
+		Merges all the sorted arrays in one pass with a heap of cursors and writes the result to out, which must have
+		room for the sum of the array sizes. No intermediate arrays are allocated. Returns the number of records written.
+	*/
+	template<typename DataRecord, typename F>
+	size_t merge_arrays_k_way(const std::vector<std::vector<DataRecord>> &arrays, F compare, DataRecord *out) {
+
+		// Cursors are pairs of (array, position), the heap keeps the cursor with the smallest record on top.
+		std::vector<std::pair<size_t, size_t>> heap;
+		for (size_t i = 0; i < arrays.size(); i++) {
+			if (arrays[i].size()) heap.emplace_back(i, 0);
+		}
+		auto heap_compare = [&arrays, &compare](const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b) {
+			return compare(arrays[b.first][b.second], arrays[a.first][a.second]);
+		};
+		std::make_heap(heap.begin(), heap.end(), heap_compare);
+
+		size_t written = 0;
+		while (heap.size()) {
+			std::pop_heap(heap.begin(), heap.end(), heap_compare);
+			std::pair<size_t, size_t> &cursor = heap.back();
+			out[written++] = arrays[cursor.first][cursor.second];
+			if (++cursor.second < arrays[cursor.first].size()) {
+				std::push_heap(heap.begin(), heap.end(), heap_compare);
+			} else {
+				heap.pop_back();
+			}
+		}
+
+		return written;
+	}
+
+	template<typename DataRecord, typename F>
+	void merge_arrays_k_way(const std::vector<std::vector<DataRecord>> &arrays, F compare, std::vector<DataRecord> &res) {
+		size_t total = 0;
+		for (const std::vector<DataRecord> &arr : arrays) {
+			total += arr.size();
+		}
+		const size_t offset = res.size();
+		res.resize(offset + total);
+		merge_arrays_k_way(arrays, compare, res.data() + offset);
+	}
+
 }
@@ -48,6 +48,21 @@ SubSystem::SubSystem() {
 	});
 }
 
+SubSystem::SubSystem(const string &domain_index_file, const string &dictionary_file) {
+
+	File::TsvFile domain_index(domain_index_file);
+	m_domain_index = new Dictionary(domain_index);
+
+	File::TsvFile dictionary(dictionary_file);
+	m_dictionary = new Dictionary(dictionary);
+
+	dictionary.read_column_into(0, m_words);
+
+	sort(m_words.begin(), m_words.end(), [](const string &a, const string &b) {
+		return a < b;
+	});
+}
+
 SubSystem::~SubSystem() {
 	delete m_dictionary;
 	delete m_domain_index;
@@ -41,6 +41,11 @@ class SubSystem {
 public:
 
 	SubSystem();
+
+	/*
+	 * Reads the domain index and the dictionary from local tsv files instead of downloading them.
+	 * */
+	SubSystem(const std::string &domain_index_file, const std::string &dictionary_file);
 	~SubSystem();
 
 	const Dictionary *domain_index() const;
@@ -25,6 +25,7 @@
  */
 
 #include "Text.h"
+#include "tokenizer.h"
 
 using namespace std;
 
@@ -39,12 +40,12 @@ namespace Text {
 		return false;
 	}
 
-	bool is_clean_word(const string &s) {
-		const char *str = s.c_str();
+	bool is_clean_word(string_view s) {
+		const char *str = s.data();
 		size_t len = s.size();
 		for (size_t i = 0; i < len; ) {
 			size_t multibyte_len = 1;
-			for (size_t j = i + 1; IS_MULTIBYTE_CODEPOINT(str[j]) && (j < len); j++, multibyte_len++) {
+			for (size_t j = i + 1; (j < len) && IS_MULTIBYTE_CODEPOINT(str[j]); j++, multibyte_len++) {
 			}
 
 			if (!is_clean_char(&str[i], multibyte_len)) {
@@ -81,21 +82,10 @@ namespace Text {
 	*/
 	vector<string> get_words(const string &str, size_t limit) {
 
-		const string word_boundary = " \t,|!";
-
-		string str_lc = lower_case(str);
-
-		vector<string> raw_words, words;
-		boost::split(raw_words, str_lc, boost::is_any_of(word_boundary));
-
-		for (string &word : raw_words) {
-			trim(word);
-			if (is_clean_word(word) && word.size() <= CC_MAX_WORD_LEN &&
-					word.size() > 0) {
-				words.push_back(word);
-			}
-			if (limit && words.size() == limit) break;
-		}
+		vector<string> words;
+		text::for_each_clean_word(str, [&words](const text::word &word) {
+			words.emplace_back(word.m_text);
+		}, limit);
 
 		return words;
 	}
@@ -110,23 +100,10 @@ namespace Text {
 	*/
 	vector<string> get_full_text_words(const string &str, size_t limit) {
 
-		const string word_boundary = " \t,|!";
-
-		string str_lc = lower_case(str);
-
-		vector<string> raw_words, words;
-		boost::split(raw_words, str_lc, boost::is_any_of(word_boundary));
-
-		for (string &word : raw_words) {
-			if (Unicode::is_valid(word)) {
-				trim(word);
-				if (word.size() <= CC_MAX_WORD_LEN && word.size() > 0) {
-					words.push_back(word);
-				}
-				if (limit && words.size() == limit) break;
-			}
-			
-		}
+		vector<string> words;
+		text::for_each_full_text_word(str, [&words](const text::word &word) {
+			words.emplace_back(word.m_text);
+		}, limit);
 
 		return words;
 	}
@@ -215,34 +192,10 @@ namespace Text {
 	*/
 	vector<string> get_expanded_full_text_words(const string &str, size_t limit) {
 
-		const string word_boundary = " \t,|!";
-		const string blend_chars = ".-:";
-
-		string str_lc = lower_case(str);
-
-		vector<string> raw_words, words, blended;
-		boost::split(raw_words, str_lc, boost::is_any_of(word_boundary));
-
-		for (string &word : raw_words) {
-			if (Unicode::is_valid(word)) {
-				trim(word);
-				if (word.size() <= CC_MAX_WORD_LEN && word.size() > 0) {
-					words.push_back(word);
-
-					if (limit && words.size() == limit) break;
-
-					boost::split(blended, word, boost::is_any_of(blend_chars));
-					if (blended.size() > 1) {
-						for (string &blended_word : blended) {
-							trim(blended_word);
-							words.push_back(blended_word);
-							if (limit && words.size() == limit) break;
-						}
-					}
-				}
-			}
-			
-		}
+		vector<string> words;
+		text::for_each_expanded_full_text_word(str, [&words](const text::word &word) {
+			words.emplace_back(word.m_text);
+		}, limit);
 
 		return words;
 	}
@@ -34,6 +34,7 @@
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <sstream>
+#include <string_view>
 #include "Stopwords.h"
 #include "parser/Unicode.h"
 #include "hash/Hash.h"
@@ -101,7 +102,7 @@ namespace Text {
 	}
 
 	bool is_clean_char(const char *ch, size_t multibyte_len);
-	bool is_clean_word(const std::string &s);
+	bool is_clean_word(std::string_view s);
 	std::string clean_word(const std::string &s);
 
 	/*
@@ -0,0 +1,229 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Text.h"
+#include "hash/Hash.h"
+
+/*
+ * Single pass word tokenizer. Gives the same words as Text::get_full_text_words, Text::get_expanded_full_text_words
+ * and Text::get_words without allocating. Words are passed to a callback as views that are only valid during the
+ * call, either into the input or into a stack buffer when they had to be lower cased.
+ * */
+
+namespace text {
+
+	namespace char_class {
+		const uint8_t boundary = 0x01; // Separates words, " \t,|!".
+		const uint8_t trim = 0x02; // Trimmed from both ends of words, ascii space and punctuation.
+		const uint8_t blend = 0x04; // Separates the parts of expanded words, ".-:".
+		const uint8_t upper = 0x08;
+
+		// The high four bits hold the number of continuation bytes after a utf-8 lead byte.
+		const uint8_t utf8_continuation = 4;
+		const uint8_t utf8_invalid = 5;
+	}
+
+	constexpr std::array<uint8_t, 256> make_char_classes() {
+		std::array<uint8_t, 256> classes = {};
+		for (int c = 0; c < 256; c++) {
+			uint8_t cls = 0;
+			if (c == ' ' || c == '\t' || c == ',' || c == '|' || c == '!') cls |= char_class::boundary;
+			// Same as isspace and ispunct in the C locale.
+			if ((c >= '\t' && c <= '\r') || c == ' ' || (c >= 33 && c <= 47) || (c >= 58 && c <= 64) ||
+				(c >= 91 && c <= 96) || (c >= 123 && c <= 126)) cls |= char_class::trim;
+			if (c == '.' || c == '-' || c == ':') cls |= char_class::blend;
+			if (c >= 'A' && c <= 'Z') cls |= char_class::upper;
+
+			uint8_t utf8 = 0;
+			if (c >= 0x80 && c < 0xc0) utf8 = char_class::utf8_continuation;
+			else if (c >= 0xc2 && c < 0xe0) utf8 = 1;
+			else if (c >= 0xe0 && c < 0xf0) utf8 = 2;
+			else if (c >= 0xf0 && c < 0xf8) utf8 = 3;
+			else if (c >= 0x80) utf8 = char_class::utf8_invalid;
+
+			classes[c] = cls | (utf8 << 4);
+		}
+		return classes;
+	}
+
+	inline constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
+
+	struct word {
+		std::string_view m_text; // Lower case word, only valid during the callback.
+		size_t m_pos; // Position of the word in the tokenized string, the word has the same length there.
+
+		uint64_t hash() const { return Hash::murmur_hash(m_text.data(), m_text.size()); }
+	};
+
+	/*
+	 * Calls fun(std::string_view word, size_t pos, bool is_valid_utf8) for every word between boundaries with space
+	 * and punctuation trimmed. Empty words and words longer than CC_MAX_WORD_LEN are skipped. fun returns false to
+	 * stop.
+	 * */
+	template<typename F>
+	void for_each_raw_word(std::string_view str, F &&fun) {
+
+		const size_t len = str.size();
+		const unsigned char *data = (const unsigned char *)str.data();
+		char lower[CC_MAX_WORD_LEN];
+
+		for (size_t i = 0; i <= len; i++) {
+			size_t first = SIZE_MAX;
+			size_t last = 0;
+			bool has_upper = false;
+			bool is_valid = true;
+			uint8_t continuations = 0;
+
+			for (; i < len; i++) {
+				const uint8_t cls = char_classes[data[i]];
+				if (cls & char_class::boundary) break;
+
+				if (!(cls & char_class::trim)) {
+					if (first == SIZE_MAX) first = i;
+					last = i;
+				}
+				has_upper |= (cls & char_class::upper) != 0;
+
+				const uint8_t utf8 = cls >> 4;
+				if (continuations) {
+					if (utf8 == char_class::utf8_continuation) continuations--;
+					else is_valid = false;
+				} else if (utf8 == char_class::utf8_continuation || utf8 == char_class::utf8_invalid) {
+					is_valid = false;
+				} else {
+					continuations = utf8;
+				}
+			}
+			if (continuations) is_valid = false;
+
+			if (first == SIZE_MAX) continue;
+			const size_t word_len = last - first + 1;
+			if (word_len > CC_MAX_WORD_LEN) continue;
+
+			std::string_view word(str.data() + first, word_len);
+			if (has_upper) {
+				for (size_t j = 0; j < word_len; j++) {
+					const char c = word[j];
+					lower[j] = (char_classes[(unsigned char)c] & char_class::upper) ? c + ('a' - 'A') : c;
+				}
+				word = std::string_view(lower, word_len);
+			}
+
+			if (!fun(word, first, is_valid)) return;
+		}
+	}
+
+	/*
+	 * Calls fun(const word &) for the words of Text::get_full_text_words, stops after limit words if limit is not 0.
+	 * */
+	template<typename F>
+	void for_each_full_text_word(std::string_view str, F &&fun, size_t limit = 0) {
+		size_t count = 0;
+		for_each_raw_word(str, [&fun, &count, limit](std::string_view text, size_t pos, bool is_valid) {
+			if (!is_valid) return true;
+			fun(word{text, pos});
+			return !(limit && ++count == limit);
+		});
+	}
+
+	/*
+	 * Calls fun(const word &) for the words of Text::get_expanded_full_text_words. Words with any of .-: are followed
+	 * by their parts, trimmed and possibly empty.
+	 * */
+	template<typename F>
+	void for_each_expanded_full_text_word(std::string_view str, F &&fun, size_t limit = 0) {
+		size_t count = 0;
+		for_each_raw_word(str, [&fun, &count, limit](std::string_view text, size_t pos, bool is_valid) {
+			if (!is_valid) return true;
+			fun(word{text, pos});
+			if (limit && ++count == limit) return false;
+
+			bool has_blend = false;
+			for (char c : text) has_blend |= (char_classes[(unsigned char)c] & char_class::blend) != 0;
+			if (!has_blend) return true;
+
+			size_t part_start = 0;
+			for (size_t i = 0; i <= text.size(); i++) {
+				if (i < text.size() && !(char_classes[(unsigned char)text[i]] & char_class::blend)) continue;
+
+				size_t first = part_start;
+				size_t end = i;
+				while (first < end && (char_classes[(unsigned char)text[first]] & char_class::trim)) first++;
+				while (end > first && (char_classes[(unsigned char)text[end - 1]] & char_class::trim)) end--;
+
+				fun(word{text.substr(first, end - first), pos + first});
+				if (limit && ++count == limit) return false;
+
+				part_start = i + 1;
+			}
+			return true;
+		});
+	}
+
+	/*
+	 * Calls fun(const word &) for the words of Text::get_words, only words with a-z, 0-9, å, ä and ö.
+	 * */
+	template<typename F>
+	void for_each_clean_word(std::string_view str, F &&fun, size_t limit = 0) {
+		size_t count = 0;
+		for_each_raw_word(str, [&fun, &count, limit](std::string_view text, size_t pos, bool) {
+			if (!Text::is_clean_word(text)) return true;
+			fun(word{text, pos});
+			return !(limit && ++count == limit);
+		});
+	}
+
+	/*
+	 * Calls fun(uint64_t hash) for the n-grams of the expanded full text words, the same hashes as
+	 * Text::words_to_ngram_hash gives for Text::get_expanded_full_text_words. The words are joined with spaces in one
+	 * buffer so every n-gram is hashed where it lies.
+	 * */
+	template<typename F>
+	void for_each_expanded_ngram_hash(std::string_view str, size_t n_grams, F &&fun) {
+
+		std::string joined;
+		std::vector<std::pair<uint32_t, uint32_t>> words;
+		for_each_expanded_full_text_word(str, [&joined, &words](const word &w) {
+			if (words.size()) joined.push_back(' ');
+			words.emplace_back(joined.size(), joined.size() + w.m_text.size());
+			joined.append(w.m_text);
+		});
+
+		for (size_t i = 0; i < words.size(); i++) {
+			for (size_t j = 0; j < n_grams && (j + i) < words.size(); j++) {
+				fun((uint64_t)Hash::murmur_hash(joined.data() + words[i].first, words[i + j].second - words[i].first));
+			}
+		}
+	}
+
+}
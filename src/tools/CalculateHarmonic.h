@@ -5,6 +5,11 @@ namespace Tools {
 
 	void calculate_harmonic_hosts();
 	void calculate_harmonic_links();
+
+	/*
+	 * Converts /mnt/edges.adj to the memory mapped /mnt/edges.csr read by calculate_harmonic.
+	 * */
+	void calculate_harmonic_csr();
 	void calculate_harmonic();
 
 }
@@ -25,6 +25,7 @@
  */
 
 #include "DomainData.h"
+#include "record_codec.h"
 
 using namespace std;
 using json = nlohmann::ordered_json;
@@ -33,7 +34,12 @@ namespace UrlStore {
 
 	const std::string DomainData::uri = "domain";
 
-	// Internal data structure, this is what is stored in byte array together with URLs.
+	// Field ids of the record_codec encoding.
+	const uint64_t field_domain = 1;
+	const uint64_t field_has_https = 2;
+	const uint64_t field_has_www = 3;
+
+	// Internal data structure of values stored before record_codec, this is followed by the domain.
 	struct DomainDataStore {
 		size_t has_https;
 		size_t has_www;
@@ -43,6 +49,16 @@ namespace UrlStore {
 	}
 
 	DomainData::DomainData(const char *cstr, size_t len) {
+
+		record_codec::record_view view(cstr, len);
+		if (view.valid()) {
+			string_view domain;
+			if (view.bytes(field_domain, domain)) m_domain = string(domain);
+			view.varint(field_has_https, m_has_https);
+			view.varint(field_has_www, m_has_www);
+			return;
+		}
+
 		if (len < sizeof(DomainDataStore) + sizeof(size_t)) {
 			return;
 		}
@@ -74,19 +90,12 @@ namespace UrlStore {
 
 	string DomainData::to_str() const {
 
-		DomainDataStore data_store = {
-			.has_https = m_has_https,
-			.has_www = m_has_www
-		};
-
-		string str;
-		str.append((char *)&data_store, sizeof(data_store));
-
-		const size_t domain_len = m_domain.size();
-		str.append((char *)&domain_len, sizeof(domain_len));
-		str.append(m_domain);
+		record_codec::record_writer writer;
+		writer.add_bytes(field_domain, m_domain);
+		writer.add_varint(field_has_https, m_has_https);
+		writer.add_varint(field_has_www, m_has_www);
 
-		return str;
+		return writer.str();
 	}
 
 	string DomainData::private_key() const {
@@ -25,6 +25,7 @@
  */
 
 #include "RobotsData.h"
+#include "record_codec.h"
 
 using namespace std;
 using json = nlohmann::ordered_json;
@@ -33,10 +34,30 @@ namespace UrlStore {
 
 	const std::string RobotsData::uri = "robots";
 
+	// Field ids of the record_codec encoding.
+	const uint64_t field_domain = 1;
+	const uint64_t field_robots = 2;
+	const uint64_t field_fetched_at = 3;
+	const uint64_t field_fetch_failed = 4;
+
 	RobotsData::RobotsData() {
 	}
 
 	RobotsData::RobotsData(const char *cstr, size_t len) {
+
+		record_codec::record_view view(cstr, len);
+		if (view.valid()) {
+			string_view domain, robots;
+			if (view.bytes(field_domain, domain)) m_domain = string(domain);
+			if (view.bytes(field_robots, robots)) m_robots = string(robots);
+			view.varint(field_fetched_at, m_fetched_at);
+			uint64_t fetch_failed = 0;
+			view.varint(field_fetch_failed, fetch_failed);
+			m_fetch_failed = fetch_failed != 0;
+			return;
+		}
+
+		// Values stored before record_codec.
 		if (len < 2*sizeof(size_t)) {
 			return;
 		}
@@ -55,6 +76,11 @@ namespace UrlStore {
 				m_domain = string(&cstr[offs_domain], domain_len);
 				m_robots = string(&cstr[offs_robots], robots_len);
 			}
+
+			const size_t offs_fetched_at = offs_robots + robots_len;
+			if (offs_fetched_at + sizeof(size_t) <= len) {
+				m_fetched_at = *((size_t *)&cstr[offs_fetched_at]);
+			}
 		}
 	}
 
@@ -65,22 +91,25 @@ namespace UrlStore {
 	}
 
 	void RobotsData::apply_update(const RobotsData &src, size_t update_bitmask) {
-		if (update_bitmask & update_robots) m_robots = src.m_robots;
+		if (update_bitmask & update_robots) {
+			// A failed fetch keeps the robots.txt we had.
+			m_fetch_failed = src.m_fetch_failed;
+			if (!src.m_fetch_failed) {
+				m_robots = src.m_robots;
+				m_fetched_at = src.m_fetched_at;
+			}
+		}
 	}
 
 	string RobotsData::to_str() const {
 
-		string str;
-
-		const size_t domain_len = m_domain.size();
-		str.append((char *)&domain_len, sizeof(domain_len));
-		str.append(m_domain);
-
-		const size_t robots_len = m_robots.size();
-		str.append((char *)&robots_len, sizeof(robots_len));
-		str.append(m_robots);
+		record_codec::record_writer writer;
+		writer.add_bytes(field_domain, m_domain);
+		writer.add_bytes(field_robots, m_robots);
+		writer.add_varint(field_fetched_at, m_fetched_at);
+		writer.add_varint(field_fetch_failed, m_fetch_failed);
 
-		return str;
+		return writer.str();
 	}
 
 	string RobotsData::private_key() const {
@@ -95,6 +124,8 @@ namespace UrlStore {
 		json message;
 		message["domain"] = m_domain;
 		message["robots"] = m_robots;
+		message["fetched_at"] = m_fetched_at;
+		message["fetch_failed"] = m_fetch_failed;
 
 		return message;
 	}
@@ -43,6 +43,8 @@ namespace UrlStore {
 
 			std::string m_domain;
 			std::string m_robots;
+			size_t m_fetched_at = 0; // Unix timestamp, 0 for records stored before it was added.
+			bool m_fetch_failed = false; // The last fetch failed, m_robots and m_fetched_at are from the one before.
 
 			void apply_update(const RobotsData &data, size_t update_bitmask);
 
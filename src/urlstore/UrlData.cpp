@@ -25,6 +25,7 @@
  */
 
 #include "UrlData.h"
+#include "record_codec.h"
 
 using namespace std;
 using json = nlohmann::ordered_json;
@@ -33,7 +34,14 @@ namespace UrlStore {
 
 	const std::string UrlData::uri = "url";
 
-	// Internal data structure, this is what is stored in byte array together with URLs.
+	// Field ids of the record_codec encoding.
+	const uint64_t field_url = 1;
+	const uint64_t field_redirect = 2;
+	const uint64_t field_link_count = 3;
+	const uint64_t field_http_code = 4;
+	const uint64_t field_last_visited = 5;
+
+	// Internal data structure of values stored before record_codec, this is followed by the URLs.
 	struct UrlDataStore {
 		size_t link_count;
 		size_t http_code;
@@ -44,6 +52,18 @@ namespace UrlStore {
 	}
 
 	UrlData::UrlData(const char *cstr, size_t len) {
+
+		record_codec::record_view view(cstr, len);
+		if (view.valid()) {
+			string_view url, redirect;
+			if (view.bytes(field_url, url)) m_url = record_codec::decode_url(url);
+			if (view.bytes(field_redirect, redirect)) m_redirect = record_codec::decode_url(redirect, &m_url);
+			view.varint(field_link_count, m_link_count);
+			view.varint(field_http_code, m_http_code);
+			view.varint(field_last_visited, m_last_visited);
+			return;
+		}
+
 		if (len < sizeof(UrlDataStore) + 2*sizeof(size_t)) {
 			return;
 		}
@@ -88,24 +108,14 @@ namespace UrlStore {
 
 	string UrlData::to_str() const {
 
-		UrlDataStore data_store = {
-			.link_count = m_link_count,
-			.http_code = m_http_code,
-			.last_visited = m_last_visited
-		};
-
-		string str;
-		str.append((char *)&data_store, sizeof(data_store));
-
-		const size_t url_len = m_url.size();
-		str.append((char *)&url_len, sizeof(url_len));
-		str.append(m_url.str());
-
-		const size_t redirect_len = m_redirect.size();
-		str.append((char *)&redirect_len, sizeof(redirect_len));
-		str.append(m_redirect.str());
+		record_codec::record_writer writer;
+		writer.add_bytes(field_url, record_codec::encode_url(m_url));
+		writer.add_bytes(field_redirect, record_codec::encode_url(m_redirect, &m_url));
+		writer.add_varint(field_link_count, m_link_count);
+		writer.add_varint(field_http_code, m_http_code);
+		writer.add_varint(field_last_visited, m_last_visited);
 
-		return str;
+		return writer.str();
 	}
 
 	string UrlData::private_key() const {
@@ -31,6 +31,11 @@
 #include <deque>
 #include <future>
 #include <thread>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 #include <boost/filesystem.hpp>
 #include "config.h"
 #include "hash/Hash.h"
@@ -41,8 +46,7 @@
 #include "json.hpp"
 #include "KeyValueStore.h"
 #include "parser/URL.h"
-#include "leveldb/db.h"
-#include "leveldb/write_batch.h"
+#include "bloom_filter.h"
 
 #include "UrlData.h"
 #include "DomainData.h"
@@ -56,17 +60,23 @@ namespace UrlStore {
 	const int OK = 0;
 	const int ERROR = 1;
 
+	/*
+	 * One record of a PUT request together with the update bitmask of the request. A bitmask of 0 replaces the stored
+	 * record.
+	 * */
 	template <typename StoreData>
-	class UrlStoreBatch {
-		public:
-			UrlStoreBatch();
-			~UrlStoreBatch();
-
-			void set(const StoreData &data);
-
-			std::vector<leveldb::WriteBatch> m_batches;
+	struct write_op {
+		StoreData m_data;
+		size_t m_update_bitmask;
 	};
 
+	/*
+	 * Records of one or more PUT requests grouped per shard and key. The keys are sorted so the reads of a shard go
+	 * through the engine in key order and the ops of each key are kept in the order they arrived.
+	 * */
+	template <typename StoreData>
+	using shard_writes = std::vector<std::map<std::string, std::vector<write_op<StoreData>>>>;
+
 	template <typename StoreData>
 	class UrlStore {
 		public:
@@ -76,18 +86,45 @@ namespace UrlStore {
 			// Key value interface
 			void set(const StoreData &data);
 			StoreData get(const string &public_key);
+			std::vector<StoreData> get_many(const std::vector<std::string> &public_keys);
 
 			// Bulk inserts.
-			void write_batch(UrlStoreBatch<StoreData> &batch);
+			void write_shard(size_t shard, std::map<std::string, std::vector<write_op<StoreData>>> &writes);
 
 			// Pending inserts.
 			bool has_pending_insert();
 			std::string next_pending_insert();
 			void add_pending_insert(const std::string &file);
+			std::vector<std::string> wait_for_pending_inserts(size_t max_files);
+
+			// Lookups answered by the Bloom filters without reading the engine.
+			size_t filtered_lookups() const { return m_filtered_lookups; }
+			bool filters_ready() const;
 
 		private:
 			std::vector<KeyValueStore *> m_shards;
+			std::vector<std::mutex> m_shard_locks;
+
+			/*
+			 * One Bloom filter per shard with all keys ever written to it. A filter is read from its snapshot at startup
+			 * and the snapshot is removed, it is written again when the store is closed. If there is no snapshot the
+			 * filter is rebuilt from a scan of the shard in the background and is not used until the scan is done.
+			 * */
+			std::vector<std::unique_ptr<bloom_filter>> m_filters;
+			std::vector<std::atomic<bool>> m_filter_ready;
+			std::vector<std::thread> m_filter_builders;
+			std::atomic<bool> m_stopping = false;
+			std::atomic<size_t> m_filtered_lookups = 0;
+
 			std::deque<std::string> m_pending_inserts;
+			std::mutex m_pending_lock;
+			std::condition_variable m_pending_cv;
+
+			static string engine_type();
+			string shard_path(size_t shard) const;
+			void build_filter(size_t shard);
+			void add_to_filter(size_t shard, const string &key);
+			bool may_contain(size_t shard, const string &key);
 
 	};
 
@@ -98,34 +135,40 @@ namespace UrlStore {
 	};
 
 	template <typename StoreData>
-	UrlStoreBatch<StoreData>::UrlStoreBatch()
-	: m_batches(Config::url_store_shards)
-	{
-		
-	}
-
-	template <typename StoreData>
-	UrlStoreBatch<StoreData>::~UrlStoreBatch() {
+	UrlStore<StoreData>::UrlStore()
+	: m_shard_locks(Config::url_store_shards), m_filter_ready(Config::url_store_shards) {
+		for (size_t i = 0; i < Config::url_store_shards; i++) {
+			boost::filesystem::create_directories(shard_path(i));
+			m_shards.push_back(new KeyValueStore(shard_path(i), engine_type()));
+		}
 
-	}
+		if (Config::url_store_bloom_mb == 0) return;
 
-	template <typename StoreData>
-	void UrlStoreBatch<StoreData>::set(const StoreData &data) {
-		const size_t shard = Hash::str(data.private_key()) % Config::url_store_shards;
-		m_batches[shard].Put(data.private_key(), data.to_str());
-	}
-
-	template <typename StoreData>
-	UrlStore<StoreData>::UrlStore()  {
-		const string &db_prefix = StoreData::uri;
+		const size_t filter_bytes = Config::url_store_bloom_mb * 1024 * 1024 / Config::url_store_shards;
 		for (size_t i = 0; i < Config::url_store_shards; i++) {
-			boost::filesystem::create_directories("/mnt/" + std::to_string(i % 8) + "/store/"+db_prefix+"/url_store_" + std::to_string(i));
-			m_shards.push_back(new KeyValueStore("/mnt/" + std::to_string(i % 8) + "/store/"+db_prefix+"/url_store_" + std::to_string(i)));
+			m_filters.emplace_back(std::make_unique<bloom_filter>(filter_bytes));
+			const string snapshot = shard_path(i) + ".bloom";
+			if (m_filters[i]->load(snapshot)) {
+				// Writes after a crash would be missing from the snapshot so it is only valid until the next one.
+				File::delete_file(snapshot);
+				m_filter_ready[i] = true;
+			} else {
+				m_filter_builders.emplace_back(&UrlStore<StoreData>::build_filter, this, i);
+			}
 		}
 	}
 
 	template <typename StoreData>
 	UrlStore<StoreData>::~UrlStore() {
+		m_stopping = true;
+		for (std::thread &builder : m_filter_builders) {
+			builder.join();
+		}
+		for (size_t i = 0; i < m_filters.size(); i++) {
+			if (m_filter_ready[i]) {
+				m_filters[i]->save(shard_path(i) + ".bloom");
+			}
+		}
 		for (KeyValueStore *shard : m_shards) {
 			delete shard;
 		}
@@ -134,31 +177,170 @@ namespace UrlStore {
 	template <typename StoreData>
 	void UrlStore<StoreData>::set(const StoreData &data) {
 		const size_t shard = Hash::str(data.private_key()) % Config::url_store_shards;
+		add_to_filter(shard, data.private_key());
 		m_shards[shard]->set(data.private_key(), data.to_str());
 	}
 
 	template <typename StoreData>
 	StoreData UrlStore<StoreData>::get(const string &public_key) {
-		const size_t shard = Hash::str(StoreData::public_key_to_private_key(public_key)) % Config::url_store_shards;
-		string value = m_shards[shard]->get(StoreData::public_key_to_private_key(public_key));
+		const string private_key = StoreData::public_key_to_private_key(public_key);
+		const size_t shard = Hash::str(private_key) % Config::url_store_shards;
+		if (!may_contain(shard, private_key)) return StoreData();
+		string value = m_shards[shard]->get(private_key);
 		if (value.size()) return StoreData(value);
 		return StoreData();
 	}
 
+	/*
+	 * Reads the keys of each shard with one multi get, keys ruled out by the Bloom filters are not read.
+	 * */
 	template <typename StoreData>
-	void UrlStore<StoreData>::write_batch(UrlStoreBatch<StoreData> &batch) {
+	vector<StoreData> UrlStore<StoreData>::get_many(const vector<string> &public_keys) {
+
+		vector<vector<string>> shard_keys(Config::url_store_shards);
+		vector<vector<size_t>> shard_positions(Config::url_store_shards);
+		for (size_t i = 0; i < public_keys.size(); i++) {
+			const string private_key = StoreData::public_key_to_private_key(public_keys[i]);
+			const size_t shard = Hash::str(private_key) % Config::url_store_shards;
+			if (!may_contain(shard, private_key)) continue;
+			shard_keys[shard].push_back(private_key);
+			shard_positions[shard].push_back(i);
+		}
+
+		vector<StoreData> datas(public_keys.size());
 		for (size_t shard = 0; shard < Config::url_store_shards; shard++) {
-			m_shards[shard]->db()->Write(leveldb::WriteOptions(), &batch.m_batches[shard]);
+			if (shard_keys[shard].empty()) continue;
+			const auto values = m_shards[shard]->engine().multi_get(shard_keys[shard]);
+			for (size_t i = 0; i < values.size(); i++) {
+				if (values[i] && values[i]->size()) datas[shard_positions[shard][i]] = StoreData(*values[i]);
+			}
+		}
+
+		return datas;
+	}
+
+	template <typename StoreData>
+	bool UrlStore<StoreData>::filters_ready() const {
+		if (m_filters.empty()) return false;
+		for (size_t i = 0; i < m_filters.size(); i++) {
+			if (!m_filter_ready[i]) return false;
+		}
+		return true;
+	}
+
+	/*
+	 * The engine is picked per store with url_store_engine[uri] in the config.
+	 * */
+	template <typename StoreData>
+	string UrlStore<StoreData>::engine_type() {
+		auto iter = Config::url_store_engines.find(StoreData::uri);
+		if (iter == Config::url_store_engines.end()) return key_value::engine_leveldb;
+		return iter->second;
+	}
+
+	/*
+	 * Engines other than leveldb get their own directories so switching engine does not mix their files, or the
+	 * Bloom filter snapshots written next to them.
+	 * */
+	template <typename StoreData>
+	string UrlStore<StoreData>::shard_path(size_t shard) const {
+		const string path = "/mnt/" + std::to_string(shard % 8) + "/store/" + StoreData::uri + "/url_store_" +
+			std::to_string(shard);
+		const string engine = engine_type();
+		if (engine == key_value::engine_leveldb) return path;
+		return path + "_" + engine;
+	}
+
+	/*
+	 * Inserts every key of the shard. Keys written during the scan are added by the write path so nothing is missed,
+	 * the iterator only has to see the keys that were there when it was created.
+	 * */
+	template <typename StoreData>
+	void UrlStore<StoreData>::build_filter(size_t shard) {
+		size_t num_keys = 0;
+		m_shards[shard]->engine().scan("", "", [this, shard, &num_keys](std::string_view key, std::string_view) {
+			m_filters[shard]->insert(string(key));
+			num_keys++;
+			return num_keys % 100000 != 0 || !m_stopping;
+		});
+		if (m_stopping) return;
+
+		m_filter_ready[shard] = true;
+		LOG_INFO("built bloom filter for " + StoreData::uri + " shard " + std::to_string(shard) + " with " +
+			std::to_string(num_keys) + " keys");
+	}
+
+	/*
+	 * Has to be called before the key is written to the engine, otherwise a lookup in between could miss it.
+	 * */
+	template <typename StoreData>
+	void UrlStore<StoreData>::add_to_filter(size_t shard, const string &key) {
+		if (m_filters.size()) m_filters[shard]->insert(key);
+	}
+
+	template <typename StoreData>
+	bool UrlStore<StoreData>::may_contain(size_t shard, const string &key) {
+		if (m_filters.empty() || !m_filter_ready[shard]) return true;
+		if (m_filters[shard]->may_contain(key)) return true;
+		m_filtered_lookups++;
+		return false;
+	}
+
+	/*
+	 * Applies the writes of one shard in a single write batch. Keys whose first op is an update are read with one multi
+	 * get, a key that is not stored yet starts from the data of the update.
+	 * */
+	template <typename StoreData>
+	void UrlStore<StoreData>::write_shard(size_t shard, std::map<std::string, std::vector<write_op<StoreData>>> &writes) {
+		std::lock_guard<std::mutex> lock(m_shard_locks[shard]);
+
+		key_value::engine &engine = m_shards[shard]->engine();
+
+		vector<string> read_keys;
+		for (const auto &[key, ops] : writes) {
+			if (ops[0].m_update_bitmask && may_contain(shard, key)) read_keys.push_back(key);
+		}
+		const auto values = engine.multi_get(read_keys);
+
+		key_value::write_batch batch;
+		size_t read_idx = 0;
+		for (auto &[key, ops] : writes) {
+			StoreData record = ops[0].m_data;
+			if (read_idx < read_keys.size() && read_keys[read_idx] == key) {
+				if (values[read_idx]) {
+					record = StoreData(*values[read_idx]);
+					record.apply_update(ops[0].m_data, ops[0].m_update_bitmask);
+				}
+				read_idx++;
+			}
+			for (size_t i = 1; i < ops.size(); i++) {
+				if (ops[i].m_update_bitmask) {
+					record.apply_update(ops[i].m_data, ops[i].m_update_bitmask);
+				} else {
+					record = ops[i].m_data;
+				}
+			}
+			add_to_filter(shard, key);
+			batch.put(key, record.to_str());
+		}
+
+		engine.write(batch);
+
+		if (engine.needs_compaction()) {
+			LOG_INFO("compacting " + shard_path(shard));
+			engine.compact();
 		}
 	}
 
 	template <typename StoreData>
 	bool UrlStore<StoreData>::has_pending_insert() {
+		std::lock_guard<std::mutex> lock(m_pending_lock);
 		return m_pending_inserts.size() > 0;
 	}
 
 	template <typename StoreData>
 	string UrlStore<StoreData>::next_pending_insert() {
+		std::lock_guard<std::mutex> lock(m_pending_lock);
 		string file = m_pending_inserts.front();
 		m_pending_inserts.pop_front();
 		return file;
@@ -166,7 +348,27 @@ namespace UrlStore {
 
 	template <typename StoreData>
 	void UrlStore<StoreData>::add_pending_insert(const string &file) {
+		std::lock_guard<std::mutex> lock(m_pending_lock);
 		m_pending_inserts.push_back(file);
+		m_pending_cv.notify_one();
+	}
+
+	/*
+	 * Blocks until there is at least one pending insert and returns up to max_files of them.
+	 * */
+	template <typename StoreData>
+	vector<string> UrlStore<StoreData>::wait_for_pending_inserts(size_t max_files) {
+		std::unique_lock<std::mutex> lock(m_pending_lock);
+		m_pending_cv.wait(lock, [this]() {
+			return m_pending_inserts.size() > 0;
+		});
+
+		vector<string> files;
+		while (m_pending_inserts.size() && files.size() < max_files) {
+			files.push_back(m_pending_inserts.front());
+			m_pending_inserts.pop_front();
+		}
+		return files;
 	}
 
 	template <typename StoreData>
@@ -210,8 +412,9 @@ namespace UrlStore {
 
 			store.add_pending_insert(filename);
 		} else {
-			UrlStoreBatch batch = get_write_data<StoreData>(store, write_data);
-			write_insert_data<StoreData>(store, batch);
+			shard_writes<StoreData> writes(Config::url_store_shards);
+			add_write_data<StoreData>(writes, write_data);
+			apply_writes<StoreData>(store, writes);
 		}
 	}
 
@@ -237,8 +440,7 @@ namespace UrlStore {
 	template <typename StoreData>
 	void handle_binary_post_request(UrlStore<StoreData> &store, const std::string &post_data, std::stringstream &response_stream) {
 		vector<string> public_keys = post_data_to_keys<StoreData>(post_data);
-		for (const string &public_key : public_keys) {
-			StoreData data = store.get(public_key);
+		for (const StoreData &data : store.get_many(public_keys)) {
 			const string bin_data = data.to_str();
 			const size_t len = bin_data.size();
 			response_stream.write((char *)&len, sizeof(size_t));
@@ -250,8 +452,7 @@ namespace UrlStore {
 	void handle_post_request(UrlStore<StoreData> &store, const std::string &post_data, std::stringstream &response_stream) {
 		vector<string> public_keys = post_data_to_keys<StoreData>(post_data);
 		nlohmann::ordered_json arr;
-		for (const string &public_key : public_keys) {
-			StoreData data = store.get(public_key);
+		for (const StoreData &data : store.get_many(public_keys)) {
 			nlohmann::ordered_json message = data.to_json();
 			arr.push_back(message);
 		}
@@ -335,89 +536,105 @@ namespace UrlStore {
 		return ERROR;
 	}
 
+	/*
+	 * Adds the records of a PUT request to the writes of their shards.
+	 * */
 	template <typename StoreData>
-	UrlStoreBatch<StoreData> get_write_data(UrlStore<StoreData> &store, const string &write_data) {
-		Profiler::instance prof1("parse and write to batches");
+	void add_write_data(shard_writes<StoreData> &writes, const string &write_data) {
 
 		const char *cstr = write_data.c_str();
 		const size_t len = write_data.size();
+		if (len < 2*sizeof(size_t)) return;
 		//const size_t deferr_bitmask = *((size_t *)&cstr[0]);
 		const size_t update_bitmask = *((size_t *)&cstr[sizeof(size_t)]);
 
 		size_t iter = 2*sizeof(size_t);
-		UrlStoreBatch<StoreData> batch;
-		while (iter < len) {
+		while (iter + sizeof(size_t) <= len) {
 			size_t data_len = *((size_t *)&cstr[iter]);
 			iter += sizeof(size_t);
 
 			if (data_len + iter > len) break;
 
 			StoreData data(&cstr[iter], data_len);
-			if (update_bitmask) {
-				StoreData to_update = store.get(data.public_key());
-				to_update.apply_update(data, update_bitmask);
-				batch.set(to_update);
-			} else {
-				batch.set(data);
-			}
+			const string key = data.private_key();
+			const size_t shard = Hash::str(key) % Config::url_store_shards;
+			writes[shard][key].push_back(write_op<StoreData>{std::move(data), update_bitmask});
 
 			iter += data_len;
 		}
-
-		return batch;
 	}
 
+	/*
+	 * Writes all shards in parallel, one WriteBatch per shard.
+	 * */
 	template <typename StoreData>
-	UrlStoreBatch<StoreData> read_insert_data(UrlStore<StoreData> &store, const string &filename) {
-
-		std::ifstream infile(filename, std::ios::binary);
-		std::stringstream buffer;
-		buffer << infile.rdbuf();
-		const string write_data = buffer.str();
+	void apply_writes(UrlStore<StoreData> &store, shard_writes<StoreData> &writes) {
+		Profiler::instance prof("apply writes");
 
-		UrlStoreBatch batch = get_write_data<StoreData>(store, write_data);
-
-		File::delete_file(filename);
-
-		return batch;
-	}
+		vector<std::future<void>> futures;
+		for (size_t shard = 0; shard < writes.size(); shard++) {
+			if (writes[shard].empty()) continue;
+			futures.emplace_back(std::async(std::launch::async, [&store, &writes, shard]() {
+				store.write_shard(shard, writes[shard]);
+			}));
+		}
 
-	template <typename StoreData>
-	void write_insert_data(UrlStore<StoreData> &store, UrlStoreBatch<StoreData> &batch) {
-		Profiler::instance prof2("leveldb Write");
-		store.write_batch(batch);
+		for (auto &fut : futures) {
+			fut.get();
+		}
 	}
 
+	/*
+	 * Reads the cache files of deferred PUT requests and groups their records per shard. The files are read in parallel
+	 * but the records are added in the order of the files so later requests win.
+	 * */
 	template <typename StoreData>
-	void run_inserter(UrlStore<StoreData> &store) {
-
-		const size_t num_files_between_compactions = 20;
+	shard_writes<StoreData> read_pending_inserts(const vector<string> &filenames) {
+		Profiler::instance prof("read pending inserts");
 
-		vector<string> filenames;
-
-		while (store.has_pending_insert() && filenames.size() < num_files_between_compactions) {
-			const string filename = store.next_pending_insert();
-			filenames.push_back(filename);
-		}
-
-		vector<std::future<UrlStoreBatch<StoreData>>> futures;
+		vector<std::future<string>> futures;
 		for (const string &filename : filenames) {
-			std::future<UrlStoreBatch<StoreData>> fut = async(read_insert_data<StoreData>, std::ref(store), filename);
-			futures.emplace_back(move(fut));
+			futures.emplace_back(std::async(std::launch::async, [filename]() {
+				std::ifstream infile(filename, std::ios::binary);
+				std::stringstream buffer;
+				buffer << infile.rdbuf();
+				return buffer.str();
+			}));
 		}
 
-		for (auto &fut : futures) {
-			UrlStoreBatch<StoreData> batch = fut.get();
-			write_insert_data<StoreData>(store, batch);
+		shard_writes<StoreData> writes(Config::url_store_shards);
+		for (size_t i = 0; i < filenames.size(); i++) {
+			add_write_data<StoreData>(writes, futures[i].get());
+			File::delete_file(filenames[i]);
 		}
+
+		return writes;
 	}
 
+	template <typename StoreData>
+	void run_inserter(UrlStore<StoreData> &store, const vector<string> &filenames) {
+		shard_writes<StoreData> writes = read_pending_inserts<StoreData>(filenames);
+		apply_writes<StoreData>(store, writes);
+	}
+
+	/*
+	 * Wakes up when files are added to the pending inserts. The next files are read and grouped while the previous
+	 * batch is written, the batches are still written one at a time and in order.
+	 * */
 	template <typename StoreData>
 	void urlstore_inserter(UrlStore<StoreData> &store) {
-		using namespace std::literals::chrono_literals;
+
+		const size_t max_files_per_batch = 20;
+
+		std::future<void> writing;
 		while (true) {
-			run_inserter<StoreData>(store);
-			std::this_thread::sleep_for(100ms);
+			const vector<string> filenames = store.wait_for_pending_inserts(max_files_per_batch);
+			auto writes = std::make_shared<shard_writes<StoreData>>(read_pending_inserts<StoreData>(filenames));
+
+			if (writing.valid()) writing.get();
+			writing = std::async(std::launch::async, [&store, writes]() {
+				apply_writes<StoreData>(store, *writes);
+			});
 		}
 	}
 
@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "bloom_filter.h"
+#include "hash/Hash.h"
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+
+namespace UrlStore {
+
+	// Odd constants from the split block Bloom filter of Parquet, one per word of the block.
+	static const uint32_t salts[8] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu,
+		0x9efc4947u, 0x5c6bfb31u};
+
+	bloom_filter::bloom_filter(size_t num_bytes)
+	: m_num_blocks(max<size_t>(1, num_bytes / (block_words * sizeof(uint64_t)))),
+	  m_words(new atomic<uint64_t>[m_num_blocks * block_words]) {
+		clear();
+	}
+
+	void bloom_filter::insert(const string &key) {
+		const uint64_t h = hash(key);
+		atomic<uint64_t> *words = &m_words[block(h) * block_words];
+		for (size_t i = 0; i < block_words; i++) {
+			words[i].fetch_or(bit(h, i), memory_order_relaxed);
+		}
+	}
+
+	bool bloom_filter::may_contain(const string &key) const {
+		const uint64_t h = hash(key);
+		const atomic<uint64_t> *words = &m_words[block(h) * block_words];
+		for (size_t i = 0; i < block_words; i++) {
+			if ((words[i].load(memory_order_relaxed) & bit(h, i)) == 0) return false;
+		}
+		return true;
+	}
+
+	void bloom_filter::clear() {
+		for (size_t i = 0; i < m_num_blocks * block_words; i++) {
+			m_words[i].store(0, memory_order_relaxed);
+		}
+	}
+
+	bool bloom_filter::save(const string &filename) const {
+		const string tmp_filename = filename + ".tmp";
+		ofstream outfile(tmp_filename, ios::binary | ios::trunc);
+		if (!outfile.is_open()) return false;
+
+		outfile.write((const char *)&snapshot_magic, sizeof(snapshot_magic));
+		outfile.write((const char *)&m_num_blocks, sizeof(m_num_blocks));
+
+		vector<uint64_t> buffer(block_words * 8192);
+		const size_t num_words = m_num_blocks * block_words;
+		for (size_t start = 0; start < num_words; start += buffer.size()) {
+			const size_t len = min(buffer.size(), num_words - start);
+			for (size_t i = 0; i < len; i++) {
+				buffer[i] = m_words[start + i].load(memory_order_relaxed);
+			}
+			outfile.write((const char *)buffer.data(), len * sizeof(uint64_t));
+		}
+		outfile.close();
+		if (!outfile) return false;
+
+		return rename(tmp_filename.c_str(), filename.c_str()) == 0;
+	}
+
+	bool bloom_filter::load(const string &filename) {
+		ifstream infile(filename, ios::binary);
+		if (!infile.is_open()) return false;
+
+		uint64_t magic = 0;
+		size_t num_blocks = 0;
+		infile.read((char *)&magic, sizeof(magic));
+		infile.read((char *)&num_blocks, sizeof(num_blocks));
+		if (!infile || magic != snapshot_magic || num_blocks != m_num_blocks) return false;
+
+		vector<uint64_t> buffer(block_words * 8192);
+		const size_t num_words = m_num_blocks * block_words;
+		for (size_t start = 0; start < num_words; start += buffer.size()) {
+			const size_t len = min(buffer.size(), num_words - start);
+			infile.read((char *)buffer.data(), len * sizeof(uint64_t));
+			if (!infile) {
+				clear();
+				return false;
+			}
+			for (size_t i = 0; i < len; i++) {
+				m_words[start + i].store(buffer[i], memory_order_relaxed);
+			}
+		}
+
+		return true;
+	}
+
+	/*
+	 * The shards are picked with Hash::str, which is murmur hash, so all keys of one filter have the same low bits.
+	 * The hash is remixed with the murmur3 finalizer so every bit used for the block and the bits depends on all
+	 * bits of the hash.
+	 * */
+	uint64_t bloom_filter::hash(const string &key) const {
+		uint64_t h = Hash::str(key);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	size_t bloom_filter::block(uint64_t hash) const {
+		// Maps the upper 32 bits to [0, m_num_blocks) without a division.
+		return (size_t)(((hash >> 32) * m_num_blocks) >> 32);
+	}
+
+	uint64_t bloom_filter::bit(uint64_t hash, size_t word) const {
+		return 1ull << (((uint32_t)hash * salts[word]) >> 26);
+	}
+
+}
@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+namespace UrlStore {
+
+	/*
+	 * Blocked Bloom filter over the keys of one url store shard. Every key sets one bit in each of the eight words of
+	 * a single 64 byte block so a lookup touches one cache line. Inserts and lookups can run at the same time from
+	 * different threads, bits are only ever set.
+	 * */
+	class bloom_filter {
+
+		public:
+			explicit bloom_filter(size_t num_bytes);
+
+			void insert(const std::string &key);
+			bool may_contain(const std::string &key) const;
+			void clear();
+
+			size_t size_in_bytes() const { return m_num_blocks * block_words * sizeof(uint64_t); }
+
+			/*
+			 * The snapshot is only read back if it was written with the same size. Returns false if the file is
+			 * missing or does not match.
+			 * */
+			bool save(const std::string &filename) const;
+			bool load(const std::string &filename);
+
+		private:
+			static constexpr size_t block_words = 8;
+			// Changed when the hash changes so snapshots with bits from the old hash are rebuilt.
+			static constexpr uint64_t snapshot_magic = 0x4d4f4f4c42535542ull;
+
+			size_t m_num_blocks;
+			std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+
+			uint64_t hash(const std::string &key) const;
+			size_t block(uint64_t hash) const;
+			uint64_t bit(uint64_t hash, size_t word) const;
+
+	};
+
+}
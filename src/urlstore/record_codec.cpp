@@ -0,0 +1,178 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "record_codec.h"
+
+using namespace std;
+
+namespace UrlStore {
+
+	namespace record_codec {
+
+		record_writer::record_writer() {
+			m_str.push_back((char)magic);
+			encode_varint(current_version, m_str);
+		}
+
+		void record_writer::add_varint(uint64_t field_id, uint64_t value) {
+			if (value == 0) return;
+			encode_varint((field_id << 1) | wire_varint, m_str);
+			encode_varint(value, m_str);
+		}
+
+		void record_writer::add_bytes(uint64_t field_id, string_view value) {
+			if (value.empty()) return;
+			encode_varint((field_id << 1) | wire_bytes, m_str);
+			encode_varint(value.size(), m_str);
+			m_str.append(value.data(), value.size());
+		}
+
+		/*
+		 * Walks all fields once so lookups do not have to check bounds again. Field id 0 is never written which keeps
+		 * most old values from passing as new records.
+		 * */
+		record_view::record_view(const char *data, size_t len)
+		: m_data(data), m_len(len) {
+
+			if (len < 2 || (uint8_t)data[0] != magic) return;
+
+			size_t pos = 1;
+			uint64_t version;
+			if (!decode_varint(data, len, pos, version)) return;
+			if (version == 0 || version > current_version) return;
+			m_fields_start = pos;
+
+			while (pos < len) {
+				uint64_t tag, value;
+				if (!decode_varint(data, len, pos, tag)) return;
+				if ((tag >> 1) == 0) return;
+				if (!decode_varint(data, len, pos, value)) return;
+				if ((tag & 1) == wire_bytes) {
+					if (value > len - pos) return;
+					pos += value;
+				}
+			}
+
+			m_valid = true;
+		}
+
+		bool record_view::varint(uint64_t field_id, uint64_t &value) const {
+			size_t pos;
+			if (!find(field_id, wire_varint, pos)) return false;
+			return decode_varint(m_data, m_len, pos, value);
+		}
+
+		bool record_view::bytes(uint64_t field_id, string_view &value) const {
+			size_t pos;
+			if (!find(field_id, wire_bytes, pos)) return false;
+			uint64_t value_len;
+			decode_varint(m_data, m_len, pos, value_len);
+			value = string_view(&m_data[pos], value_len);
+			return true;
+		}
+
+		/*
+		 * Sets pos to the value of the field. Records only have a handful of fields so they are scanned.
+		 * */
+		bool record_view::find(uint64_t field_id, uint64_t wire_type, size_t &pos) const {
+			if (!m_valid) return false;
+
+			size_t iter = m_fields_start;
+			while (iter < m_len) {
+				uint64_t tag, value;
+				decode_varint(m_data, m_len, iter, tag);
+				if ((tag >> 1) == field_id && (tag & 1) == wire_type) {
+					pos = iter;
+					return true;
+				}
+				decode_varint(m_data, m_len, iter, value);
+				if ((tag & 1) == wire_bytes) iter += value;
+			}
+			return false;
+		}
+
+		string encode_url(const URL &url, const URL *base) {
+
+			string encoded;
+			const string url_str = url.str();
+			if (url_str.empty()) return encoded;
+
+			const string scheme = url.scheme();
+			const string prefix = scheme + "://" + (url.has_www() ? "www." : "") + url.host();
+
+			if ((scheme != "http" && scheme != "https") || url.host().empty() ||
+				url_str.compare(0, prefix.size(), prefix) != 0) {
+				encode_varint(url_raw, encoded);
+				encoded.append(url_str);
+				return encoded;
+			}
+
+			const bool same_host = base != nullptr && base->host() == url.host();
+			const uint64_t flags = (url.has_https() ? url_https : 0) | (url.has_www() ? url_www : 0) |
+				(same_host ? url_same_host : 0);
+			encode_varint(flags, encoded);
+			if (!same_host) {
+				encode_varint(url.host().size(), encoded);
+				encoded.append(url.host());
+			}
+			encoded.append(url_str, prefix.size());
+
+			return encoded;
+		}
+
+		URL decode_url(string_view encoded, const URL *base) {
+
+			size_t pos = 0;
+			uint64_t flags;
+			if (!decode_varint(encoded.data(), encoded.size(), pos, flags)) return URL();
+
+			if (flags & url_raw) {
+				return URL(string(encoded.substr(pos)));
+			}
+
+			string host;
+			if (flags & url_same_host) {
+				if (base == nullptr) return URL();
+				host = base->host();
+			} else {
+				uint64_t host_len;
+				if (!decode_varint(encoded.data(), encoded.size(), pos, host_len)) return URL();
+				if (host_len > encoded.size() - pos) return URL();
+				host = string(encoded.substr(pos, host_len));
+				pos += host_len;
+			}
+
+			string url_str = (flags & url_https) ? "https://" : "http://";
+			if (flags & url_www) url_str += "www.";
+			url_str += host;
+			url_str.append(encoded.substr(pos));
+
+			return URL(url_str);
+		}
+
+	}
+
+}
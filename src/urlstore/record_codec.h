@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "parser/URL.h"
+
+namespace UrlStore {
+
+	/*
+		Binary encoding of the records stored in the url store.
+
+		A record is [magic][varint version][fields] where every field is [varint tag][value]. The tag is the field id
+		shifted up one bit with the wire type in the lowest bit, wire_varint values are a single varint and wire_bytes
+		values are a varint length followed by the bytes. Fields with the default value (0 or empty) are not written.
+
+		Schema evolution: field ids are never reused or change type. New fields get new ids, readers skip ids they do
+		not know and fields missing from older records keep their default value, so stored leveldb values never have to
+		be rewritten. The version is only bumped for changes old readers can not skip.
+
+		Values written before this encoding do not start with the magic byte followed by a valid record and are read by
+		the old decoders of each record type, they are converted the next time the record is written.
+
+		URLs are encoded as [varint flags][host][path suffix], the scheme and www are flags and the path suffix is the
+		rest of the URL string after the host. The host is left out when it is the same as the host of the base URL of
+		the record, the redirect of a UrlData is encoded relative to the URL. URLs that do not start with their scheme,
+		www and host are stored raw.
+	*/
+	namespace record_codec {
+
+		const uint8_t magic = 0xA7;
+		const uint64_t current_version = 1;
+
+		const uint64_t wire_varint = 0;
+		const uint64_t wire_bytes = 1;
+
+		const uint64_t url_https = 0x1;
+		const uint64_t url_www = 0x2;
+		const uint64_t url_same_host = 0x4;
+		const uint64_t url_raw = 0x8;
+
+		inline void encode_varint(uint64_t value, std::string &dest) {
+			while (value >= 0x80) {
+				dest.push_back((char)((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			dest.push_back((char)value);
+		}
+
+		/*
+		 * Decodes a varint at position pos and moves pos past it. Returns false if the data ends before the varint.
+		 * */
+		inline bool decode_varint(const char *data, size_t len, size_t &pos, uint64_t &value) {
+			value = 0;
+			for (size_t shift = 0; shift < 64 && pos < len; shift += 7) {
+				const uint8_t byte = (uint8_t)data[pos++];
+				value |= (uint64_t)(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) return true;
+			}
+			return false;
+		}
+
+		class record_writer {
+
+			public:
+				record_writer();
+
+				void add_varint(uint64_t field_id, uint64_t value);
+				void add_bytes(uint64_t field_id, std::string_view value);
+
+				const std::string &str() const { return m_str; }
+
+			private:
+				std::string m_str;
+
+		};
+
+		/*
+		 * Reads fields directly from the stored bytes, string fields point into the record and are not copied. The
+		 * record has to outlive the view.
+		 * */
+		class record_view {
+
+			public:
+				record_view(const char *data, size_t len);
+
+				// False for values in the old encoding and for corrupt records.
+				bool valid() const { return m_valid; }
+
+				bool varint(uint64_t field_id, uint64_t &value) const;
+				bool bytes(uint64_t field_id, std::string_view &value) const;
+
+			private:
+				const char *m_data;
+				size_t m_len;
+				size_t m_fields_start = 0;
+				bool m_valid = false;
+
+				bool find(uint64_t field_id, uint64_t wire_type, size_t &pos) const;
+
+		};
+
+		std::string encode_url(const URL &url, const URL *base = nullptr);
+		URL decode_url(std::string_view encoded, const URL *base = nullptr);
+
+	}
+
+}
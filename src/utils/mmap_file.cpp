@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mmap_file.hpp"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace utils {
+
+	mmap_file::mmap_file(const std::string &path)
+	: m_path(path) {
+
+		m_fd = open(m_path.c_str(), O_RDONLY);
+		if (m_fd < 0) return;
+
+		struct stat st;
+		if (fstat(m_fd, &st) != 0) {
+			close(m_fd);
+			m_fd = -1;
+			return;
+		}
+
+		m_size = st.st_size;
+		m_inode = st.st_ino;
+		m_mtime = st.st_mtim;
+
+		if (m_size == 0) return;
+
+		void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(m_fd);
+			m_fd = -1;
+			m_size = 0;
+			return;
+		}
+
+		m_data = static_cast<char *>(ptr);
+	}
+
+	mmap_file::~mmap_file() {
+		if (m_data != nullptr) {
+			munmap(m_data, m_size);
+		}
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+	}
+
+	bool mmap_file::is_stale() const {
+		struct stat st;
+		if (stat(m_path.c_str(), &st) != 0) {
+			// The file was removed, only stale if we had it open.
+			return is_open();
+		}
+		if (!is_open()) return true;
+
+		return st.st_ino != m_inode || (size_t)st.st_size != m_size || st.st_mtim.tv_sec != m_mtime.tv_sec ||
+			st.st_mtim.tv_nsec != m_mtime.tv_nsec;
+	}
+
+	uint64_t mmap_file::version() const {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (uint64_t part : {(uint64_t)m_inode, (uint64_t)m_size, (uint64_t)m_mtime.tv_sec, (uint64_t)m_mtime.tv_nsec}) {
+			hash = (hash ^ part) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+}
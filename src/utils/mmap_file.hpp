@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace utils {
+
+	/*
+	 * Read only memory map of a whole file. The mapping keeps the underlying inode alive so a file that is replaced
+	 * with rename(2) can still be read through an old mapping until it is destroyed.
+	 * */
+	class mmap_file {
+
+		public:
+
+			explicit mmap_file(const std::string &path);
+			~mmap_file();
+
+			bool is_open() const { return m_fd >= 0; }
+			const char *data() const { return m_data; }
+			size_t size() const { return m_size; }
+			const std::string &path() const { return m_path; }
+			ino_t inode() const { return m_inode; }
+
+			/*
+			 * Returns true if the path now points to another file than the one we have mapped.
+			 * */
+			bool is_stale() const;
+
+			/*
+			 * Identifies the mapped version of the file, changes when the file is replaced or modified.
+			 * */
+			uint64_t version() const;
+
+		private:
+
+			// Non copyable
+			mmap_file(const mmap_file &);
+			mmap_file &operator=(const mmap_file &);
+
+			std::string m_path;
+			int m_fd = -1;
+			char *m_data = nullptr;
+			size_t m_size = 0;
+			ino_t m_inode = 0;
+			struct timespec m_mtime = {0, 0};
+
+	};
+
+}
@@ -0,0 +1,301 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "query_pool.hpp"
+#include "config.h"
+#include <fstream>
+#include <sstream>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace utils {
+
+	namespace {
+
+		thread_local query_pool *current_pool = nullptr;
+		thread_local size_t current_worker = 0;
+
+		// Cpu time of tasks run nested inside the task currently executing on this thread, so that a task helping out
+		// while it waits for sub tasks is not charged for their time.
+		thread_local uint64_t nested_cpu_nanos = 0;
+
+		uint64_t thread_cpu_nanos() {
+			struct timespec ts;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+			return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+		}
+
+		/*
+			Parses a kernel cpu list like "0-15,32-47".
+		*/
+		std::vector<int> parse_cpu_list(const std::string &list) {
+			std::vector<int> cpus;
+			std::stringstream ss(list);
+			std::string range;
+			while (std::getline(ss, range, ',')) {
+				if (range.empty() || range == "\n") continue;
+				const size_t dash = range.find('-');
+				try {
+					const int first = std::stoi(range.substr(0, dash));
+					const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+					for (int cpu = first; cpu <= last; cpu++) {
+						cpus.push_back(cpu);
+					}
+				} catch (...) {
+					return {};
+				}
+			}
+			return cpus;
+		}
+
+		/*
+			Returns the cpus of each NUMA node that this process is allowed to run on. Empty if the machine has one node.
+		*/
+		std::vector<std::vector<int>> numa_nodes() {
+			cpu_set_t allowed;
+			CPU_ZERO(&allowed);
+			if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return {};
+
+			std::vector<std::vector<int>> nodes;
+			for (size_t node = 0; ; node++) {
+				std::ifstream infile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+				if (!infile.is_open()) break;
+				std::string list;
+				std::getline(infile, list);
+
+				std::vector<int> cpus;
+				for (int cpu : parse_cpu_list(list)) {
+					if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+				}
+				if (cpus.size()) nodes.push_back(cpus);
+			}
+			if (nodes.size() < 2) return {};
+			return nodes;
+		}
+
+		void pin_thread(std::thread &thread, const std::vector<int> &cpus) {
+			if (cpus.empty()) return;
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (int cpu : cpus) {
+				CPU_SET(cpu, &set);
+			}
+			pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+		}
+
+	}
+
+	query_pool::query_pool(size_t num_threads) {
+		if (num_threads == 0) num_threads = 1;
+
+		const std::vector<std::vector<int>> nodes = numa_nodes();
+		m_num_nodes = std::max<size_t>(nodes.size(), 1);
+
+		std::vector<size_t> worker_node(num_threads);
+		for (size_t i = 0; i < num_threads; i++) {
+			worker_node[i] = i % m_num_nodes;
+			m_workers.emplace_back(std::make_unique<worker>());
+			if (nodes.size()) m_workers[i]->m_cpus = nodes[worker_node[i]];
+		}
+
+		// Steal from workers on the same node first, then from the rest. Start after ourselves so that not every worker
+		// hammers worker 0.
+		for (size_t i = 0; i < num_threads; i++) {
+			for (size_t same_node = 0; same_node < 2; same_node++) {
+				for (size_t j = 1; j < num_threads; j++) {
+					const size_t victim = (i + j) % num_threads;
+					if ((worker_node[victim] == worker_node[i]) == (same_node == 0)) {
+						m_workers[i]->m_steal_order.push_back(victim);
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < num_threads; i++) {
+			m_workers[i]->m_thread = std::thread([this, i]() {
+				this->handle_work(i);
+			});
+			pin_thread(m_workers[i]->m_thread, m_workers[i]->m_cpus);
+		}
+	}
+
+	query_pool::~query_pool() {
+		{
+			std::lock_guard<std::mutex> lock(m_sleep_lock);
+			m_stop = true;
+		}
+		m_condition.notify_all();
+
+		for (auto &w : m_workers) {
+			if (w->m_thread.joinable()) {
+				w->m_thread.join();
+			}
+		}
+	}
+
+	query_pool &query_pool::instance() {
+		static query_pool pool(Config::query_pool_threads ? Config::query_pool_threads : std::thread::hardware_concurrency());
+		return pool;
+	}
+
+	void query_pool::push(task &&t) {
+		const size_t worker_id = (current_pool == this) ? current_worker : (m_next_worker++ % m_workers.size());
+
+		{
+			// Counted under the lock so the task is not popped before it is counted and m_queued never wraps.
+			std::lock_guard<std::mutex> lock(m_workers[worker_id]->m_lock);
+			m_workers[worker_id]->m_tasks.emplace_back(std::move(t));
+			m_queued++;
+		}
+
+		{
+			// Makes sure a worker that just evaluated the wait predicate is actually waiting before we notify.
+			std::lock_guard<std::mutex> lock(m_sleep_lock);
+		}
+		m_condition.notify_one();
+	}
+
+	bool query_pool::try_pop(size_t worker_id, task &t) {
+		worker &self = *m_workers[worker_id];
+		{
+			std::lock_guard<std::mutex> lock(self.m_lock);
+			if (self.m_tasks.size()) {
+				t = std::move(self.m_tasks.back());
+				self.m_tasks.pop_back();
+				m_queued--;
+				return true;
+			}
+		}
+		for (size_t victim_id : self.m_steal_order) {
+			worker &victim = *m_workers[victim_id];
+			std::lock_guard<std::mutex> lock(victim.m_lock);
+			if (victim.m_tasks.size()) {
+				t = std::move(victim.m_tasks.front());
+				victim.m_tasks.pop_front();
+				m_queued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void query_pool::run(task &t) {
+		std::exception_ptr exception;
+		const uint64_t outer_nested = nested_cpu_nanos;
+		nested_cpu_nanos = 0;
+		const uint64_t start = thread_cpu_nanos();
+		try {
+			t.m_fun();
+		} catch (...) {
+			exception = std::current_exception();
+		}
+		const uint64_t cpu_nanos = thread_cpu_nanos() - start;
+		const uint64_t own_cpu_nanos = cpu_nanos - std::min(cpu_nanos, nested_cpu_nanos);
+		nested_cpu_nanos = outer_nested + cpu_nanos;
+
+		t.m_fun = nullptr;
+		t.m_query->finish(own_cpu_nanos, exception);
+	}
+
+	void query_pool::handle_work(size_t worker_id) {
+		current_pool = this;
+		current_worker = worker_id;
+
+		while (true) {
+			task t;
+			if (try_pop(worker_id, t)) {
+				run(t);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleep_lock);
+			m_condition.wait(lock, [this] {
+				return m_stop || m_queued > 0;
+			});
+			if (m_stop && m_queued == 0) return;
+		}
+	}
+
+	query_pool::query::query(query_pool &pool)
+	: m_pool(pool) {
+	}
+
+	query_pool::query::~query() {
+		wait_for_tasks();
+	}
+
+	void query_pool::query::submit(std::function<void()> &&fun) {
+		m_pending++;
+		m_pool.push(task{std::move(fun), this});
+	}
+
+	void query_pool::query::wait() {
+		wait_for_tasks();
+
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			std::swap(exception, m_exception);
+		}
+		if (exception) std::rethrow_exception(exception);
+	}
+
+	double query_pool::query::cpu_time() const {
+		return (double)m_cpu_nanos / 1000.0;
+	}
+
+	void query_pool::query::wait_for_tasks() {
+		if (current_pool == &m_pool) {
+			// We are a worker of the pool, help out instead of blocking a worker thread.
+			while (m_pending > 0) {
+				task t;
+				if (m_pool.try_pop(current_worker, t)) {
+					m_pool.run(t);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+			// finish() decrements under the lock, taking it here makes sure it is done with us before we return.
+			std::lock_guard<std::mutex> lock(m_lock);
+		} else {
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_done.wait(lock, [this] {
+				return m_pending == 0;
+			});
+		}
+	}
+
+	void query_pool::query::finish(uint64_t cpu_nanos, std::exception_ptr exception) {
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_cpu_nanos += cpu_nanos;
+		if (exception && !m_exception) m_exception = exception;
+		if (--m_pending == 0) {
+			m_done.notify_all();
+		}
+	}
+
+}
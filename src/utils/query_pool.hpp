@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <memory>
+#include <exception>
+
+namespace utils {
+
+	/*
+		Process wide pool of query executor threads. The workers are started once and reused by all queries so that no
+		threads are created or destroyed on the request path.
+
+		Every worker owns a task deque. Tasks submitted from inside a worker go to the back of its own deque and are
+		popped from there (LIFO), idle workers steal from the front of the other deques. Workers are spread round robin
+		over the NUMA nodes found in /sys/devices/system/node and pinned to the cpus of their node, stealing goes to
+		workers on the same node first.
+
+		Tasks are submitted through a query_pool::query that tracks completion and accumulates the cpu time that the
+		workers spent on its tasks.
+	*/
+	class query_pool {
+
+		public:
+
+			class query;
+
+			explicit query_pool(size_t num_threads);
+			~query_pool();
+
+			/*
+				The process wide pool, started on first use with Config::query_pool_threads workers (0 means one per cpu).
+			*/
+			static query_pool &instance();
+
+			size_t num_threads() const { return m_workers.size(); }
+			size_t num_nodes() const { return m_num_nodes; }
+
+		private:
+
+			struct task {
+				std::function<void()> m_fun;
+				query *m_query;
+			};
+
+			struct worker {
+				std::deque<task> m_tasks;
+				std::mutex m_lock;
+				std::vector<size_t> m_steal_order;
+				std::vector<int> m_cpus;
+				std::thread m_thread;
+			};
+
+			std::vector<std::unique_ptr<worker>> m_workers;
+			size_t m_num_nodes = 1;
+			std::atomic<size_t> m_next_worker = 0;
+
+			std::mutex m_sleep_lock;
+			std::condition_variable m_condition;
+			std::atomic<size_t> m_queued = 0;
+			bool m_stop = false;
+
+			query_pool(const query_pool &) = delete;
+			query_pool &operator=(const query_pool &) = delete;
+
+			void push(task &&t);
+			bool try_pop(size_t worker_id, task &t);
+			void run(task &t);
+			void handle_work(size_t worker_id);
+
+	};
+
+	/*
+		A group of tasks belonging to one query. wait() blocks until all submitted tasks have finished, when called from
+		a pool worker it keeps executing queued tasks instead of blocking so nested queries can not deadlock the pool.
+		The first exception thrown by a task is rethrown from wait().
+	*/
+	class query_pool::query {
+
+		public:
+
+			explicit query(query_pool &pool = query_pool::instance());
+			~query();
+
+			void submit(std::function<void()> &&fun);
+			void wait();
+
+			/*
+				Returns the cpu time in microseconds that the pool threads have spent executing tasks of this query.
+			*/
+			double cpu_time() const;
+
+		private:
+
+			friend class query_pool;
+
+			query_pool &m_pool;
+			std::atomic<size_t> m_pending = 0;
+			std::atomic<uint64_t> m_cpu_nanos = 0;
+			std::mutex m_lock;
+			std::condition_variable m_done;
+			std::exception_ptr m_exception;
+
+			query(const query &) = delete;
+			query &operator=(const query &) = delete;
+
+			void wait_for_tasks();
+			void finish(uint64_t cpu_nanos, std::exception_ptr exception);
+
+	};
+
+}
@@ -105,6 +105,67 @@ BOOST_AUTO_TEST_CASE(intersection_test) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(intersection_strategies) {
+
+	struct record {
+		uint64_t m_value;
+		float m_score;
+	};
+
+	std::vector<record> data;
+	for (uint64_t i = 0; i < 1000; i++) {
+		data.push_back(record{i * 3 + 0x8000000000000000ull, 1.0f});
+	}
+
+	const std::vector<algorithm::intersection_strategy> strategies = {
+		algorithm::intersection_strategy::linear,
+		algorithm::intersection_strategy::simd,
+		algorithm::intersection_strategy::galloping
+	};
+
+	// All strategies should find the first position not less than the key.
+	for (auto strategy : strategies) {
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 0, data.size(), 0ull), 0);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 0, data.size(), 0x8000000000000000ull), 0);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 0, data.size(), 0x8000000000000000ull + 3), 1);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 0, data.size(), 0x8000000000000000ull + 4), 2);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 10, data.size(), 0x8000000000000000ull + 2997), 999);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 500, data.size(), 0xFFFFFFFFFFFFFFFFull), 1000);
+		BOOST_CHECK_EQUAL(algorithm::search(strategy, data.data(), 998, 999, 0x8000000000000000ull + 2997), 999);
+	}
+
+	BOOST_CHECK(algorithm::choose_intersection_strategy<record>(5, 5000000) == algorithm::intersection_strategy::galloping);
+	BOOST_CHECK(algorithm::choose_intersection_strategy<record>(5, 10) != algorithm::intersection_strategy::galloping);
+	BOOST_CHECK(algorithm::choose_intersection_strategy<record>(5, 10) == algorithm::intersection_strategy::linear);
+	BOOST_CHECK(algorithm::choose_intersection_strategy<int>(5, 10) == algorithm::intersection_strategy::linear);
+	if (algorithm::has_simd_support()) {
+		BOOST_CHECK(algorithm::choose_intersection_strategy<record>(5, 100) == algorithm::intersection_strategy::simd);
+	}
+
+	// Only records where the values can be loaded with contiguous loads are searched with simd.
+	struct wide_record {
+		uint64_t m_value;
+		float m_score;
+		uint64_t m_count;
+	};
+	BOOST_CHECK(algorithm::simd_searchable<record>);
+	BOOST_CHECK(algorithm::simd_searchable<uint64_t>);
+	BOOST_CHECK(!algorithm::simd_searchable<wide_record>);
+	BOOST_CHECK(algorithm::choose_intersection_strategy<wide_record>(5, 100) == algorithm::intersection_strategy::linear);
+
+	// A short list against a long list uses galloping search, scores are summed.
+	std::vector<record> short_list = {record{0x8000000000000000ull + 3, 2.0f}, record{0x8000000000000000ull + 4, 2.0f},
+		record{0x8000000000000000ull + 2997, 2.0f}};
+	std::vector<record> result = algorithm::intersection<record>({data, short_list, data}, [](record &a, const record &b) {
+		a.m_score += b.m_score;
+	});
+
+	BOOST_REQUIRE_EQUAL(result.size(), 2);
+	BOOST_CHECK_EQUAL(result[0].m_value, 0x8000000000000000ull + 3);
+	BOOST_CHECK_EQUAL(result[0].m_score, 4.0f);
+	BOOST_CHECK_EQUAL(result[1].m_value, 0x8000000000000000ull + 2997);
+}
+
 BOOST_AUTO_TEST_CASE(incremental_partitions) {
 
 	{
@@ -28,9 +28,29 @@
 #include "parser/Warc.h"
 #include "parser/URL.h"
 #include "parser/cc_parser.h"
+#include "parser/warc_reader.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 
 BOOST_AUTO_TEST_SUITE(cc_parser)
 
+std::string gzip_warc_record(const std::string &type, const std::string &url, const std::string &html) {
+	const std::string content = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n" + html;
+	const std::string record = "WARC/1.0\r\nWARC-Type: " + type + "\r\nWARC-Target-URI: " + url +
+		"\r\nWARC-Date: 2021-07-31T20:08:45Z\r\nWARC-IP-Address: 127.0.0.1\r\nContent-Length: " +
+		std::to_string(content.size()) + "\r\n\r\n" + content + "\r\n\r\n";
+
+	std::string compressed;
+	{
+		boost::iostreams::filtering_ostream compress_stream;
+		compress_stream.push(boost::iostreams::gzip_compressor());
+		compress_stream.push(boost::iostreams::back_inserter(compressed));
+		compress_stream << record;
+	}
+	return compressed;
+}
+
 BOOST_AUTO_TEST_CASE(download_warc_paths) {
 	{
 		vector<string> paths = Parser::download_warc_paths();
@@ -167,4 +187,68 @@ BOOST_AUTO_TEST_CASE(parse_cc_batch_301) {
 
 }
 
+BOOST_AUTO_TEST_CASE(warc_reader_records) {
+
+	// Larger than the buffer of the reader so it has to grow.
+	const std::string long_html = "<title>long</title>" + std::string(WARC_READER_BUFFER_LEN + 1000, 'a');
+
+	const std::string data = gzip_warc_record("response", "https://a.com/", "<title>a</title>") +
+		gzip_warc_record("request", "https://b.com/", "") +
+		gzip_warc_record("response", "https://c.com/", long_html) +
+		gzip_warc_record("response", "https://d.com/", "<title>d</title>");
+
+	// Fed in small parts so records and gzip members are cut between inputs.
+	parser::warc_reader reader;
+	parser::warc_record record;
+	std::vector<std::string> urls;
+	std::vector<std::string> types;
+	std::vector<std::string> bodies;
+	for (size_t pos = 0; pos < data.size(); pos += 1000) {
+		reader.set_input(data.data() + pos, std::min<size_t>(1000, data.size() - pos));
+		while (reader.next(record)) {
+			urls.emplace_back(record.header("warc-target-uri"));
+			types.emplace_back(record.type());
+			bodies.emplace_back(record.http_body());
+		}
+	}
+
+	BOOST_CHECK(!reader.error());
+	BOOST_REQUIRE_EQUAL(urls.size(), 4);
+	BOOST_CHECK_EQUAL(urls[0], "https://a.com/");
+	BOOST_CHECK_EQUAL(types[0], "response");
+	BOOST_CHECK_EQUAL(bodies[0], "<title>a</title>");
+	BOOST_CHECK_EQUAL(types[1], "request");
+	BOOST_CHECK(bodies[2] == long_html);
+	BOOST_CHECK_EQUAL(urls[3], "https://d.com/");
+	BOOST_CHECK_EQUAL(bodies[3], "<title>d</title>");
+}
+
+BOOST_AUTO_TEST_CASE(parse_warc_file_parallel) {
+
+	const std::string path = "/tmp/warc_parallel_test.warc.gz";
+	{
+		std::ofstream outfile(path, std::ios::binary | std::ios::trunc);
+		for (size_t i = 0; i < 500; i++) {
+			const std::string url = "https://site" + std::to_string(i) + ".com/page";
+			outfile << gzip_warc_record("response", url, "<title>Page " + std::to_string(i) + "</title><h1>Heading</h1>"
+				"<p>Some text</p><a href=\"https://other" + std::to_string(i) + ".com/\">Other</a>");
+		}
+	}
+
+	std::ifstream infile(path, std::ios::binary);
+	const std::string data((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+	BOOST_CHECK_EQUAL(parser::warc_member_ranges(data.data(), data.size(), 4).size(), 4);
+
+	Warc::Parser serial;
+	std::istringstream stream(data);
+	BOOST_CHECK(serial.parse_stream(stream));
+
+	Warc::Parser parallel;
+	BOOST_CHECK(parallel.parse_file(path, 4));
+
+	BOOST_CHECK_EQUAL(std::count(serial.result().begin(), serial.result().end(), '\n'), 500);
+	BOOST_CHECK(parallel.result() == serial.result());
+	BOOST_CHECK(parallel.link_result() == serial.link_result());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,13 @@
 
 #include "hash_table/HashTable.h"
 #include "hash_table/HashTableHelper.h"
+#include "hash_table/compactor.h"
+#include "hash_table/dictionary_codec.h"
+#include "file/File.h"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <shared_mutex>
+#include <unistd.h>
 
 BOOST_AUTO_TEST_SUITE(hash_table)
 
@@ -161,7 +168,8 @@ BOOST_AUTO_TEST_CASE(optimize) {
 		HashTableShard shard("test_index", 0);
 
 		BOOST_CHECK_EQUAL(shard.size(), shard_size);
-		BOOST_CHECK_EQUAL(shard.file_size(), shard_file_size);
+		// The optimized shard stores the values in one block so it is smaller than the three gzipped values.
+		BOOST_CHECK(shard.file_size() <= shard_file_size);
 
 		BOOST_CHECK_EQUAL(shard.find(1), "data element 1 v2");
 		BOOST_CHECK_EQUAL(shard.find(2), "data element 2 v2");
@@ -178,4 +186,388 @@ BOOST_AUTO_TEST_CASE(optimize_empty) {
 
 }
 
+BOOST_AUTO_TEST_CASE(find_many) {
+
+	HashTableHelper::truncate("test_index");
+
+	{
+		vector<HashTableShardBuilder *> shards = HashTableHelper::create_shard_builders("test_index");
+
+		for (size_t i = 0; i < 1000; i++) {
+			HashTableHelper::add_data(shards, i, "Random test data with id: " + std::to_string(i));
+		}
+
+		HashTableHelper::write(shards);
+		HashTableHelper::sort(shards);
+
+		HashTableHelper::delete_shard_builders(shards);
+	}
+
+	{
+		HashTable hash_table("test_index");
+
+		// Unordered keys spread over all shards with duplicates and keys that are not in the table.
+		vector<uint64_t> keys = {999, 5, 2000, 17, 5, 123456789, 0};
+		for (size_t i = 1; i < 1000; i += 7) {
+			keys.push_back(i);
+		}
+
+		vector<string> values = hash_table.find_many(keys);
+
+		BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+		for (size_t i = 0; i < keys.size(); i++) {
+			BOOST_CHECK_EQUAL(values[i], hash_table.find(keys[i]));
+			if (keys[i] < 1000) {
+				BOOST_CHECK_EQUAL(values[i], "Random test data with id: " + std::to_string(keys[i]));
+			} else {
+				BOOST_CHECK_EQUAL(values[i], "");
+			}
+		}
+
+		BOOST_CHECK(hash_table.find_many({}).size() == 0);
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(optimize_dictionary) {
+
+	HashTableHelper::truncate("test_index");
+
+	vector<string> rows;
+	for (size_t i = 0; i < 5000; i++) {
+		rows.push_back("https://www.example" + std::to_string(i % 50) + ".com/articles/" + std::to_string(i) +
+			"\tArticle number " + std::to_string(i) + " - Example news\tThis is the snippet of article " +
+			std::to_string(i * 7919) + " about the most recent news from the example site.");
+	}
+
+	size_t gzip_file_size = 0;
+	{
+		HashTableShardBuilder builder("test_index", 0);
+		for (size_t i = 0; i < rows.size(); i++) {
+			builder.add(i, rows[i]);
+		}
+		builder.write();
+		builder.sort();
+
+		HashTableShard shard("test_index", 0);
+		gzip_file_size = shard.file_size();
+
+		BOOST_CHECK_EQUAL(shard.find(17), rows[17]);
+	}
+
+	{
+		HashTableShardBuilder builder("test_index", 0);
+		builder.optimize();
+
+		HashTableShard shard("test_index", 0);
+		BOOST_CHECK_EQUAL(shard.size(), rows.size());
+		BOOST_CHECK(shard.file_size() < gzip_file_size / 2);
+
+		for (size_t i = 0; i < rows.size(); i += 13) {
+			BOOST_CHECK_EQUAL(shard.find(i), rows[i]);
+		}
+		BOOST_CHECK_EQUAL(shard.find(rows.size() + 1), "");
+	}
+
+	{
+		// Values appended after optimize are gzipped and the shard can be optimized again.
+		HashTableShardBuilder builder("test_index", 0);
+		builder.add(3, "updated value");
+		builder.add(100000, "new value");
+		builder.write();
+		builder.sort();
+
+		{
+			HashTableShard shard("test_index", 0);
+			BOOST_CHECK_EQUAL(shard.find(3), "updated value");
+			BOOST_CHECK_EQUAL(shard.find(100000), "new value");
+			BOOST_CHECK_EQUAL(shard.find(4), rows[4]);
+		}
+
+		builder.optimize();
+
+		HashTableShard shard("test_index", 0);
+		BOOST_CHECK_EQUAL(shard.size(), rows.size() + 1);
+		BOOST_CHECK_EQUAL(shard.find(3), "updated value");
+		BOOST_CHECK_EQUAL(shard.find(100000), "new value");
+		BOOST_CHECK_EQUAL(shard.find(4999), rows[4999]);
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE(optimize_streaming) {
+
+	HashTableHelper::truncate("test_index");
+
+	// More values than the dictionary trainer samples so the samples are thinned out while the shard is streamed.
+	vector<string> rows;
+	for (size_t i = 0; i < 10000; i++) {
+		rows.push_back("https://www.example" + std::to_string(i % 50) + ".com/articles/" + std::to_string(i) +
+			"\tArticle number " + std::to_string(i) + " - Example news\tThis is the snippet of article " +
+			std::to_string(i * 7919) + " about the most recent news from the example site. The article continues " +
+			"with more text about " + std::to_string(i * 31) + " things that happened on the example site.");
+	}
+
+	HashTableShardBuilder builder("test_index", 0);
+	for (size_t i = 0; i < rows.size(); i++) {
+		builder.add(i, "replaced value " + std::to_string(i));
+		if (builder.full()) builder.write();
+	}
+	builder.write();
+	for (size_t i = 0; i < rows.size(); i++) {
+		builder.add(i, rows[i]);
+		if (builder.full()) builder.write();
+	}
+	builder.write();
+	builder.sort();
+	builder.optimize();
+
+	BOOST_CHECK(!boost::filesystem::exists(builder.filename_data_tmp()));
+	BOOST_CHECK(!boost::filesystem::exists(builder.filename_pos_tmp()));
+
+	HashTableShard shard("test_index", 0);
+	BOOST_CHECK_EQUAL(shard.size(), rows.size());
+	for (size_t i = 0; i < rows.size(); i += 97) {
+		BOOST_CHECK_EQUAL(shard.find(i), rows[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(dictionary_codec_values) {
+
+	namespace codec = hash_table::dictionary_codec;
+
+	std::vector<uint64_t> keys = {1, 2, 3};
+	std::vector<std::string> values = {"first value", "", std::string(100000, 'x') + "end"};
+	const std::string dictionary = "some dictionary data with first value";
+	const std::string block = codec::compress_block(keys, values, dictionary);
+
+	// Lookups reuse the inflate stream of the thread and only inflate up to the end of the value.
+	for (size_t round = 0; round < 2; round++) {
+		for (size_t i = 0; i < values.size(); i++) {
+			std::string value;
+			BOOST_REQUIRE(codec::decompress_value(block.data(), block.size(), i, dictionary, value));
+			BOOST_CHECK(value == values[i]);
+		}
+	}
+
+	std::string value;
+	BOOST_CHECK(!codec::decompress_value(block.data(), block.size(), 3, dictionary, value));
+	BOOST_CHECK(!codec::decompress_value(block.data(), block.size() / 2, 2, dictionary, value));
+	BOOST_CHECK(codec::decompress_value(block.data(), block.size(), 0, dictionary, value));
+	BOOST_CHECK_EQUAL(value, "first value");
+}
+
+BOOST_AUTO_TEST_CASE(online_compaction) {
+
+	HashTableHelper::truncate("test_index");
+
+	{
+		HashTableShardBuilder builder("test_index", 0);
+		for (size_t i = 0; i < 100; i++) {
+			builder.add(i * Config::ht_num_shards, "data element " + std::to_string(i) + " v1");
+		}
+		builder.write();
+		builder.sort();
+
+		// Overwrite half of the keys.
+		for (size_t i = 0; i < 50; i++) {
+			builder.add(i * Config::ht_num_shards, "data element " + std::to_string(i) + " v2");
+		}
+		builder.write();
+		builder.sort();
+	}
+
+	// The reader is opened before the compaction and keeps working after the files are swapped.
+	HashTableShard shard("test_index", 0);
+	const size_t file_size = shard.file_size();
+
+	hash_table::compactor compactor("test_index");
+
+	const hash_table::shard_stats stats = compactor.stats(0);
+	BOOST_CHECK_EQUAL(stats.m_file_size, file_size);
+	BOOST_CHECK_EQUAL(stats.m_live_bytes + stats.m_dead_bytes, file_size);
+	BOOST_CHECK(stats.garbage_ratio() > 0.25 && stats.garbage_ratio() < 0.45);
+	BOOST_CHECK_EQUAL(compactor.stats(1).m_file_size, 0);
+
+	const vector<size_t> shards = compactor.pick_shards();
+	BOOST_REQUIRE_EQUAL(shards.size(), 1);
+	BOOST_CHECK_EQUAL(shards[0], 0);
+
+	BOOST_CHECK(compactor.compact(0));
+
+	BOOST_CHECK_EQUAL(shard.file_size(), stats.m_live_bytes);
+	BOOST_CHECK_EQUAL(shard.size(), 100);
+	for (size_t i = 0; i < 100; i++) {
+		const std::string version = i < 50 ? " v2" : " v1";
+		BOOST_CHECK_EQUAL(shard.find(i * Config::ht_num_shards), "data element " + std::to_string(i) + version);
+	}
+
+	BOOST_CHECK_EQUAL(compactor.stats(0).m_dead_bytes, 0);
+	BOOST_CHECK(compactor.pick_shards().empty());
+	BOOST_CHECK(!boost::filesystem::exists(shard.filename_data() + ".compact"));
+
+	{
+		HashTable hash_table("test_index");
+		BOOST_CHECK_EQUAL(hash_table.size(), 100);
+		BOOST_CHECK_EQUAL(hash_table.find(0), "data element 0 v2");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(online_compaction_optimized) {
+
+	HashTableHelper::truncate("test_index");
+
+	vector<string> rows;
+	for (size_t i = 0; i < 2000; i++) {
+		rows.push_back("https://www.example" + std::to_string(i % 50) + ".com/articles/" + std::to_string(i) +
+			"\tArticle number " + std::to_string(i) + " - Example news");
+	}
+
+	HashTableShardBuilder builder("test_index", 0);
+	for (size_t i = 0; i < rows.size(); i++) {
+		builder.add(i, rows[i]);
+	}
+	builder.write();
+	builder.sort();
+	builder.optimize();
+
+	// Values appended after optimize leave the replaced values in blocks, the blocks and the dictionary are copied.
+	for (size_t i = 0; i < 10; i++) {
+		builder.add(i, "first update " + std::to_string(i));
+	}
+	builder.write();
+	builder.sort();
+	for (size_t i = 0; i < 10; i++) {
+		builder.add(i, "second update " + std::to_string(i));
+	}
+	builder.write();
+	builder.sort();
+
+	HashTableShard shard("test_index", 0);
+
+	hash_table::compactor compactor("test_index");
+	BOOST_CHECK(compactor.stats(0).m_dead_bytes > 0);
+	BOOST_CHECK(compactor.compact(0));
+
+	BOOST_CHECK_EQUAL(shard.size(), rows.size());
+	BOOST_CHECK_EQUAL(shard.find(3), "second update 3");
+	for (size_t i = 10; i < rows.size(); i += 7) {
+		BOOST_CHECK_EQUAL(shard.find(i), rows[i]);
+	}
+
+	vector<string> values = shard.find_many({1999, 0, 5000});
+	BOOST_CHECK_EQUAL(values[0], rows[1999]);
+	BOOST_CHECK_EQUAL(values[1], "second update 0");
+	BOOST_CHECK_EQUAL(values[2], "");
+}
+
+BOOST_AUTO_TEST_CASE(replace_files_recovery) {
+
+	HashTableHelper::truncate("test_index");
+
+	HashTableShardBuilder builder("test_index", 0);
+	const std::string data = builder.filename_data();
+	const std::string pos = builder.filename_pos();
+
+	builder.add(16, "version 1");
+	builder.write();
+	builder.sort();
+	File::copy_file(data, "/tmp/hash_table_v1.data");
+	File::copy_file(pos, "/tmp/hash_table_v1.pos");
+
+	builder.truncate();
+	builder.add(16, "version 2");
+	builder.add(32, "only in version 2");
+	builder.write();
+	builder.sort();
+
+	// A failed rename of the data file rolls back the pos file.
+	File::copy_file("/tmp/hash_table_v1.pos", "/tmp/hash_table_new.pos");
+	{
+		std::unique_lock<std::shared_mutex> lock(HashTableShard::files_lock(data));
+		BOOST_CHECK(!HashTableShard::replace_files(data, pos, "/tmp/hash_table_missing.data",
+			"/tmp/hash_table_new.pos"));
+	}
+	BOOST_CHECK(!boost::filesystem::exists(pos + ".old"));
+	BOOST_CHECK(!boost::filesystem::exists(data + ".old"));
+	{
+		HashTableShard shard("test_index", 0);
+		BOOST_CHECK_EQUAL(shard.find(16), "version 2");
+	}
+
+	// A crash after the pos file was renamed but not the data file is rolled back when the shard is opened.
+	File::copy_file(data, "/tmp/hash_table_v2.data");
+	File::copy_file(pos, "/tmp/hash_table_v2.pos");
+	File::copy_file("/tmp/hash_table_v1.pos", "/tmp/hash_table_new.pos");
+	BOOST_REQUIRE(link(data.c_str(), (data + ".old").c_str()) == 0);
+	BOOST_REQUIRE(link(pos.c_str(), (pos + ".old").c_str()) == 0);
+	BOOST_REQUIRE(rename("/tmp/hash_table_new.pos", pos.c_str()) == 0);
+	{
+		HashTableShard shard("test_index", 0);
+		BOOST_CHECK_EQUAL(shard.find(16), "version 2");
+		BOOST_CHECK_EQUAL(shard.find(32), "only in version 2");
+	}
+	BOOST_CHECK(!boost::filesystem::exists(pos + ".old"));
+	BOOST_CHECK(!boost::filesystem::exists(data + ".old"));
+
+	// A crash after both renames keeps the new files.
+	BOOST_REQUIRE(link(data.c_str(), (data + ".old").c_str()) == 0);
+	BOOST_REQUIRE(link(pos.c_str(), (pos + ".old").c_str()) == 0);
+	BOOST_REQUIRE(rename("/tmp/hash_table_v1.pos", pos.c_str()) == 0);
+	BOOST_REQUIRE(rename("/tmp/hash_table_v1.data", data.c_str()) == 0);
+	{
+		HashTableShard shard("test_index", 0);
+		BOOST_CHECK_EQUAL(shard.find(16), "version 1");
+		BOOST_CHECK_EQUAL(shard.find(32), "");
+	}
+	BOOST_CHECK(!boost::filesystem::exists(pos + ".old"));
+	BOOST_CHECK(!boost::filesystem::exists(data + ".old"));
+
+	// And a successful replace.
+	{
+		std::unique_lock<std::shared_mutex> lock(HashTableShard::files_lock(data));
+		BOOST_CHECK(HashTableShard::replace_files(data, pos, "/tmp/hash_table_v2.data", "/tmp/hash_table_v2.pos"));
+	}
+	HashTableShard shard("test_index", 0);
+	BOOST_CHECK_EQUAL(shard.find(32), "only in version 2");
+	BOOST_CHECK(!boost::filesystem::exists(pos + ".old"));
+}
+
+BOOST_AUTO_TEST_CASE(reopen_after_write) {
+
+	HashTableHelper::truncate("test_index");
+
+	HashTableShardBuilder builder("test_index", 0);
+	builder.add(16, "first");
+	builder.write();
+
+	HashTableShard shard("test_index", 0);
+	BOOST_CHECK_EQUAL(shard.find(16), "first");
+	BOOST_CHECK_EQUAL(shard.find(32), "");
+
+	// The data file keeps its inode, the shard opens the files again because the version has changed.
+	builder.add(32, "second");
+	builder.write();
+	BOOST_CHECK_EQUAL(shard.find(32), "second");
+	BOOST_CHECK_EQUAL(shard.size(), 2);
+
+	builder.sort();
+	BOOST_CHECK_EQUAL(shard.find(16), "first");
+	BOOST_CHECK_EQUAL(shard.find(32), "second");
+}
+
+BOOST_AUTO_TEST_CASE(compaction_rate_limit) {
+
+	hash_table::rate_limiter unlimited(0);
+	unlimited.consume(1ull << 40);
+
+	const auto start = std::chrono::steady_clock::now();
+	hash_table::rate_limiter limiter(1000000);
+	for (size_t i = 0; i < 10; i++) {
+		limiter.consume(20000);
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	BOOST_CHECK(elapsed >= std::chrono::milliseconds(190));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "host_graph/host_graph.h"
+#include "parser/URL.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/filesystem.hpp>
+
+BOOST_AUTO_TEST_SUITE(host_graph)
+
+void write_gz_file(const std::string &filename, const std::vector<std::string> &lines) {
+	std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+	boost::iostreams::filtering_ostream compress_stream;
+	compress_stream.push(boost::iostreams::gzip_compressor());
+	compress_stream.push(outfile);
+	for (const std::string &line : lines) {
+		compress_stream << line << "\n";
+	}
+}
+
+BOOST_AUTO_TEST_CASE(build_host_graph) {
+
+	const std::string dir = "/tmp/host_graph_test";
+	boost::filesystem::create_directories(dir);
+
+	write_gz_file(dir + "/urls_1.gz", {
+		"http://a.com/\ttitle",
+		"http://b.com/page\ttitle",
+		"http://a.com/other\ttitle",
+	});
+	write_gz_file(dir + "/urls_2.gz", {
+		"http://c.com/\ttitle",
+		"http://b.com/\ttitle",
+		"http://d.com/\ttitle",
+	});
+
+	// Tiny buffers so every thread writes several runs.
+	::host_graph::options opts;
+	opts.m_buffer_bytes = 2 * 8 * 2;
+	opts.m_num_threads = 2;
+	opts.m_work_dir = dir;
+
+	const size_t num_hosts = ::host_graph::build_hosts({dir + "/urls_1.gz", dir + "/urls_2.gz"}, dir + "/hosts.txt",
+		dir + "/hosts.ids", opts);
+	BOOST_CHECK_EQUAL(num_hosts, 4);
+
+	::host_graph::host_ids ids(dir + "/hosts.ids");
+	BOOST_REQUIRE_EQUAL(ids.size(), 4);
+
+	std::map<std::string, uint32_t> host_id;
+	for (const std::string host : {"a.com", "b.com", "c.com", "d.com"}) {
+		BOOST_REQUIRE(ids.find(URL("http://" + host + "/").host_hash(), host_id[host]));
+	}
+	uint32_t id;
+	BOOST_CHECK(!ids.find(URL("http://e.com/").host_hash(), id));
+
+	std::ifstream hosts_file(dir + "/hosts.txt");
+	std::string line;
+	size_t num_lines = 0;
+	while (getline(hosts_file, line)) {
+		std::vector<std::string> cols;
+		boost::algorithm::split(cols, line, boost::is_any_of("\t"));
+		BOOST_REQUIRE_EQUAL(cols.size(), 3);
+		BOOST_CHECK_EQUAL(std::stoull(cols[0]), host_id[cols[2]]);
+		num_lines++;
+	}
+	BOOST_CHECK_EQUAL(num_lines, 4);
+
+	write_gz_file(dir + "/links_1.gz", {
+		"a.com\t/\tb.com\t/\tlink text",
+		"a.com\t/x\tb.com\t/y\tduplicate",
+		"c.com\t/\tb.com\t/\tlink text",
+		"e.com\t/\tb.com\t/\tnot in the graph",
+	});
+	write_gz_file(dir + "/links_2.gz", {
+		"d.com\t/\ta.com\t/\tlink text",
+		"c.com\t/\tb.com\t/z\tduplicate",
+		"b.com\t/\ta.com\t/\tlink text",
+	});
+
+	const size_t num_edges = ::host_graph::build_edges({dir + "/links_1.gz", dir + "/links_2.gz"}, ids,
+		dir + "/edges.adj", opts);
+	BOOST_CHECK_EQUAL(num_edges, 4);
+
+	::host_graph::adjacency_reader reader(dir + "/edges.adj");
+	BOOST_CHECK_EQUAL(reader.num_vertices(), 4);
+	BOOST_CHECK_EQUAL(reader.num_edges(), 4);
+
+	std::map<uint32_t, std::vector<uint32_t>> incoming;
+	uint32_t vertex;
+	std::vector<uint32_t> edges;
+	size_t num_vertices = 0;
+	while (reader.next(vertex, edges)) {
+		BOOST_CHECK_EQUAL(vertex, num_vertices++);
+		incoming[vertex] = edges;
+	}
+	BOOST_CHECK_EQUAL(num_vertices, 4);
+
+	std::vector<uint32_t> to_b = {host_id["a.com"], host_id["c.com"]};
+	std::sort(to_b.begin(), to_b.end());
+	BOOST_CHECK(incoming[host_id["b.com"]] == to_b);
+
+	std::vector<uint32_t> to_a = {host_id["b.com"], host_id["d.com"]};
+	std::sort(to_a.begin(), to_a.end());
+	BOOST_CHECK(incoming[host_id["a.com"]] == to_a);
+
+	BOOST_CHECK(incoming[host_id["c.com"]].empty());
+
+	// The run files are removed.
+	size_t num_files = 0;
+	for (const auto &entry : boost::filesystem::directory_iterator(dir)) {
+		BOOST_CHECK(entry.path().extension() != ".run");
+		num_files++;
+	}
+	BOOST_CHECK_EQUAL(num_files, 7);
+
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -297,6 +297,70 @@ BOOST_AUTO_TEST_CASE(html_parser_long_text) {
 	Config::html_parser_long_text_len = 1000;
 }
 
+BOOST_AUTO_TEST_CASE(html_tokenizer) {
+
+	const string html = "<!DOCTYPE html><DIV class='a b' data-x=\"1 > 2\">text<!-- <p>comment</p> --><br/>"
+		"<script>if (a < b) document.write('</div>');</script></DIV>";
+
+	parser::html_tokenizer tokenizer(html);
+	parser::html_token token;
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.m_type == parser::html_token_type::start_tag);
+	BOOST_CHECK(token.is("div"));
+	BOOST_CHECK_EQUAL(token.attribute("class"), "a b");
+	BOOST_CHECK_EQUAL(token.attribute("data-x"), "1 > 2");
+	BOOST_CHECK(!token.has_attribute("id"));
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.m_type == parser::html_token_type::text);
+	BOOST_CHECK_EQUAL(token.m_text, "text");
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.is("br"));
+	BOOST_CHECK(token.m_self_closing);
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.is("script"));
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.m_type == parser::html_token_type::end_tag);
+	BOOST_CHECK(token.is("script"));
+
+	BOOST_REQUIRE(tokenizer.next(token));
+	BOOST_CHECK(token.m_type == parser::html_token_type::end_tag);
+	BOOST_CHECK(token.is("div"));
+
+	BOOST_CHECK(!tokenizer.next(token));
+}
+
+BOOST_AUTO_TEST_CASE(html_parse_single_pass) {
+	HtmlParser parser;
+
+	parser.parse("<TITLE>Fish &amp; chips</TITLE><h1>Caf&eacute; &#8211; menu</h1><!-- <h1>old</h1> -->"
+		"<script>var s = '<title>no</title>';</script><p>first&nbsp;&lt;line&gt;</p>", "https://example.com/");
+	BOOST_CHECK_EQUAL(parser.title(), "Fish & chips");
+	BOOST_CHECK_EQUAL(parser.h1(), "Café – menu");
+	BOOST_CHECK_EQUAL(parser.text(), "first <line");
+	BOOST_CHECK(parser.should_insert());
+
+	parser.parse("<title>links</title><body><a href='https://other.com/a?b=1' rel=\"nofollow\">Other <b>site</b></a>"
+		"<a href=\"/internal\">Internal</a><a href=\"http://skatteverket.se/\">Skatteverket</A>"
+		"<a href=\"https://empty.com/\"></a></body>", "https://example.com/");
+	const vector<HtmlLink> links = parser.links();
+	BOOST_REQUIRE_EQUAL(links.size(), 2);
+	BOOST_CHECK_EQUAL(links[0].target_host(), "other.com");
+	BOOST_CHECK_EQUAL(links[0].target_path(), "/a?b=1");
+	BOOST_CHECK_EQUAL(links[0].text(), "Other site");
+	BOOST_CHECK(links[0].nofollow());
+	BOOST_CHECK_EQUAL(links[1].target_host(), "skatteverket.se");
+	BOOST_CHECK_EQUAL(links[1].text(), "Skatteverket");
+	BOOST_CHECK(!links[1].nofollow());
+
+	parser.parse("<title>meta</title><meta property=\"og:description\" content=\"Read &quot;this&quot; first.\">");
+	BOOST_CHECK_EQUAL(parser.meta(), "Read \"this\" first");
+}
+
 /*
 	test these links: <a href="http://skatteverket.se/">Skatteverket</A>
 	here: http://nomell.se/2009/03/24/prisa-gud-har-kommer-skatteaterbaringen/
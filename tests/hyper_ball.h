@@ -25,6 +25,8 @@
  */
 
 #include "algorithm/HyperBall.h"
+#include "algorithm/edge_csr.h"
+#include <boost/filesystem.hpp>
 
 BOOST_AUTO_TEST_SUITE(hyper_ball)
 
@@ -130,5 +132,72 @@ BOOST_AUTO_TEST_CASE(harmonic_centrality_hyper_ball3) {
 
 }
 
+BOOST_AUTO_TEST_CASE(harmonic_centrality_hyper_ball_csr) {
+
+	const std::vector<std::pair<uint32_t, uint32_t>> e = {
+		std::make_pair(0, 1),
+		std::make_pair(1, 2),
+		std::make_pair(2, 0),
+		std::make_pair(2, 3),
+		std::make_pair(3, 4),
+		std::make_pair(3, 5),
+		std::make_pair(4, 2),
+		std::make_pair(5, 4),
+		std::make_pair(5, 2000), // Outside the graph, skipped.
+	};
+	const size_t n = 1000;
+
+	algorithm::write_edge_csr("/tmp/hyper_ball_test.csr", n, [&e](const algorithm::edge_callback &callback) {
+		for (const auto &edge : e) {
+			callback(edge.second, edge.first);
+		}
+	});
+
+	{
+		const algorithm::edge_csr graph("/tmp/hyper_ball_test.csr");
+		BOOST_CHECK_EQUAL(graph.num_vertices(), n);
+		BOOST_CHECK_EQUAL(graph.num_edges(), 8);
+		BOOST_REQUIRE_EQUAL(graph.edges(2).size(), 2);
+		BOOST_CHECK_EQUAL(graph.edges(2)[0], 1);
+		BOOST_CHECK_EQUAL(graph.edges(2)[1], 4);
+		BOOST_CHECK_EQUAL(graph.edges(6).size(), 0);
+
+		std::vector<double> h = Algorithm::hyper_ball(graph);
+		BOOST_CHECK(h.size() == n);
+		BOOST_CHECK_CLOSE(h[0], 8.0/3.0, 0.000001);
+		BOOST_CHECK_CLOSE(h[1], 7.0/3.0, 0.000001);
+		BOOST_CHECK_CLOSE(h[2], 7.0/2.0, 0.000001);
+		BOOST_CHECK_EQUAL(h[6], 0.0);
+	}
+
+	// Truncated files are rejected.
+	boost::filesystem::resize_file("/tmp/hyper_ball_test.csr", 100);
+	BOOST_CHECK_THROW(algorithm::edge_csr("/tmp/hyper_ball_test.csr"), Logger::LoggedException);
+	boost::filesystem::remove("/tmp/hyper_ball_test.csr");
+}
+
+BOOST_AUTO_TEST_CASE(harmonic_centrality_hyper_ball_memory_limit) {
+
+	// A star where 2000 vertices link to vertex 0.
+	const size_t n = 2001;
+	std::vector<uint64_t> offsets(n + 1, 2000);
+	offsets[0] = 0;
+	std::vector<uint32_t> edges;
+	for (uint32_t v = 1; v < n; v++) {
+		edges.push_back(v);
+	}
+	const algorithm::edge_csr graph(std::move(offsets), std::move(edges));
+
+	Algorithm::hyper_ball_options options;
+	std::vector<double> precise = Algorithm::hyper_ball(graph, options);
+	BOOST_CHECK_CLOSE(precise[0], 2000.0, 3 * 1.04 / std::sqrt(32768.0) * 100.0);
+
+	// Only room for counters with 2^10 registers.
+	options.m_max_memory = n * 1100;
+	std::vector<double> approximate = Algorithm::hyper_ball(graph, options);
+	BOOST_CHECK_CLOSE(approximate[0], 2000.0, 3 * 1.04 / std::sqrt(1024.0) * 100.0);
+	BOOST_CHECK_EQUAL(approximate[1], 0.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
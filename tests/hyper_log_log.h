@@ -26,6 +26,7 @@
 
 #include "algorithm/HyperLogLog.h"
 #include <cstdlib>
+#include <sstream>
 
 BOOST_AUTO_TEST_SUITE(hyper_log_log)
 
@@ -98,8 +99,13 @@ BOOST_AUTO_TEST_CASE(hyper_log_log_data_copy) {
 		hl1.insert(i);
 	}
 
-	Algorithm::HyperLogLog<uint32_t> hl2(hl1.data());
+	std::stringstream stream;
+	hl1.serialize(stream);
 
+	Algorithm::HyperLogLog<uint32_t> hl2;
+	BOOST_REQUIRE(hl2.deserialize(stream));
+
+	BOOST_CHECK_EQUAL(hl2.size(), hl1.size());
 	BOOST_CHECK(std::abs((int)hl2.size() - 250000) < 250000 * hl1.error_bound());
 
 	std::vector<size_t> sizes = {25000, 50000, 75000, 100000, 200000, 300000, 400000};
@@ -115,4 +121,128 @@ BOOST_AUTO_TEST_CASE(hyper_log_log_data_copy) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(hyper_log_log_sparse) {
+
+	Algorithm::HyperLogLog<size_t> hll;
+	for (size_t i = 0; i < 1000; i++) {
+		hll.insert(i);
+		hll.insert(i);
+	}
+
+	BOOST_CHECK(hll.is_sparse());
+	BOOST_CHECK_EQUAL(hll.size(), 1000);
+
+	// Switches to dense registers when the sparse list gets larger than the registers.
+	for (size_t i = 1000; i < 20000; i++) {
+		hll.insert(i);
+	}
+	BOOST_CHECK(!hll.is_sparse());
+
+	// The estimate has no bias in the range where the sparse and dense estimates meet.
+	for (size_t i = 20000; i < 100000; i++) {
+		hll.insert(i);
+		if (i % 10000 == 0) {
+			BOOST_CHECK(std::abs((int)hll.size() - (int)(i + 1)) < (i + 1) * hll.error_bound());
+		}
+	}
+
+	// Sparse and dense counters can be merged in both directions.
+	Algorithm::HyperLogLog<size_t> sparse;
+	for (size_t i = 100000; i < 101000; i++) {
+		sparse.insert(i);
+	}
+	Algorithm::HyperLogLog<size_t> dense = hll + sparse;
+	Algorithm::HyperLogLog<size_t> dense2 = sparse + hll;
+	BOOST_CHECK_EQUAL(dense.size(), dense2.size());
+	BOOST_CHECK(std::abs((int)dense.size() - 101000) < 101000 * hll.error_bound());
+
+	Algorithm::HyperLogLog<size_t> sparse2;
+	for (size_t i = 100500; i < 101500; i++) {
+		sparse2.insert(i);
+	}
+	sparse += sparse2;
+	BOOST_CHECK(sparse.is_sparse());
+	BOOST_CHECK(std::abs((int)sparse.size() - 1500) <= 2);
+}
+
+BOOST_AUTO_TEST_CASE(hyper_log_log_serialize) {
+
+	Algorithm::HyperLogLog<size_t> sparse;
+	for (size_t i = 0; i < 10; i++) {
+		sparse.insert(i);
+	}
+
+	std::stringstream stream;
+	sparse.serialize(stream);
+
+	// Ten entries take a few bytes instead of all the registers.
+	BOOST_CHECK(stream.str().size() < 64);
+
+	Algorithm::HyperLogLog<size_t> copy;
+	copy.insert(1000);
+	BOOST_REQUIRE(copy.deserialize(stream));
+	BOOST_CHECK(copy.is_sparse());
+	BOOST_CHECK_EQUAL(copy.size(), 10);
+
+	std::stringstream corrupt(std::string("\x09\x0F\x00", 3));
+	BOOST_CHECK(!copy.deserialize(corrupt));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	// Valid headers followed by fewer registers or sparse entries than they announce.
+	std::stringstream truncated_dense(std::string("\x01\x0F\x00", 3) + std::string(1000, '\x11'));
+	BOOST_CHECK(!copy.deserialize(truncated_dense));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	std::stringstream truncated_sparse(std::string("\x01\x0F\x01\x0A\x05\x05", 6));
+	BOOST_CHECK(!copy.deserialize(truncated_sparse));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	// Sparse entries past the sparse index range, repeated or wrapping around would index outside the registers.
+	std::stringstream out_of_range(std::string("\x01\x0F\x01\x01\x80\x80\x80\x80\x08", 9));
+	BOOST_CHECK(!copy.deserialize(out_of_range));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	std::stringstream repeated(std::string("\x01\x0F\x01\x02\x05\x00", 6));
+	BOOST_CHECK(!copy.deserialize(repeated));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	std::stringstream wrapping(std::string("\x01\x0F\x01\x02\x05\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x01", 15));
+	BOOST_CHECK(!copy.deserialize(wrapping));
+	BOOST_CHECK_EQUAL(copy.size(), 0);
+
+	std::stringstream last_entry(std::string("\x01\x0F\x01\x01\xFF\xFF\xFF\xFF\x07", 9));
+	BOOST_CHECK(copy.deserialize(last_entry));
+	BOOST_CHECK(copy.is_sparse());
+
+	// Counters written as raw registers keep hashing the string representation of the values.
+	std::vector<char> registers(Algorithm::HyperLogLog<size_t>::legacy_registers_len, 0);
+	std::hash<std::string> hasher;
+	for (size_t i = 0; i < 100; i++) {
+		const size_t x = hasher(std::to_string(i));
+		const size_t j = x >> 49;
+		registers[j] = std::max(registers[j], (char)(__builtin_clzll(x << 15) + 1));
+	}
+
+	Algorithm::HyperLogLog<size_t> legacy(registers.data());
+	const size_t legacy_size = legacy.size();
+	BOOST_CHECK(std::abs((int)legacy_size - 100) <= 1);
+	for (size_t i = 0; i < 100; i++) {
+		legacy.insert(i);
+	}
+	BOOST_CHECK_EQUAL(legacy.size(), legacy_size);
+
+	std::stringstream legacy_stream;
+	legacy.serialize(legacy_stream);
+	Algorithm::HyperLogLog<size_t> legacy_copy;
+	BOOST_REQUIRE(legacy_copy.deserialize(legacy_stream));
+	legacy_copy.insert(50);
+	BOOST_CHECK_EQUAL(legacy_copy.size(), legacy_size);
+
+	// Counters with different hashes or precision can not be merged.
+	BOOST_CHECK_THROW(legacy_copy += sparse, Logger::LoggedException);
+	Algorithm::HyperLogLog<size_t> low_precision(10);
+	BOOST_CHECK_THROW(low_precision += sparse, Logger::LoggedException);
+	BOOST_CHECK_THROW(sparse + low_precision, Logger::LoggedException);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
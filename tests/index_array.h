@@ -31,8 +31,10 @@
 #include "indexer/sharded_index.h"
 #include "indexer/snippet.h"
 #include "indexer/index_tree.h"
+#include "indexer/posting_cache.h"
 #include "algorithm/HyperLogLog.h"
 #include "parser/URL.h"
+#include "file/File.h"
 #include "transfer/Transfer.h"
 #include "memory/debugger.h"
 
@@ -69,7 +71,7 @@ BOOST_AUTO_TEST_CASE(index_builder) {
 	{
 		indexer::index<indexer::generic_record> idx("test", 0, 1000);
 		size_t total;
-		std::vector<indexer::generic_record> res = idx.find(123, total);
+		std::vector<indexer::generic_record> res = *idx.find(123, total);
 		// Results are sorted by value.
 		BOOST_REQUIRE_EQUAL(res.size(), 10);
 		BOOST_CHECK_EQUAL(total, 100);
@@ -101,7 +103,7 @@ BOOST_AUTO_TEST_CASE(index) {
 
 	{
 		indexer::index<indexer::generic_record> idx("test", 0);
-		std::vector<indexer::generic_record> res = idx.find(123);
+		std::vector<indexer::generic_record> res = *idx.find(123);
 		// Results are sorted by value.
 		BOOST_CHECK_EQUAL(res[0].m_value, 1);
 		BOOST_CHECK_EQUAL(res[1].m_value, 2);
@@ -109,6 +111,353 @@ BOOST_AUTO_TEST_CASE(index) {
 
 }
 
+BOOST_AUTO_TEST_CASE(index_reopen) {
+
+	/*
+	 * The reader keeps its files mapped, it should pick up the new files after the builder has merged.
+	 * */
+	indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+	builder.truncate();
+
+	builder.add(123, indexer::generic_record(1, 0.2f));
+	builder.append();
+	builder.merge();
+
+	indexer::index<indexer::generic_record> idx("test", 0, 1000);
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 1);
+	BOOST_CHECK_EQUAL(idx.find(124)->size(), 0);
+
+	builder.add(123, indexer::generic_record(2, 0.3f));
+	builder.add(124, indexer::generic_record(3, 0.3f));
+	builder.append();
+	builder.merge();
+
+	size_t total;
+	std::vector<indexer::generic_record> res = *idx.find(123, total);
+	BOOST_REQUIRE_EQUAL(res.size(), 2);
+	BOOST_CHECK_EQUAL(total, 2);
+	BOOST_CHECK_EQUAL(res[0].m_value, 1);
+	BOOST_CHECK_EQUAL(res[1].m_value, 2);
+	BOOST_CHECK_EQUAL(idx.find(124)->size(), 1);
+	BOOST_CHECK_EQUAL(idx.get_document_count(), 3);
+
+	builder.truncate();
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(index_reopen_mismatched_files) {
+
+	indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+	builder.truncate();
+	builder.add(123, indexer::generic_record(1, 0.2f));
+	builder.append();
+	builder.merge();
+
+	// Keep the data file of the first merge.
+	File::copy_file("/mnt/0/full_text/test/0.data", "/mnt/0/full_text/test/0.data.first");
+
+	builder.add(123, indexer::generic_record(2, 0.3f));
+	builder.append();
+	builder.merge();
+
+	indexer::index<indexer::generic_record> idx("test", 0, 1000);
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 2);
+
+	// The keys file of the second merge with the data file of the first is what a reader sees between the renames
+	// in publish_files. The reader keeps the files it has.
+	boost::filesystem::rename("/mnt/0/full_text/test/0.data.first", "/mnt/0/full_text/test/0.data");
+	idx.reopen_if_changed();
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 2);
+
+	// The next merge publishes files that match again, it merges into the data file of the first merge.
+	builder.add(123, indexer::generic_record(3, 0.4f));
+	builder.append();
+	builder.merge();
+	std::vector<indexer::generic_record> res = *idx.find(123);
+	BOOST_REQUIRE_EQUAL(res.size(), 2);
+	BOOST_CHECK_EQUAL(res[0].m_value, 1);
+	BOOST_CHECK_EQUAL(res[1].m_value, 3);
+}
+
+BOOST_AUTO_TEST_CASE(index_meta_header) {
+
+	indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+	builder.truncate();
+	builder.add(123, indexer::generic_record(1, 0.2f));
+	builder.append();
+	builder.merge();
+	BOOST_CHECK(!boost::filesystem::exists("/mnt/0/full_text/test/0.meta.tmp"));
+
+	indexer::index<indexer::generic_record> idx("test", 0, 1000);
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 1);
+
+	// A meta file that ends inside the header, with a new data file so the reader maps the files again.
+	const uint64_t header[] = {indexer::posting_codec::meta_magic_generation, indexer::posting_codec::current_format};
+	std::ofstream meta_writer("/mnt/0/full_text/test/0.meta", std::ios::binary | std::ios::trunc);
+	meta_writer.write((const char *)header, sizeof(header));
+	meta_writer.close();
+	File::copy_file("/mnt/0/full_text/test/0.data", "/mnt/0/full_text/test/0.data.copy");
+	boost::filesystem::rename("/mnt/0/full_text/test/0.data.copy", "/mnt/0/full_text/test/0.data");
+
+	// The reader keeps the files it has and a new reader refuses the meta file.
+	idx.reopen_if_changed();
+	BOOST_CHECK_EQUAL(idx.find(123)->size(), 1);
+	BOOST_CHECK_THROW(indexer::index<indexer::generic_record>("test", 0, 1000), Logger::LoggedException);
+
+	std::istringstream short_header(std::string((const char *)header, sizeof(header)));
+	uint64_t format, generation;
+	size_t unique_count;
+	BOOST_CHECK(!indexer::posting_codec::read_meta_header(short_header, format, unique_count, generation));
+
+	// Unknown formats are refused too.
+	const uint64_t future[] = {indexer::posting_codec::meta_magic, indexer::posting_codec::current_format + 1, 5};
+	std::istringstream future_header(std::string((const char *)future, sizeof(future)));
+	BOOST_CHECK(!indexer::posting_codec::read_meta_header(future_header, format, unique_count, generation));
+
+	// Truncating replaces the broken meta file.
+	builder.truncate();
+	indexer::index<indexer::generic_record> idx2("test", 0, 1000);
+	BOOST_CHECK_EQUAL(idx2.find(123)->size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(index_builder_runs) {
+
+	/*
+	 * Small runs so the append cache is sorted in several runs on disk.
+	 * */
+	const size_t run_len = Config::ft_merge_run_len;
+	Config::ft_merge_run_len = 7;
+
+	{
+		indexer::index_builder<indexer::generic_record> builder("test", 0, 1000, 5);
+		builder.truncate();
+
+		for (size_t j = 0; j < 2; j++) {
+			for (size_t i = 0; i < 20; i++) {
+				builder.add(1, indexer::generic_record(i, (float)i));
+			}
+		}
+		// Same page as key 1.
+		for (size_t i = 0; i < 3; i++) {
+			builder.add(1001, indexer::generic_record(i, 1.0f));
+		}
+		builder.add(2, indexer::generic_record(5, 1.0f));
+		builder.append();
+		builder.merge();
+
+		BOOST_CHECK(!boost::filesystem::exists("/mnt/0/full_text/test/0.run.0"));
+
+		indexer::index<indexer::generic_record> idx("test", 0, 1000);
+
+		size_t total;
+		std::vector<indexer::generic_record> res = *idx.find(1, total);
+		BOOST_REQUIRE_EQUAL(res.size(), 5);
+		BOOST_CHECK_EQUAL(total, 20);
+		for (size_t i = 0; i < 5; i++) {
+			BOOST_CHECK_EQUAL(res[i].m_value, 15 + i);
+			BOOST_CHECK_EQUAL(res[i].m_count, 2);
+		}
+		BOOST_CHECK_EQUAL(idx.find(1001)->size(), 3);
+		BOOST_CHECK_EQUAL(idx.find(2)->size(), 1);
+
+		// Merge with the records already in the data file.
+		builder.add(2, indexer::generic_record(5, 1.0f));
+		builder.add(2, indexer::generic_record(6, 1.0f));
+		builder.add(1, indexer::generic_record(100, 100.0f));
+		builder.append();
+		builder.merge();
+
+		res = *idx.find(2);
+		BOOST_REQUIRE_EQUAL(res.size(), 2);
+		BOOST_CHECK_EQUAL(res[0].m_value, 5);
+		BOOST_CHECK_EQUAL(res[0].m_count, 2);
+		BOOST_CHECK_EQUAL(res[1].m_value, 6);
+
+		res = *idx.find(1, total);
+		BOOST_REQUIRE_EQUAL(res.size(), 5);
+		BOOST_CHECK_EQUAL(total, 21);
+		BOOST_CHECK_EQUAL(res[0].m_value, 16);
+		BOOST_CHECK_EQUAL(res[4].m_value, 100);
+		BOOST_CHECK_EQUAL(idx.get_document_count(), 21);
+		BOOST_CHECK_EQUAL(idx.find(1001)->size(), 3);
+
+		builder.truncate();
+	}
+
+	Config::ft_merge_run_len = run_len;
+}
+
+BOOST_AUTO_TEST_CASE(posting_cache) {
+
+	// One shard with room for 4 entries of 100 bytes.
+	indexer::posting_cache cache(400, 1);
+
+	auto value = [](int v) { return std::make_shared<const int>(v); };
+
+	BOOST_CHECK(cache.find(1, 1, 1) == nullptr);
+	BOOST_CHECK(cache.insert(1, 1, 1, value(1), 100));
+	BOOST_REQUIRE(cache.find(1, 1, 1) != nullptr);
+	BOOST_CHECK_EQUAL(*std::static_pointer_cast<const int>(cache.find(1, 1, 1)), 1);
+
+	// Same key in another index is another entry.
+	BOOST_CHECK(cache.find(2, 1, 1) == nullptr);
+
+	// A new generation invalidates the entry.
+	BOOST_CHECK(cache.find(1, 1, 2) == nullptr);
+	BOOST_CHECK_EQUAL(cache.get_stats().m_invalidations, 1);
+
+	// Make keys 10..13 hot and fill the cache with them.
+	for (uint64_t key = 10; key < 14; key++) {
+		for (size_t i = 0; i < 5; i++) cache.find(1, key, 1);
+		BOOST_CHECK(cache.insert(1, key, 1, value(key), 100));
+	}
+	BOOST_CHECK_EQUAL(cache.get_stats().m_size, 400);
+
+	// A key that was only requested once is not allowed to evict a hot key.
+	cache.find(1, 20, 1);
+	BOOST_CHECK(!cache.insert(1, 20, 1, value(20), 100));
+	BOOST_CHECK_EQUAL(cache.get_stats().m_rejections, 1);
+
+	// A key that is hotter than the least recently used one replaces it.
+	for (size_t i = 0; i < 10; i++) cache.find(1, 21, 1);
+	BOOST_CHECK(cache.insert(1, 21, 1, value(21), 100));
+	BOOST_CHECK_EQUAL(cache.get_stats().m_evictions, 1);
+	BOOST_CHECK(cache.find(1, 10, 1) == nullptr);
+	BOOST_CHECK(cache.find(1, 21, 1) != nullptr);
+
+	// Values larger than a shard are never admitted.
+	BOOST_CHECK(!cache.insert(1, 30, 1, value(30), 1000));
+
+	cache.set_capacity(0);
+	BOOST_CHECK(!cache.enabled());
+	BOOST_CHECK_EQUAL(cache.get_stats().m_size, 0);
+}
+
+BOOST_AUTO_TEST_CASE(index_posting_cache) {
+
+	indexer::posting_cache &cache = indexer::posting_cache::instance();
+	cache.clear();
+	cache.set_capacity(64ull * 1024 * 1024);
+
+	{
+		indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+		builder.truncate();
+
+		builder.add(123, indexer::generic_record(1, 0.2f));
+		builder.append();
+		builder.merge();
+
+		indexer::index<indexer::generic_record> idx("test", 0, 1000);
+		BOOST_CHECK_EQUAL(idx.find(123)->size(), 1);
+
+		const size_t hits = cache.get_stats().m_hits;
+		const auto first = idx.find(123);
+		BOOST_CHECK_EQUAL(first->size(), 1);
+		BOOST_CHECK_EQUAL(cache.get_stats().m_hits, hits + 1);
+
+		// Hits share the cached records instead of copying them.
+		BOOST_CHECK(idx.find(123) == first);
+
+		// The cached result must not survive the merge.
+		builder.add(123, indexer::generic_record(2, 0.3f));
+		builder.append();
+		builder.merge();
+
+		size_t total;
+		std::vector<indexer::generic_record> res = *idx.find(123, total);
+		BOOST_REQUIRE_EQUAL(res.size(), 2);
+		BOOST_CHECK_EQUAL(total, 2);
+		BOOST_CHECK_EQUAL(res[1].m_value, 2);
+		BOOST_CHECK(cache.get_stats().m_invalidations > 0);
+
+		builder.truncate();
+		BOOST_CHECK_EQUAL(idx.find(123)->size(), 0);
+	}
+
+	cache.set_capacity(0);
+}
+
+BOOST_AUTO_TEST_CASE(posting_codec) {
+
+	std::vector<indexer::generic_record> records;
+	for (size_t i = 0; i < 1000; i++) {
+		indexer::generic_record record(i * i * 1000 + 7, 0.01f * i);
+		record.m_count = i % 3 + 1;
+		records.push_back(record);
+	}
+	records.push_back(indexer::generic_record(0xFFFFFFFFFFFFFFFFull, 12345.0f));
+
+	std::string encoded;
+	indexer::posting_codec::encode(records, encoded);
+	BOOST_CHECK(encoded.size() < records.size() * sizeof(indexer::generic_record) / 2);
+
+	std::vector<indexer::generic_record> decoded;
+	BOOST_REQUIRE(indexer::posting_codec::decode(encoded.data(), encoded.size(), decoded));
+	BOOST_REQUIRE_EQUAL(decoded.size(), records.size());
+	for (size_t i = 0; i < records.size(); i++) {
+		BOOST_CHECK_EQUAL(decoded[i].m_value, records[i].m_value);
+		BOOST_CHECK_EQUAL(decoded[i].m_count, records[i].m_count);
+		BOOST_CHECK_CLOSE(decoded[i].m_score, records[i].m_score, 0.4);
+	}
+
+	// Truncated data should not decode.
+	std::vector<indexer::generic_record> truncated;
+	BOOST_CHECK(!indexer::posting_codec::decode(encoded.data(), encoded.size() - 1, truncated));
+}
+
+BOOST_AUTO_TEST_CASE(index_raw_format) {
+
+	/*
+	 * Indexes written before the compressed format have no version in the meta file and raw pages.
+	 * */
+	{
+		indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+		builder.truncate();
+	}
+
+	std::vector<indexer::generic_record> records = {indexer::generic_record(5, 0.5f), indexer::generic_record(7, 0.7f)};
+	const size_t page[] = {1, 123, 0, records.size() * sizeof(indexer::generic_record), 2};
+	std::ofstream data_writer("/mnt/0/full_text/test/0.data", std::ios::binary | std::ios::trunc);
+	data_writer.write((const char *)page, sizeof(page));
+	data_writer.write((const char *)records.data(), records.size() * sizeof(indexer::generic_record));
+	data_writer.close();
+
+	std::ofstream key_writer("/mnt/0/full_text/test/0.keys", std::ios::binary | std::ios::trunc);
+	for (size_t i = 0; i < 1000; i++) {
+		const size_t pos = i == 123 ? 0 : SIZE_MAX;
+		key_writer.write((const char *)&pos, sizeof(pos));
+	}
+	key_writer.close();
+
+	const size_t unique_count = 2;
+	std::ofstream meta_writer("/mnt/0/full_text/test/0.meta", std::ios::binary | std::ios::trunc);
+	meta_writer.write((const char *)&unique_count, sizeof(unique_count));
+	meta_writer.close();
+
+	indexer::index<indexer::generic_record> idx("test", 0, 1000);
+	size_t total;
+	std::vector<indexer::generic_record> res = *idx.find(123, total);
+	BOOST_REQUIRE_EQUAL(res.size(), 2);
+	BOOST_CHECK_EQUAL(total, 2);
+	BOOST_CHECK_EQUAL(res[1].m_value, 7);
+	BOOST_CHECK_EQUAL(res[1].m_score, 0.7f);
+	BOOST_CHECK_EQUAL(idx.get_document_count(), 2);
+
+	// Merging into the old index rewrites it in the current format.
+	{
+		indexer::index_builder<indexer::generic_record> builder("test", 0, 1000);
+		builder.add(123, indexer::generic_record(6, 0.6f));
+		builder.append();
+		builder.merge();
+	}
+
+	res = *idx.find(123);
+	BOOST_REQUIRE_EQUAL(res.size(), 3);
+	BOOST_CHECK_EQUAL(res[0].m_value, 5);
+	BOOST_CHECK_EQUAL(res[1].m_value, 6);
+	BOOST_CHECK_EQUAL(res[2].m_value, 7);
+}
+
 BOOST_AUTO_TEST_CASE(sharded_index) {
 
 	struct record {
@@ -135,7 +484,7 @@ BOOST_AUTO_TEST_CASE(sharded_index) {
 
 	{
 		indexer::sharded_index<indexer::generic_record> idx("sharded_index", 10);
-		std::vector<indexer::generic_record> res = idx.find(123);
+		std::vector<indexer::generic_record> res = *idx.find(123);
 		// Results are sorted by value.
 		BOOST_REQUIRE_EQUAL(res.size(), 1);
 		BOOST_CHECK_EQUAL(res[0].m_value, 123);
@@ -189,7 +538,7 @@ BOOST_AUTO_TEST_CASE(index_frequency) {
 		BOOST_CHECK(idx.get_document_count() == 3);
 		BOOST_CHECK(total == 1);
 
-		std::vector<indexer::domain_record> res = idx.find(123, total);
+		std::vector<indexer::domain_record> res = *idx.find(123, total);
 		BOOST_CHECK(total == 2);
 		BOOST_REQUIRE(res.size() == 2);
 		BOOST_CHECK(res[0].m_value == 1);
@@ -25,6 +25,8 @@
  */
 
 #include "KeyValueStore.h"
+#include "key_value/hash_log_engine.h"
+#include <boost/filesystem.hpp>
 
 BOOST_AUTO_TEST_SUITE(key_value_store)
 
@@ -39,4 +41,158 @@ BOOST_AUTO_TEST_CASE(get_set) {
 
 }
 
+void check_engine(key_value::engine &engine) {
+
+	std::string value;
+	BOOST_CHECK(!engine.get("a/1", value));
+
+	key_value::write_batch batch;
+	batch.put("a/1", "one");
+	batch.put("a/2", "two");
+	batch.put("b/1", "three");
+	batch.put("a/2", "two again");
+	batch.remove("b/1");
+	batch.put("c/1", "four");
+	engine.write(batch);
+
+	BOOST_CHECK(engine.get("a/1", value));
+	BOOST_CHECK_EQUAL(value, "one");
+	BOOST_CHECK(engine.get("a/2", value));
+	BOOST_CHECK_EQUAL(value, "two again");
+	BOOST_CHECK(!engine.get("b/1", value));
+
+	const auto values = engine.multi_get({"c/1", "b/1", "a/1", "x"});
+	BOOST_REQUIRE_EQUAL(values.size(), 4);
+	BOOST_CHECK(values[0] && *values[0] == "four");
+	BOOST_CHECK(!values[1]);
+	BOOST_CHECK(values[2] && *values[2] == "one");
+	BOOST_CHECK(!values[3]);
+
+	auto snapshot = engine.get_snapshot();
+	engine.put("a/1", "changed");
+	engine.put("a/3", "new");
+	engine.remove("c/1");
+
+	BOOST_CHECK(engine.get("a/1", value, snapshot.get()));
+	BOOST_CHECK_EQUAL(value, "one");
+	BOOST_CHECK(!engine.get("a/3", value, snapshot.get()));
+	BOOST_CHECK(engine.get("c/1", value, snapshot.get()));
+	BOOST_CHECK(engine.get("a/1", value));
+	BOOST_CHECK_EQUAL(value, "changed");
+	BOOST_CHECK(!engine.get("c/1", value));
+
+	std::map<std::string, std::string> scanned;
+	engine.scan_prefix("a/", [&scanned](std::string_view key, std::string_view value) {
+		scanned[std::string(key)] = std::string(value);
+		return true;
+	});
+	BOOST_CHECK_EQUAL(scanned.size(), 3);
+	BOOST_CHECK_EQUAL(scanned["a/1"], "changed");
+	BOOST_CHECK_EQUAL(scanned["a/3"], "new");
+
+	scanned.clear();
+	engine.scan("", "", [&scanned](std::string_view key, std::string_view value) {
+		scanned[std::string(key)] = std::string(value);
+		return true;
+	}, snapshot.get());
+	BOOST_CHECK_EQUAL(scanned.size(), 3);
+	BOOST_CHECK_EQUAL(scanned["a/1"], "one");
+	BOOST_CHECK_EQUAL(scanned["c/1"], "four");
+
+	size_t num_visited = 0;
+	engine.scan("", "", [&num_visited](std::string_view, std::string_view) {
+		return ++num_visited < 2;
+	});
+	BOOST_CHECK_EQUAL(num_visited, 2);
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_engine) {
+
+	const std::string path = "/tmp/key_value_leveldb_test";
+	boost::filesystem::remove_all(path);
+	{
+		KeyValueStore kv_store(path, key_value::engine_leveldb);
+		check_engine(kv_store.engine());
+	}
+	boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(hash_log_engine) {
+
+	const std::string path = "/tmp/key_value_hash_log_test";
+	boost::filesystem::remove_all(path);
+	{
+		KeyValueStore kv_store(path, key_value::engine_hash_log);
+		check_engine(kv_store.engine());
+	}
+
+	// The index is rebuilt from the log.
+	key_value::hash_log_engine engine(path);
+	std::string value;
+	BOOST_CHECK_EQUAL(engine.size(), 3);
+	BOOST_CHECK(engine.get("a/1", value));
+	BOOST_CHECK_EQUAL(value, "changed");
+	BOOST_CHECK(!engine.get("b/1", value));
+	BOOST_CHECK(!engine.get("c/1", value));
+
+	// Fixed 64 bit keys and enough keys to grow the index a few times.
+	for (uint64_t i = 0; i < 5000; i++) {
+		engine.put(std::string((const char *)&i, sizeof(i)), std::to_string(i));
+	}
+	for (uint64_t i = 0; i < 5000; i += 2) {
+		engine.put(std::string((const char *)&i, sizeof(i)), "overwritten");
+	}
+	BOOST_CHECK_EQUAL(engine.size(), 5003);
+	for (uint64_t i = 0; i < 5000; i++) {
+		BOOST_REQUIRE(engine.get(std::string((const char *)&i, sizeof(i)), value));
+		BOOST_CHECK_EQUAL(value, i % 2 ? std::to_string(i) : "overwritten");
+	}
+
+	const size_t live_bytes = engine.live_bytes();
+	BOOST_CHECK(engine.dead_bytes() > 0);
+
+	// Compaction waits for snapshots.
+	{
+		auto snapshot = engine.get_snapshot();
+		engine.compact();
+		BOOST_CHECK(engine.dead_bytes() > 0);
+	}
+	engine.compact();
+	BOOST_CHECK_EQUAL(engine.dead_bytes(), 0);
+	BOOST_CHECK_EQUAL(engine.live_bytes(), live_bytes);
+	BOOST_CHECK_EQUAL(boost::filesystem::file_size(path + "/data.log"), live_bytes);
+	BOOST_CHECK(engine.get("a/3", value));
+	BOOST_CHECK_EQUAL(value, "new");
+	const uint64_t key = 4999;
+	BOOST_CHECK(engine.get(std::string((const char *)&key, sizeof(key)), value));
+	BOOST_CHECK_EQUAL(value, "4999");
+
+	engine.put("last", "cut off");
+}
+
+BOOST_AUTO_TEST_CASE(hash_log_engine_recovery) {
+
+	// A record cut off by a crash is dropped when the log is opened.
+	const std::string path = "/tmp/key_value_hash_log_test";
+	const uintmax_t log_size = boost::filesystem::file_size(path + "/data.log");
+	boost::filesystem::resize_file(path + "/data.log", log_size - 2);
+
+	{
+		key_value::hash_log_engine engine(path);
+		std::string value;
+		BOOST_CHECK(!engine.get("last", value));
+		BOOST_CHECK(engine.get("a/3", value));
+		BOOST_CHECK_EQUAL(engine.size(), 5003);
+
+		engine.put("after", "crash");
+	}
+
+	key_value::hash_log_engine engine(path);
+	std::string value;
+	BOOST_CHECK(engine.get("after", value));
+	BOOST_CHECK_EQUAL(value, "crash");
+
+	boost::filesystem::remove_all(path);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
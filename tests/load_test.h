@@ -0,0 +1,145 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "load_test/histogram.h"
+#include "load_test/zipf.h"
+#include "load_test/fcgi_client.h"
+#include "load_test/load_test.h"
+
+BOOST_AUTO_TEST_SUITE(load_tests)
+
+BOOST_AUTO_TEST_CASE(histogram_percentiles) {
+
+	::load_test::histogram hist;
+
+	BOOST_CHECK_EQUAL(hist.count(), 0);
+	BOOST_CHECK_EQUAL(hist.percentile(50.0), 0);
+
+	for (uint64_t i = 1; i <= 100000; i++) {
+		hist.record(i);
+	}
+
+	BOOST_CHECK_EQUAL(hist.count(), 100000);
+	BOOST_CHECK_EQUAL(hist.min(), 1);
+	BOOST_CHECK_EQUAL(hist.max(), 100000);
+	BOOST_CHECK_CLOSE(hist.mean(), 50000.5, 0.001);
+
+	// Relative error is below 2^-7 with the default precision.
+	BOOST_CHECK_CLOSE((double)hist.percentile(50.0), 50000.0, 1.0);
+	BOOST_CHECK_CLOSE((double)hist.percentile(90.0), 90000.0, 1.0);
+	BOOST_CHECK_CLOSE((double)hist.percentile(99.0), 99000.0, 1.0);
+	BOOST_CHECK_CLOSE((double)hist.percentile(99.9), 99900.0, 1.0);
+	BOOST_CHECK_EQUAL(hist.percentile(100.0), 100000);
+
+	// Small values are exact.
+	::load_test::histogram small;
+	small.record(3);
+	small.record(5);
+	small.record(7);
+	BOOST_CHECK_EQUAL(small.percentile(50.0), 5);
+	BOOST_CHECK_EQUAL(small.buckets().size(), 3);
+
+	::load_test::histogram merged;
+	merged.merge(small);
+	merged.merge(hist);
+	BOOST_CHECK_EQUAL(merged.count(), 100003);
+	BOOST_CHECK_EQUAL(merged.min(), 1);
+	BOOST_CHECK_EQUAL(merged.max(), 100000);
+
+	size_t total = 0;
+	for (const auto &b : merged.buckets()) {
+		total += b.m_count;
+	}
+	BOOST_CHECK_EQUAL(total, 100003);
+}
+
+BOOST_AUTO_TEST_CASE(zipf_skew) {
+
+	std::mt19937_64 gen(1);
+	::load_test::zipf_distribution dist(1000, 1.0);
+
+	std::vector<size_t> counts(1000, 0);
+	for (size_t i = 0; i < 100000; i++) {
+		const size_t rank = dist(gen);
+		BOOST_REQUIRE(rank < 1000);
+		counts[rank]++;
+	}
+
+	// P(0) = 1 / H(1000) ~ 0.134 and P(0) / P(1) = 2
+	BOOST_CHECK(counts[0] > 12500 && counts[0] < 14500);
+	BOOST_CHECK(counts[0] > counts[1] * 1.8 && counts[0] < counts[1] * 2.2);
+	BOOST_CHECK(counts[1] > counts[10]);
+}
+
+BOOST_AUTO_TEST_CASE(fcgi_encode) {
+
+	const std::string params = ::load_test::fcgi::encode_params({{"REQUEST_URI", "/?q=test"}, {std::string(200, 'a'), ""}});
+
+	BOOST_REQUIRE_EQUAL(params.size(), 2 + 11 + 8 + 5 + 200);
+	BOOST_CHECK_EQUAL(params[0], 11);
+	BOOST_CHECK_EQUAL(params[1], 8);
+	BOOST_CHECK_EQUAL(params.substr(2, 19), "REQUEST_URI/?q=test");
+	// Lengths above 127 are encoded in four bytes with the high bit set.
+	BOOST_CHECK_EQUAL((uint8_t)params[21], 0x80);
+	BOOST_CHECK_EQUAL((uint8_t)params[24], 200);
+	BOOST_CHECK_EQUAL(params[25], 0);
+
+	const std::string request = ::load_test::fcgi::encode_request(1, {{"A", "B"}});
+
+	// begin request, params, empty params, empty stdin
+	BOOST_REQUIRE_EQUAL(request.size(), 16 + 16 + 8 + 8);
+	BOOST_CHECK_EQUAL(request[0], 1);
+	BOOST_CHECK_EQUAL(request[1], 1);
+	BOOST_CHECK_EQUAL(request[3], 1);
+	BOOST_CHECK_EQUAL(request[5], 8);
+	BOOST_CHECK_EQUAL(request[9], 1);
+	BOOST_CHECK_EQUAL(request[17], 4);
+	BOOST_CHECK_EQUAL(request[21], 4);
+	BOOST_CHECK_EQUAL(request[22], 4);
+	BOOST_CHECK_EQUAL(request.substr(24, 4), std::string("\x01\x01" "AB", 4));
+	BOOST_CHECK_EQUAL(request[33], 4);
+	BOOST_CHECK_EQUAL(request[37], 0);
+	BOOST_CHECK_EQUAL(request[41], 5);
+}
+
+BOOST_AUTO_TEST_CASE(synthetic_query_log) {
+
+	::load_test::options opts;
+	opts.m_queries = 50;
+	opts.m_requests = 1000;
+
+	const std::vector<std::string> queries = ::load_test::query_log(opts);
+	BOOST_CHECK_EQUAL(queries.size(), 1000);
+	BOOST_CHECK(queries == ::load_test::query_log(opts));
+
+	std::set<std::string> unique(queries.begin(), queries.end());
+	BOOST_CHECK(unique.size() <= 50);
+
+	BOOST_CHECK_EQUAL(::load_test::synthetic_word(0), "loka");
+	BOOST_CHECK(::load_test::synthetic_word(1) != ::load_test::synthetic_word(2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -61,7 +61,6 @@ using std::pair;
 #include "api.h"
 #include "search_engine.h"
 #include "configuration.h"
-#include "performance.h"
 #include "sort.h"
 #include "algorithm.h"
 #include "deduplication.h"
@@ -83,6 +82,9 @@ using std::pair;
 #include "index_array.h"
 #include "memory.h"
 #include "thread_pool.h"
+#include "load_test.h"
+#include "host_graph.h"
+#include "merger.h"
 
 void run_before() {
 	Config::read_config("../tests/test_config.conf");
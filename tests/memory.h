@@ -25,6 +25,9 @@
  */
 
 #include "memory/memory.h"
+#include "memory/debugger.h"
+#include <thread>
+#include <fcntl.h>
 
 BOOST_AUTO_TEST_SUITE(memory)
 
@@ -33,4 +36,105 @@ BOOST_AUTO_TEST_CASE(mem) {
 	std::cout << "available_memory:" << available_memory << std::endl;
 }
 
+BOOST_AUTO_TEST_CASE(memory_counters_threads) {
+
+	const size_t num_threads = 8;
+	const size_t num_allocations = 1000;
+	std::vector<std::vector<char *>> pointers(num_threads, std::vector<char *>(num_allocations));
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads);
+
+	const size_t mem_start = memory::allocated_memory();
+	const size_t num_start = memory::num_allocated();
+
+	for (size_t t = 0; t < num_threads; t++) {
+		threads.emplace_back([t, &pointers]() {
+			for (size_t i = 0; i < num_allocations; i++) {
+				pointers[t][i] = new char[100];
+			}
+			for (size_t i = 0; i < num_allocations / 2; i++) {
+				delete [] pointers[t][i];
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+
+	BOOST_CHECK_EQUAL(memory::num_allocated(), num_start + num_threads * num_allocations / 2);
+	BOOST_CHECK_EQUAL(memory::allocated_memory(), mem_start + num_threads * num_allocations / 2 * 100);
+
+	// Freeing on another thread than the allocating one.
+	for (size_t t = 0; t < num_threads; t++) {
+		for (size_t i = num_allocations / 2; i < num_allocations; i++) {
+			delete [] pointers[t][i];
+		}
+	}
+
+	BOOST_CHECK_EQUAL(memory::num_allocated(), num_start);
+	BOOST_CHECK_EQUAL(memory::allocated_memory(), mem_start);
+}
+
+BOOST_AUTO_TEST_CASE(memory_size_histogram) {
+
+	std::vector<char *> pointers(11);
+
+	memory::enable_size_histogram(true);
+	const std::array<size_t, memory::num_size_classes> before = memory::size_histogram();
+
+	for (size_t i = 0; i < 10; i++) {
+		pointers[i] = new char[1000];
+	}
+	pointers[10] = new char[1024];
+
+	const std::array<size_t, memory::num_size_classes> after = memory::size_histogram();
+	memory::enable_size_histogram(false);
+
+	for (char *p : pointers) {
+		delete [] p;
+	}
+
+	BOOST_CHECK_GE(after[10] - before[10], 10); // [512, 1024)
+	BOOST_CHECK_GE(after[11] - before[11], 1); // [1024, 2048)
+}
+
+__attribute__((noinline)) void memory_profiled_allocations(std::vector<char *> &pointers) {
+	for (char *&p : pointers) {
+		p = new char[4096];
+	}
+}
+
+BOOST_AUTO_TEST_CASE(memory_heap_profiler) {
+
+	std::vector<char *> pointers(100);
+
+	memory::enable_heap_profiler(1);
+	memory_profiled_allocations(pointers);
+	memory::disable_heap_profiler();
+
+	for (char *p : pointers) {
+		delete [] p;
+	}
+
+	const std::vector<memory::heap_profile_site> profile = memory::heap_profile();
+	BOOST_REQUIRE(profile.size() > 0);
+	BOOST_CHECK_EQUAL(profile[0].m_count, 100);
+	BOOST_CHECK_EQUAL(profile[0].m_bytes, 100 * 4096);
+	BOOST_CHECK(profile[0].m_frames.size() > 0);
+
+	const std::string dump_file = "/tmp/alexandria_heap_profile.txt";
+	const int fd = open(dump_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	BOOST_REQUIRE(fd >= 0);
+	memory::dump_heap_profile(fd, 5);
+	close(fd);
+
+	std::ifstream infile(dump_file);
+	std::string line;
+	std::getline(infile, line);
+	BOOST_CHECK(line.find("heap profile") == 0);
+	std::getline(infile, line);
+	BOOST_CHECK_EQUAL(line, "#0 bytes: 409600 allocations: 100");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ *
+ * Alexandria.org
+ *
+ * Copyright (c) 2021 Josef Cullhed, <info@alexandria.org>, et al.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "indexer/merger.h"
+#include "config.h"
+#include <thread>
+#include <atomic>
+
+BOOST_AUTO_TEST_SUITE(merger)
+
+BOOST_AUTO_TEST_CASE(merger_largest_first) {
+
+	const size_t threads_per_disk = Config::merger_threads_per_disk;
+	Config::merger_threads_per_disk = 1;
+
+	std::mutex lock;
+	std::vector<size_t> appended;
+	std::vector<size_t> merged;
+
+	const std::vector<size_t> sizes = {10, 40, 20, 30};
+	for (size_t i = 0; i < sizes.size(); i++) {
+		const size_t size = sizes[i];
+		indexer::merger::register_builder(i, 0, [size]() { return size; },
+			[size, &lock, &appended]() {
+				std::lock_guard<std::mutex> guard(lock);
+				appended.push_back(size);
+			},
+			[size, &lock, &merged]() {
+				std::lock_guard<std::mutex> guard(lock);
+				merged.push_back(size);
+			});
+	}
+
+	indexer::merger::append_all();
+	indexer::merger::merge_all();
+
+	BOOST_CHECK((appended == std::vector<size_t>{40, 30, 20, 10}));
+	BOOST_CHECK((merged == std::vector<size_t>{40, 30, 20, 10}));
+
+	for (size_t i = 0; i < sizes.size(); i++) {
+		indexer::merger::deregister_builder(i);
+	}
+
+	// Deregistered builders are not flushed.
+	appended.clear();
+	indexer::merger::append_all();
+	BOOST_CHECK_EQUAL(appended.size(), 0);
+
+	Config::merger_threads_per_disk = threads_per_disk;
+}
+
+BOOST_AUTO_TEST_CASE(merger_per_disk_limit) {
+
+	const size_t threads_per_disk = Config::merger_threads_per_disk;
+	Config::merger_threads_per_disk = 2;
+
+	const size_t num_disks = 3;
+	std::array<std::atomic<size_t>, num_disks> running{};
+	std::array<std::atomic<size_t>, num_disks> max_running{};
+	std::atomic<size_t> num_appended = 0;
+
+	for (size_t i = 0; i < 18; i++) {
+		const size_t disk = i % num_disks;
+		indexer::merger::register_builder(i, disk, []() { return 1; },
+			[disk, &running, &max_running, &num_appended]() {
+				const size_t now = ++running[disk];
+				size_t prev = max_running[disk];
+				while (prev < now && !max_running[disk].compare_exchange_weak(prev, now));
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				running[disk]--;
+				num_appended++;
+			}, []() {});
+	}
+
+	indexer::merger::append_all();
+
+	BOOST_CHECK_EQUAL(num_appended, 18);
+	for (size_t disk = 0; disk < num_disks; disk++) {
+		BOOST_CHECK(max_running[disk] >= 1);
+		BOOST_CHECK(max_running[disk] <= 2);
+	}
+
+	for (size_t i = 0; i < 18; i++) {
+		indexer::merger::deregister_builder(i);
+	}
+
+	Config::merger_threads_per_disk = threads_per_disk;
+}
+
+BOOST_AUTO_TEST_CASE(merger_wait_while_flushing) {
+
+	std::atomic<bool> started = false;
+	std::atomic<bool> release = false;
+
+	auto flushed = indexer::merger::register_builder(1, 0, []() { return 1; }, [&started, &release]() {
+		started = true;
+		while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}, []() {});
+	auto other = indexer::merger::register_builder(2, 0, []() { return 1; }, []() {}, []() {});
+
+	std::thread flusher([flushed]() { flushed->append(); });
+	while (!started) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	// Only adds to the builder being flushed wait.
+	other->wait_while_flushing();
+
+	std::atomic<bool> waited = false;
+	std::thread adder([flushed, &waited]() {
+		flushed->wait_while_flushing();
+		waited = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	BOOST_CHECK(!waited);
+
+	release = true;
+	adder.join();
+	flusher.join();
+	BOOST_CHECK(waited);
+
+	indexer::merger::deregister_builder(1);
+	indexer::merger::deregister_builder(2);
+	BOOST_CHECK(!flushed->append());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -25,11 +25,475 @@
  */
 
 #include "scraper/scraper.h"
+#include "scraper/event_loop.h"
+#include "scraper/timer_wheel.h"
 #include <queue>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 BOOST_AUTO_TEST_SUITE(scraper)
 
+/*
+ * Minimal HTTP/1.1 server on 127.0.0.1 for the scraper tests. GET and POST requests are answered from a table of host
+ * and path, other POST requests and all PUT requests (store uploads) get an empty 200 response. Connections are kept
+ * alive.
+ * */
+class http_stub {
+	public:
+
+		http_stub() {
+			m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+			int one = 1;
+			setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+			sockaddr_in addr{};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			addr.sin_port = 0;
+			bind(m_listen_fd, (sockaddr *)&addr, sizeof(addr));
+			listen(m_listen_fd, 64);
+
+			socklen_t len = sizeof(addr);
+			getsockname(m_listen_fd, (sockaddr *)&addr, &len);
+			m_port = ntohs(addr.sin_port);
+
+			m_accept_thread = std::thread([this]() {
+				accept_loop();
+			});
+		}
+
+		~http_stub() {
+			shutdown(m_listen_fd, SHUT_RDWR);
+			close(m_listen_fd);
+			m_accept_thread.join();
+
+			m_lock.lock();
+			for (int fd : m_fds) shutdown(fd, SHUT_RDWR);
+			m_lock.unlock();
+
+			for (std::thread &thread : m_threads) thread.join();
+			for (int fd : m_fds) close(fd);
+		}
+
+		size_t port() const { return m_port; }
+		void set_page(const std::string &host, const std::string &path, const std::string &body) {
+			m_pages[host + path] = body;
+		}
+		void set_delay_ms(size_t delay_ms) { m_delay_ms = delay_ms; }
+
+		std::vector<std::string> requests() {
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_requests;
+		}
+
+		size_t num_connections(const std::string &host) {
+			std::lock_guard<std::mutex> lock(m_lock);
+			return m_connections[host];
+		}
+
+		size_t max_concurrent_gets() const { return m_max_concurrent_gets; }
+
+	private:
+
+		int m_listen_fd;
+		size_t m_port;
+		size_t m_delay_ms = 0;
+		std::thread m_accept_thread;
+		std::mutex m_lock;
+		std::vector<int> m_fds;
+		std::vector<std::thread> m_threads;
+		std::map<std::string, std::string> m_pages;
+		std::vector<std::string> m_requests;
+		std::map<std::string, size_t> m_connections;
+		size_t m_concurrent_gets = 0;
+		size_t m_max_concurrent_gets = 0;
+
+		void accept_loop() {
+			while (true) {
+				const int fd = accept(m_listen_fd, nullptr, nullptr);
+				if (fd < 0) break;
+				std::lock_guard<std::mutex> lock(m_lock);
+				m_fds.push_back(fd);
+				m_threads.emplace_back([this, fd]() {
+					serve(fd);
+				});
+			}
+		}
+
+		bool fill(int fd, std::string &buffer) {
+			char chunk[4096];
+			const ssize_t len = recv(fd, chunk, sizeof(chunk), 0);
+			if (len <= 0) return false;
+			buffer.append(chunk, len);
+			return true;
+		}
+
+		// Reads a chunked request body, the data itself is not needed.
+		bool skip_chunked_body(int fd, std::string &buffer) {
+			while (true) {
+				size_t line_end;
+				while ((line_end = buffer.find("\r\n")) == std::string::npos) {
+					if (!fill(fd, buffer)) return false;
+				}
+				const size_t chunk_len = std::stoull(buffer.substr(0, line_end), nullptr, 16);
+				while (buffer.size() < line_end + 2 + chunk_len + 2) {
+					if (!fill(fd, buffer)) return false;
+				}
+				buffer.erase(0, line_end + 2 + chunk_len + 2);
+				if (chunk_len == 0) return true;
+			}
+		}
+
+		void serve(int fd) {
+			std::string buffer;
+			bool first_request = true;
+			while (true) {
+				size_t head_end;
+				while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+					if (!fill(fd, buffer)) return;
+				}
+
+				std::vector<std::string> lines;
+				const std::string head = buffer.substr(0, head_end);
+				boost::algorithm::split(lines, head, boost::is_any_of("\n"));
+				buffer.erase(0, head_end + 4);
+
+				std::vector<std::string> request_line;
+				boost::algorithm::split(request_line, boost::algorithm::trim_copy(lines[0]), boost::is_any_of(" "));
+				const std::string method = request_line[0];
+				const std::string path = request_line[1];
+
+				std::string host;
+				size_t content_len = 0;
+				bool chunked = false;
+				bool expect_continue = false;
+				for (size_t i = 1; i < lines.size(); i++) {
+					const size_t colon = lines[i].find(':');
+					if (colon == std::string::npos) continue;
+					const std::string name = boost::algorithm::to_lower_copy(lines[i].substr(0, colon));
+					const std::string value = boost::algorithm::trim_copy(lines[i].substr(colon + 1));
+					if (name == "host") host = value.substr(0, value.find(':'));
+					if (name == "content-length") content_len = std::stoull(value);
+					if (name == "transfer-encoding") chunked = value == "chunked";
+					if (name == "expect") expect_continue = true;
+				}
+
+				if (expect_continue) {
+					const std::string cont = "HTTP/1.1 100 Continue\r\n\r\n";
+					send(fd, cont.c_str(), cont.size(), MSG_NOSIGNAL);
+				}
+				if (chunked) {
+					if (!skip_chunked_body(fd, buffer)) return;
+				} else {
+					while (buffer.size() < content_len) {
+						if (!fill(fd, buffer)) return;
+					}
+					buffer.erase(0, content_len);
+				}
+
+				const bool is_get = method == "GET";
+				{
+					std::lock_guard<std::mutex> lock(m_lock);
+					m_requests.push_back(method + " " + host + path);
+					if (first_request) m_connections[host]++;
+					if (is_get) {
+						m_concurrent_gets++;
+						m_max_concurrent_gets = std::max(m_max_concurrent_gets, m_concurrent_gets);
+					}
+				}
+				first_request = false;
+
+				if (is_get) std::this_thread::sleep_for(std::chrono::milliseconds(m_delay_ms));
+
+				int code = 200;
+				std::string body;
+				auto iter = m_pages.find(host + path);
+				if (method != "PUT" && iter != m_pages.end()) {
+					body = iter->second;
+				} else if (method == "GET") {
+					code = 404;
+					body = "not found";
+				}
+
+				const std::string response = "HTTP/1.1 " + std::to_string(code) + (code == 200 ? " OK" : " Not Found") +
+					"\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: " + std::to_string(body.size()) +
+					"\r\n\r\n" + body;
+
+				if (is_get) {
+					std::lock_guard<std::mutex> lock(m_lock);
+					m_concurrent_gets--;
+				}
+
+				if (send(fd, response.c_str(), response.size(), MSG_NOSIGNAL) < 0) return;
+			}
+		}
+};
+
+BOOST_AUTO_TEST_CASE(timer_wheel) {
+
+	Scraper::timer_wheel<int> wheel(8, 10, 1000);
+
+	wheel.schedule(1, 0);
+	wheel.schedule(2, 25);
+	wheel.schedule(3, 75);
+	wheel.schedule(4, 200); // More than one turn of the wheel.
+	BOOST_CHECK_EQUAL(wheel.size(), 4);
+	BOOST_CHECK_EQUAL(wheel.ms_until_next_tick(1004), 6);
+
+	std::vector<int> expired;
+	auto collect = [&expired](int item) {
+		expired.push_back(item);
+	};
+
+	wheel.advance(1009, collect);
+	BOOST_CHECK(expired.empty());
+
+	wheel.advance(1010, collect);
+	BOOST_CHECK(expired == std::vector<int>({1}));
+
+	wheel.advance(1030, collect);
+	BOOST_CHECK(expired == std::vector<int>({1, 2}));
+
+	wheel.advance(1190, collect);
+	BOOST_CHECK(expired == std::vector<int>({1, 2, 3}));
+	BOOST_CHECK_EQUAL(wheel.size(), 1);
+
+	// Items scheduled from the callback land in later slots.
+	wheel.advance(1200, [&wheel, &expired](int item) {
+		expired.push_back(item);
+		wheel.schedule(item + 1, 10);
+	});
+	BOOST_CHECK(expired == std::vector<int>({1, 2, 3, 4}));
+
+	wheel.advance(1210, collect);
+	BOOST_CHECK(expired == std::vector<int>({1, 2, 3, 4, 5}));
+	BOOST_CHECK(wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(robots_rules) {
+
+	const std::string token = Scraper::user_agent_token();
+
+	Scraper::robots_rules global("User-agent: *\n"
+		"Disallow: /private\n"
+		"Allow: /private/open\n"
+		"Disallow: /*.pdf$\n"
+		"\n"
+		"User-agent: OtherBot\n"
+		"Disallow: /\n", token);
+	BOOST_CHECK(global.allowed_path("/"));
+	BOOST_CHECK(!global.allowed_path("/private"));
+	BOOST_CHECK(!global.allowed_path("/private/page"));
+	BOOST_CHECK(global.allowed_path("/private/open/page"));
+	BOOST_CHECK(!global.allowed_path("/doc.pdf"));
+	BOOST_CHECK(global.allowed_path("/doc.pdf?download=1"));
+	BOOST_CHECK(!global.allowed(URL("http://example.com/private/page?a=b")));
+
+	// The group for our user agent replaces the global group.
+	Scraper::robots_rules specific("User-agent: *\n"
+		"Disallow: /\n"
+		"\n"
+		"User-agent: " + boost::algorithm::to_lower_copy(token) + "\n"
+		"Disallow: /admin\n", token);
+	BOOST_CHECK(specific.allowed_path("/"));
+	BOOST_CHECK(!specific.allowed_path("/admin/users"));
+
+	Scraper::robots_rules empty_disallow("User-agent: *\n"
+		"Disallow: /\n"
+		"\n"
+		"User-agent: " + token + "/1.0\n"
+		"Disallow:\n", token);
+	BOOST_CHECK(empty_disallow.allowed_path("/anything"));
+
+	// Allow wins a tie.
+	Scraper::robots_rules tie("User-agent: *\nDisallow: /page\nAllow: /page\n", token);
+	BOOST_CHECK(tie.allowed_path("/page"));
+
+	Scraper::robots_rules not_robots("<html><body>Not found</body></html>", token);
+	BOOST_CHECK(not_robots.allowed_path("/"));
+	BOOST_CHECK_EQUAL(not_robots.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(robots_cache) {
+
+	Scraper::robots_cache cache(100, 2);
+	auto rules = std::make_shared<Scraper::robots_rules>("User-agent: *\nDisallow: /private\n",
+		Scraper::user_agent_token());
+
+	cache.put("a.com", rules, 1000);
+	BOOST_CHECK(cache.get("a.com", 1050) == rules);
+	BOOST_CHECK(cache.get("a.com", 1100) == nullptr);
+	BOOST_CHECK(cache.get("b.com", 1050) == nullptr);
+	BOOST_CHECK_EQUAL(cache.hits(), 1);
+	BOOST_CHECK_EQUAL(cache.misses(), 2);
+
+	// Only records fetched within the ttl are loaded from the url store.
+	UrlStore::RobotsData fresh;
+	fresh.m_domain = "b.com";
+	fresh.m_robots = "User-agent: *\nDisallow: /\n";
+	fresh.m_fetched_at = 1040;
+	UrlStore::RobotsData stale = fresh;
+	stale.m_domain = "c.com";
+	stale.m_fetched_at = 900;
+	UrlStore::RobotsData missing;
+
+	cache.load({fresh, stale, missing}, 1050);
+	BOOST_CHECK(cache.contains("b.com", 1050));
+	BOOST_CHECK(!cache.contains("c.com", 1050));
+	BOOST_CHECK(!cache.get("b.com", 1050)->allowed_path("/page"));
+
+	// The cache is full, the expired entry of a.com is dropped first.
+	cache.put("d.com", rules, 1100);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+	BOOST_CHECK(cache.contains("b.com", 1100));
+	BOOST_CHECK(cache.contains("d.com", 1100));
+
+	cache.put("e.com", rules, 1110);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+	BOOST_CHECK(cache.contains("e.com", 1110));
+}
+
+BOOST_AUTO_TEST_CASE(robots_fetch_failed) {
+
+	// Uploads from the store go to the stub.
+	http_stub stub;
+	const std::string upload = Config::upload;
+	Config::upload = "127.0.0.1:" + std::to_string(stub.port());
+
+	Scraper::robots_cache cache(100, 10);
+	{
+		Scraper::store store;
+
+		// A robots.txt request that times out disallows the host for this run and is not cached.
+		Scraper::scraper scraper("failed.test", &store);
+		scraper.set_robots_cache(&cache);
+		scraper.push_url(URL("http://failed.test/"));
+		scraper.handle_robots_response(scraper.robots_url(), CURLE_OPERATION_TIMEDOUT);
+
+		URL url;
+		BOOST_CHECK(!scraper.next_url(url));
+		BOOST_CHECK(!cache.contains("failed.test", time(nullptr)));
+	}
+
+	Config::upload = upload;
+
+	// A stored failed fetch is not loaded either, even with a fresh fetch time from an earlier fetch.
+	UrlStore::RobotsData failed;
+	failed.m_domain = "failed.test";
+	failed.m_robots = "User-agent: *\nDisallow: /private\n";
+	failed.m_fetched_at = time(nullptr);
+	failed.m_fetch_failed = true;
+	cache.load({failed}, time(nullptr));
+	BOOST_CHECK(!cache.contains("failed.test", time(nullptr)));
+}
+
+BOOST_AUTO_TEST_CASE(event_loop_scraper) {
+
+	http_stub stub;
+	stub.set_delay_ms(20);
+
+	auto page = [](const std::string &title) {
+		return "<html><head><meta charset=\"utf-8\"><title>" + title + "</title></head><body><h1>" + title +
+			"</h1><p>Some text on the page about " + title + ".</p><a href=\"/other\">other page</a></body></html>";
+	};
+
+	stub.set_page("a.test", "/robots.txt", "User-agent: *\nDisallow: /private\n");
+	stub.set_page("a.test", "/", page("a start"));
+	stub.set_page("a.test", "/1", page("a first"));
+	stub.set_page("a.test", "/2", page("a second"));
+	stub.set_page("a.test", "/private", page("a private"));
+	stub.set_page("b.test", "/", page("b start"));
+	stub.set_page("b.test", "/1", page("b first"));
+	stub.set_page("c.test", "/", page("c start"));
+	stub.set_page("c.test", "/secret", page("c secret"));
+	stub.set_page("a.test", "/3", page("a third"));
+
+	// The robots.txt of c.test was fetched before and comes from the url store.
+	UrlStore::RobotsData stored_robots;
+	stored_robots.m_domain = "c.test";
+	stored_robots.m_robots = "User-agent: *\nDisallow: /secret\n";
+	stored_robots.m_fetched_at = time(nullptr);
+	std::string robots_response;
+	UrlStore::append_data_str(stored_robots, robots_response);
+	stub.set_page("127.0.0.1", "/store/robots", robots_response);
+
+	// Uploads from the store go to the stub as well.
+	const std::string upload = Config::upload;
+	const std::string url_store_host = Config::url_store_host;
+	Config::upload = "127.0.0.1:" + std::to_string(stub.port());
+	Config::url_store_host = "http://127.0.0.1:" + std::to_string(stub.port());
+
+	std::string last;
+	{
+		Scraper::store store;
+		Scraper::engine engine(&store, 2, 1);
+		engine.set_timeout(0);
+		engine.set_connect_to({"::127.0.0.1:" + std::to_string(stub.port())});
+		engine.start_threads();
+
+		engine.push_urls({
+			"http://a.test/",
+			"http://a.test/1",
+			"http://a.test/private",
+			"http://a.test/2",
+			"http://a.test/missing",
+			"http://b.test/",
+			"http://b.test/1",
+			"http://c.test/",
+			"http://c.test/secret",
+		});
+		engine.wait();
+		BOOST_CHECK_EQUAL(engine.size(), 0);
+
+		// A new run on a.test uses the robots.txt rules in the cache.
+		engine.push_urls({"http://a.test/3"});
+		engine.wait();
+		BOOST_CHECK_EQUAL(engine.robots().hits(), 2);
+
+		last = store.tail();
+	}
+
+	Config::upload = upload;
+	Config::url_store_host = url_store_host;
+
+	std::vector<std::string> cols;
+	boost::algorithm::split(cols, last, boost::is_any_of("\t"));
+	BOOST_REQUIRE(cols.size() > 2);
+	BOOST_CHECK(cols[0].find(".test/") != std::string::npos);
+
+	const std::vector<std::string> requests = stub.requests();
+	std::map<std::string, std::vector<std::string>> gets;
+	for (const std::string &request : requests) {
+		if (request.substr(0, 4) != "GET ") continue;
+		const std::string url = request.substr(4);
+		const std::string host = url.substr(0, url.find('/'));
+		gets[host].push_back(url.substr(host.size()));
+	}
+
+	// robots.txt first and the disallowed urls are never requested.
+	BOOST_CHECK(gets["a.test"] == std::vector<std::string>({"/robots.txt", "/", "/1", "/2", "/missing", "/3"}));
+	BOOST_CHECK(gets["b.test"] == std::vector<std::string>({"/robots.txt", "/", "/1"}));
+	BOOST_CHECK(gets["c.test"] == std::vector<std::string>({"/"}));
+
+	// All hosts have the same ip so only one request is in flight at a time, robots.txt included.
+	BOOST_CHECK_EQUAL(stub.max_concurrent_gets(), 1);
+
+	// Each host uses one connection for all its requests.
+	BOOST_CHECK_EQUAL(stub.num_connections("a.test"), 1);
+	BOOST_CHECK_EQUAL(stub.num_connections("b.test"), 1);
+	BOOST_CHECK_EQUAL(stub.num_connections("c.test"), 1);
+
+	// The results were uploaded when the store was destroyed.
+	BOOST_CHECK(std::count_if(requests.begin(), requests.end(), [](const std::string &request) {
+		return request.substr(0, 4) == "PUT ";
+	}) > 0);
+}
+
 BOOST_AUTO_TEST_CASE(scraper) {
 
 	Scraper::store store;
@@ -177,4 +177,38 @@ BOOST_AUTO_TEST_CASE(merge_many_arrays_of_struct) {
 
 }
 
+BOOST_AUTO_TEST_CASE(merge_arrays_k_way) {
+
+	{
+		vector<vector<int>> inp{{1, 4, 9}, {}, {2, 3, 10, 11}, {5}, {0, 6, 7, 8}};
+		vector<int> res;
+		Sort::merge_arrays_k_way(inp, [](int a, int b) { return a < b; }, res);
+
+		BOOST_CHECK(res.size() == 12);
+		for (size_t i = 0; i < res.size(); i++) {
+			BOOST_CHECK(res[i] == (int)i);
+		}
+	}
+
+	{
+		vector<vector<int>> inp;
+		for (int i = 0; i < 50; i++) {
+			vector<int> arr;
+			for (int j = i; j < 5000; j += 50) {
+				arr.push_back(j);
+			}
+			inp.push_back(arr);
+		}
+		vector<int> res;
+		Sort::merge_arrays(inp, res);
+
+		vector<int> out(5000);
+		const size_t written = Sort::merge_arrays_k_way(inp, [](int a, int b) { return a < b; }, out.data());
+
+		BOOST_CHECK(written == 5000);
+		BOOST_CHECK(out == res);
+	}
+
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,6 +25,7 @@
  */
 
 #include "text/Text.h"
+#include "text/tokenizer.h"
 
 BOOST_AUTO_TEST_SUITE(text)
 
@@ -155,4 +156,57 @@ BOOST_AUTO_TEST_CASE(word_freq, * boost::unit_test::tolerance(0.00001)) {
 	BOOST_TEST(freq["is"] == 2.0/9.0);
 }
 
+BOOST_AUTO_TEST_CASE(tokenizer_words) {
+
+	const string str = "Hello, WORLD!  (Alexandria) \xff\xfe bad-utf8 Räksmörgås |done";
+
+	vector<string> words;
+	vector<size_t> positions;
+	vector<uint64_t> hashes;
+	text::for_each_full_text_word(str, [&](const text::word &word) {
+		words.emplace_back(word.m_text);
+		positions.push_back(word.m_pos);
+		hashes.push_back(word.hash());
+	});
+
+	BOOST_CHECK(words == vector<string>({"hello", "world", "alexandria", "bad-utf8", "räksmörgås", "done"}));
+	BOOST_CHECK(words == Text::get_full_text_words(str));
+	BOOST_CHECK_EQUAL(str.substr(positions[1], 5), "WORLD");
+	BOOST_CHECK_EQUAL(str.substr(positions[2], 10), "Alexandria");
+	BOOST_CHECK_EQUAL(hashes[4], Hash::str("räksmörgås"));
+
+	words.clear();
+	text::for_each_full_text_word(str, [&](const text::word &word) {
+		words.emplace_back(word.m_text);
+	}, 2);
+	BOOST_CHECK(words == vector<string>({"hello", "world"}));
+
+	words.clear();
+	text::for_each_expanded_full_text_word("www.example.com: -x-", [&](const text::word &word) {
+		words.emplace_back(word.m_text);
+	});
+	BOOST_CHECK(words == vector<string>({"www.example.com", "www", "example", "com", "x"}));
+	BOOST_CHECK(words == Text::get_expanded_full_text_words("www.example.com: -x-"));
+
+	BOOST_CHECK(Text::get_words("Hej Josef, jÜsef 123!") == vector<string>({"hej", "josef", "123"}));
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_ngrams) {
+
+	const string str = "The Library of Alexandria: ancient-knowledge, open source";
+
+	vector<uint64_t> expected;
+	Text::words_to_ngram_hash(Text::get_expanded_full_text_words(str), 3, [&expected](uint64_t hash) {
+		expected.push_back(hash);
+	});
+
+	vector<uint64_t> hashes;
+	text::for_each_expanded_ngram_hash(str, 3, [&hashes](uint64_t hash) {
+		hashes.push_back(hash);
+	});
+
+	BOOST_CHECK(hashes == expected);
+	BOOST_CHECK_EQUAL(hashes[1], Hash::str("the library"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,6 +25,7 @@
  */
 
 #include "utils/thread_pool.hpp"
+#include "utils/query_pool.hpp"
 
 BOOST_AUTO_TEST_SUITE(thread_pool)
 
@@ -71,4 +72,68 @@ BOOST_AUTO_TEST_CASE(thread_pool2) {
 	
 }
 
+BOOST_AUTO_TEST_CASE(query_pool) {
+	utils::query_pool pool(4);
+
+	BOOST_CHECK(pool.num_threads() == 4);
+	BOOST_CHECK(pool.num_nodes() >= 1);
+
+	vector<int> vec(1000);
+	utils::query_pool::query query(pool);
+	for (int &i : vec) {
+		query.submit([&i]() {
+			i++;
+		});
+	}
+	query.wait();
+
+	for (int i : vec) {
+		BOOST_CHECK(i == 1);
+	}
+
+	// The pool is reused by the next query.
+	std::atomic<size_t> sum = 0;
+	utils::query_pool::query query2(pool);
+	for (size_t i = 0; i < 8; i++) {
+		query2.submit([&sum]() {
+			volatile size_t x = 0;
+			for (size_t j = 0; j < 10000000; j++) x = x + j;
+			sum++;
+		});
+	}
+	query2.wait();
+
+	BOOST_CHECK(sum == 8);
+	BOOST_CHECK(query2.cpu_time() > 0.0);
+	BOOST_CHECK(query2.cpu_time() >= query.cpu_time());
+}
+
+BOOST_AUTO_TEST_CASE(query_pool_nested) {
+	utils::query_pool pool(2);
+
+	// Tasks waiting for their own sub tasks must not deadlock the pool even when all workers are waiting.
+	std::atomic<size_t> count = 0;
+	utils::query_pool::query query(pool);
+	for (size_t i = 0; i < 8; i++) {
+		query.submit([&pool, &count]() {
+			utils::query_pool::query inner(pool);
+			for (size_t j = 0; j < 8; j++) {
+				inner.submit([&count]() {
+					count++;
+				});
+			}
+			inner.wait();
+		});
+	}
+	query.wait();
+
+	BOOST_CHECK(count == 64);
+
+	utils::query_pool::query failing(pool);
+	failing.submit([]() {
+		throw std::runtime_error("task failed");
+	});
+	BOOST_CHECK_THROW(failing.wait(), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
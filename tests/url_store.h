@@ -25,6 +25,9 @@
  */
 
 #include "urlstore/UrlStore.h"
+#include "urlstore/record_codec.h"
+#include "urlstore/bloom_filter.h"
+#include "hash/Hash.h"
 #include "json.hpp"
 
 using namespace std::literals::chrono_literals;
@@ -80,6 +83,7 @@ BOOST_AUTO_TEST_CASE(robots_data) {
 		"Disallow: /\n";
 	data.m_domain = "test.com";
 	data.m_robots = robots_content;
+	data.m_fetched_at = 1650000000;
 
 	string string_data = data.to_str();
 
@@ -87,6 +91,117 @@ BOOST_AUTO_TEST_CASE(robots_data) {
 
 	BOOST_CHECK_EQUAL(data2.m_domain, "test.com");
 	BOOST_CHECK_EQUAL(data2.m_robots, robots_content);
+	BOOST_CHECK_EQUAL(data2.m_fetched_at, 1650000000);
+	BOOST_CHECK(!data2.m_fetch_failed);
+
+	// A failed fetch is stored but keeps the robots.txt and fetch time we had.
+	UrlStore::RobotsData failed;
+	failed.m_domain = "test.com";
+	failed.m_fetch_failed = true;
+	UrlStore::RobotsData failed2(failed.to_str());
+	BOOST_CHECK(failed2.m_fetch_failed);
+
+	data2.apply_update(failed2, UrlStore::update_robots);
+	BOOST_CHECK(data2.m_fetch_failed);
+	BOOST_CHECK_EQUAL(data2.m_robots, robots_content);
+	BOOST_CHECK_EQUAL(data2.m_fetched_at, 1650000000);
+
+	data2.apply_update(data, UrlStore::update_robots);
+	BOOST_CHECK(!data2.m_fetch_failed);
+
+	// Records stored before record_codec, with and without the fetch time.
+	std::string legacy_data;
+	const size_t domain_len = data.m_domain.size();
+	const size_t robots_len = robots_content.size();
+	legacy_data.append((char *)&domain_len, sizeof(size_t));
+	legacy_data.append(data.m_domain);
+	legacy_data.append((char *)&robots_len, sizeof(size_t));
+	legacy_data.append(robots_content);
+
+	UrlStore::RobotsData data3(legacy_data);
+	BOOST_CHECK_EQUAL(data3.m_domain, "test.com");
+	BOOST_CHECK_EQUAL(data3.m_robots, robots_content);
+	BOOST_CHECK_EQUAL(data3.m_fetched_at, 0);
+
+	legacy_data.append((char *)&data.m_fetched_at, sizeof(size_t));
+	UrlStore::RobotsData data4(legacy_data);
+	BOOST_CHECK_EQUAL(data4.m_robots, robots_content);
+	BOOST_CHECK_EQUAL(data4.m_fetched_at, 1650000000);
+}
+
+BOOST_AUTO_TEST_CASE(record_codec) {
+
+	UrlStore::UrlData url_data;
+	url_data.m_url = URL("https://www.example.com/a/page.html?id=1");
+	url_data.m_redirect = URL("https://www.example.com/b/page.html");
+	url_data.m_link_count = 300;
+	url_data.m_http_code = 301;
+	url_data.m_last_visited = 1650000000;
+
+	// The redirect only stores its path and the numbers are varints, this was 115 bytes before record_codec.
+	const std::string string_data = url_data.to_str();
+	BOOST_CHECK_EQUAL(string_data.size(), 61);
+
+	UrlStore::UrlData url_data2(string_data);
+	BOOST_CHECK_EQUAL(url_data2.m_url.str(), "https://www.example.com/a/page.html?id=1");
+	BOOST_CHECK_EQUAL(url_data2.m_redirect.str(), "https://www.example.com/b/page.html");
+	BOOST_CHECK_EQUAL(url_data2.m_redirect.host(), "example.com");
+	BOOST_CHECK_EQUAL(url_data2.m_link_count, 300);
+	BOOST_CHECK_EQUAL(url_data2.m_http_code, 301);
+	BOOST_CHECK_EQUAL(url_data2.m_last_visited, 1650000000);
+
+	// URLs that can not be split into host and path are stored as they are.
+	for (const std::string url : {"http://example.com", "http://EXAMPLE.com/a", "ftp://example.com/file",
+			"http://example.com:8080/a"}) {
+		UrlStore::UrlData data;
+		data.m_url = URL(url);
+		BOOST_CHECK_EQUAL(UrlStore::UrlData(data.to_str()).m_url.str(), url);
+	}
+
+	// Fields added later are skipped by older readers and missing fields keep their defaults.
+	UrlStore::record_codec::record_writer writer;
+	writer.add_bytes(1, "example.com");
+	writer.add_bytes(100, "a field from the future");
+	writer.add_varint(101, 12345);
+	writer.add_varint(3, 1);
+	UrlStore::DomainData domain_data(writer.str());
+	BOOST_CHECK_EQUAL(domain_data.m_domain, "example.com");
+	BOOST_CHECK_EQUAL(domain_data.m_has_https, 0);
+	BOOST_CHECK_EQUAL(domain_data.m_has_www, 1);
+
+	UrlStore::record_codec::record_view view(writer.str().c_str(), writer.str().size());
+	std::string_view field;
+	BOOST_REQUIRE(view.bytes(100, field));
+	BOOST_CHECK(field.data() > writer.str().c_str() && field.data() < writer.str().c_str() + writer.str().size());
+	BOOST_CHECK_EQUAL(field, "a field from the future");
+
+	// Truncated records are not valid.
+	UrlStore::record_codec::record_view truncated(writer.str().c_str(), writer.str().size() - 1);
+	BOOST_CHECK(!truncated.valid());
+
+	// Values stored before record_codec.
+	struct {
+		size_t link_count = 7;
+		size_t http_code = 200;
+		size_t last_visited = 1600000000;
+	} legacy_store;
+	const std::string url = "https://example.com/";
+	const std::string redirect = "https://example.org/";
+	const size_t url_len = url.size();
+	const size_t redirect_len = redirect.size();
+	std::string legacy_data;
+	legacy_data.append((char *)&legacy_store, sizeof(legacy_store));
+	legacy_data.append((char *)&url_len, sizeof(size_t));
+	legacy_data.append(url);
+	legacy_data.append((char *)&redirect_len, sizeof(size_t));
+	legacy_data.append(redirect);
+
+	UrlStore::UrlData legacy(legacy_data);
+	BOOST_CHECK_EQUAL(legacy.m_url.str(), url);
+	BOOST_CHECK_EQUAL(legacy.m_redirect.str(), redirect);
+	BOOST_CHECK_EQUAL(legacy.m_link_count, 7);
+	BOOST_CHECK_EQUAL(legacy.m_http_code, 200);
+	BOOST_CHECK_EQUAL(legacy.m_last_visited, 1600000000);
 }
 
 BOOST_AUTO_TEST_CASE(server) {
@@ -253,4 +368,208 @@ BOOST_AUTO_TEST_CASE(domain) {
 
 }
 
+BOOST_AUTO_TEST_CASE(write_batch) {
+
+	UrlStore::UrlStore<UrlStore::DomainData> store;
+	const std::string prefix = std::to_string(rand()) + "-write-batch-";
+
+	auto make_put = [](size_t deferr_bitmask, size_t update_bitmask, const std::vector<UrlStore::DomainData> &datas) {
+		std::string put_data;
+		UrlStore::append_bitmask<UrlStore::DomainData>(deferr_bitmask, put_data);
+		UrlStore::append_bitmask<UrlStore::DomainData>(update_bitmask, put_data);
+		for (const auto &data : datas) {
+			UrlStore::append_data_str(data, put_data);
+		}
+		return put_data;
+	};
+	auto make_data = [&prefix](const std::string &domain, size_t has_https, size_t has_www) {
+		UrlStore::DomainData data;
+		data.m_domain = prefix + domain;
+		data.m_has_https = has_https;
+		data.m_has_www = has_www;
+		return data;
+	};
+
+	std::stringstream response;
+	UrlStore::handle_put_request(store, make_put(0x0, 0x0, {make_data("a.com", 1, 1), make_data("b.com", 0, 1)}),
+		response);
+
+	// Only https is updated on a.com, the second record of b.com is applied on top of the first.
+	UrlStore::handle_put_request(store, make_put(0x0, UrlStore::update_has_https, {make_data("a.com", 0, 0),
+		make_data("b.com", 1, 0), make_data("b.com", 0, 0)}), response);
+
+	auto a = store.get(prefix + "a.com");
+	BOOST_CHECK_EQUAL(a.m_domain, prefix + "a.com");
+	BOOST_CHECK_EQUAL(a.m_has_https, 0);
+	BOOST_CHECK_EQUAL(a.m_has_www, 1);
+
+	auto b = store.get(prefix + "b.com");
+	BOOST_CHECK_EQUAL(b.m_has_https, 0);
+	BOOST_CHECK_EQUAL(b.m_has_www, 1);
+
+	// An update of a domain that is not stored is stored under its own key.
+	UrlStore::handle_put_request(store, make_put(0x0, UrlStore::update_has_www, {make_data("c.com", 1, 1)}), response);
+	auto c = store.get(prefix + "c.com");
+	BOOST_CHECK_EQUAL(c.m_domain, prefix + "c.com");
+	BOOST_CHECK_EQUAL(c.m_has_www, 1);
+	BOOST_CHECK_EQUAL(store.get("").m_domain, "");
+
+	// Deferred requests are written to the cache path and picked up by the inserter in order.
+	const std::string cache_path = Config::url_store_cache_path;
+	Config::url_store_cache_path = "/tmp/url_store_write_batch_test";
+	boost::filesystem::create_directories(Config::url_store_cache_path);
+
+	UrlStore::handle_put_request(store, make_put(0x1, 0x0, {make_data("d.com", 1, 0)}), response);
+	UrlStore::handle_put_request(store, make_put(0x1, UrlStore::update_has_www, {make_data("d.com", 0, 1)}), response);
+	BOOST_CHECK(store.has_pending_insert());
+
+	const std::vector<std::string> files = store.wait_for_pending_inserts(20);
+	BOOST_CHECK_EQUAL(files.size(), 2);
+	BOOST_CHECK(!store.has_pending_insert());
+	UrlStore::run_inserter(store, files);
+
+	auto d = store.get(prefix + "d.com");
+	BOOST_CHECK_EQUAL(d.m_has_https, 1);
+	BOOST_CHECK_EQUAL(d.m_has_www, 1);
+	for (const std::string &file : files) {
+		BOOST_CHECK(!boost::filesystem::exists(file));
+	}
+
+	boost::filesystem::remove_all(Config::url_store_cache_path);
+	Config::url_store_cache_path = cache_path;
+}
+
+BOOST_AUTO_TEST_CASE(bloom_filter) {
+
+	UrlStore::bloom_filter filter(64 * 1024);
+	BOOST_CHECK_EQUAL(filter.size_in_bytes(), 64 * 1024);
+
+	for (size_t i = 0; i < 10000; i++) {
+		filter.insert("example.com/page-" + std::to_string(i));
+	}
+	for (size_t i = 0; i < 10000; i++) {
+		BOOST_CHECK(filter.may_contain("example.com/page-" + std::to_string(i)));
+	}
+
+	// About 52 bits per key.
+	size_t false_positives = 0;
+	for (size_t i = 0; i < 10000; i++) {
+		if (filter.may_contain("example.org/page-" + std::to_string(i))) false_positives++;
+	}
+	BOOST_CHECK(false_positives < 50);
+
+	// The keys of one shard all have the same Hash::str modulo the number of shards.
+	UrlStore::bloom_filter shard_filter(64 * 1024);
+	std::vector<std::string> shard_keys;
+	for (size_t i = 0; shard_keys.size() < 20000; i++) {
+		const std::string key = "example.com/shard-page-" + std::to_string(i);
+		if (Hash::str(key) % 64 == 0) shard_keys.push_back(key);
+	}
+	for (size_t i = 0; i < 10000; i++) {
+		shard_filter.insert(shard_keys[i]);
+	}
+	size_t shard_false_positives = 0;
+	for (size_t i = 10000; i < 20000; i++) {
+		if (shard_filter.may_contain(shard_keys[i])) shard_false_positives++;
+	}
+	BOOST_CHECK(shard_false_positives < 50);
+
+	const std::string filename = "/tmp/url_store_bloom_filter_test.bloom";
+	BOOST_REQUIRE(filter.save(filename));
+
+	UrlStore::bloom_filter filter2(64 * 1024);
+	BOOST_REQUIRE(filter2.load(filename));
+	for (size_t i = 0; i < 10000; i++) {
+		BOOST_CHECK(filter2.may_contain("example.com/page-" + std::to_string(i)));
+	}
+
+	// A snapshot of a filter with another size is not used.
+	UrlStore::bloom_filter filter3(128 * 1024);
+	BOOST_CHECK(!filter3.load(filename));
+	BOOST_CHECK(!filter3.load(filename + ".missing"));
+
+	boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(bloom_filtered_store) {
+
+	const size_t bloom_mb = Config::url_store_bloom_mb;
+	Config::url_store_bloom_mb = 1;
+	const std::string prefix = std::to_string(rand()) + "-bloom-";
+
+	{
+		UrlStore::UrlStore<UrlStore::RobotsData> store;
+		while (!store.filters_ready()) {
+			std::this_thread::sleep_for(10ms);
+		}
+
+		UrlStore::RobotsData data;
+		data.m_domain = prefix + "a.com";
+		data.m_robots = "User-agent: *";
+		store.set(data);
+
+		BOOST_CHECK_EQUAL(store.get(prefix + "a.com").m_robots, "User-agent: *");
+		BOOST_CHECK_EQUAL(store.filtered_lookups(), 0);
+
+		for (size_t i = 0; i < 100; i++) {
+			BOOST_CHECK_EQUAL(store.get(prefix + "missing-" + std::to_string(i) + ".com").m_domain, "");
+		}
+		BOOST_CHECK(store.filtered_lookups() > 90);
+
+		std::stringstream response;
+		std::string put_data;
+		UrlStore::append_bitmask<UrlStore::RobotsData>(0x0, put_data);
+		UrlStore::append_bitmask<UrlStore::RobotsData>(0x0, put_data);
+		data.m_domain = prefix + "b.com";
+		UrlStore::append_data_str(data, put_data);
+		UrlStore::handle_put_request(store, put_data, response);
+
+		BOOST_CHECK_EQUAL(store.get(prefix + "b.com").m_domain, prefix + "b.com");
+	}
+
+	// The filters are written when the store is closed and read back without a scan.
+	{
+		UrlStore::UrlStore<UrlStore::RobotsData> store;
+		BOOST_CHECK(store.filters_ready());
+		BOOST_CHECK_EQUAL(store.get(prefix + "a.com").m_domain, prefix + "a.com");
+		BOOST_CHECK_EQUAL(store.get(prefix + "b.com").m_domain, prefix + "b.com");
+		BOOST_CHECK_EQUAL(store.filtered_lookups(), 0);
+	}
+
+	Config::url_store_bloom_mb = bloom_mb;
+}
+
+BOOST_AUTO_TEST_CASE(hash_log_store) {
+
+	Config::url_store_engines["domain"] = key_value::engine_hash_log;
+	const std::string prefix = std::to_string(rand()) + "-hash-log-";
+
+	{
+		UrlStore::UrlStore<UrlStore::DomainData> store;
+
+		std::string put_data;
+		UrlStore::append_bitmask<UrlStore::DomainData>(0x0, put_data);
+		UrlStore::append_bitmask<UrlStore::DomainData>(UrlStore::update_has_https, put_data);
+		for (const std::string domain : {"a.com", "b.com", "c.com"}) {
+			UrlStore::DomainData data;
+			data.m_domain = prefix + domain;
+			data.m_has_https = 1;
+			UrlStore::append_data_str(data, put_data);
+		}
+		std::stringstream response;
+		UrlStore::handle_put_request(store, put_data, response);
+	}
+
+	UrlStore::UrlStore<UrlStore::DomainData> store;
+	const auto datas = store.get_many({prefix + "b.com", prefix + "missing.com", prefix + "a.com"});
+	BOOST_REQUIRE_EQUAL(datas.size(), 3);
+	BOOST_CHECK_EQUAL(datas[0].m_domain, prefix + "b.com");
+	BOOST_CHECK_EQUAL(datas[0].m_has_https, 1);
+	BOOST_CHECK_EQUAL(datas[1].m_domain, "");
+	BOOST_CHECK_EQUAL(datas[2].m_domain, prefix + "a.com");
+	BOOST_CHECK(boost::filesystem::exists("/mnt/0/store/domain/url_store_0_hash_log/data.log"));
+
+	Config::url_store_engines.erase("domain");
+}
+
 BOOST_AUTO_TEST_SUITE_END()